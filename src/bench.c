@@ -0,0 +1,538 @@
+/**
+ * @file bench.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details lt-bench measures end-to-end latency of every operation lt-util exposes. Each operation is executed
+ * N times, preparation which is not part of the operation (e.g. erasing a slot before a key is generated there)
+ * is not measured. Results are printed as a table and optionally written as JSON.
+ *
+ * Benchmark overwrites content of one ECC slot, one R memory slot and one M&D slot, see print_usage().
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "bench_stats.h"
+#include "commands.h"
+#include "eph_pool.h"
+#include "key_cache.h"
+#include "timing.h"
+#include "vault.h"
+
+#define BENCH_ITERATIONS_DEFAULT 100
+#define BENCH_ECC_SLOT_DEFAULT   31
+// Below slots of PIN and PIN vault
+#define BENCH_R_MEM_SLOT_DEFAULT (LT_VAULT_INDEX_SLOT - 1)
+#define BENCH_MACANDD_SLOT_DEFAULT 127
+
+/** @brief Everything an operation needs, slots are chosen on command line */
+struct bench_ctx {
+    lt_handle_t *h;
+    int ecc_slot;
+    int r_mem_slot;
+    int macandd_slot;
+    uint8_t buf[4096];
+};
+
+/**
+ * @brief One benchmarked operation, executed once
+ *
+ * @param ctx         Benchmark context
+ * @param size        Size of message or payload, 0 when operation has no size
+ * @param ns          Measured latency of the operation itself
+ * @return lt_ret_t   LT_OK if success, otherwise error of the failed call
+ */
+typedef lt_ret_t (*bench_op_fn)(struct bench_ctx *ctx, size_t size, uint64_t *ns);
+
+/**
+ * @brief Brings slots into the state an operation needs, called once before the iterations and not measured
+ *
+ * @param ctx         Benchmark context
+ * @param size        Size of message or payload
+ * @return lt_ret_t   LT_OK if success, otherwise error of the failed call
+ */
+typedef lt_ret_t (*bench_prepare_fn)(struct bench_ctx *ctx, size_t size);
+
+struct bench_op {
+    const char *name;
+    size_t size;
+    bench_op_fn fn;
+    /** NULL when operation needs no preparation */
+    bench_prepare_fn prepare;
+    /** Operation needs secure session */
+    bool session;
+};
+
+// Logging of lt_util_dev_open()/lt_util_session_open() would be measured too, so it is muted
+static int mute_stdout(void)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    return saved;
+}
+
+static void unmute_stdout(int saved)
+{
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+// Generates a key when ECC slot is empty
+static lt_ret_t prepare_ecc_key(struct bench_ctx *ctx, size_t size)
+{
+    lt_ecc_curve_type_t curve;
+    ecc_key_origin_t origin;
+    uint8_t pubkey[64];
+    if (lt_ecc_key_read(ctx->h, (uint8_t)ctx->ecc_slot, pubkey, &curve, &origin) == LT_OK) {
+        return LT_OK;
+    }
+    return lt_ecc_key_generate(ctx->h, (uint8_t)ctx->ecc_slot, CURVE_ED25519);
+}
+
+// Writes size bytes into R memory slot, so they can be read back
+static lt_ret_t prepare_r_mem(struct bench_ctx *ctx, size_t size)
+{
+    lt_ret_t ret = lt_r_mem_data_erase(ctx->h, (uint16_t)ctx->r_mem_slot);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    return lt_r_mem_data_write(ctx->h, (uint16_t)ctx->r_mem_slot, ctx->buf, (uint16_t)size);
+}
+
+static lt_ret_t op_init(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    lt_util_session_reset(ctx->h);
+    int saved = mute_stdout();
+    uint64_t start = bench_now_ns();
+    int ret = lt_util_dev_open(ctx->h);
+    *ns = bench_now_ns() - start;
+    unmute_stdout(saved);
+
+    return ret == 0 ? LT_OK : LT_FAIL;
+}
+
+static lt_ret_t op_handshake(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    lt_util_session_reset(ctx->h);
+    int saved = mute_stdout();
+    int ret = lt_util_dev_open(ctx->h);
+    uint64_t start = bench_now_ns();
+    if (ret == 0) {
+        // Device is already open and kept, so only the handshake is executed
+        ret = lt_util_session_open(ctx->h);
+    }
+    *ns = bench_now_ns() - start;
+    unmute_stdout(saved);
+
+    return ret == 0 ? LT_OK : LT_FAIL;
+}
+
+#if LT_UTIL_EPH_POOL
+// Host ephemeral keypair as lt_session_start() gets it, from full pool, or computed with LT_UTIL_EPH_POOL=0
+static lt_ret_t op_eph_keypair(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    uint8_t priv[32], pub[32];
+    lt_eph_pool_start();
+    lt_eph_pool_wait_full();
+    uint64_t start = bench_now_ns();
+    lt_eph_pool_keypair(priv, pub);
+    *ns = bench_now_ns() - start;
+    memset(priv, 0, sizeof(priv));
+
+    return LT_OK;
+}
+#endif
+
+// Host sleep of size microseconds as ports and retries make it, shows what the timer of this board adds
+static lt_ret_t op_sleep(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    (void)ctx;
+    uint64_t start = bench_now_ns();
+    lt_timing_sleep_us((uint32_t)size);
+    *ns = bench_now_ns() - start;
+    return LT_OK;
+}
+
+static lt_ret_t op_random_value_get(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    uint64_t start = bench_now_ns();
+    lt_ret_t ret = lt_random_value_get(ctx->h, ctx->buf, (uint16_t)size);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_ecc_key_generate(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    lt_ret_t ret = lt_ecc_key_erase(ctx->h, (uint8_t)ctx->ecc_slot);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    uint64_t start = bench_now_ns();
+    ret = lt_ecc_key_generate(ctx->h, (uint8_t)ctx->ecc_slot, CURVE_ED25519);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_ecc_key_read(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    lt_ecc_curve_type_t curve;
+    ecc_key_origin_t origin;
+    uint64_t start = bench_now_ns();
+    lt_ret_t ret = lt_ecc_key_read(ctx->h, (uint8_t)ctx->ecc_slot, ctx->buf, &curve, &origin);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_ecc_eddsa_sign(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    uint8_t signature[64];
+    uint64_t start = bench_now_ns();
+    lt_ret_t ret = lt_ecc_eddsa_sign(ctx->h, (uint8_t)ctx->ecc_slot, ctx->buf, (uint16_t)size, signature);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_r_mem_data_write(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    lt_ret_t ret = lt_r_mem_data_erase(ctx->h, (uint16_t)ctx->r_mem_slot);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    uint64_t start = bench_now_ns();
+    ret = lt_r_mem_data_write(ctx->h, (uint16_t)ctx->r_mem_slot, ctx->buf, (uint16_t)size);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_r_mem_data_read(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    uint16_t read_size = 0;
+    uint64_t start = bench_now_ns();
+    lt_ret_t ret = lt_r_mem_data_read(ctx->h, (uint16_t)ctx->r_mem_slot, ctx->buf, &read_size);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_r_mem_data_erase(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    lt_ret_t ret = lt_r_mem_data_erase(ctx->h, (uint16_t)ctx->r_mem_slot);
+    if (ret == LT_OK) {
+        ret = lt_r_mem_data_write(ctx->h, (uint16_t)ctx->r_mem_slot, ctx->buf, (uint16_t)size);
+    }
+    if (ret != LT_OK) {
+        return ret;
+    }
+    uint64_t start = bench_now_ns();
+    ret = lt_r_mem_data_erase(ctx->h, (uint16_t)ctx->r_mem_slot);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static lt_ret_t op_mac_and_destroy(struct bench_ctx *ctx, size_t size, uint64_t *ns)
+{
+    uint8_t data_in[32];
+    uint64_t start = bench_now_ns();
+    lt_ret_t ret = lt_mac_and_destroy(ctx->h, ctx->macandd_slot, ctx->buf, data_in);
+    *ns = bench_now_ns() - start;
+
+    return ret;
+}
+
+static const struct bench_op bench_ops[] = {
+    {"init",               0,    op_init,              NULL,            false},
+    {"handshake",          0,    op_handshake,         NULL,            false},
+#if LT_UTIL_EPH_POOL
+    {"eph_keypair",        0,    op_eph_keypair,       NULL,            false},
+#endif
+    {"sleep",              100,  op_sleep,             NULL,            false},
+    {"sleep",              1000, op_sleep,             NULL,            false},
+    {"random_value_get",   32,   op_random_value_get,  NULL,            true},
+    {"random_value_get",   255,  op_random_value_get,  NULL,            true},
+    {"ecc_key_generate",   0,    op_ecc_key_generate,  NULL,            true},
+    {"ecc_key_read",       0,    op_ecc_key_read,      prepare_ecc_key, true},
+    {"ecc_eddsa_sign",     32,   op_ecc_eddsa_sign,    prepare_ecc_key, true},
+    {"ecc_eddsa_sign",     256,  op_ecc_eddsa_sign,    prepare_ecc_key, true},
+    {"ecc_eddsa_sign",     1024, op_ecc_eddsa_sign,    prepare_ecc_key, true},
+    {"ecc_eddsa_sign",     4095, op_ecc_eddsa_sign,    prepare_ecc_key, true},
+    {"r_mem_data_write",   1,    op_r_mem_data_write,  NULL,            true},
+    {"r_mem_data_write",   64,   op_r_mem_data_write,  NULL,            true},
+    {"r_mem_data_write",   256,  op_r_mem_data_write,  NULL,            true},
+    {"r_mem_data_write",   444,  op_r_mem_data_write,  NULL,            true},
+    {"r_mem_data_read",    1,    op_r_mem_data_read,   prepare_r_mem,   true},
+    {"r_mem_data_read",    64,   op_r_mem_data_read,   prepare_r_mem,   true},
+    {"r_mem_data_read",    256,  op_r_mem_data_read,   prepare_r_mem,   true},
+    {"r_mem_data_read",    444,  op_r_mem_data_read,   prepare_r_mem,   true},
+    {"r_mem_data_erase",   1,    op_r_mem_data_erase,  NULL,            true},
+    {"r_mem_data_erase",   444,  op_r_mem_data_erase,  NULL,            true},
+    {"mac_and_destroy",    32,   op_mac_and_destroy,   NULL,            true},
+};
+#define BENCH_OPS_COUNT (sizeof(bench_ops) / sizeof(bench_ops[0]))
+
+static void print_usage(void)
+{
+    printf("\r\nUsage:\r\n\n"
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+"\t./lt-bench /dev/ttyACM0 [-n <iterations>] [-o <op>[,<op>...]] [-j <file|->] [-e <slot>] [-m <slot>] [-a|-A <slot>]\r\n\n"
+#else
+"\t./lt-bench [-n <iterations>] [-o <op>[,<op>...]] [-j <file|->] [-e <slot>] [-m <slot>] [-a|-A <slot>]\r\n\n"
+#endif
+"\t -n <iterations>   Number of executions of each operation (default %d)\r\n"
+"\t -o <ops>          Comma separated names of operations to run (default all)\r\n"
+"\t -j <file|->       Write results also as JSON into file or stdout\r\n"
+"\t -e <slot>         ECC slot used for key generation and signing, its key is ERASED (default %d)\r\n"
+"\t -m <slot>         R memory slot used for write/read/erase, its content is ERASED (default %d)\r\n"
+"\t -a <slot>         M&D slot used for mac_and_destroy, its content is OVERWRITTEN (default %d)\r\n"
+"\t -A <slot>         Same as -a, but also slots 0-%d of "MAC_SET" and "VAULT", a PIN using them is DESTROYED\r\n\n"
+"\t Operations:",
+    BENCH_ITERATIONS_DEFAULT, BENCH_ECC_SLOT_DEFAULT, BENCH_R_MEM_SLOT_DEFAULT, BENCH_MACANDD_SLOT_DEFAULT,
+    LT_VAULT_MD_END - 1);
+    for (size_t i = 0; i < BENCH_OPS_COUNT; i++) {
+        if (i == 0 || strcmp(bench_ops[i].name, bench_ops[i - 1].name) != 0) {
+            printf(" %s", bench_ops[i].name);
+        }
+    }
+    printf("\r\n\n");
+}
+
+// Returns true when operation is listed in comma separated list, NULL list selects everything
+static bool op_selected(const char *list, const char *name)
+{
+    if (!list) {
+        return true;
+    }
+    size_t len = strlen(name);
+    for (const char *p = list; *p;) {
+        const char *end = strchr(p, ',');
+        size_t item_len = end ? (size_t)(end - p) : strlen(p);
+        if (item_len == len && strncmp(p, name, len) == 0) {
+            return true;
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return false;
+}
+
+static int parse_number(const char *str, long min, long max, long *val)
+{
+    char *endptr;
+    *val = strtol(str, &endptr, 10);
+    if (*endptr != '\0' || *val < min || *val > max) {
+        return 1;
+    }
+    return 0;
+}
+
+static void print_json(FILE *fp, long iterations, const struct bench_stats *stats, const lt_ret_t *errors,
+                       const bool *selected)
+{
+    bool first = true;
+    fprintf(fp, "{\n  \"iterations\": %ld,\n  \"results\": [", iterations);
+    for (size_t i = 0; i < BENCH_OPS_COUNT; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+        fprintf(fp, "%s\n    {\"op\": \"%s\", \"size\": %zu, \"status\": \"%s\", \"n\": %zu, "
+                "\"min_ns\": %llu, \"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu, \"ops_per_s\": %.2f}",
+                first ? "" : ",", bench_ops[i].name, bench_ops[i].size, lt_ret_verbose(errors[i]), stats[i].n,
+                (unsigned long long)stats[i].min, (unsigned long long)stats[i].p50,
+                (unsigned long long)stats[i].p99, (unsigned long long)stats[i].max, stats[i].ops_per_s);
+        first = false;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev_path = NULL;
+    const char *ops_list = NULL;
+    const char *json_path = NULL;
+    long iterations = BENCH_ITERATIONS_DEFAULT;
+    long ecc_slot = BENCH_ECC_SLOT_DEFAULT;
+    long r_mem_slot = BENCH_R_MEM_SLOT_DEFAULT;
+    long macandd_slot = BENCH_MACANDD_SLOT_DEFAULT;
+
+    int i = 1;
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+    if (argc < 2) {
+        print_usage();
+        return 0;
+    }
+    dev_path = argv[i++];
+#endif
+    for (; i < argc; i++) {
+        int err = 0;
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], 1, 1000000, &iterations);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            ops_list = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], 0, 31, &ecc_slot);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], 0, LT_VAULT_R_MEM_RESERVED_FIRST - 1, &r_mem_slot);
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], LT_VAULT_MD_END, 127, &macandd_slot);
+        } else if (strcmp(argv[i], "-A") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], 0, 127, &macandd_slot);
+            if (!err && macandd_slot < LT_VAULT_MD_END) {
+                LT_LOG_WARN("M&D slot %ld may belong to "MAC_SET" or "VAULT", its PIN will not work anymore",
+                            macandd_slot);
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+        if (err) {
+            LT_LOG_ERROR("Invalid value of %s", argv[i - 1]);
+            return 1;
+        }
+    }
+
+    bool selected[BENCH_OPS_COUNT];
+    bool any_selected = false;
+    for (size_t k = 0; k < BENCH_OPS_COUNT; k++) {
+        selected[k] = op_selected(ops_list, bench_ops[k].name);
+        any_selected |= selected[k];
+    }
+    if (!any_selected) {
+        LT_LOG_ERROR("No operation matches %s", ops_list);
+        return 1;
+    }
+
+    uint64_t *ns = calloc(iterations, sizeof(uint64_t));
+    if (!ns) {
+        LT_LOG_ERROR("Error allocating results");
+        return 1;
+    }
+
+    lt_handle_t h = {0};
+    struct lt_util_dev dev;
+    lt_util_dev_setup(&h, &dev, dev_path);
+    lt_util_session_keep(&h, true);
+
+    struct bench_ctx ctx = {.h = &h, .ecc_slot = (int)ecc_slot, .r_mem_slot = (int)r_mem_slot,
+                            .macandd_slot = (int)macandd_slot};
+    for (size_t k = 0; k < sizeof(ctx.buf); k++) {
+        ctx.buf[k] = (uint8_t)k;
+    }
+
+    struct bench_stats stats[BENCH_OPS_COUNT] = {0};
+    lt_ret_t errors[BENCH_OPS_COUNT] = {0};
+    int status = 0;
+
+    printf("%-18s %6s %8s %10s %10s %10s %10s %10s\n", "operation", "size", "n", "min [us]", "p50 [us]", "p99 [us]",
+           "max [us]", "ops/s");
+    for (size_t k = 0; k < BENCH_OPS_COUNT; k++) {
+        if (!selected[k]) {
+            continue;
+        }
+        const struct bench_op *op = &bench_ops[k];
+
+        size_t done = 0;
+        long runs = iterations;
+        if (op->prepare) {
+            int saved = mute_stdout();
+            int ret = lt_util_session_open(&h);
+            unmute_stdout(saved);
+            errors[k] = (ret == 0) ? op->prepare(&ctx, op->size) : LT_HOST_NO_SESSION;
+            if (errors[k] != LT_OK) {
+                lt_util_session_reset(&h);
+                runs = 0;
+            }
+        }
+        for (long it = 0; it < runs; it++) {
+            if (op->session && h.l3.session != SESSION_ON) {
+                int saved = mute_stdout();
+                int ret = lt_util_session_open(&h);
+                unmute_stdout(saved);
+                if (ret != 0) {
+                    errors[k] = LT_HOST_NO_SESSION;
+                    break;
+                }
+            }
+            errors[k] = op->fn(&ctx, op->size, &ns[done]);
+            if (errors[k] != LT_OK) {
+                // Do not trust the session after a failure
+                lt_util_session_reset(&h);
+                break;
+            }
+            done++;
+        }
+        bench_stats_compute(ns, done, &stats[k]);
+
+        if (errors[k] != LT_OK) {
+            printf("%-18s %6zu %8zu failed: %s\n", op->name, op->size, done, lt_ret_verbose(errors[k]));
+            status = 1;
+            continue;
+        }
+        printf("%-18s %6zu %8zu %10.1f %10.1f %10.1f %10.1f %10.1f\n", op->name, op->size, done,
+               stats[k].min / 1e3, stats[k].p50 / 1e3, stats[k].p99 / 1e3, stats[k].max / 1e3, stats[k].ops_per_s);
+    }
+
+#if LT_UTIL_EPH_POOL
+    struct lt_eph_pool_stats eph_stats;
+    lt_eph_pool_get_stats(&eph_stats);
+    printf("Ephemeral keypairs of handshakes: %llu from pool, %llu computed on the spot\n",
+           (unsigned long long)eph_stats.hits, (unsigned long long)eph_stats.misses);
+#endif
+    // LT_UTIL_TIMING_HIST prints it again at exit
+    if (!getenv(LT_UTIL_TIMING_HIST_ENV)) {
+        lt_timing_print_hist(stdout);
+    }
+
+    // Leave used slots empty
+    int saved = mute_stdout();
+    if (lt_util_session_open(&h) == 0) {
+        lt_ecc_key_erase(&h, (uint8_t)ecc_slot);
+        lt_r_mem_data_erase(&h, (uint16_t)r_mem_slot);
+        // Slot was generated and erased many times, lt-util must not serve its old key
+        lt_key_cache_invalidate(&h, (uint8_t)ecc_slot);
+    }
+    lt_util_session_reset(&h);
+    unmute_stdout(saved);
+    free(ns);
+
+    if (json_path) {
+        FILE *fp = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!fp) {
+            LT_LOG_ERROR("Error opening file %s: %s", json_path, strerror(errno));
+            return 1;
+        }
+        print_json(fp, iterations, stats, errors, selected);
+        if (fp != stdout && fclose(fp) != 0) {
+            LT_LOG_ERROR("Error writing file %s", json_path);
+            return 1;
+        }
+    }
+
+    return status;
+}
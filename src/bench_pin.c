@@ -0,0 +1,458 @@
+/**
+ * @file bench_pin.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details lt-bench-pin measures PIN operations of macandd.c: PIN set, correct and wrong PIN check, lazy check with
+ * postponed re-arm and the whole lockout sequence. Every scenario is executed N times and its latency is broken down
+ * into phases (M&D calls, R memory round trips, KDF on host, backoff sleeps) as counted by struct lt_macandd_stats.
+ * Time not covered by any phase is reported as "other". Results are printed as a table and optionally written as
+ * JSON, which also records MACANDD_ROUNDS and MACANDD_JOURNAL_SLOTS, so builds can be compared.
+ *
+ * Benchmark overwrites PIN data in R memory and M&D slots 0 to MACANDD_ROUNDS - 1, see print_usage().
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "bench_stats.h"
+#include "commands.h"
+#include "macandd.h"
+
+#define BENCH_PIN_ITERATIONS_DEFAULT 20
+
+/** @brief Phases reported for every scenario: phases of struct lt_macandd_stats, rest of the time and the total */
+#define BENCH_PIN_PHASE_OTHER (LT_MACANDD_PHASE_COUNT)
+#define BENCH_PIN_PHASE_TOTAL (LT_MACANDD_PHASE_COUNT + 1)
+#define BENCH_PIN_PHASES      (LT_MACANDD_PHASE_COUNT + 2)
+
+static const uint8_t bench_pin_ok[] = {1, 2, 3, 4};
+static const uint8_t bench_pin_wrong[] = {4, 3, 2, 1};
+static const uint8_t bench_pin_add[] = {0xbe, 0x9c, 0x4e, 0x11};
+
+/** @brief Measurement of one execution of a scenario */
+struct bench_pin_sample {
+    uint64_t ns[BENCH_PIN_PHASES];
+    uint32_t calls[BENCH_PIN_PHASES];
+};
+
+/**
+ * @brief One benchmarked scenario, executed once
+ *
+ * @details Scenario calls bench_pin_begin() and bench_pin_end() around the measured part, anything outside of them
+ *          (e.g. restoring attempts after a wrong PIN) is not measured.
+ *
+ * @param h           Device's handle
+ * @param sample      Measurement of the scenario
+ * @return lt_ret_t   LT_OK if success, otherwise error of the failed call
+ */
+typedef lt_ret_t (*bench_pin_fn)(lt_handle_t *h, struct bench_pin_sample *sample);
+
+struct bench_pin_scenario {
+    const char *name;
+    bench_pin_fn fn;
+    /** PIN is set before the iterations */
+    bool pin_set;
+};
+
+static uint64_t bench_pin_start;
+
+static void bench_pin_begin(void)
+{
+    lt_macandd_stats_reset();
+    bench_pin_start = bench_now_ns();
+}
+
+static void bench_pin_end(struct bench_pin_sample *sample)
+{
+    uint64_t total = bench_now_ns() - bench_pin_start;
+    struct lt_macandd_stats stats;
+    lt_macandd_stats_get(&stats);
+
+    uint64_t covered = 0;
+    for (int p = 0; p < LT_MACANDD_PHASE_COUNT; p++) {
+        sample->ns[p] = stats.phase_ns[p];
+        sample->calls[p] = stats.phase_calls[p];
+        covered += stats.phase_ns[p];
+    }
+    sample->ns[BENCH_PIN_PHASE_OTHER] = total > covered ? total - covered : 0;
+    sample->calls[BENCH_PIN_PHASE_OTHER] = 0;
+    sample->ns[BENCH_PIN_PHASE_TOTAL] = total;
+    sample->calls[BENCH_PIN_PHASE_TOTAL] = 1;
+}
+
+static const char *bench_pin_phase_name(int phase)
+{
+    if (phase == BENCH_PIN_PHASE_OTHER) {
+        return "other";
+    }
+    if (phase == BENCH_PIN_PHASE_TOTAL) {
+        return "total";
+    }
+    return lt_macandd_phase_name((enum lt_macandd_phase)phase);
+}
+
+static lt_ret_t bench_pin_set(lt_handle_t *h)
+{
+    uint8_t secret[32];
+    lt_ret_t ret = lt_PIN_set(h, bench_pin_ok, sizeof(bench_pin_ok), bench_pin_add, sizeof(bench_pin_add), secret);
+    memset(secret, 0, sizeof(secret));
+    return ret;
+}
+
+static lt_ret_t bench_pin_check(lt_handle_t *h, const uint8_t *pin)
+{
+    uint8_t secret[32];
+    lt_ret_t ret = lt_PIN_check(h, pin, 4, bench_pin_add, sizeof(bench_pin_add), secret);
+    memset(secret, 0, sizeof(secret));
+    return ret;
+}
+
+static lt_ret_t scenario_set(lt_handle_t *h, struct bench_pin_sample *sample)
+{
+    bench_pin_begin();
+    lt_ret_t ret = bench_pin_set(h);
+    bench_pin_end(sample);
+    return ret;
+}
+
+static lt_ret_t scenario_check_ok(lt_handle_t *h, struct bench_pin_sample *sample)
+{
+    bench_pin_begin();
+    lt_ret_t ret = bench_pin_check(h, bench_pin_ok);
+    bench_pin_end(sample);
+    return ret;
+}
+
+// Time until the secret is released, the re-arm which follows is not measured
+static lt_ret_t scenario_check_lazy(lt_handle_t *h, struct bench_pin_sample *sample)
+{
+    uint8_t secret[32];
+    struct lt_macandd_rearm rearm;
+
+    bench_pin_begin();
+    lt_ret_t ret = lt_PIN_check_lazy(h, bench_pin_ok, sizeof(bench_pin_ok), bench_pin_add, sizeof(bench_pin_add),
+                                     secret, &rearm);
+    bench_pin_end(sample);
+    memset(secret, 0, sizeof(secret));
+    if (ret != LT_OK) {
+        return ret;
+    }
+    return lt_PIN_rearm(h, &rearm);
+}
+
+// Re-arm postponed by lazy check, the check itself is not measured
+static lt_ret_t scenario_rearm(lt_handle_t *h, struct bench_pin_sample *sample)
+{
+    uint8_t secret[32];
+    struct lt_macandd_rearm rearm;
+
+    lt_ret_t ret = lt_PIN_check_lazy(h, bench_pin_ok, sizeof(bench_pin_ok), bench_pin_add, sizeof(bench_pin_add),
+                                     secret, &rearm);
+    memset(secret, 0, sizeof(secret));
+    if (ret != LT_OK) {
+        return ret;
+    }
+    bench_pin_begin();
+    ret = lt_PIN_rearm(h, &rearm);
+    bench_pin_end(sample);
+    return ret;
+}
+
+// Correct PIN afterwards restores attempts and is not measured
+static lt_ret_t scenario_check_wrong(lt_handle_t *h, struct bench_pin_sample *sample)
+{
+    bench_pin_begin();
+    lt_ret_t ret = bench_pin_check(h, bench_pin_wrong);
+    bench_pin_end(sample);
+    if (ret == LT_OK) {
+        return LT_FAIL;
+    }
+    return bench_pin_check(h, bench_pin_ok);
+}
+
+// MACANDD_ROUNDS wrong PINs and then the correct one, which must be refused; PIN is set again afterwards
+static lt_ret_t scenario_lockout(lt_handle_t *h, struct bench_pin_sample *sample)
+{
+    lt_ret_t ret;
+
+    bench_pin_begin();
+    for (int k = 0; k < MACANDD_ROUNDS; k++) {
+        if (bench_pin_check(h, bench_pin_wrong) == LT_OK) {
+            bench_pin_end(sample);
+            return LT_FAIL;
+        }
+    }
+    ret = bench_pin_check(h, bench_pin_ok);
+    bench_pin_end(sample);
+    if (ret == LT_OK) {
+        return LT_FAIL;
+    }
+    return bench_pin_set(h);
+}
+
+static const struct bench_pin_scenario bench_pin_scenarios[] = {
+    {"set",         scenario_set,         false},
+    {"check_ok",    scenario_check_ok,    true},
+    {"check_lazy",  scenario_check_lazy,  true},
+    {"rearm",       scenario_rearm,       true},
+    {"check_wrong", scenario_check_wrong, true},
+    {"lockout",     scenario_lockout,     true},
+};
+#define BENCH_PIN_SCENARIOS_COUNT (sizeof(bench_pin_scenarios) / sizeof(bench_pin_scenarios[0]))
+
+/** @brief Statistics of one phase of one scenario */
+struct bench_pin_result {
+    struct bench_stats stats[BENCH_PIN_PHASES];
+    /** Calls of the phase within one execution, median */
+    uint64_t calls[BENCH_PIN_PHASES];
+};
+
+static void print_usage(void)
+{
+    printf("\r\nUsage:\r\n\n"
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+"\t./lt-bench-pin /dev/ttyACM0 [-n <iterations>] [-o <scenario>[,<scenario>...]] [-j <file|->]\r\n\n"
+#else
+"\t./lt-bench-pin [-n <iterations>] [-o <scenario>[,<scenario>...]] [-j <file|->]\r\n\n"
+#endif
+"\t -n <iterations>   Number of executions of each scenario (default %d)\r\n"
+"\t -o <scenarios>    Comma separated names of scenarios to run (default all)\r\n"
+"\t -j <file|->       Write results also as JSON into file or stdout\r\n\n"
+"\t PIN data set by -mac-set is OVERWRITTEN, M&D slots 0 - %d are used (MACANDD_ROUNDS %d)\r\n\n"
+"\t Scenarios:",
+    BENCH_PIN_ITERATIONS_DEFAULT, MACANDD_ROUNDS - 1, MACANDD_ROUNDS);
+    for (size_t i = 0; i < BENCH_PIN_SCENARIOS_COUNT; i++) {
+        printf(" %s", bench_pin_scenarios[i].name);
+    }
+    printf("\r\n\n");
+}
+
+// Returns true when scenario is listed in comma separated list, NULL list selects everything
+static bool scenario_selected(const char *list, const char *name)
+{
+    if (!list) {
+        return true;
+    }
+    size_t len = strlen(name);
+    for (const char *p = list; *p;) {
+        const char *end = strchr(p, ',');
+        size_t item_len = end ? (size_t)(end - p) : strlen(p);
+        if (item_len == len && strncmp(p, name, len) == 0) {
+            return true;
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return false;
+}
+
+// Logging of lt_util_session_open() would mix with the table, so it is muted
+static int mute_stdout(void)
+{
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    return saved;
+}
+
+static void unmute_stdout(int saved)
+{
+    fflush(stdout);
+    if (saved >= 0) {
+        dup2(saved, STDOUT_FILENO);
+        close(saved);
+    }
+}
+
+static void compute_result(struct bench_pin_sample *samples, size_t n, uint64_t *tmp, struct bench_pin_result *res)
+{
+    for (int p = 0; p < BENCH_PIN_PHASES; p++) {
+        for (size_t k = 0; k < n; k++) {
+            tmp[k] = samples[k].calls[p];
+        }
+        bench_stats_compute(tmp, n, &res->stats[p]);
+        res->calls[p] = res->stats[p].p50;
+
+        for (size_t k = 0; k < n; k++) {
+            tmp[k] = samples[k].ns[p];
+        }
+        bench_stats_compute(tmp, n, &res->stats[p]);
+    }
+}
+
+static void print_json(FILE *fp, long iterations, const struct bench_pin_result *results, const lt_ret_t *errors,
+                       const bool *selected)
+{
+    bool first = true;
+    fprintf(fp, "{\n  \"macandd_rounds\": %d,\n  \"journal_slots\": %d,\n  \"iterations\": %ld,\n  \"results\": [",
+            MACANDD_ROUNDS, MACANDD_JOURNAL_SLOTS, iterations);
+    for (size_t i = 0; i < BENCH_PIN_SCENARIOS_COUNT; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+        const struct bench_pin_result *res = &results[i];
+        fprintf(fp, "%s\n    {\"scenario\": \"%s\", \"status\": \"%s\", \"n\": %zu, \"phases\": [",
+                first ? "" : ",", bench_pin_scenarios[i].name, lt_ret_verbose(errors[i]),
+                res->stats[BENCH_PIN_PHASE_TOTAL].n);
+        for (int p = 0; p < BENCH_PIN_PHASES; p++) {
+            fprintf(fp, "%s\n      {\"phase\": \"%s\", \"calls\": %llu, \"min_ns\": %llu, \"p50_ns\": %llu, "
+                    "\"p99_ns\": %llu, \"max_ns\": %llu}",
+                    p ? "," : "", bench_pin_phase_name(p), (unsigned long long)res->calls[p],
+                    (unsigned long long)res->stats[p].min, (unsigned long long)res->stats[p].p50,
+                    (unsigned long long)res->stats[p].p99, (unsigned long long)res->stats[p].max);
+        }
+        fprintf(fp, "\n    ]}");
+        first = false;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev_path = NULL;
+    const char *scenarios_list = NULL;
+    const char *json_path = NULL;
+    long iterations = BENCH_PIN_ITERATIONS_DEFAULT;
+
+    int i = 1;
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+    if (argc < 2) {
+        print_usage();
+        return 0;
+    }
+    dev_path = argv[i++];
+#endif
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            char *endptr;
+            iterations = strtol(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || iterations < 1 || iterations > 100000) {
+                LT_LOG_ERROR("Invalid value of -n");
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            scenarios_list = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            json_path = argv[++i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    bool selected[BENCH_PIN_SCENARIOS_COUNT];
+    bool any_selected = false;
+    for (size_t k = 0; k < BENCH_PIN_SCENARIOS_COUNT; k++) {
+        selected[k] = scenario_selected(scenarios_list, bench_pin_scenarios[k].name);
+        any_selected |= selected[k];
+    }
+    if (!any_selected) {
+        LT_LOG_ERROR("No scenario matches %s", scenarios_list);
+        return 1;
+    }
+
+    struct bench_pin_sample *samples = calloc(iterations, sizeof(*samples));
+    uint64_t *tmp = calloc(iterations, sizeof(uint64_t));
+    if (!samples || !tmp) {
+        LT_LOG_ERROR("Error allocating results");
+        free(samples);
+        free(tmp);
+        return 1;
+    }
+
+    lt_handle_t h = {0};
+    struct lt_util_dev dev;
+    lt_util_dev_setup(&h, &dev, dev_path);
+    lt_util_session_keep(&h, true);
+
+    static struct bench_pin_result results[BENCH_PIN_SCENARIOS_COUNT];
+    lt_ret_t errors[BENCH_PIN_SCENARIOS_COUNT] = {0};
+    int status = 0;
+
+    printf("MACANDD_ROUNDS %d, MACANDD_JOURNAL_SLOTS %d\n", MACANDD_ROUNDS, MACANDD_JOURNAL_SLOTS);
+    printf("%-12s %-16s %6s %10s %10s %10s\n", "scenario", "phase", "calls", "p50 [us]", "p99 [us]", "max [us]");
+    for (size_t k = 0; k < BENCH_PIN_SCENARIOS_COUNT; k++) {
+        if (!selected[k]) {
+            continue;
+        }
+        const struct bench_pin_scenario *sc = &bench_pin_scenarios[k];
+
+        size_t done = 0;
+        for (long it = 0; it < iterations; it++) {
+            if (h.l3.session != SESSION_ON) {
+                int saved = mute_stdout();
+                int ret = lt_util_session_open(&h);
+                unmute_stdout(saved);
+                if (ret != 0) {
+                    errors[k] = LT_HOST_NO_SESSION;
+                    break;
+                }
+            }
+            if (it == 0 && sc->pin_set) {
+                errors[k] = bench_pin_set(&h);
+                if (errors[k] != LT_OK) {
+                    lt_util_session_reset(&h);
+                    break;
+                }
+            }
+            errors[k] = sc->fn(&h, &samples[done]);
+            if (errors[k] != LT_OK) {
+                // Do not trust the session after a failure
+                lt_util_session_reset(&h);
+                break;
+            }
+            done++;
+        }
+        compute_result(samples, done, tmp, &results[k]);
+
+        if (errors[k] != LT_OK) {
+            printf("%-12s failed after %zu: %s\n", sc->name, done, lt_ret_verbose(errors[k]));
+            status = 1;
+            continue;
+        }
+        for (int p = 0; p < BENCH_PIN_PHASES; p++) {
+            const struct bench_stats *st = &results[k].stats[p];
+            // Phases which did not happen in this scenario only clutter the table
+            if (p < LT_MACANDD_PHASE_COUNT && st->max == 0) {
+                continue;
+            }
+            printf("%-12s %-16s %6llu %10.1f %10.1f %10.1f\n", sc->name, bench_pin_phase_name(p),
+                   (unsigned long long)results[k].calls[p], st->p50 / 1e3, st->p99 / 1e3, st->max / 1e3);
+        }
+    }
+
+    lt_util_session_reset(&h);
+    free(samples);
+    free(tmp);
+
+    if (json_path) {
+        FILE *fp = strcmp(json_path, "-") == 0 ? stdout : fopen(json_path, "w");
+        if (!fp) {
+            LT_LOG_ERROR("Error opening file %s: %s", json_path, strerror(errno));
+            return 1;
+        }
+        print_json(fp, iterations, results, errors, selected);
+        if (fp != stdout && fclose(fp) != 0) {
+            LT_LOG_ERROR("Error writing file %s", json_path);
+            return 1;
+        }
+    }
+
+    return status;
+}
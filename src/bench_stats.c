@@ -0,0 +1,57 @@
+/**
+ * @file bench_stats.c
+ * @author Tropic Square s.r.o.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench_stats.h"
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted array
+static uint64_t percentile(const uint64_t *sorted, size_t n, unsigned pct)
+{
+    size_t rank = (n * pct + 99) / 100;
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[rank - 1];
+}
+
+void bench_stats_compute(uint64_t *ns, size_t n, struct bench_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    if (n == 0) {
+        return;
+    }
+
+    qsort(ns, n, sizeof(*ns), compare_u64);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) {
+        sum += ns[i];
+    }
+
+    stats->n = n;
+    stats->min = ns[0];
+    stats->p50 = percentile(ns, n, 50);
+    stats->p99 = percentile(ns, n, 99);
+    stats->max = ns[n - 1];
+    stats->ops_per_s = sum ? (double)n * 1e9 / (double)sum : 0.0;
+}
@@ -0,0 +1,43 @@
+#ifndef BENCH_STATS_H
+#define BENCH_STATS_H
+
+/**
+ * @file bench_stats.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Latency statistics shared by benchmarks
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Summary of measured latencies, all times in nanoseconds */
+struct bench_stats {
+    size_t n;
+    uint64_t min;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+    /** Operations per second, computed from the sum of latencies */
+    double ops_per_s;
+};
+
+/**
+ * @brief Current time of monotonic clock
+ *
+ * @return uint64_t   Nanoseconds
+ */
+uint64_t bench_now_ns(void);
+
+/**
+ * @brief Compute min, p50, p99, max and ops/s of measured latencies
+ *
+ * @param ns          Latencies in nanoseconds, array is sorted in place
+ * @param n           Number of latencies
+ * @param stats       Computed statistics, all zero when n is 0
+ */
+void bench_stats_compute(uint64_t *ns, size_t n, struct bench_stats *stats);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * @file bench_transport.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details lt-bench-transport measures the HAL port of USB dongle alone: every iteration is one L1 frame
+ * (chip select low, SPI transfer, chip select high) of a given size, as libtropic sends it. Without a serialport
+ * it talks to a stand-in dongle on a pseudo-terminal, which answers as the dongle does and sends every byte back,
+ * so no hardware is needed and received bytes are checked. Build it with and without USB_DONGLE_FAST to compare
+ * the ports.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "libtropic_port.h"
+#include "bench_stats.h"
+#include "commands.h"
+
+#define BENCH_TRANSPORT_ITERATIONS_DEFAULT 200
+
+// Frame sizes: chip status poll, short command, L2 frame carrying 444 B of R memory write in pieces, full frame
+static const uint16_t bench_transport_sizes[] = {1, 34, 128, sizeof(((lt_l2_state_t *)0)->buff)};
+#define BENCH_TRANSPORT_SIZES_COUNT (sizeof(bench_transport_sizes) / sizeof(bench_transport_sizes[0]))
+
+static void print_usage(void)
+{
+    printf("\r\nUsage:\r\n\n"
+           "\t./lt-bench-transport [<serialport>] [-n <iterations>]\r\n\n"
+           "\t <serialport>      USB dongle, its chip sees the frames, received bytes are not checked\r\n"
+           "\t                   (default: stand-in dongle on a pseudo-terminal, echoing every byte)\r\n"
+           "\t -n <iterations>   Frames of each size (default %d)\r\n"
+           "\t Baud rate is taken from "LT_UTIL_BAUD_ENV" (default %d).\r\n\n",
+           BENCH_TRANSPORT_ITERATIONS_DEFAULT, LT_UTIL_BAUD_DEFAULT);
+}
+
+// Reads one line ended by '\n' from the pseudo-terminal, returns its length without '\n', -1 on end
+static int standin_line(int fd, char *line, size_t len)
+{
+    size_t pos = 0;
+    for (;;) {
+        char c;
+        ssize_t n = read(fd, &c, 1);
+        if (n <= 0) {
+            if ((n < 0) && (errno == EINTR)) {
+                continue;
+            }
+            return -1;
+        }
+        if (c == '\n') {
+            line[pos] = '\0';
+            return (int)pos;
+        }
+        if (pos + 1 < len) {
+            line[pos++] = c;
+        }
+    }
+}
+
+static int standin_write(int fd, const char *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return 1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+// Answers chip select with "OK", hexadecimal frame ended by 'x' is sent back as it came
+static void *standin_dongle(void *arg)
+{
+    int fd = *(int *)arg;
+    char line[2 * 512 + 8];
+    for (;;) {
+        int len = standin_line(fd, line, sizeof(line));
+        if (len < 0) {
+            break;
+        }
+        if ((strcmp(line, "CS=0") == 0) || (strcmp(line, "CS=1") == 0)) {
+            if (standin_write(fd, "OK\r\n", 4)) {
+                break;
+            }
+        } else if ((len > 0) && (line[len - 1] == 'x')) {
+            line[len - 1] = '\r';
+            line[len] = '\n';
+            if (standin_write(fd, line, (size_t)len + 1)) {
+                break;
+            }
+        }
+    }
+    return NULL;
+}
+
+static int standin_open(int *master, char *slave_path, size_t len)
+{
+    *master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((*master < 0) || (grantpt(*master) != 0) || (unlockpt(*master) != 0)) {
+        return 1;
+    }
+    const char *name = ptsname(*master);
+    if (!name || (strlen(name) >= len)) {
+        return 1;
+    }
+    strcpy(slave_path, name);
+
+    // Dongle side sees bytes as they were written, without echo or line editing
+    struct termios tty;
+    if (tcgetattr(*master, &tty) == 0) {
+        cfmakeraw(&tty);
+        tcsetattr(*master, TCSANOW, &tty);
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev_path = NULL;
+    long iterations = BENCH_TRANSPORT_ITERATIONS_DEFAULT;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-n") == 0) && (i + 1 < argc)) {
+            char *endptr;
+            iterations = strtol(argv[++i], &endptr, 10);
+            if ((*endptr != '\0') || (iterations < 1) || (iterations > 1000000)) {
+                LT_LOG_ERROR("Invalid value of -n");
+                return 1;
+            }
+        } else if ((argv[i][0] != '-') && !dev_path) {
+            dev_path = argv[i];
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    int master = -1;
+    char slave_path[DEVICE_PATH_MAX_LEN];
+    pthread_t standin;
+    if (!dev_path) {
+        if (standin_open(&master, slave_path, sizeof(slave_path)) != 0) {
+            LT_LOG_ERROR("Error creating pseudo-terminal: %s", strerror(errno));
+            return 1;
+        }
+        if (pthread_create(&standin, NULL, standin_dongle, &master) != 0) {
+            LT_LOG_ERROR("Error starting stand-in dongle");
+            return 1;
+        }
+        dev_path = slave_path;
+    }
+
+    uint64_t *ns = calloc((size_t)iterations, sizeof(uint64_t));
+    if (!ns) {
+        LT_LOG_ERROR("Error allocating results");
+        return 1;
+    }
+
+    lt_handle_t h = {0};
+    struct lt_util_dev dev;
+    lt_util_dev_setup(&h, &dev, dev_path);
+    if (lt_port_init(&h.l2) != LT_OK) {
+        LT_LOG_ERROR("Error opening %s", dev_path);
+        return 1;
+    }
+
+    int status = 0;
+    printf("%-6s %8s %10s %10s %10s %10s %12s", "size", "n", "min [us]", "p50 [us]", "p99 [us]", "max [us]",
+           "frames/s");
+#if USB_DONGLE_FAST
+    printf(" %9s %9s", "syscalls", "B/frame");
+#endif
+    printf("\n");
+    for (size_t k = 0; k < BENCH_TRANSPORT_SIZES_COUNT; k++) {
+        uint16_t size = bench_transport_sizes[k];
+        size_t done = 0;
+#if USB_DONGLE_FAST
+        memset(&dev.uart.stats, 0, sizeof(dev.uart.stats));
+#endif
+        for (long it = 0; it < iterations; it++) {
+            uint8_t sent[sizeof(h.l2.buff)];
+            for (uint16_t i = 0; i < size; i++) {
+                sent[i] = (uint8_t)(i + it);
+            }
+            memcpy(h.l2.buff, sent, size);
+
+            uint64_t start = bench_now_ns();
+            lt_ret_t ret = lt_port_spi_csn_low(&h.l2);
+            if (ret == LT_OK) {
+                ret = lt_port_spi_transfer(&h.l2, 0, size, LT_L1_TIMEOUT_MS_DEFAULT);
+            }
+            if (ret == LT_OK) {
+                ret = lt_port_spi_csn_high(&h.l2);
+            }
+            ns[done] = bench_now_ns() - start;
+
+            if (ret != LT_OK) {
+                LT_LOG_ERROR("Frame of %u B failed: %s", size, lt_ret_verbose(ret));
+                status = 1;
+                break;
+            }
+            if ((master >= 0) && (memcmp(h.l2.buff, sent, size) != 0)) {
+                LT_LOG_ERROR("Frame of %u B came back changed", size);
+                status = 1;
+                break;
+            }
+            done++;
+        }
+
+        struct bench_stats stats;
+        bench_stats_compute(ns, done, &stats);
+        printf("%-6u %8zu %10.1f %10.1f %10.1f %10.1f %12.1f", size, done, stats.min / 1e3, stats.p50 / 1e3,
+               stats.p99 / 1e3, stats.max / 1e3, stats.ops_per_s);
+#if USB_DONGLE_FAST
+        const struct lt_usb_fast_stats *io = &dev.uart.stats;
+        printf(" %9.1f %9.1f", done ? (double)(io->writes + io->reads + io->polls) / done : 0.0,
+               done ? (double)(io->bytes_out + io->bytes_in) / done : 0.0);
+#endif
+        printf("\n");
+        if (status) {
+            break;
+        }
+    }
+
+    lt_port_deinit(&h.l2);
+    if (master >= 0) {
+        // Stand-in gets end of file once the port closed the other side
+        pthread_join(standin, NULL);
+        close(master);
+    }
+    free(ns);
+
+    return status;
+}
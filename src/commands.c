@@ -0,0 +1,2127 @@
+/**
+ * @file commands.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Implementation of lt-util commands. Each command opens the device, establishes secure session, executes
+ * one L3 command and closes the device again, unless the session is kept open by lt_util_session_keep() (lt-utild).
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "string.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "macandd.h"
+#include "vault.h"
+#include "key_cache.h"
+#include "commands.h"
+#include "digest.h"
+#include "eph_pool.h"
+#include "crc32.h"
+#include "provision.h"
+#include "rng_stream.h"
+#include "sign_batch.h"
+#include "spi_calibrate.h"
+#include "stpub_cache.h"
+#include "trace.h"
+
+#define LT_LOG_CMD(f_, ...) LT_LOG("[CMD] " f_, ##__VA_ARGS__)
+
+#define HEX_DATA_SIZE 32
+
+/** @brief Last slot of R memory */
+#define R_MEM_SLOT_MAX     511
+/** @brief Maximal size of data in one slot of R memory */
+#define R_MEM_DATA_LEN_MAX 444
+
+/**
+ * @brief Archive written by process_mem_dump(), all values little endian:
+ *
+ *     header: "LTRM" | version (1B) | reserved (1B) | number of records (2B)
+ *     record: slot (2B) | data length (2B) | CRC-32 of slot, length and data (4B) | data
+ *
+ * Records are ordered by slot number, empty slots have no record.
+ */
+#define R_MEM_ARCHIVE_MAGIC       "LTRM"
+#define R_MEM_ARCHIVE_VERSION     1
+#define R_MEM_ARCHIVE_HEADER_LEN  8
+#define R_MEM_ARCHIVE_RECORD_LEN  8
+
+/**
+ * @brief Devices which were distributed by Tropic Square company are populated with different versions of engineering samples of TROPIC01. Each TROPIC01
+ * is by default distributed with initial pairing keys (SH0).
+ * These keys are used to establish secure channel with the device and to perform various operations.
+ * If you are not able to establish handshake with your device, you may need to change the keys.
+ *
+ * For more info please read datasheet to find out how handshake works.
+ *
+ * @details As a rule of thumb:
+ *     keys used in TS1301 are defined under "Engineering Samples 01"
+ *     keys used in TS1302 are defined under "Engineering Samples 02"
+ *     Raspberrypi shield (HW SPI) was distributed with both, so you might need to check which keys work.
+ *     If you have Mikroe click shield or arduino shield, you might need to check as well which keys work.
+ *
+ */
+int8_t pkey_index_0 =  PAIRING_KEY_SLOT_INDEX_0;
+#if USB_DONGLE_TS1301
+#pragma message("Compiling for USB_DONGLE_TS1301")
+#define ENGINEERING_SAMPLES_01
+#endif
+#if USB_DONGLE_TS1302
+#pragma message("Compiling for USB_DONGLE_TS1302")
+#define ENGINEERING_SAMPLES_02
+#endif
+#if LINUX_SPI
+// In rare situation (very old devkit) you might need to define ENGINEERING_SAMPLES_01 here
+#define ENGINEERING_SAMPLES_02
+#endif
+#if SIMULATOR
+#pragma message("Compiling for SIMULATOR")
+// Simulated chip is paired with the same keys as current devkits
+#define ENGINEERING_SAMPLES_02
+#endif
+//#if defined(XXX)
+//// code for XXX
+//#elif defined(YYY)
+//// code for YYY
+//#else
+//// code for ZZZ
+//#endif
+#ifdef ENGINEERING_SAMPLES_01
+// Engineering samples 01 keys:
+#pragma message("Compiling lt-util with ENGINEERING_SAMPLES_01 keys, please check if they are correct for your device")
+uint8_t sh0priv[] = {0xd0,0x99,0x92,0xb1,0xf1,0x7a,0xbc,0x4d,0xb9,0x37,0x17,0x68,0xa2,0x7d,0xa0,0x5b,0x18,0xfa,0xb8,0x56,0x13,0xa7,0x84,0x2c,0xa6,0x4c,0x79,0x10,0xf2,0x2e,0x71,0x6b};
+uint8_t sh0pub[]  = {0xe7,0xf7,0x35,0xba,0x19,0xa3,0x3f,0xd6,0x73,0x23,0xab,0x37,0x26,0x2d,0xe5,0x36,0x08,0xca,0x57,0x85,0x76,0x53,0x43,0x52,0xe1,0x8f,0x64,0xe6,0x13,0xd3,0x8d,0x54};
+#endif
+#ifdef ENGINEERING_SAMPLES_02
+// Engineering samples 02 keys
+#pragma message("Compiling lt-util with ENGINEERING_SAMPLES_02 keys, please check if they are correct for your device")
+uint8_t sh0priv[] = {0x28,0x3F,0x5A,0x0F,0xFC,0x41,0xCF,0x50,0x98,0xA8,0xE1,0x7D,0xB6,0x37,0x2C,0x3C,0xAA,0xD1,0xEE,0xEE,0xDF,0x0F,0x75,0xBC,0x3F,0xBF,0xCD,0x9C,0xAB,0x3D,0xE9,0x72};
+uint8_t sh0pub[]  = {0xF9,0x75,0xEB,0x3C,0x2F,0xD7,0x90,0xC9,0x6F,0x29,0x4F,0x15,0x57,0xA5,0x03,0x17,0x80,0xC9,0xAA,0xFA,0x14,0x0D,0xA2,0x8F,0x55,0xE7,0x51,0x57,0x37,0xB2,0x50,0x2C};
+#endif
+
+// Device description the handle was attached to by lt_util_dev_setup()
+static struct lt_util_dev *util_dev(lt_handle_t *h)
+{
+#if USB_DONGLE_TS1301 || USB_DONGLE_TS1302
+    return (struct lt_util_dev *)((char *)h->l2.device - offsetof(struct lt_util_dev, uart));
+#elif LINUX_SPI
+    return (struct lt_util_dev *)((char *)h->l2.device - offsetof(struct lt_util_dev, spi));
+#else
+    return (struct lt_util_dev *)((char *)h->l2.device - offsetof(struct lt_util_dev, sim));
+#endif
+}
+
+#if LINUX_SPI || SIMULATOR
+// SPI clock from LT_UTIL_SPI_SPEED_ENV, calibration is left to lt_util_dev_open()
+static void lt_util_spi_speed_setup(struct lt_util_dev *dev, uint32_t *speed)
+{
+    const char *env = getenv(LT_UTIL_SPI_SPEED_ENV);
+    if(!env) {
+        return;
+    }
+
+    char *endptr;
+    unsigned long hz = strtoul(env, &endptr, 10);
+    if(strcmp(env, "auto") == 0) {
+        dev->spi_calibrate = LT_UTIL_SPI_AUTO;
+    } else if(strcmp(env, "calibrate") == 0) {
+        dev->spi_calibrate = LT_UTIL_SPI_CALIBRATE;
+    } else if((*endptr == '\0') && (hz > 0) && (hz <= UINT32_MAX)) {
+        *speed = (uint32_t)hz;
+    } else {
+        LT_LOG_WARN("Ignoring %s=%s, using %u Hz", LT_UTIL_SPI_SPEED_ENV, env, (unsigned)*speed);
+    }
+}
+
+// Names bus and chip select of the device for the cache of calibrated clock
+static uint32_t *lt_util_spi_bus(struct lt_util_dev *dev, char *bus, size_t len)
+{
+#if LINUX_SPI
+    const char *spidev = strrchr(dev->spi.spi_dev, '/');
+    spidev = spidev ? spidev + 1 : dev->spi.spi_dev;
+#if LINUX_SPI_IOC
+    if(dev->spi.gpio_cs_num == LT_SPI_IOC_CS_NATIVE) {
+        snprintf(bus, len, "%s-native", spidev);
+        return &dev->spi.spi_speed;
+    }
+#endif
+    snprintf(bus, len, "%s-cs%d", spidev, (int)dev->spi.gpio_cs_num);
+    return &dev->spi.spi_speed;
+#else
+    snprintf(bus, len, "sim");
+    return &dev->sim.spi_speed;
+#endif
+}
+#endif
+
+void lt_util_dev_setup(lt_handle_t *h, struct lt_util_dev *dev, const char *path)
+{
+    memset(dev, 0, sizeof(*dev));
+#if USB_DONGLE_TS1301 || USB_DONGLE_TS1302
+    dev->uart.baud_rate = LT_UTIL_BAUD_DEFAULT;
+    const char *baud = getenv(LT_UTIL_BAUD_ENV);
+    if(baud) {
+        char *endptr;
+        unsigned long rate = strtoul(baud, &endptr, 10);
+#if USB_DONGLE_FAST
+        if(strcmp(baud, "auto") == 0) {
+            dev->uart.baud_rate = LT_USB_FAST_BAUD_AUTO;
+        } else
+#endif
+        if((*endptr == '\0') && (rate > 0) && (rate <= UINT32_MAX)) {
+            dev->uart.baud_rate = (uint32_t)rate;
+        } else {
+            LT_LOG_WARN("Ignoring %s=%s, using %u baud", LT_UTIL_BAUD_ENV, baud, (unsigned)LT_UTIL_BAUD_DEFAULT);
+        }
+    }
+    strncpy(dev->uart.dev_path, path, DEVICE_PATH_MAX_LEN);
+    h->l2.device = &dev->uart;
+#endif
+#if LINUX_SPI
+    // This will setup mappings compatible with RPi and our RPi shield.
+    strcpy(dev->spi.gpio_dev, "/dev/gpiochip0");
+    strcpy(dev->spi.spi_dev, "/dev/spidev0.0");
+    dev->spi.spi_speed = 1000000; // 1 MHz
+    dev->spi.gpio_cs_num = 25;    // GPIO 25 as on RPi shield.
+#if LINUX_SPI_IOC
+    const char *irq = getenv(LT_UTIL_INT_GPIO_ENV);
+    dev->spi.gpio_int_num = (irq && *irq) ? atoi(irq) : LT_SPI_IOC_INT_NONE;
+#endif
+    if(path) {
+        // Other chips on the same bus differ in spidev and chip select GPIO, e.g. "/dev/spidev0.1:24"
+        const char *cs = strchr(path, ':');
+        size_t len = cs ? (size_t)(cs - path) : strlen(path);
+        if(len >= sizeof(dev->spi.spi_dev)) {
+            len = sizeof(dev->spi.spi_dev) - 1;
+        }
+        memcpy(dev->spi.spi_dev, path, len);
+        dev->spi.spi_dev[len] = '\0';
+        if(cs) {
+            dev->spi.gpio_cs_num = atoi(cs + 1);
+#if LINUX_SPI_IOC
+            if((strncmp(cs + 1, "native", 6) == 0) && ((cs[7] == '\0') || (cs[7] == ':'))) {
+                dev->spi.gpio_cs_num = LT_SPI_IOC_CS_NATIVE;
+            }
+            // Interrupt pin follows chip select, e.g. "/dev/spidev0.0:native:24"
+            irq = strchr(cs + 1, ':');
+            if(irq) {
+                dev->spi.gpio_int_num = atoi(irq + 1);
+            }
+#endif
+        }
+    }
+    h->l2.device = &dev->spi;
+    lt_util_spi_speed_setup(dev, &dev->spi.spi_speed);
+#endif
+#if SIMULATOR
+    memcpy(dev->sim.sh0pub, sh0pub, sizeof(dev->sim.sh0pub));
+    dev->sim.state_path = path ? path : getenv(LT_SIM_STATE_ENV);
+    dev->sim.latency = getenv(LT_SIM_LATENCY_ENV);
+    dev->sim.spi_speed = 1000000;
+    const char *spi_max = getenv(LT_SIM_SPI_MAX_HZ_ENV);
+    dev->sim.spi_max_hz = spi_max ? (uint32_t)strtoul(spi_max, NULL, 10) : 0;
+    lt_util_spi_speed_setup(dev, &dev->sim.spi_speed);
+    h->l2.device = &dev->sim;
+#endif
+}
+
+int lt_util_expand(const char *in, const char *placeholder, const char *value, char *out, size_t out_len)
+{
+    size_t pos = 0;
+    while (*in) {
+        const char *part = in;
+        size_t len = 1;
+        if (strncmp(in, placeholder, strlen(placeholder)) == 0) {
+            part = value;
+            len = strlen(value);
+            in += strlen(placeholder);
+        } else {
+            in++;
+        }
+        if (pos + len >= out_len) {
+            return 1;
+        }
+        memcpy(out + pos, part, len);
+        pos += len;
+    }
+    out[pos] = '\0';
+
+    return 0;
+}
+
+void lt_util_session_keep(lt_handle_t *h, bool keep)
+{
+    util_dev(h)->session_keep = keep;
+}
+
+bool lt_util_session_is_kept(lt_handle_t *h)
+{
+    return util_dev(h)->session_keep;
+}
+
+int lt_util_dev_open(lt_handle_t *h)
+{
+    // Device opened earlier by this command (e.g. for serial number of the cache) or kept by lt-utild
+    struct lt_util_dev *dev = util_dev(h);
+    if(dev->dev_ready) {
+        return 0;
+    }
+
+    // Keypair for the handshake is computed while lt_init() and certificate transfer run
+    lt_eph_pool_start();
+
+#if LINUX_SPI || SIMULATOR
+    if(dev->spi_calibrate != LT_UTIL_SPI_FIXED) {
+        // Calibration opens the device itself at every clock it tries
+        bool force = (dev->spi_calibrate == LT_UTIL_SPI_CALIBRATE);
+        dev->spi_calibrate = LT_UTIL_SPI_FIXED;
+        char bus[PATH_MAX];
+        uint32_t *speed = lt_util_spi_bus(dev, bus, sizeof(bus));
+        lt_util_spi_calibrate(h, bus, speed, force);
+    }
+#endif
+
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = lt_init(h);
+    LT_TRACE_END(start, "cmd", "lt_init");
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error lt_init(): %s", lt_ret_verbose(ret));
+        lt_deinit(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_init(): %s", lt_ret_verbose(ret));
+    }
+    dev->dev_ready = true;
+
+    return 0;
+}
+
+static uint64_t session_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int lt_util_session_open(lt_handle_t *h)
+{
+    struct lt_util_dev *dev = util_dev(h);
+    if(dev->dev_ready && (h->l3.session == SESSION_ON)) {
+        return 0;
+    }
+
+    if(lt_util_dev_open(h) != 0) {
+        return 1;
+    }
+
+    LT_TRACE_BEGIN(start);
+    uint64_t setup_ns = session_now_ns();
+    lt_ret_t ret;
+    if(lt_stpub_cache_enabled()) {
+        ret = lt_stpub_session_start(h, sh0priv, sh0pub, pkey_index_0);
+    } else {
+        ret = lt_verify_chip_and_start_secure_session(h, sh0priv, sh0pub, pkey_index_0);
+    }
+    setup_ns = session_now_ns() - setup_ns;
+    LT_TRACE_END(start, "cmd", "handshake");
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error sec channel: %s", lt_ret_verbose(ret));
+        lt_util_session_reset(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("Secure channel established in %.1f ms: %s", setup_ns / 1e6, lt_ret_verbose(ret));
+    }
+
+    return 0;
+}
+
+void lt_util_session_close(lt_handle_t *h)
+{
+    if(util_dev(h)->session_keep) {
+        return;
+    }
+    lt_util_session_reset(h);
+}
+
+void lt_util_session_reset(lt_handle_t *h)
+{
+    struct lt_util_dev *dev = util_dev(h);
+    if(dev->dev_ready) {
+        lt_deinit(h);
+    }
+    dev->dev_ready = false;
+    dev->serial[0] = '\0';
+}
+
+static int process_rng_get(lt_handle_t *h, char *count_in, char *file) {
+    if(!count_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters process_rng_get()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "RNG" %s %s", count_in, file);
+    }
+
+    // Parsing count number
+    char *endptr;
+    long int count = strtol(count_in, &endptr, 10);
+    if((*endptr != '\0') || (count > RANDOM_VALUE_GET_LEN_MAX) || (count < 1)) {
+        LT_LOG_ERROR("Invalid length passed, use number between 1-255");
+        return 1;
+    }
+
+    // Opening file into which random bytes will be written
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s", file);
+        return 1;
+    }
+    LT_LOG_INFO("File \"%s\" opened for writing", file);
+
+    // Get random bytes from TROPIC01 into bytes[] buffer
+    uint8_t bytes[RANDOM_VALUE_GET_LEN_MAX] = {0};
+    if(lt_util_session_open(h) != 0) {
+        fclose(fp);
+        return 1;
+    }
+    lt_ret_t ret;
+
+    ret = lt_random_value_get(h, bytes, count);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        fclose(fp);
+        return ret;
+    } else {
+        LT_LOG_INFO("lt_random_value_get(): %s", lt_ret_verbose(ret));
+    }
+
+    // Store content of bytes[] buffer into file
+    size_t written = fwrite(bytes, sizeof(uint8_t), count, fp);
+    if(written !=count) {
+        LT_LOG_ERROR("Error writing into file, %zu written", written);
+        fclose(fp);
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("Wrote %zu bytes into file \"%s\"", written, file);
+    }
+
+    fclose(fp);
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+static int process_ecc_install(lt_handle_t *h, char *slot_in, char *file) {
+    if(!slot_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters process_rng_get()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_INSTALL" %s %s", slot_in, file);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    }
+    LT_LOG_INFO("Slot number: %ld is valid", slot);
+
+    // Opening file from which first 32B will be taken as private key
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error process_ecc_install() opening fileE");
+        return 1;
+    }
+    LT_LOG_INFO("File \"%s\" opened for reading", file);
+
+    // Read keypair from file into keypair[] buffer
+    uint8_t keypair[64] = {0};
+    size_t read = fread(keypair, sizeof(uint8_t), 64, fp);
+    LT_LOG_INFO("Number of bytes read: %zu", read);
+    fclose(fp);
+
+    // Install first 32B from keypair[] into ecc slot priv key
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+    ret = lt_ecc_key_store(h, slot, CURVE_ED25519, keypair); // Only first 32B will be taken
+    // Even a failed command may have changed the slot
+    lt_key_cache_invalidate(h, (uint8_t)slot);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_ecc_key_store(): %s", lt_ret_verbose(ret));
+    }
+
+    lt_util_session_close(h);
+
+    LT_LOG("OK");
+    return 0;
+}
+
+static int process_ecc_generate(lt_handle_t *h, char *slot_in) {
+    if(!slot_in) {
+        LT_LOG_ERROR("Error, NULL parameters process_ecc_clear()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_GENERATE" %s", slot_in);
+    }
+
+     // Parsing slot number
+     char *endptr;
+     long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Generate EdDSA  private key in a given slot
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+    lt_ecc_curve_type_t curve = 2;
+    ecc_key_origin_t origin = 2;
+    ret = lt_ecc_key_generate(h, (uint8_t)slot, CURVE_ED25519);
+    lt_key_cache_invalidate(h, (uint8_t)slot);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return ret;
+    } else {
+        LT_LOG_INFO("lt_ecc_key_generate() : %s", lt_ret_verbose(ret));
+    }
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+static int process_ecc_download(lt_handle_t *h, char *slot_in, char *file) {
+
+    if(!slot_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters process_rng_get()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_DOWNLOAD" %s %s", slot_in, file);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Opening file
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error process_ecc_download() opening file");
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for writing", file);
+    }
+
+    // With the key cache enabled, key read before and not changed since by lt-util is served without secure session
+    uint8_t pubkey[64] = {0};
+    struct lt_key_cache cache;
+    bool cached = lt_key_cache_enabled() && (lt_key_cache_load(h, &cache) == 0);
+    if(cached && (cache.slot[slot].state == LT_KEY_CACHE_KEY)) {
+        memcpy(pubkey, cache.slot[slot].pubkey, sizeof(pubkey));
+        LT_LOG("Public key of slot %ld is cached on this host, it was not read from the chip", slot);
+        size_t written = fwrite(pubkey, sizeof(uint8_t), 32, fp);
+        LT_LOG_INFO("Number of elements written: %zu", written);
+        lt_util_session_close(h);
+        return (fclose(fp) != 0) || (written != 32);
+    }
+
+    if(lt_util_session_open(h) != 0) {
+        fclose(fp);
+        return 1;
+    }
+    lt_ret_t ret;
+    lt_ecc_curve_type_t curve = 2;
+    ecc_key_origin_t origin = 2;
+    ret = lt_ecc_key_read(h, (uint8_t)slot, pubkey, &curve, &origin);
+    if(cached && (lt_key_cache_record(&cache, (uint8_t)slot, ret, pubkey, curve, origin) == 0)) {
+        lt_key_cache_save(h, &cache);
+    }
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        fclose(fp);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_ecc_key_read(): %s", lt_ret_verbose(ret));
+    }
+
+    size_t written = fwrite(pubkey, sizeof(uint8_t), 32, fp);
+    LT_LOG_INFO("Number of elements written: %zu", written);
+
+    fclose(fp);
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+static int process_ecc_clear(lt_handle_t *h, char *slot_in) {
+    if(!slot_in) {
+        LT_LOG_ERROR("Error, NULL parameters process_ecc_clear()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_CLEAR" %s", slot_in);
+    }
+
+     // Parsing slot number
+     char *endptr;
+     long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Clear given slot in TROPIC01
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+    lt_ecc_curve_type_t curve = 2;
+    ecc_key_origin_t origin = 2;
+    ret = lt_ecc_key_erase(h, (uint8_t)slot);
+    lt_key_cache_invalidate(h, (uint8_t)slot);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_ecc_key_erase(): %s", lt_ret_verbose(ret));
+    }
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+static int process_ecc_sign(lt_handle_t *h, char *slot_in, char *msg_file_in, char* signature_file_out) {
+    if(!slot_in || !msg_file_in || !signature_file_out) {
+        LT_LOG_ERROR("Error, NULL parameters process_rng_get()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_SIGN" %s %s %s", slot_in, msg_file_in, signature_file_out);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Opening file from which a hash will be read
+    FILE *msg_fp = fopen(msg_file_in, "rb");
+    if (msg_fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s", msg_file_in);
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for reading", msg_file_in);
+    }
+
+    fseek(msg_fp, 0L, SEEK_END);
+    long msg_size = ftell(msg_fp);
+    rewind(msg_fp);
+
+    // Message is sent to TROPIC01 as a whole, bigger files are signed through their digest
+    if((msg_size < 0) || (msg_size > ECC_SIGN_MSG_LEN_MAX)) {
+        LT_LOG_ERROR("Error, size of file to sign must be between 0 - 4095 B, use "ECC" "ECC_SIGN_DIGEST" for bigger files");
+        fclose(msg_fp);
+        return 1;
+    }
+
+    // Opening file into which a signature will be written
+    FILE *fp_sig = fopen(signature_file_out, "wb");
+    if (fp_sig == NULL) {
+        LT_LOG_ERROR("Error opening file %s", signature_file_out);
+        fclose(msg_fp);
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for writing", signature_file_out);
+    }
+
+    // Read hash from file
+    uint8_t msg[ECC_SIGN_MSG_LEN_MAX] = {0};
+    size_t read = fread(msg, sizeof(uint8_t), msg_size, msg_fp);
+    LT_LOG_INFO("Number of bytes read: %zu", read);
+    fclose(msg_fp);
+
+    // Sign hash in TROPIC01
+    if(lt_util_session_open(h) != 0) {
+        fclose(fp_sig);
+        return 1;
+    }
+    lt_ret_t ret;
+    uint8_t signature_rs[64] = {0};
+    ret = lt_ecc_eddsa_sign(h, (uint8_t)slot, msg, msg_size, signature_rs);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        fclose(fp_sig);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_ecc_eddsa_sign(): %s", lt_ret_verbose(ret));
+    }
+
+    // Write signature into file
+    size_t written = fwrite(signature_rs, sizeof(uint8_t), 64, fp_sig);
+    if(written != 64) {
+        LT_LOG_ERROR("Error writing into file, written: %zu", written);
+        fclose(fp_sig);
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("Wrote %zu bytes into file \"%s\"", written, signature_file_out);
+    }
+
+    fclose(fp_sig);
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+static int process_ecc_sign_digest(lt_handle_t *h, char *slot_in, char *file_in, char *signature_file_out,
+                                   char *alg_in) {
+    if(!slot_in || !file_in || !signature_file_out || !alg_in) {
+        LT_LOG_ERROR("Error, NULL parameters process_ecc_sign_digest()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_SIGN_DIGEST" %s %s %s %s", slot_in, file_in, signature_file_out, alg_in);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+
+    if((*endptr != '\0') || (slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    enum digest_alg alg;
+    if(digest_alg_parse(alg_in, &alg) != 0) {
+        LT_LOG_ERROR("Error, unknown digest %s, use sha256, sha512 or sha256-tree", alg_in);
+        return 1;
+    }
+
+    // Hash the file before session is established, this can take a while for big files
+    struct digest_header header;
+    if(digest_file(file_in, alg, &header) != 0) {
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" hashed with %s", file_in, alg_in);
+    }
+
+    FILE *fp_sig = fopen(signature_file_out, "wb");
+    if (fp_sig == NULL) {
+        LT_LOG_ERROR("Error opening file %s", signature_file_out);
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for writing", signature_file_out);
+    }
+
+    // Header holds the digest together with description of what was hashed, it is signed as a whole
+    if(lt_util_session_open(h) != 0) {
+        fclose(fp_sig);
+        return 1;
+    }
+    uint8_t signature_rs[64] = {0};
+    lt_ret_t ret = lt_ecc_eddsa_sign(h, (uint8_t)slot, (uint8_t *)&header, sizeof(header), signature_rs);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        fclose(fp_sig);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_ecc_eddsa_sign(): %s", lt_ret_verbose(ret));
+    }
+
+    // Write header followed by signature
+    size_t written = fwrite(&header, 1, sizeof(header), fp_sig);
+    written += fwrite(signature_rs, 1, sizeof(signature_rs), fp_sig);
+    if((fclose(fp_sig) != 0) || (written != sizeof(header) + sizeof(signature_rs))) {
+        LT_LOG_ERROR("Error writing into file, written: %zu", written);
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("Wrote %zu bytes into file \"%s\"", written, signature_file_out);
+    }
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+static int process_mem_store(lt_handle_t *h, char *slot_in, char *file) {
+    if(!slot_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters process_mem_store()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "MEM" "MEM_STORE" %s %s", slot_in, file);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 511)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else if(slot >= LT_VAULT_R_MEM_RESERVED_FIRST) {
+        LT_LOG_ERROR("Error, slots %d-%d are reserved for "VAULT" and PIN of "MAC_SET, LT_VAULT_R_MEM_RESERVED_FIRST,
+                     R_MEM_DATA_SLOT_MACANDD);
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Opening file
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error process_ecc_download() opening file");
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for reading", file);
+    }
+
+    fseek(fp, 0L, SEEK_END);
+    long sz = ftell(fp);
+    rewind(fp);
+
+    if((sz < 1) || (sz > 444)) {
+        LT_LOG_ERROR("Error, size of file to store must be between 1 - 444 B");
+        fclose(fp);
+        return 1;
+    } else {
+        LT_LOG_INFO("File size: %ld is valid", sz);
+    }
+
+    // Read keypair from file into keypair[] buffer
+    uint8_t mem_content[444] = {0};
+    size_t read = fread(mem_content, sizeof(uint8_t), sz, fp);
+    if(read != sz) {
+        LT_LOG_ERROR("Error when reading a file");
+        fclose(fp);
+        return 1;
+    } else {
+        LT_LOG_INFO("Read %zu bytes from file", read);
+    }
+
+    fclose(fp);
+
+    // Store the content into r memory slot
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+
+    ret = lt_r_mem_data_write(h, (uint16_t)slot, mem_content,(uint16_t)sz);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_r_mem_data_write(): %s", lt_ret_verbose(ret));
+    }
+
+    lt_util_session_close(h);
+
+    return 0;
+
+}
+
+static int process_mem_read(lt_handle_t *h, char *slot_in, char *file) {
+    if(!slot_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters process_mem_read()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "MEM" "MEM_READ" %s %s", slot_in, file);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 511)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Opening file
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error process_ecc_download() opening file");
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for writing", file);
+    }
+
+    // Read keypair from file into keypair[] buffer
+    uint8_t mem_content[444] = {0};
+
+    // Store the content into r memory slot
+    if(lt_util_session_open(h) != 0) {
+        fclose(fp);
+        return 1;
+    }
+    lt_ret_t ret;
+    lt_ecc_curve_type_t curve = 2;
+    ecc_key_origin_t origin = 2;
+    uint16_t data_size;
+    ret = lt_r_mem_data_read(h, (uint16_t)slot, mem_content, &data_size);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        fclose(fp);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_r_mem_data_read(): %s", lt_ret_verbose(ret));
+    }
+
+    // Store content of bytes[] buffer into file
+    size_t written = fwrite(mem_content, sizeof(uint8_t), data_size, fp);
+    if(written != data_size) {
+        LT_LOG_ERROR("Error writing into file, %zu written", written);
+        fclose(fp);
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("Wrote %zu bytes into file \"%s\"", written, file);
+    }
+
+    fclose(fp);
+
+    lt_util_session_close(h);
+
+    return 0;
+
+}
+
+static int process_mem_erase(lt_handle_t *h, char *slot_in)
+{
+    if(!slot_in) {
+        LT_LOG_ERROR("Error, NULL parameters process_mem_erase()");
+    } else {
+        LT_LOG_CMD("lt-util "MEM" "MEM_ERASE" %s", slot_in);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+    // TODO check endptr
+
+    if((slot < 0) || (slot > 511)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    } else if(slot >= LT_VAULT_R_MEM_RESERVED_FIRST) {
+        LT_LOG_ERROR("Error, slots %d-%d are reserved for "VAULT" and PIN of "MAC_SET, LT_VAULT_R_MEM_RESERVED_FIRST,
+                     R_MEM_DATA_SLOT_MACANDD);
+        return 1;
+    } else {
+        LT_LOG_INFO("Slot number: %ld is valid", slot);
+    }
+
+    // Clear given slot in TROPIC01
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+    lt_ecc_curve_type_t curve = 2;
+    ecc_key_origin_t origin = 2;
+    ret = lt_r_mem_data_erase(h, (uint16_t)slot);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("lt_r_mem_data_erase(): %s", lt_ret_verbose(ret));
+    }
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+// CRC of one archive record covers its slot number and length as well
+static uint32_t r_mem_record_crc(const uint8_t *record_head, const uint8_t *data, uint16_t len)
+{
+    uint32_t crc = lt_util_crc32(0, record_head, 4);
+    return lt_util_crc32(crc, data, len);
+}
+
+static int process_mem_dump(lt_handle_t *h, char *range_in, char *file)
+{
+    if(!range_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters process_mem_dump()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "MEM" "MEM_DUMP" %s %s", range_in, file);
+    }
+
+    // Parsing range of slots, either "<from>-<to>" or a single slot
+    char *endptr;
+    long int from = strtol(range_in, &endptr, 10);
+    long int to = from;
+    if(*endptr == '-') {
+        to = strtol(endptr + 1, &endptr, 10);
+    }
+    if((*endptr != '\0') || (from < 0) || (to > R_MEM_SLOT_MAX) || (from > to)) {
+        LT_LOG_ERROR("Error, wrong range of slots, use <from>-<to> within 0-511");
+        return 1;
+    } else if(to >= LT_VAULT_R_MEM_RESERVED_FIRST) {
+        // Archive could not be restored, restore refuses these slots
+        LT_LOG_ERROR("Error, slots %d-%d are reserved for "VAULT" and PIN of "MAC_SET", they are not dumped",
+                     LT_VAULT_R_MEM_RESERVED_FIRST, R_MEM_DATA_SLOT_MACANDD);
+        return 1;
+    } else {
+        LT_LOG_INFO("Slots %ld-%ld are valid", from, to);
+    }
+
+    FILE *fp = fopen(file, "wb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s", file);
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for writing", file);
+    }
+
+    // Number of records is not known yet, header is rewritten at the end
+    uint8_t header[R_MEM_ARCHIVE_HEADER_LEN] = {0};
+    memcpy(header, R_MEM_ARCHIVE_MAGIC, 4);
+    header[4] = R_MEM_ARCHIVE_VERSION;
+    if(fwrite(header, 1, sizeof(header), fp) != sizeof(header)) {
+        LT_LOG_ERROR("Error writing into file %s", file);
+        fclose(fp);
+        return 1;
+    }
+
+    if(lt_util_session_open(h) != 0) {
+        fclose(fp);
+        return 1;
+    }
+
+    uint16_t records = 0;
+    for(long int slot = from; slot <= to; slot++) {
+        uint8_t data[R_MEM_DATA_LEN_MAX];
+        uint16_t data_size = 0;
+        lt_ret_t ret = lt_r_mem_data_read(h, (uint16_t)slot, data, &data_size);
+        if(lt_macandd_r_mem_empty(ret, data_size)) {
+            continue;
+        }
+        if((ret != LT_OK) || (data_size > R_MEM_DATA_LEN_MAX)) {
+            LT_LOG_ERROR("Error reading slot %ld: %s", slot, lt_ret_verbose(ret));
+            lt_util_session_close(h);
+            fclose(fp);
+            return 1;
+        }
+
+        uint8_t record[R_MEM_ARCHIVE_RECORD_LEN];
+        record[0] = slot & 0xff;
+        record[1] = slot >> 8;
+        record[2] = data_size & 0xff;
+        record[3] = data_size >> 8;
+        uint32_t crc = r_mem_record_crc(record, data, data_size);
+        for(int i = 0; i < 4; i++) {
+            record[4 + i] = crc >> (8 * i);
+        }
+        if((fwrite(record, 1, sizeof(record), fp) != sizeof(record))
+           || (fwrite(data, 1, data_size, fp) != data_size)) {
+            LT_LOG_ERROR("Error writing into file %s", file);
+            lt_util_session_close(h);
+            fclose(fp);
+            return 1;
+        }
+        records++;
+    }
+    lt_util_session_close(h);
+
+    header[6] = records & 0xff;
+    header[7] = records >> 8;
+    if((fseek(fp, 0L, SEEK_SET) != 0) || (fwrite(header, 1, sizeof(header), fp) != sizeof(header))
+       || (fclose(fp) != 0)) {
+        LT_LOG_ERROR("Error writing into file %s", file);
+        return 1;
+    }
+    LT_LOG_INFO("Dumped %u non-empty slots of %ld into file \"%s\"", records, to - from + 1, file);
+
+    return 0;
+}
+
+static int process_mem_restore(lt_handle_t *h, char *file)
+{
+    if(!file) {
+        LT_LOG_ERROR("Error, NULL parameters process_mem_restore()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "MEM" "MEM_RESTORE" %s", file);
+    }
+
+    FILE *fp = fopen(file, "rb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s", file);
+        return 1;
+    } else {
+        LT_LOG_INFO("File \"%s\" opened for reading", file);
+    }
+
+    // Whole archive is loaded and checked first, so a corrupted archive does not leave chip half restored
+    static uint8_t archive[R_MEM_ARCHIVE_HEADER_LEN
+                           + (R_MEM_SLOT_MAX + 1) * (R_MEM_ARCHIVE_RECORD_LEN + R_MEM_DATA_LEN_MAX) + 1];
+    size_t archive_len = fread(archive, 1, sizeof(archive), fp);
+    fclose(fp);
+    if((archive_len < R_MEM_ARCHIVE_HEADER_LEN) || (archive_len == sizeof(archive))
+       || (memcmp(archive, R_MEM_ARCHIVE_MAGIC, 4) != 0) || (archive[4] != R_MEM_ARCHIVE_VERSION)) {
+        LT_LOG_ERROR("Error, %s is not an R memory archive", file);
+        return 1;
+    }
+
+    uint16_t records = archive[6] | (archive[7] << 8);
+    size_t offset = R_MEM_ARCHIVE_HEADER_LEN;
+    for(uint16_t i = 0; i < records; i++) {
+        const uint8_t *record = archive + offset;
+        if(offset + R_MEM_ARCHIVE_RECORD_LEN > archive_len) {
+            LT_LOG_ERROR("Error, archive is truncated");
+            return 1;
+        }
+        uint16_t slot = record[0] | (record[1] << 8);
+        uint16_t len = record[2] | (record[3] << 8);
+        uint32_t crc = record[4] | (record[5] << 8) | (record[6] << 16) | ((uint32_t)record[7] << 24);
+        if((slot > R_MEM_SLOT_MAX) || (len < 1) || (len > R_MEM_DATA_LEN_MAX)
+           || (offset + R_MEM_ARCHIVE_RECORD_LEN + len > archive_len)) {
+            LT_LOG_ERROR("Error, record %u is invalid", i);
+            return 1;
+        }
+        if(slot >= LT_VAULT_R_MEM_RESERVED_FIRST) {
+            LT_LOG_ERROR("Error, slot %u is reserved for "VAULT" and PIN of "MAC_SET", it is not restored", slot);
+            return 1;
+        }
+        if(r_mem_record_crc(record, record + R_MEM_ARCHIVE_RECORD_LEN, len) != crc) {
+            LT_LOG_ERROR("Error, CRC of record for slot %u does not match", slot);
+            return 1;
+        }
+        offset += R_MEM_ARCHIVE_RECORD_LEN + len;
+    }
+    if(offset != archive_len) {
+        LT_LOG_ERROR("Error, unexpected data after last record");
+        return 1;
+    }
+    LT_LOG_INFO("Archive contains %u valid records", records);
+
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+
+    // Slot must be erased before it is written
+    offset = R_MEM_ARCHIVE_HEADER_LEN;
+    for(uint16_t i = 0; i < records; i++) {
+        uint8_t *record = archive + offset;
+        uint16_t slot = record[0] | (record[1] << 8);
+        uint16_t len = record[2] | (record[3] << 8);
+        lt_ret_t ret = lt_r_mem_data_erase(h, slot);
+        if(ret == LT_OK) {
+            ret = lt_r_mem_data_write(h, slot, record + R_MEM_ARCHIVE_RECORD_LEN, len);
+        }
+        if(ret != LT_OK) {
+            LT_LOG_ERROR("Error restoring slot %u: %s", slot, lt_ret_verbose(ret));
+            lt_util_session_close(h);
+            return 1;
+        }
+        offset += R_MEM_ARCHIVE_RECORD_LEN + len;
+    }
+    lt_util_session_close(h);
+    LT_LOG_INFO("Restored %u slots from file \"%s\"", records, file);
+
+    return 0;
+}
+
+static const char *ecc_curve_name(uint8_t curve)
+{
+    return (curve == CURVE_P256) ? "P256" : (curve == CURVE_ED25519) ? "Ed25519" : "?";
+}
+
+static const char *ecc_origin_name(uint8_t origin)
+{
+    return (origin == CURVE_GENERATED) ? "generated" : (origin == CURVE_STORED) ? "stored" : "?";
+}
+
+// Reads ECC slots which are not known in the cache, all of them when refresh is set
+static int ecc_cache_fill(lt_handle_t *h, struct lt_key_cache *cache, bool refresh)
+{
+    bool session = false;
+
+    for(uint8_t slot = 0; slot < LT_KEY_CACHE_SLOTS; slot++) {
+        if(!refresh && (cache->slot[slot].state != LT_KEY_CACHE_UNKNOWN)) {
+            continue;
+        }
+        if(!session && (lt_util_session_open(h) != 0)) {
+            return 1;
+        }
+        session = true;
+
+        uint8_t pubkey[64] = {0};
+        lt_ecc_curve_type_t curve = 0;
+        ecc_key_origin_t origin = 0;
+        lt_ret_t ret = lt_ecc_key_read(h, slot, pubkey, &curve, &origin);
+        if(lt_key_cache_record(cache, slot, ret, pubkey, curve, origin) != 0) {
+            LT_LOG_ERROR("Error reading ECC slot %u: %s", slot, lt_ret_verbose(ret));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Prints occupied R memory slots as ranges, e.g. "0-3,511"
+static void print_r_mem_ranges(const struct lt_key_cache *cache)
+{
+    unsigned occupied = 0;
+    char ranges[BATCH_LINE_LEN_MAX] = "";
+    size_t pos = 0;
+    for(unsigned slot = 0; slot < LT_KEY_CACHE_R_MEM_SLOTS; slot++) {
+        if(!(cache->r_mem[slot / 8] & (1u << (slot % 8)))) {
+            continue;
+        }
+        unsigned last = slot;
+        while((last + 1 < LT_KEY_CACHE_R_MEM_SLOTS) && (cache->r_mem[(last + 1) / 8] & (1u << ((last + 1) % 8)))) {
+            last++;
+        }
+        occupied += last - slot + 1;
+        int n = (last == slot) ? snprintf(ranges + pos, sizeof(ranges) - pos, "%s%u", pos ? "," : "", slot)
+                               : snprintf(ranges + pos, sizeof(ranges) - pos, "%s%u-%u", pos ? "," : "", slot, last);
+        pos += (n > 0) ? (size_t)n : 0;
+        slot = last;
+    }
+
+    char when[32];
+    time_t t = (time_t)cache->r_mem_time;
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&t));
+    printf("R memory: %u of %u slots occupied%s%s (probed %s)\n", occupied, LT_KEY_CACHE_R_MEM_SLOTS,
+           occupied ? ": " : "", ranges, when);
+}
+
+static int process_ecc_list(lt_handle_t *h, bool probe_r_mem)
+{
+    LT_LOG_CMD("lt-util "ECC" "ECC_LIST"%s", probe_r_mem ? " "MEM : "");
+
+    // Listing works also with the cache disabled, it is just not stored
+    struct lt_key_cache cache;
+    bool cached = (lt_key_cache_load(h, &cache) == 0);
+    if(ecc_cache_fill(h, &cache, true) != 0) {
+        lt_util_session_close(h);
+        return 1;
+    }
+
+    if(probe_r_mem) {
+        memset(cache.r_mem, 0, sizeof(cache.r_mem));
+        for(uint16_t slot = 0; slot < LT_KEY_CACHE_R_MEM_SLOTS; slot++) {
+            uint8_t data[R_MEM_DATA_LEN_MAX];
+            uint16_t data_size = 0;
+            lt_ret_t ret = lt_r_mem_data_read(h, slot, data, &data_size);
+            if(lt_macandd_r_mem_empty(ret, data_size)) {
+                continue;
+            }
+            if(ret != LT_OK) {
+                LT_LOG_ERROR("Error reading slot %u: %s", slot, lt_ret_verbose(ret));
+                lt_util_session_close(h);
+                return 1;
+            }
+            cache.r_mem[slot / 8] |= 1u << (slot % 8);
+        }
+        cache.r_mem_valid = 1;
+        cache.r_mem_time = (uint64_t)time(NULL);
+    }
+    // Stored before the device is closed, path of the cache file needs serial number of the chip
+    if(cached) {
+        lt_key_cache_save(h, &cache);
+    }
+    lt_util_session_close(h);
+
+    unsigned keys = 0;
+    printf("%-5s %-8s %-10s %s\n", "slot", "curve", "origin", "public key");
+    for(uint8_t slot = 0; slot < LT_KEY_CACHE_SLOTS; slot++) {
+        const struct lt_key_cache_slot *s = &cache.slot[slot];
+        if(s->state != LT_KEY_CACHE_KEY) {
+            printf("%-5u %s\n", slot, "-");
+            continue;
+        }
+        keys++;
+        printf("%-5u %-8s %-10s ", slot, ecc_curve_name(s->curve), ecc_origin_name(s->origin));
+        for(size_t i = 0; i < lt_key_cache_pubkey_len(s->curve); i++) {
+            printf("%02x", s->pubkey[i]);
+        }
+        printf("\n");
+    }
+    printf("ECC: %u of %u slots hold a key\n", keys, LT_KEY_CACHE_SLOTS);
+    if(cache.r_mem_valid) {
+        print_r_mem_ranges(&cache);
+    }
+
+    return 0;
+}
+
+static int process_ecc_find(lt_handle_t *h, char *file)
+{
+    if(!file) {
+        LT_LOG_ERROR("Error, NULL parameters process_ecc_find()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_FIND" %s", file);
+    }
+
+    // Public key as written by -e -d, 32 B of Ed25519 or 64 B of P256 key
+    uint8_t pubkey[65];
+    FILE *fp = fopen(file, "rb");
+    if(fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s", file);
+        return 1;
+    }
+    size_t len = fread(pubkey, 1, sizeof(pubkey), fp);
+    fclose(fp);
+    if((len != 32) && (len != 64)) {
+        LT_LOG_ERROR("Error, public key must have 32 or 64 B");
+        return 1;
+    }
+
+    // With the key cache enabled, only slots it does not know are read from the chip
+    struct lt_key_cache cache;
+    bool cached = (lt_key_cache_load(h, &cache) == 0);
+    if(ecc_cache_fill(h, &cache, !lt_key_cache_enabled()) != 0) {
+        lt_util_session_close(h);
+        return 1;
+    }
+    if(cached) {
+        lt_key_cache_save(h, &cache);
+    }
+    lt_util_session_close(h);
+
+    int found = -1;
+    for(uint8_t slot = 0; (slot < LT_KEY_CACHE_SLOTS) && (found < 0); slot++) {
+        const struct lt_key_cache_slot *s = &cache.slot[slot];
+        if((s->state == LT_KEY_CACHE_KEY) && (lt_key_cache_pubkey_len(s->curve) == len)
+           && !memcmp(s->pubkey, pubkey, len)) {
+            found = slot;
+        }
+    }
+    if(found < 0) {
+        LT_LOG("Key not found");
+        return 1;
+    }
+    LT_LOG("Slot %d", found);
+
+    return 0;
+}
+
+// Debug output function to print data in hex format
+void print_hex(const uint8_t *data, size_t len) {
+    if (!data) {
+        printf("(null)\n");
+        return;
+    }
+    for (size_t i = 0; i < len; ++i) {
+        printf("%02X", data[i]);
+        if (i < len - 1) {
+            printf(" ");
+        }
+    }
+    printf("\n");
+}
+
+// R memory traffic and time spent waiting for busy chip during the last PIN operation
+static void print_macandd_stats(void)
+{
+    struct lt_macandd_stats stats;
+    lt_macandd_stats_get(&stats);
+    LT_LOG_INFO("M&D R memory: %u ops, %u B, %u retries, waited %.3f ms (max %.3f ms)", (unsigned)stats.ops,
+                (unsigned)stats.bytes, (unsigned)stats.retries, stats.wait_us / 1000.0, stats.wait_max_us / 1000.0);
+}
+
+// Parses 4-digit PIN and hexadecimal additional data of M&D commands
+static int macandd_parse_args(const char *pin, const char *add, uint8_t pin_bytes[4], uint8_t add_bytes[32],
+                              uint8_t *add_bytes_len)
+{
+    size_t pin_len = strlen(pin);
+    if (pin_len != 4) {
+        LT_LOG_ERROR("PIN must be exactly 4 digits");
+        return 1;
+    }
+    for (size_t i = 0; i < 4; ++i) {
+        if (!isdigit((unsigned char)pin[i])) {
+            LT_LOG_ERROR("PIN must contain only digits");
+            return 1;
+        }
+        pin_bytes[i] = (uint8_t)(pin[i] - '0');
+    }
+
+    size_t add_len = strlen(add);
+    if (add_len % 2 != 0) {
+        LT_LOG_ERROR("Address hex string must have even length");
+        return 1;
+    }
+    if (add_len / 2 > 32) {
+        LT_LOG_ERROR("Address too long, max %u bytes", 32u);
+        return 1;
+    }
+    *add_bytes_len = add_len / 2;
+    for (size_t i = 0; i < *add_bytes_len; ++i) {
+        char byte_str[3] = { add[2*i], add[2*i+1], '\0' };
+        char *endptr = NULL;
+        long val = strtol(byte_str, &endptr, 16);
+        if (*endptr != '\0' || val < 0 || val > 0xFF) {
+            LT_LOG_ERROR("Invalid hex character in address");
+            return 1;
+        }
+        add_bytes[i] = (uint8_t)val;
+    }
+
+    return 0;
+}
+
+// Stores secret released by M&D into file
+static int macandd_secret_store(const char *filename, const uint8_t secret[32])
+{
+    FILE *fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s for writing", filename);
+        return 1;
+    }
+    size_t written = fwrite(secret, sizeof(uint8_t), 32, fp);
+    fclose(fp);
+    if (written != 32) {
+        LT_LOG_ERROR("Error writing secret to file, %zu bytes written", written);
+        return 1;
+    }
+    LT_LOG_INFO("Wrote %zu bytes into file \"%s\"", written, filename);
+
+    return 0;
+}
+
+static int process_macandd_set(lt_handle_t *h, char *pin, char *add, char *filename)
+{
+    if(!h || !pin || !add || !filename) {
+        LT_LOG_ERROR("Error, NULL parameters process_macandd_set()");
+    } else {
+        LT_LOG_CMD("lt-util "MAC_SET" %s %s %s", pin, add, filename);
+    }
+
+    uint8_t pin_bytes[4] = {0};
+    uint8_t add_bytes[32] = {0};
+    uint8_t add_bytes_len = 0;
+    if(macandd_parse_args(pin, add, pin_bytes, add_bytes, &add_bytes_len) != 0) {
+        return 1;
+    }
+
+    // Clear given slot in TROPIC01
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+
+    uint8_t secret[32];
+
+    print_hex(pin_bytes, 4);
+    print_hex(add_bytes, add_bytes_len);
+    printf("%d\r\n", add_bytes_len);
+
+    lt_macandd_stats_reset();
+    ret = lt_PIN_set(h, pin_bytes, 4, add_bytes, add_bytes_len, secret);
+    print_macandd_stats();
+    if (ret != LT_OK) {
+        LT_LOG_ERROR("Error setting PIN and address: %s", lt_ret_verbose(ret));
+        return 1;
+    } else {
+        LT_LOG_INFO("PIN and add bytes set successfully");
+    }
+    print_hex(secret, sizeof(secret));
+    printf("\r\n");
+
+    // store secret into file
+    int status = macandd_secret_store(filename, secret);
+    memset(secret, 0, sizeof(secret));
+    lt_util_session_close(h);
+
+    return status;
+}
+
+int lt_util_chip_serial(lt_handle_t *h, char serial[LT_UTIL_SERIAL_HEX_LEN + 1])
+{
+    struct lt_util_dev *dev = util_dev(h);
+    struct lt_chip_id_t chip_id;
+
+    if(lt_util_dev_open(h) != 0) {
+        return 1;
+    }
+    // Chip can not change while the device is open
+    if(dev->serial[0] != '\0') {
+        memcpy(serial, dev->serial, sizeof(dev->serial));
+        return 0;
+    }
+    lt_ret_t ret = lt_get_info_chip_id(h, &chip_id);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("Error lt_get_info_chip_id: %s", lt_ret_verbose(ret));
+        return 1;
+    }
+
+    const uint8_t *sn = (const uint8_t *)&chip_id.ser_num;
+    for(size_t i = 0; i < sizeof(chip_id.ser_num); i++) {
+        snprintf(serial + 2 * i, 3, "%02x", sn[i]);
+    }
+    memcpy(dev->serial, serial, sizeof(dev->serial));
+
+    return 0;
+}
+
+bool lt_util_macandd_rearm_pending(lt_handle_t *h)
+{
+    return util_dev(h)->macandd_rearm.pending;
+}
+
+int lt_util_macandd_rearm(lt_handle_t *h)
+{
+    struct lt_macandd_rearm *macandd_rearm = &util_dev(h)->macandd_rearm;
+    if(!macandd_rearm->pending) {
+        return 0;
+    }
+    // Command which checked the PIN re-arms within its own session, which it closes itself
+    bool in_session = util_dev(h)->dev_ready && (h->l3.session == SESSION_ON);
+    if(!in_session && (lt_util_session_open(h) != 0)) {
+        return 1;
+    }
+
+    lt_macandd_stats_reset();
+    lt_ret_t ret = lt_PIN_rearm(h, macandd_rearm);
+    print_macandd_stats();
+    if(ret == LT_FAIL) {
+        LT_LOG_WARN("M&D re-arm dropped, M&D data changed since PIN check");
+    } else if(ret != LT_OK) {
+        // Stays pending, next call tries again
+        LT_LOG_ERROR("lt_PIN_rearm(): %s", lt_ret_verbose(ret));
+        lt_util_session_reset(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("M&D slots re-armed");
+    }
+    if(!in_session) {
+        lt_util_session_close(h);
+    }
+
+    return 0;
+}
+
+static int process_macandd_verify(lt_handle_t *h, char *pin, char *add, char *filename)
+{
+    if(!h || !pin || !add || !filename) {
+        LT_LOG_ERROR("Error, NULL parameters process_macandd_verify()");
+    } else {
+        LT_LOG_CMD("lt-util "MAC_VERIFY" %s %s %s", pin, add, filename);
+    }
+
+    uint8_t pin_bytes[4] = {0};
+    uint8_t add_bytes[32] = {0};
+    uint8_t add_bytes_len = 0;
+    if(macandd_parse_args(pin, add, pin_bytes, add_bytes, &add_bytes_len) != 0) {
+        return 1;
+    }
+
+    // Clear given slot in TROPIC01
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+    lt_ret_t ret;
+
+    uint8_t secret[32] = {0};
+    print_hex(pin_bytes, 4);
+    print_hex(add_bytes, add_bytes_len);
+    print_hex(secret, sizeof(secret));
+    printf("%d\r\n", add_bytes_len);
+
+    lt_macandd_stats_reset();
+    ret = lt_PIN_check_lazy(h, pin_bytes, 4, add_bytes, add_bytes_len, secret, &util_dev(h)->macandd_rearm);
+    print_macandd_stats();
+    if (ret != LT_OK) {
+        LT_LOG_ERROR("lt_PIN_check(): %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    } else {
+        LT_LOG_INFO("PIN checked successfully");
+    }
+
+    // store secret into file
+    int status = macandd_secret_store(filename, secret);
+    memset(secret, 0, sizeof(secret));
+
+    // Secret is out, the slots are re-armed in this session unless it stays open for more commands
+    if(!util_dev(h)->session_keep && (lt_util_macandd_rearm(h) != 0)) {
+        status = 1;
+    }
+    lt_util_session_close(h);
+
+    return status;
+}
+
+// Parses record ID of PIN vault
+static int vault_parse_id(const char *id_in, uint8_t *id)
+{
+    char *endptr = NULL;
+    long val = strtol(id_in, &endptr, 10);
+    if (*id_in == '\0' || *endptr != '\0' || val < 0 || val >= LT_VAULT_RECORDS_MAX) {
+        LT_LOG_ERROR("Record ID must be between 0 and %d", LT_VAULT_RECORDS_MAX - 1);
+        return 1;
+    }
+    *id = (uint8_t)val;
+
+    return 0;
+}
+
+static int process_vault_set(lt_handle_t *h, char *id_in, char *rounds_in, char *pin, char *add, char *filename)
+{
+    if(!h || !id_in || !rounds_in || !pin || !add || !filename) {
+        LT_LOG_ERROR("Error, NULL parameters process_vault_set()");
+        return 1;
+    }
+    LT_LOG_CMD("lt-util "VAULT" "VAULT_SET" %s %s %s %s %s", id_in, rounds_in, pin, add, filename);
+
+    uint8_t id;
+    if(vault_parse_id(id_in, &id) != 0) {
+        return 1;
+    }
+    char *endptr = NULL;
+    long rounds = strtol(rounds_in, &endptr, 10);
+    if(*rounds_in == '\0' || *endptr != '\0' || rounds < 1 || rounds > MACANDD_ROUNDS_MAX) {
+        LT_LOG_ERROR("Rounds must be between 1 and %d", MACANDD_ROUNDS_MAX);
+        return 1;
+    }
+    uint8_t pin_bytes[4] = {0};
+    uint8_t add_bytes[32] = {0};
+    uint8_t add_bytes_len = 0;
+    if(macandd_parse_args(pin, add, pin_bytes, add_bytes, &add_bytes_len) != 0) {
+        return 1;
+    }
+
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+
+    uint8_t secret[32];
+    lt_macandd_stats_reset();
+    lt_ret_t ret = lt_vault_set(h, id, (uint8_t)rounds, pin_bytes, 4, add_bytes, add_bytes_len, secret);
+    print_macandd_stats();
+    if(ret == LT_FAIL) {
+        LT_LOG_ERROR("Not enough free M&D slots for %ld rounds, or vault index is damaged", rounds);
+        lt_util_session_close(h);
+        return 1;
+    } else if(ret != LT_OK) {
+        LT_LOG_ERROR("lt_vault_set(): %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    }
+    LT_LOG_INFO("PIN of record %u set with %ld attempts", id, rounds);
+
+    int status = macandd_secret_store(filename, secret);
+    memset(secret, 0, sizeof(secret));
+    lt_util_session_close(h);
+
+    return status;
+}
+
+static int process_vault_verify(lt_handle_t *h, char *id_in, char *pin, char *add, char *filename)
+{
+    if(!h || !id_in || !pin || !add || !filename) {
+        LT_LOG_ERROR("Error, NULL parameters process_vault_verify()");
+        return 1;
+    }
+    LT_LOG_CMD("lt-util "VAULT" "VAULT_VERIFY" %s %s %s %s", id_in, pin, add, filename);
+
+    uint8_t id;
+    if(vault_parse_id(id_in, &id) != 0) {
+        return 1;
+    }
+    uint8_t pin_bytes[4] = {0};
+    uint8_t add_bytes[32] = {0};
+    uint8_t add_bytes_len = 0;
+    if(macandd_parse_args(pin, add, pin_bytes, add_bytes, &add_bytes_len) != 0) {
+        return 1;
+    }
+
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+
+    uint8_t secret[32] = {0};
+    lt_macandd_stats_reset();
+    lt_ret_t ret = lt_vault_check_lazy(h, id, pin_bytes, 4, add_bytes, add_bytes_len, secret,
+                                       &util_dev(h)->macandd_rearm);
+    print_macandd_stats();
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("lt_vault_check(): %s", lt_ret_verbose(ret));
+        lt_util_session_close(h);
+        return 1;
+    }
+    LT_LOG_INFO("PIN of record %u checked successfully", id);
+
+    int status = macandd_secret_store(filename, secret);
+    memset(secret, 0, sizeof(secret));
+
+    // Secret is out, the slots are re-armed in this session unless it stays open for more commands
+    if(!util_dev(h)->session_keep && (lt_util_macandd_rearm(h) != 0)) {
+        status = 1;
+    }
+    lt_util_session_close(h);
+
+    return status;
+}
+
+static int process_vault_remove(lt_handle_t *h, char *id_in)
+{
+    if(!h || !id_in) {
+        LT_LOG_ERROR("Error, NULL parameters process_vault_remove()");
+        return 1;
+    }
+    LT_LOG_CMD("lt-util "VAULT" "VAULT_REMOVE" %s", id_in);
+
+    uint8_t id;
+    if(vault_parse_id(id_in, &id) != 0) {
+        return 1;
+    }
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+
+    lt_ret_t ret = lt_vault_remove(h, id);
+    lt_util_session_close(h);
+    if(ret == LT_FAIL) {
+        LT_LOG_ERROR("Record %u does not exist", id);
+        return 1;
+    } else if(ret != LT_OK) {
+        LT_LOG_ERROR("lt_vault_remove(): %s", lt_ret_verbose(ret));
+        return 1;
+    }
+    LT_LOG_INFO("Record %u removed", id);
+
+    return 0;
+}
+
+static int process_vault_list(lt_handle_t *h)
+{
+    if(!h) {
+        LT_LOG_ERROR("Error, NULL parameters process_vault_list()");
+        return 1;
+    }
+    LT_LOG_CMD("lt-util "VAULT" "VAULT_LIST);
+
+    if(lt_util_session_open(h) != 0) {
+        return 1;
+    }
+
+    struct lt_vault_index index;
+    lt_ret_t ret = lt_vault_index_read(h, &index);
+    lt_util_session_close(h);
+    if(ret != LT_OK) {
+        LT_LOG_ERROR("lt_vault_index_read(): %s", lt_ret_verbose(ret));
+        return 1;
+    }
+
+    unsigned records = 0;
+    for(uint8_t id = 0; id < LT_VAULT_RECORDS_MAX; id++) {
+        struct lt_macandd_layout layout;
+        if(lt_vault_layout(&index, id, &layout) != LT_OK) {
+            continue;
+        }
+        printf("%2u: rounds %2u, M&D slots %u-%u, R memory slot %u, journal slots %u-%u\r\n", id, layout.rounds,
+               layout.md_slot, layout.md_slot + layout.rounds - 1, layout.data_slot, layout.journal_slot,
+               layout.journal_slot + layout.journal_slots - 1);
+        records++;
+    }
+    LT_LOG_INFO("%u records, index version %u", records, (unsigned)index.seq);
+
+    return 0;
+}
+
+static int process_chip_id(lt_handle_t *h) {
+
+    struct lt_chip_id_t chip_id;
+
+    if(lt_util_dev_open(h) != 0) {
+        return 1;
+    }
+
+    lt_ret_t ret = lt_get_info_chip_id(h, &chip_id);
+    if (ret != LT_OK) {
+        LT_LOG_ERROR("Error lt_get_info_chip_id: %s", lt_ret_verbose(ret));
+        return 1;
+    }
+
+    ret = lt_print_chip_id(&chip_id, printf);
+    if (ret != LT_OK) {
+        LT_LOG_ERROR("Error lt_print_chip_id: %s", lt_ret_verbose(ret));
+        return 1;
+    }
+
+    lt_util_session_close(h);
+
+    return 0;
+}
+
+// Splits line into whitespace separated arguments in place, quotes are removed. Returns number of arguments or -1.
+static int batch_split_line(char *line, char *argv[], int argv_max)
+{
+    int argc = 0;
+    char *in = line;
+    while (*in) {
+        while (isspace((unsigned char)*in)) {
+            in++;
+        }
+        if (*in == '\0' || (argc == 0 && *in == '#')) {
+            break;
+        }
+        if (argc == argv_max) {
+            return -1;
+        }
+
+        // Argument is compacted into its own place, it can only get shorter when quotes are removed
+        char *out = in;
+        argv[argc++] = out;
+        char quote = 0;
+        while (*in && (quote || !isspace((unsigned char)*in))) {
+            if (!quote && (*in == '"' || *in == '\'')) {
+                quote = *in++;
+            } else if (quote && *in == quote) {
+                quote = 0;
+                in++;
+            } else {
+                *out++ = *in++;
+            }
+        }
+        if (quote) {
+            return -1;
+        }
+        if (*in) {
+            in++;
+        }
+        *out = '\0';
+    }
+
+    return argc;
+}
+
+int lt_util_run_batch(lt_handle_t *h, const char *file, bool keep_going)
+{
+    if(!h || !file) {
+        LT_LOG_ERROR("Error, NULL parameters lt_util_run_batch()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "BATCH" %s%s", file, keep_going ? " "BATCH_KEEP_GOING : "");
+    }
+
+    bool from_stdin = (strcmp(file, "-") == 0);
+    FILE *fp = from_stdin ? stdin : fopen(file, "r");
+    if (fp == NULL) {
+        LT_LOG_ERROR("Error opening file %s", file);
+        return 1;
+    }
+
+    // Session stays open for all commands, unless caller (lt-utild) already keeps it open anyway
+    bool was_kept = util_dev(h)->session_keep;
+    lt_util_session_keep(h, true);
+
+    // Not static, every device of "--devices" runs its own batch
+    char line[BATCH_LINE_LEN_MAX + 1];
+    char expanded[BATCH_LINE_LEN_MAX + 1];
+    const char *name = util_dev(h)->name;
+    char *argv[BATCH_ARGS_MAX];
+    unsigned int line_num = 0, executed = 0, failed = 0;
+    int ret = 0;
+    while (fgets(line, sizeof(line), fp)) {
+        line_num++;
+        size_t len = strlen(line);
+        if ((len && line[len - 1] != '\n' && !feof(fp))
+            || (name && lt_util_expand(line, LT_UTIL_DEVICE_NAME, name, expanded, sizeof(expanded)) != 0)) {
+            LT_LOG_ERROR("[BATCH] %u: line too long", line_num);
+            ret = 1;
+            break;
+        }
+
+        int argc = batch_split_line(name ? expanded : line, argv, BATCH_ARGS_MAX);
+        if (argc == 0) {
+            continue;
+        }
+
+        int status;
+        if (argc < 0) {
+            LT_LOG_ERROR("[BATCH] %u: cannot parse line", line_num);
+            status = LT_UTIL_ERR_ARGS;
+        } else if (strcmp(argv[0], BATCH) == 0) {
+            LT_LOG_ERROR("[BATCH] %u: nested batch is not supported", line_num);
+            status = LT_UTIL_ERR_ARGS;
+        } else {
+            status = lt_util_run_command(h, argc, argv);
+            if (status == LT_UTIL_ERR_ARGS) {
+                LT_LOG_ERROR("ERROR wrong parameters entered");
+            } else if (status != 0) {
+                // Do not trust the session after a failure, next command starts a new one
+                lt_util_session_reset(h);
+            }
+        }
+        executed++;
+        LT_LOG("[BATCH] %u: %d", line_num, status);
+
+        if (status != 0) {
+            failed++;
+            ret = 1;
+            if (!keep_going) {
+                break;
+            }
+        }
+    }
+    if (ferror(fp)) {
+        LT_LOG_ERROR("Error reading file %s", file);
+        ret = 1;
+    }
+    if (!from_stdin) {
+        fclose(fp);
+    }
+
+    lt_util_session_keep(h, was_kept);
+    if(!was_kept && (lt_util_macandd_rearm(h) != 0)) {
+        ret = 1;
+    }
+    lt_util_session_close(h);
+
+    LT_LOG("[BATCH] executed %u, failed %u", executed, failed);
+
+    return ret;
+}
+
+static int run_command(lt_handle_t *h, int argc, char *argv[])
+{
+    if (argc == 2 || argc == 3) {
+        if (strcmp(argv[0], BATCH) == 0) {
+            if (argc == 2) {
+                return lt_util_run_batch(h, argv[1], false);
+            } else if (strcmp(argv[2], BATCH_KEEP_GOING) == 0) {
+                return lt_util_run_batch(h, argv[1], true);
+            }
+            return LT_UTIL_ERR_ARGS;
+        }
+        if (strcmp(argv[0], PROVISION) == 0) {
+            return lt_util_provision(h, argv[1], argc == 3 ? argv[2] : ".");
+        }
+    }
+
+    if (argc == 1) {
+        if (strcmp(argv[0], CHIP_ID) == 0) {
+            return process_chip_id(h);
+        }
+    }
+    else if (argc == 2) {
+        if((strcmp(argv[0], VAULT) == 0) && (strcmp(argv[1], VAULT_LIST) == 0)) {
+            return process_vault_list(h);
+        } else if((strcmp(argv[0], ECC) == 0) && (strcmp(argv[1], ECC_LIST) == 0)) {
+            return process_ecc_list(h, false);
+        }
+    }
+    else if (argc == 3) {
+        // RNG
+        if(strcmp(argv[0], RNG) == 0) {
+            return process_rng_get(h, argv[1], argv[2]);
+        }
+        // ECC 3 arguments
+        else if(strcmp(argv[0], ECC) == 0) {
+            if (strcmp(argv[1], ECC_GENERATE) == 0) {
+                return process_ecc_generate(h, argv[2]);
+            } else if (strcmp(argv[1], ECC_CLEAR) == 0) {
+                return process_ecc_clear(h, argv[2]);
+            } else if (strcmp(argv[1], ECC_FIND) == 0) {
+                return process_ecc_find(h, argv[2]);
+            } else if ((strcmp(argv[1], ECC_LIST) == 0) && (strcmp(argv[2], MEM) == 0)) {
+                return process_ecc_list(h, true);
+            }
+        }
+        // MEM 3 arguments
+        else if(strcmp(argv[0], MEM) == 0) {
+            if (strcmp(argv[1], MEM_ERASE) == 0) {
+                return process_mem_erase(h, argv[2]);
+            } else if (strcmp(argv[1], MEM_RESTORE) == 0) {
+                return process_mem_restore(h, argv[2]);
+            }
+        }
+        else if((strcmp(argv[0], VAULT) == 0) && (strcmp(argv[1], VAULT_REMOVE) == 0)) {
+            return process_vault_remove(h, argv[2]);
+        }
+    } else if (argc == 4) {
+        // RNG stream
+        if((strcmp(argv[0], RNG) == 0) && (strcmp(argv[1], RNG_STREAM) == 0)) {
+            return lt_util_rng_stream(h, argv[2], argv[3]);
+        }
+        else if(strcmp(argv[0], ECC) == 0) {
+            if (strcmp(argv[1], ECC_INSTALL) == 0) {
+                return process_ecc_install(h, argv[2], argv[3]);
+            } else if (strcmp(argv[1], ECC_DOWNLOAD) == 0) {
+                return process_ecc_download(h, argv[2], argv[3]);
+            }
+        } else if(strcmp(argv[0], MEM) == 0) {
+            if (strcmp(argv[1], MEM_STORE) == 0) {
+                return process_mem_store(h, argv[2], argv[3]);
+            } else if (strcmp(argv[1], MEM_READ) == 0) {
+                return process_mem_read(h, argv[2], argv[3]);
+            } else if (strcmp(argv[1], MEM_DUMP) == 0) {
+                return process_mem_dump(h, argv[2], argv[3]);
+            }
+        } // Macandd set 4 arguments
+        else if(strcmp(argv[0], MAC_SET) == 0) {
+            return process_macandd_set(h, argv[1], argv[2], argv[3]);
+        } // Macandd verify 4 arguments
+        else if(strcmp(argv[0], MAC_VERIFY) == 0) {
+            return process_macandd_verify(h, argv[1], argv[2], argv[3]);
+        }
+    } else if (argc == 5) {
+        if(strcmp(argv[0], ECC) == 0) {
+            if (strcmp(argv[1], ECC_SIGN) == 0) {
+                return process_ecc_sign(h, argv[2], argv[3], argv[4]);
+            } else if (strcmp(argv[1], ECC_SIGN_DIGEST) == 0) {
+                return process_ecc_sign_digest(h, argv[2], argv[3], argv[4], "sha256");
+            } else if (strcmp(argv[1], ECC_SIGN_BATCH) == 0) {
+                return lt_util_sign_batch(h, argv[2], argv[3], argv[4]);
+            }
+        }
+    } else if (argc == 6) {
+        if(strcmp(argv[0], ECC) == 0) {
+            if (strcmp(argv[1], ECC_SIGN_DIGEST) == 0) {
+                return process_ecc_sign_digest(h, argv[2], argv[3], argv[4], argv[5]);
+            }
+        } else if((strcmp(argv[0], VAULT) == 0) && (strcmp(argv[1], VAULT_VERIFY) == 0)) {
+            return process_vault_verify(h, argv[2], argv[3], argv[4], argv[5]);
+        }
+    } else if (argc == 7) {
+        if((strcmp(argv[0], VAULT) == 0) && (strcmp(argv[1], VAULT_SET) == 0)) {
+            return process_vault_set(h, argv[2], argv[3], argv[4], argv[5], argv[6]);
+        }
+    }
+
+    return LT_UTIL_ERR_ARGS;
+}
+
+#if LINUX_SPI_IOC
+// System calls the port made for one command
+static void spi_ioc_report(lt_handle_t *h, const struct lt_spi_ioc_stats *before)
+{
+    const struct lt_spi_ioc_stats *now = &util_dev(h)->spi.stats;
+    uint64_t messages = now->messages - before->messages;
+    uint64_t cs_sets = now->cs_sets - before->cs_sets;
+    uint64_t frames = now->frames - before->frames;
+    if(frames == 0) {
+        return;
+    }
+#ifdef LT_USE_INT_PIN
+    uint64_t int_calls = now->int_calls - before->int_calls;
+    LT_LOG_INFO("SPI: %llu syscalls (%llu messages, %llu chip select, %llu interrupt) in %llu frames, "
+                "%llu interrupt waits timed out", (unsigned long long)(messages + cs_sets + int_calls),
+                (unsigned long long)messages, (unsigned long long)cs_sets, (unsigned long long)int_calls,
+                (unsigned long long)frames, (unsigned long long)(now->int_timeouts - before->int_timeouts));
+#else
+    LT_LOG_INFO("SPI: %llu syscalls (%llu messages, %llu chip select) in %llu frames, %.2f per frame",
+                (unsigned long long)(messages + cs_sets), (unsigned long long)messages, (unsigned long long)cs_sets,
+                (unsigned long long)frames, (double)(messages + cs_sets) / frames);
+#endif
+}
+#endif
+
+// lt-utild serves one client at a time and returns output of limited size, so a command which runs until interrupted
+// would block all other clients and one reading stdin would read that of the daemon
+static bool run_command_refused(lt_handle_t *h, int argc, char *argv[])
+{
+    if(!util_dev(h)->daemon || (argc < 2)) {
+        return false;
+    }
+    if((strcmp(argv[0], RNG) == 0) && (strcmp(argv[1], RNG_STREAM) == 0)) {
+        LT_LOG_ERROR("Error, "RNG" "RNG_STREAM" is not available through lt-utild, execute it directly");
+        return true;
+    }
+    if((strcmp(argv[0], BATCH) == 0) && (strcmp(argv[1], "-") == 0)) {
+        LT_LOG_ERROR("Error, lt-utild does not read commands from stdin, pass a file to "BATCH);
+        return true;
+    }
+
+    return false;
+}
+
+int lt_util_run_command(lt_handle_t *h, int argc, char *argv[])
+{
+    if(run_command_refused(h, argc, argv)) {
+        return 1;
+    }
+    // Re-arm left by a previous command is not the concern of this one, failure is reported and retried later
+    lt_util_macandd_rearm(h);
+
+#if LINUX_SPI_IOC
+    struct lt_spi_ioc_stats spi_stats = util_dev(h)->spi.stats;
+#endif
+#if LT_UTIL_TRACE
+    // Span is named after the command and its subcommand, e.g. "-e -s"
+    char name[LT_TRACE_NAME_LEN_MAX + 1] = "";
+    if (argc > 0) {
+        snprintf(name, sizeof(name), "%s%s%s", argv[0], (argc > 1 && argv[1][0] == '-') ? " " : "",
+                 (argc > 1 && argv[1][0] == '-') ? argv[1] : "");
+    }
+    LT_TRACE_BEGIN(start);
+    int ret = run_command(h, argc, argv);
+    LT_TRACE_END(start, "cmd", name);
+#else
+    int ret = run_command(h, argc, argv);
+#endif
+#if LINUX_SPI_IOC
+    spi_ioc_report(h, &spi_stats);
+#endif
+    return ret;
+}
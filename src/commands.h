@@ -0,0 +1,270 @@
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+/**
+ * @file commands.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Command handlers shared by lt-util and lt-utild
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "libtropic.h"
+#include "macandd.h"
+#if USB_DONGLE_FAST
+#include "lt_port_usb_fast.h"
+#elif USB_DONGLE_TS1301 || USB_DONGLE_TS1302
+#include "lt_port_unix_usb_dongle.h"
+#endif
+#if LINUX_SPI_IOC
+#include "lt_port_spi_ioc.h"
+#elif LINUX_SPI
+#include "lt_port_unix_spi.h"
+#endif
+#if SIMULATOR
+#include "lt_port_sim.h"
+#endif
+
+// CHIP_ID
+#define CHIP_ID "-i"
+
+// RNG
+#define RNG         "-r"
+#define RNG_STREAM  "--stream"
+// ECC
+#define ECC "-e"
+#define ECC_INSTALL  "-i"
+#define ECC_GENERATE "-g"
+#define ECC_DOWNLOAD "-d"
+#define ECC_CLEAR    "-c"
+#define ECC_SIGN     "-s"
+#define ECC_SIGN_DIGEST "-sd"
+#define ECC_SIGN_BATCH  "--sign-batch"
+#define ECC_LIST     "--list"
+#define ECC_FIND     "--find"
+
+/** @brief Maximal size of message signed by lt_ecc_eddsa_sign(), bigger files are signed through their digest */
+#define ECC_SIGN_MSG_LEN_MAX 4095
+// MEM
+#define MEM "-m"
+#define MEM_STORE    "-s"
+#define MEM_READ     "-r"
+#define MEM_ERASE    "-e"
+#define MEM_DUMP     "--dump"
+#define MEM_RESTORE  "--restore"
+// Mac And Destroy
+#define MAC_SET      "-mac-set"
+#define MAC_VERIFY   "-mac-ver"
+// PIN vault, Mac And Destroy protected records addressed by ID
+#define VAULT        "-vault"
+#define VAULT_SET    "-s"
+#define VAULT_VERIFY "-v"
+#define VAULT_REMOVE "-r"
+#define VAULT_LIST   "-l"
+// Forward command to lt-utild instead of opening the device
+#define VIA_DAEMON   "--via-daemon"
+// Execute command on many devices at once
+#define DEVICES      "--devices"
+// Provision chip from a manifest, resumable by journal
+#define PROVISION    "--provision"
+// SPI clock in Hz, "auto" or "calibrate", precedes the command (LINUX_SPI)
+#define SPI_SPEED    "--spi-speed"
+// Batch of commands executed within one secure session
+#define BATCH            "--batch"
+#define BATCH_KEEP_GOING "--keep-going"
+/** @brief Maximal length of one line in batch file */
+#define BATCH_LINE_LEN_MAX 4096
+/** @brief Maximal number of arguments on one line in batch file */
+#define BATCH_ARGS_MAX     16
+
+/** @brief Placeholder in arguments and batch lines replaced by name of the device with "--devices" */
+#define LT_UTIL_DEVICE_NAME "{dev}"
+
+/** @brief Returned by lt_util_run_command() when arguments do not match any command */
+#define LT_UTIL_ERR_ARGS 2
+
+/** @brief Environment variable with baud rate of USB dongle, "auto" probes the fastest one (USB_DONGLE_FAST) */
+#define LT_UTIL_BAUD_ENV "LT_UTIL_BAUD"
+/** @brief Baud rate of USB dongle when LT_UTIL_BAUD_ENV is not set */
+#define LT_UTIL_BAUD_DEFAULT 115200
+
+/** @brief Environment variable with GPIO line of TROPIC01 interrupt pin (LINUX_SPI_IOC with LT_USE_INT_PIN) */
+#define LT_UTIL_INT_GPIO_ENV "LT_UTIL_INT_GPIO"
+
+/** @brief Length of serial number of the chip as hexadecimal string, without terminating zero */
+#define LT_UTIL_SERIAL_HEX_LEN (2 * sizeof(struct lt_ser_num_t))
+
+/**
+ * @brief Transport specific device description and command state, one per chip
+ *
+ * @details Commands find it through the handle, so every chip with its own handle can be driven from its own thread.
+ */
+struct lt_util_dev {
+#if USB_DONGLE_FAST
+    struct lt_dev_usb_fast uart;
+#elif USB_DONGLE_TS1301 || USB_DONGLE_TS1302
+    lt_dev_unix_usb_dongle_t uart;
+#endif
+#if LINUX_SPI_IOC
+    struct lt_dev_spi_ioc spi;
+#elif LINUX_SPI
+    lt_dev_unix_spi_t spi;
+#endif
+#if SIMULATOR
+    struct lt_dev_sim sim;
+#endif
+    /** @brief Set when session is kept open between commands, see lt_util_session_keep() */
+    bool session_keep;
+    /** @brief Set when lt_init() was called and lt_deinit() was not called yet */
+    bool dev_ready;
+    /** @brief Re-arm of M&D slots left by the last successful PIN check, see lt_util_macandd_rearm() */
+    struct lt_macandd_rearm macandd_rearm;
+    /** @brief Replaces LT_UTIL_DEVICE_NAME in batch lines, NULL when lt-util drives only this device */
+    const char *name;
+    /** @brief Set by lt-utild: commands which stream or read stdin are refused, see lt_util_run_command() */
+    bool daemon;
+    /** @brief Serial number read by lt_util_chip_serial(), empty until the device is open */
+    char serial[LT_UTIL_SERIAL_HEX_LEN + 1];
+#if LINUX_SPI || SIMULATOR
+    /** @brief SPI clock is calibrated by the next lt_util_dev_open(), see spi_calibrate.h */
+    enum lt_util_spi_calibrate { LT_UTIL_SPI_FIXED, LT_UTIL_SPI_AUTO, LT_UTIL_SPI_CALIBRATE } spi_calibrate;
+#endif
+};
+
+/**
+ * @brief Fill device description with default settings and attach it to the handle
+ *
+ * @param h           Device's handle
+ * @param dev         Device description, must outlive the handle
+ * @param path        Serialport of usb dongle. For LINUX_SPI "<spidev>[:<gpio_cs_num>]", LINUX_SPI_IOC also takes
+ *                    "<spidev>:<gpio_cs_num|native>:<gpio_int_num>", and for SIMULATOR state file,
+ *                    NULL keeps defaults of those two.
+ */
+void lt_util_dev_setup(lt_handle_t *h, struct lt_util_dev *dev, const char *path);
+
+/**
+ * @brief Copy string, every placeholder in it is replaced by value
+ *
+ * @param in          String to copy
+ * @param placeholder Placeholder, e.g. LT_UTIL_DEVICE_NAME
+ * @param value       Value replacing the placeholder
+ * @param out         Buffer for the result
+ * @param out_len     Size of the buffer
+ * @return int        0 if success, 1 if the result does not fit
+ */
+int lt_util_expand(const char *in, const char *placeholder, const char *value, char *out, size_t out_len);
+
+/**
+ * @brief Keep device and secure session open between commands
+ *
+ * @details When enabled, lt_util_session_close() does nothing and the next command reuses the session,
+ *          so only the first command pays for lt_init() and the handshake. Call lt_util_session_reset()
+ *          to really close it.
+ *
+ * @param h           Device's handle
+ * @param keep        true to keep the session open
+ */
+void lt_util_session_keep(lt_handle_t *h, bool keep);
+
+/**
+ * @brief Check whether the session is kept open between commands
+ *
+ * @param h           Device's handle
+ * @return true       Session is kept, see lt_util_session_keep()
+ */
+bool lt_util_session_is_kept(lt_handle_t *h);
+
+/**
+ * @brief Initialize the device (no secure session), unless it is already initialized and kept open
+ *
+ * @param h           Device's handle
+ * @return int        0 if success, otherwise 1
+ */
+int lt_util_dev_open(lt_handle_t *h);
+
+/**
+ * @brief Initialize the device and establish secure session, unless it is already established and kept open
+ *
+ * @param h           Device's handle
+ * @return int        0 if success, otherwise 1
+ */
+int lt_util_session_open(lt_handle_t *h);
+
+/**
+ * @brief Close device after a command, unless the session is kept open
+ *
+ * @param h           Device's handle
+ */
+void lt_util_session_close(lt_handle_t *h);
+
+/**
+ * @brief Close device unconditionally, next lt_util_session_open() does a full handshake
+ *
+ * @param h           Device's handle
+ */
+void lt_util_session_reset(lt_handle_t *h);
+
+/**
+ * @brief Read serial number of the chip, it identifies the chip in journals and caches kept on host
+ *
+ * @details Needs no secure session, the device is opened if it is not open yet and stays open. The number is read
+ *          once per opening of the device.
+ *
+ * @param h           Device's handle
+ * @param serial      Filled with serial number as lowercase hexadecimal string
+ * @return int        0 if success, otherwise 1
+ */
+int lt_util_chip_serial(lt_handle_t *h, char serial[LT_UTIL_SERIAL_HEX_LEN + 1]);
+
+/**
+ * @brief Finish re-arm of M&D slots postponed by the last successful PIN check
+ *
+ * @details "-mac-ver" releases the secret as soon as the PIN is verified. When the session is not kept, re-arm runs
+ *          right after the secret is written, otherwise it is left for idle time (lt-utild) or runs before the next
+ *          command. Opens the session if needed.
+ *
+ * @param h           Device's handle
+ * @return int        0 if done or nothing is pending, otherwise 1
+ */
+int lt_util_macandd_rearm(lt_handle_t *h);
+
+/**
+ * @brief Check whether re-arm of M&D slots is pending
+ *
+ * @param h           Device's handle
+ * @return true       lt_util_macandd_rearm() has work to do
+ */
+bool lt_util_macandd_rearm_pending(lt_handle_t *h);
+
+/**
+ * @brief Parse and execute one command
+ *
+ * @details With daemon set in struct lt_util_dev, -r --stream and --batch - are refused.
+ *
+ * @param h           Device's handle
+ * @param argc        Number of command arguments
+ * @param argv        Command arguments without program name and serialport, e.g. {"-e", "-g", "0"}
+ * @return int        0 if success, LT_UTIL_ERR_ARGS when arguments are not recognized, otherwise 1
+ */
+int lt_util_run_command(lt_handle_t *h, int argc, char *argv[]);
+
+/**
+ * @brief Execute commands listed in a file, one command per line, within one secure session
+ *
+ * @details Each line holds arguments of one command exactly as they would be passed to lt-util after serialport,
+ *          e.g. "-e -s 0 message signature". Arguments are separated by whitespace and may be quoted, empty lines
+ *          and lines starting with '#' are skipped. Status of every command is printed as "[BATCH] <line>: <status>".
+ *          When a command fails, session is established again before the next command.
+ *
+ * @param h           Device's handle
+ * @param file        Path to the file with commands, "-" reads them from stdin
+ * @param keep_going  false to stop on first failed command, true to execute all commands
+ * @return int        0 if all commands succeeded, otherwise 1
+ */
+int lt_util_run_batch(lt_handle_t *h, const char *file, bool keep_going);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+/**
+ * @file crc32.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief CRC-32 (IEEE 802.3, as used by zlib) protecting records stored on the host or in R memory
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Update CRC-32 with data, start with crc = 0
+ *
+ * @param crc         CRC of previous data, 0 for the first call
+ * @param data        Data
+ * @param len         Length of data
+ * @return uint32_t   Updated CRC
+ */
+uint32_t lt_util_crc32(uint32_t crc, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,329 @@
+/**
+ * @file devices.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Execution of one command or batch on many chips at once
+ *
+ * @details State of a chip (kept session, pending M&D re-arm) lives in its struct lt_util_dev, so workers share
+ * nothing but the read-only command arguments. Only chips on one SPI controller share its bus, chip selects of one
+ * could be driven while the other transfers, so their workers take the mutex of the bus for the whole command and
+ * run one after another. Logs of workers interleave, the summary table at the end tells which chip failed.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <glob.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "devices.h"
+#include "trace.h"
+
+/** @brief Longest device path, including LINUX_SPI chip select suffix */
+#define DEVICES_PATH_MAX 256
+
+/** @brief One chip and the thread driving it */
+struct device_worker {
+    char path[DEVICES_PATH_MAX];
+    char name[DEVICES_PATH_MAX];
+    lt_handle_t h;
+    struct lt_util_dev dev;
+    char **argv;
+    int argc;
+    int status;
+    uint64_t elapsed_ns;
+    pthread_t thread;
+    bool started;
+    /** @brief Mutex of the bus shared with other workers, NULL when the chip has a bus of its own */
+    pthread_mutex_t *bus_lock;
+};
+
+/** @brief Devices found in the list */
+struct device_list {
+    unsigned count;
+    char path[LT_UTIL_DEVICES_MAX][DEVICES_PATH_MAX];
+};
+
+static uint64_t devices_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int device_list_add(struct device_list *list, const char *path, const char *suffix)
+{
+    if (list->count == LT_UTIL_DEVICES_MAX) {
+        LT_LOG_ERROR("Too many devices, max %d", LT_UTIL_DEVICES_MAX);
+        return 1;
+    }
+    char *dst = list->path[list->count];
+    if (snprintf(dst, DEVICES_PATH_MAX, "%s%s", path, suffix) >= DEVICES_PATH_MAX) {
+        LT_LOG_ERROR("Device path too long: %s", path);
+        return 1;
+    }
+    // Two workers on one chip would break each other's session
+    for (unsigned i = 0; i < list->count; i++) {
+        if (strcmp(list->path[i], dst) == 0) {
+            LT_LOG_ERROR("Device %s is listed twice", dst);
+            return 1;
+        }
+    }
+    list->count++;
+
+    return 0;
+}
+
+// Splits comma separated list and expands wildcards
+static int device_list_parse(const char *in, struct device_list *list)
+{
+    char *copy = strdup(in);
+    if (!copy) {
+        return 1;
+    }
+
+    int ret = 0;
+    char *save = NULL;
+    list->count = 0;
+    for (char *item = strtok_r(copy, ",", &save); item && ret == 0; item = strtok_r(NULL, ",", &save)) {
+        char suffix[DEVICES_PATH_MAX] = "";
+#if LINUX_SPI
+        // Chip select suffix is not part of the file name which is matched
+        char *cs = strrchr(item, ':');
+        if (cs) {
+            *cs = '\0';
+            snprintf(suffix, sizeof(suffix), ":%s", cs + 1);
+        }
+#endif
+        if (!strpbrk(item, "*?[")) {
+            ret = device_list_add(list, item, suffix);
+            continue;
+        }
+
+        glob_t g;
+        int gret = glob(item, 0, NULL, &g);
+        if (gret == GLOB_NOMATCH) {
+            LT_LOG_ERROR("No device matches %s", item);
+            ret = 1;
+        } else if (gret != 0) {
+            LT_LOG_ERROR("Error expanding %s", item);
+            ret = 1;
+        }
+        for (size_t i = 0; gret == 0 && ret == 0 && i < g.gl_pathc; i++) {
+            ret = device_list_add(list, g.gl_pathv[i], suffix);
+        }
+        if (gret == 0) {
+            globfree(&g);
+        }
+    }
+    free(copy);
+
+    if (ret == 0 && list->count == 0) {
+        LT_LOG_ERROR("No device given");
+        ret = 1;
+    }
+
+    return ret;
+}
+
+// Copies arguments with LT_UTIL_DEVICE_NAME replaced, name is file name of the device
+static char **device_args(const char *name, int argc, char *argv[])
+{
+    char **out = calloc((size_t)argc + 1, sizeof(char *));
+    if (!out) {
+        return NULL;
+    }
+    for (int i = 0; i < argc; i++) {
+        out[i] = malloc(BATCH_LINE_LEN_MAX + 1);
+        if (!out[i] || lt_util_expand(argv[i], LT_UTIL_DEVICE_NAME, name, out[i], BATCH_LINE_LEN_MAX + 1) != 0) {
+            LT_LOG_ERROR("Argument too long: %s", argv[i]);
+            free(out[i]);
+            out[i] = NULL;
+            return out;
+        }
+    }
+
+    return out;
+}
+
+static void device_args_free(char **argv, int argc)
+{
+    if (!argv) {
+        return;
+    }
+    for (int i = 0; i < argc; i++) {
+        free(argv[i]);
+    }
+    free(argv);
+}
+
+#if LINUX_SPI
+// SPI controller of the device, e.g. "spidev0" for "/dev/spidev0.1:24", any other path is a bus of its own
+static void device_bus(const char *path, char *bus, size_t len)
+{
+    const char *base = strrchr(path, '/');
+    unsigned num;
+    if (sscanf(base ? base + 1 : path, "spidev%u.", &num) == 1) {
+        snprintf(bus, len, "spidev%u", num);
+        return;
+    }
+    snprintf(bus, len, "%s", path);
+    char *cs = strchr(bus, ':');
+    if (cs) {
+        *cs = '\0';
+    }
+}
+
+// Workers of chips on one bus get one mutex, locks has room for one mutex per device
+static void device_bus_locks(struct device_worker *workers, unsigned count, pthread_mutex_t *locks)
+{
+    char bus[LT_UTIL_DEVICES_MAX][DEVICES_PATH_MAX];
+
+    for (unsigned i = 0; i < count; i++) {
+        device_bus(workers[i].path, bus[i], sizeof(bus[i]));
+        for (unsigned j = 0; j < i; j++) {
+            if (strcmp(bus[i], bus[j]) != 0) {
+                continue;
+            }
+            if (!workers[j].bus_lock) {
+                pthread_mutex_init(&locks[j], NULL);
+                workers[j].bus_lock = &locks[j];
+            }
+            workers[i].bus_lock = workers[j].bus_lock;
+            LT_LOG_INFO("%s shares SPI bus %s with %s, they run one after another", workers[i].path, bus[i],
+                        workers[j].path);
+            break;
+        }
+    }
+}
+#endif
+
+static void *device_worker_run(void *arg)
+{
+    struct device_worker *w = arg;
+
+    if (w->bus_lock) {
+        pthread_mutex_lock(w->bus_lock);
+    }
+    // Time spent waiting for the bus is not time of the chip
+    uint64_t start = devices_now_ns();
+    w->status = lt_util_run_command(&w->h, w->argc, w->argv);
+    w->elapsed_ns = devices_now_ns() - start;
+    if (w->bus_lock) {
+        pthread_mutex_unlock(w->bus_lock);
+    }
+
+    return NULL;
+}
+
+int lt_util_run_devices(const char *list_in, int argc, char *argv[])
+{
+    if (argc < 1) {
+        return LT_UTIL_ERR_ARGS;
+    }
+#if LT_UTIL_TRACE
+    if (strcmp(argv[0], TRACE) == 0) {
+        LT_LOG_ERROR(TRACE" records one chip, it can not be used with "DEVICES);
+        return 1;
+    }
+#endif
+
+    struct device_list *list = calloc(1, sizeof(*list));
+    if (!list) {
+        return 1;
+    }
+    if (device_list_parse(list_in, list) != 0) {
+        free(list);
+        return 1;
+    }
+    // Batch from stdin or random stream to stdout can serve only one chip
+    for (int i = 0; i < argc && list->count > 1; i++) {
+        if (strcmp(argv[i], "-") == 0) {
+            LT_LOG_ERROR("'-' (stdin/stdout) can not be shared by %u devices", list->count);
+            free(list);
+            return 1;
+        }
+    }
+
+    struct device_worker *workers = calloc(list->count, sizeof(*workers));
+    pthread_mutex_t *bus_locks = calloc(list->count, sizeof(*bus_locks));
+    if (!workers || !bus_locks) {
+        free(workers);
+        free(bus_locks);
+        free(list);
+        return 1;
+    }
+    for (unsigned i = 0; i < list->count; i++) {
+        strcpy(workers[i].path, list->path[i]);
+    }
+#if LINUX_SPI
+    device_bus_locks(workers, list->count, bus_locks);
+#endif
+
+    uint64_t start = devices_now_ns();
+    for (unsigned i = 0; i < list->count; i++) {
+        struct device_worker *w = &workers[i];
+        // File name of the device, ':' of LINUX_SPI chip select becomes '_'
+        const char *base = strrchr(w->path, '/');
+        strcpy(w->name, base ? base + 1 : w->path);
+        for (char *c = w->name; *c; c++) {
+            *c = (*c == ':') ? '_' : *c;
+        }
+        w->argc = argc;
+        w->argv = device_args(w->name, argc, argv);
+        w->status = 1;
+        if (!w->argv || !w->argv[argc - 1]) {
+            continue;
+        }
+        lt_util_dev_setup(&w->h, &w->dev, w->path);
+        w->dev.name = w->name;
+        if (pthread_create(&w->thread, NULL, device_worker_run, w) != 0) {
+            LT_LOG_ERROR("%s: can not start worker thread", w->path);
+            continue;
+        }
+        w->started = true;
+    }
+    for (unsigned i = 0; i < list->count; i++) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+    uint64_t wall_ns = devices_now_ns() - start;
+
+    unsigned failed = 0, bad_args = 0;
+    uint64_t sum_ns = 0;
+    printf("\n%-32s %-8s %10s\n", "device", "status", "time [ms]");
+    for (unsigned i = 0; i < list->count; i++) {
+        struct device_worker *w = &workers[i];
+        const char *status = w->status == 0 ? "ok" : (w->status == LT_UTIL_ERR_ARGS ? "args" : "FAIL");
+        printf("%-32s %-8s %10.1f\n", w->path, status, w->elapsed_ns / 1e6);
+        failed += w->status != 0;
+        bad_args += w->status == LT_UTIL_ERR_ARGS;
+        sum_ns += w->elapsed_ns;
+        device_args_free(w->argv, w->argc);
+        if (w->bus_lock == &bus_locks[i]) {
+            pthread_mutex_destroy(&bus_locks[i]);
+        }
+    }
+    printf("%u devices, %u failed, wall time %.1f ms, sum of device times %.1f ms\n", list->count, failed,
+           wall_ns / 1e6, sum_ns / 1e6);
+
+    unsigned count = list->count;
+    free(workers);
+    free(bus_locks);
+    free(list);
+
+    if (bad_args == count) {
+        return LT_UTIL_ERR_ARGS;
+    }
+    return failed ? 1 : 0;
+}
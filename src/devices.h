@@ -0,0 +1,36 @@
+#ifndef DEVICES_H
+#define DEVICES_H
+
+/**
+ * @file devices.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Execution of one command or batch on many chips at once
+ *
+ * @details Every chip gets a worker thread with its own handle and transport, so total time is given by the slowest
+ * chip rather than by the sum of all of them. Results are collected per chip and printed when all workers finish.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+/** @brief Maximal number of chips driven at once */
+#define LT_UTIL_DEVICES_MAX 64
+
+/**
+ * @brief Execute the same command on every chip of the list, each in its own thread
+ *
+ * @details Items of the list are separated by commas, an item with wildcards is expanded with glob(3), e.g.
+ *          "/dev/ttyACM*". For LINUX_SPI an item is "<spidev>[:<gpio_cs_num>]", for SIMULATOR it is a state file.
+ *          Chips on one SPI controller are driven one after another.
+ *          LT_UTIL_DEVICE_NAME in arguments and batch lines is replaced by file name of the device, e.g. "ttyACM0",
+ *          so every chip gets its own files.
+ *
+ * @param list        List of devices
+ * @param argc        Number of command arguments
+ * @param argv        Command arguments, as for lt_util_run_command()
+ * @return int        0 if the command succeeded on all chips, LT_UTIL_ERR_ARGS when arguments are not recognized,
+ *                    otherwise 1
+ */
+int lt_util_run_devices(const char *list, int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,611 @@
+/**
+ * @file digest.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details SHA-256 and SHA-512 (FIPS 180-4) for hashing of big files before they are signed by TROPIC01.
+ * Files are mapped into memory, so hashing is limited by disk bandwidth and by the hash itself.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define DIGEST_HAVE_SHANI 1
+#endif
+
+#include "libtropic_logging.h"
+#include "digest.h"
+
+/** @brief Files are read in chunks of this size when they cannot be mapped */
+#define DIGEST_READ_CHUNK (1024u * 1024u)
+/** @brief Upper limit of threads used by DIGEST_SHA256_TREE */
+#define DIGEST_TREE_THREADS_MAX 64
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint64_t K512[80] = {
+    0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc, 0x3956c25bf348b538,
+    0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118, 0xd807aa98a3030242, 0x12835b0145706fbe,
+    0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2, 0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235,
+    0xc19bf174cf692694, 0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+    0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5, 0x983e5152ee66dfab,
+    0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4, 0xc6e00bf33da88fc2, 0xd5a79147930aa725,
+    0x06ca6351e003826f, 0x142929670a0e6e70, 0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed,
+    0x53380d139d95b3df, 0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+    0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30, 0xd192e819d6ef5218,
+    0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8, 0x19a4c116b8d2d0c8, 0x1e376c085141ab53,
+    0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8, 0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373,
+    0x682e6ff3d6b2b8a3, 0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+    0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b, 0xca273eceea26619c,
+    0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178, 0x06f067aa72176fba, 0x0a637dc5a2c898a6,
+    0x113f9804bef90dae, 0x1b710b35131c471b, 0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc,
+    0x431d67c49c100d4c, 0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROR64(x, n) (((x) >> (n)) | ((x) << (64 - (n))))
+
+static uint32_t load_be32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint64_t load_be64(const uint8_t *p)
+{
+    return ((uint64_t)load_be32(p) << 32) | load_be32(p + 4);
+}
+
+static void store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void store_be64(uint8_t *p, uint64_t v)
+{
+    store_be32(p, v >> 32);
+    store_be32(p + 4, (uint32_t)v);
+}
+
+static void sha256_blocks_generic(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    uint32_t w[64];
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = load_be32(data + 4 * i);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+            uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += 64;
+    }
+}
+
+#ifdef DIGEST_HAVE_SHANI
+// SHA-NI keeps state as ABEF/CDGH pairs, each group of four rounds takes one 128-bit slice of message schedule
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_shani(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);   // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);                                     // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);                                           // CDGH
+
+    while (blocks--) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i x[4];
+
+        for (int g = 0; g < 16; g++) {
+            __m128i msg;
+            if (g < 4) {
+                msg = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * g)), bswap);
+            } else {
+                // W[t] = s1(W[t-2]) + W[t-7] + s0(W[t-15]) + W[t-16] for four words at once
+                msg = _mm_sha256msg1_epu32(x[g % 4], x[(g + 1) % 4]);
+                msg = _mm_add_epi32(msg, _mm_alignr_epi8(x[(g + 3) % 4], x[(g + 2) % 4], 4));
+                msg = _mm_sha256msg2_epu32(msg, x[(g + 3) % 4]);
+            }
+            x[g % 4] = msg;
+
+            msg = _mm_add_epi32(msg, _mm_loadu_si128((const __m128i *)&K256[4 * g]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+        }
+
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+        data += 64;
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);        // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1);     // DCHG
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);  // DCBA
+    state1 = _mm_alignr_epi8(state1, tmp, 8);     // ABEF
+    _mm_storeu_si128((__m128i *)&state[0], state0);
+    _mm_storeu_si128((__m128i *)&state[4], state1);
+}
+
+static bool cpu_has_shani(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+        return false;
+    }
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & (1u << 29)) != 0;
+}
+#endif
+
+static void (*sha256_blocks)(uint32_t state[8], const uint8_t *data, size_t blocks);
+static pthread_once_t sha256_once = PTHREAD_ONCE_INIT;
+
+static void sha256_select(void)
+{
+    sha256_blocks = sha256_blocks_generic;
+#ifdef DIGEST_HAVE_SHANI
+    if (cpu_has_shani()) {
+        sha256_blocks = sha256_blocks_shani;
+    }
+#endif
+}
+
+void digest_sha256_init(struct digest_sha256_ctx *ctx)
+{
+    static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    pthread_once(&sha256_once, sha256_select);
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->len = 0;
+    ctx->buf_len = 0;
+}
+
+void digest_sha256_update(struct digest_sha256_ctx *ctx, const uint8_t *data, size_t len)
+{
+    ctx->len += len;
+    if (ctx->buf_len) {
+        size_t n = 64 - ctx->buf_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ctx->buf + ctx->buf_len, data, n);
+        ctx->buf_len += n;
+        data += n;
+        len -= n;
+        if (ctx->buf_len < 64) {
+            return;
+        }
+        sha256_blocks(ctx->state, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+    // Whole blocks are hashed directly from caller's buffer
+    if (len >= 64) {
+        sha256_blocks(ctx->state, data, len / 64);
+        data += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(ctx->buf, data, len);
+    ctx->buf_len = len;
+}
+
+void digest_sha256_final(struct digest_sha256_ctx *ctx, uint8_t *digest)
+{
+    uint64_t bits = ctx->len * 8;
+    uint8_t pad[72] = {0x80};
+    size_t pad_len = (ctx->buf_len < 56) ? (56 - ctx->buf_len) : (120 - ctx->buf_len);
+    store_be64(pad + pad_len, bits);
+    digest_sha256_update(ctx, pad, pad_len + 8);
+    for (int i = 0; i < 8; i++) {
+        store_be32(digest + 4 * i, ctx->state[i]);
+    }
+}
+
+static void sha512_blocks(uint64_t state[8], const uint8_t *data, size_t blocks)
+{
+    uint64_t w[80];
+    while (blocks--) {
+        for (int i = 0; i < 16; i++) {
+            w[i] = load_be64(data + 8 * i);
+        }
+        for (int i = 16; i < 80; i++) {
+            uint64_t s0 = ROR64(w[i - 15], 1) ^ ROR64(w[i - 15], 8) ^ (w[i - 15] >> 7);
+            uint64_t s1 = ROR64(w[i - 2], 19) ^ ROR64(w[i - 2], 61) ^ (w[i - 2] >> 6);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint64_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint64_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 80; i++) {
+            uint64_t t1 = h + (ROR64(e, 14) ^ ROR64(e, 18) ^ ROR64(e, 41)) + ((e & f) ^ (~e & g)) + K512[i] + w[i];
+            uint64_t t2 = (ROR64(a, 28) ^ ROR64(a, 34) ^ ROR64(a, 39)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+
+        data += 128;
+    }
+}
+
+void digest_sha512_init(struct digest_sha512_ctx *ctx)
+{
+    static const uint64_t iv[8] = {0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+                                   0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179};
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->len = 0;
+    ctx->buf_len = 0;
+}
+
+void digest_sha512_update(struct digest_sha512_ctx *ctx, const uint8_t *data, size_t len)
+{
+    ctx->len += len;
+    if (ctx->buf_len) {
+        size_t n = 128 - ctx->buf_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(ctx->buf + ctx->buf_len, data, n);
+        ctx->buf_len += n;
+        data += n;
+        len -= n;
+        if (ctx->buf_len < 128) {
+            return;
+        }
+        sha512_blocks(ctx->state, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+    if (len >= 128) {
+        sha512_blocks(ctx->state, data, len / 128);
+        data += len & ~(size_t)127;
+        len &= 127;
+    }
+    memcpy(ctx->buf, data, len);
+    ctx->buf_len = len;
+}
+
+void digest_sha512_final(struct digest_sha512_ctx *ctx, uint8_t *digest)
+{
+    // Message length is stored as 128-bit value, files handled here never exceed 2^61 bytes
+    uint8_t pad[144] = {0x80};
+    size_t pad_len = (ctx->buf_len < 112) ? (112 - ctx->buf_len) : (240 - ctx->buf_len);
+    store_be64(pad + pad_len, ctx->len >> 61);
+    store_be64(pad + pad_len + 8, ctx->len << 3);
+    digest_sha512_update(ctx, pad, pad_len + 16);
+    for (int i = 0; i < 8; i++) {
+        store_be64(digest + 8 * i, ctx->state[i]);
+    }
+}
+
+int digest_alg_parse(const char *name, enum digest_alg *alg)
+{
+    if (strcmp(name, "sha256") == 0) {
+        *alg = DIGEST_SHA256;
+    } else if (strcmp(name, "sha512") == 0) {
+        *alg = DIGEST_SHA512;
+    } else if (strcmp(name, "sha256-tree") == 0) {
+        *alg = DIGEST_SHA256_TREE;
+    } else {
+        return 1;
+    }
+    return 0;
+}
+
+/** @brief Input of one file hashed by several threads */
+struct tree_job {
+    const uint8_t *map;
+    int fd;
+    uint64_t size;
+    uint64_t leaves;
+    uint64_t next;
+    uint8_t *leaf_digests;
+    pthread_mutex_t lock;
+    int err;
+};
+
+// Hashes one leaf, data is taken from the mapping or read into buf when file is not mapped
+static int tree_hash_leaf(struct tree_job *job, uint64_t leaf, uint8_t *buf)
+{
+    uint64_t offset = leaf << DIGEST_TREE_LEAF_LOG2;
+    uint64_t len = job->size - offset;
+    if (len > (1ull << DIGEST_TREE_LEAF_LOG2)) {
+        len = 1ull << DIGEST_TREE_LEAF_LOG2;
+    }
+
+    struct digest_sha256_ctx ctx;
+    digest_sha256_init(&ctx);
+    digest_sha256_update(&ctx, (const uint8_t *)"\x00", 1);
+    if (job->map) {
+        digest_sha256_update(&ctx, job->map + offset, len);
+    } else {
+        while (len) {
+            size_t chunk = len > DIGEST_READ_CHUNK ? DIGEST_READ_CHUNK : len;
+            ssize_t n = pread(job->fd, buf, chunk, offset);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                return 1;
+            }
+            digest_sha256_update(&ctx, buf, n);
+            offset += n;
+            len -= n;
+        }
+    }
+    digest_sha256_final(&ctx, job->leaf_digests + leaf * DIGEST_SHA256_LEN);
+
+    return 0;
+}
+
+static void *tree_worker(void *arg)
+{
+    struct tree_job *job = arg;
+    uint8_t *buf = job->map ? NULL : malloc(DIGEST_READ_CHUNK);
+    if (!job->map && !buf) {
+        pthread_mutex_lock(&job->lock);
+        job->err = 1;
+        pthread_mutex_unlock(&job->lock);
+        return NULL;
+    }
+
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        uint64_t leaf = job->next++;
+        int err = job->err;
+        pthread_mutex_unlock(&job->lock);
+        if (err || leaf >= job->leaves) {
+            break;
+        }
+        if (tree_hash_leaf(job, leaf, buf) != 0) {
+            pthread_mutex_lock(&job->lock);
+            job->err = 1;
+            pthread_mutex_unlock(&job->lock);
+            break;
+        }
+    }
+
+    free(buf);
+    return NULL;
+}
+
+static int digest_tree(const uint8_t *map, int fd, uint64_t size, uint8_t *digest)
+{
+    struct tree_job job = {.map = map, .fd = fd, .size = size, .next = 0, .err = 0};
+    job.leaves = (size + (1ull << DIGEST_TREE_LEAF_LOG2) - 1) >> DIGEST_TREE_LEAF_LOG2;
+    if (job.leaves == 0) {
+        // Empty file is one empty leaf
+        job.leaves = 1;
+    }
+    job.leaf_digests = malloc(job.leaves * DIGEST_SHA256_LEN);
+    if (!job.leaf_digests) {
+        return 1;
+    }
+    pthread_mutex_init(&job.lock, NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) {
+        cpus = 1;
+    }
+    if ((uint64_t)cpus > job.leaves) {
+        cpus = (long)job.leaves;
+    }
+    if (cpus > DIGEST_TREE_THREADS_MAX) {
+        cpus = DIGEST_TREE_THREADS_MAX;
+    }
+
+    pthread_t threads[DIGEST_TREE_THREADS_MAX];
+    long started = 0;
+    for (long i = 1; i < cpus; i++) {
+        if (pthread_create(&threads[started], NULL, tree_worker, &job) != 0) {
+            break;
+        }
+        started++;
+    }
+    // Calling thread works as well, so hashing proceeds even if no thread could be started
+    tree_worker(&job);
+    for (long i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&job.lock);
+
+    if (!job.err) {
+        struct digest_sha256_ctx ctx;
+        digest_sha256_init(&ctx);
+        digest_sha256_update(&ctx, (const uint8_t *)"\x01", 1);
+        digest_sha256_update(&ctx, job.leaf_digests, job.leaves * DIGEST_SHA256_LEN);
+        digest_sha256_final(&ctx, digest);
+    }
+    free(job.leaf_digests);
+
+    return job.err;
+}
+
+// Sequential hash of mapped data, or of data read from fd when file could not be mapped
+static int digest_linear(const uint8_t *map, int fd, uint64_t size, enum digest_alg alg, uint8_t *digest)
+{
+    struct digest_sha256_ctx ctx256;
+    struct digest_sha512_ctx ctx512;
+    if (alg == DIGEST_SHA256) {
+        digest_sha256_init(&ctx256);
+    } else {
+        digest_sha512_init(&ctx512);
+    }
+
+    uint8_t *buf = NULL;
+    if (!map) {
+        buf = malloc(DIGEST_READ_CHUNK);
+        if (!buf) {
+            return 1;
+        }
+    }
+
+    uint64_t done = 0;
+    while (done < size) {
+        const uint8_t *data;
+        size_t len;
+        if (map) {
+            data = map;
+            len = size;
+        } else {
+            ssize_t n = read(fd, buf, DIGEST_READ_CHUNK);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                free(buf);
+                return 1;
+            }
+            data = buf;
+            len = n;
+        }
+        if (alg == DIGEST_SHA256) {
+            digest_sha256_update(&ctx256, data, len);
+        } else {
+            digest_sha512_update(&ctx512, data, len);
+        }
+        done += len;
+    }
+    free(buf);
+
+    if (alg == DIGEST_SHA256) {
+        digest_sha256_final(&ctx256, digest);
+    } else {
+        digest_sha512_final(&ctx512, digest);
+    }
+
+    return 0;
+}
+
+int digest_file(const char *path, enum digest_alg alg, struct digest_header *header)
+{
+    if (!path || !header) {
+        return 1;
+    }
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, DIGEST_HEADER_MAGIC, sizeof(header->magic));
+    header->version = DIGEST_HEADER_VERSION;
+    header->alg = alg;
+    switch (alg) {
+        case DIGEST_SHA256:
+            header->digest_len = DIGEST_SHA256_LEN;
+            break;
+        case DIGEST_SHA512:
+            header->digest_len = DIGEST_SHA512_LEN;
+            break;
+        case DIGEST_SHA256_TREE:
+            header->digest_len = DIGEST_SHA256_LEN;
+            header->leaf_log2 = DIGEST_TREE_LEAF_LOG2;
+            break;
+        default:
+            return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LT_LOG_ERROR("Error opening file %s: %s", path, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        LT_LOG_ERROR("Error, %s is not a regular file", path);
+        close(fd);
+        return 1;
+    }
+    uint64_t size = (uint64_t)st.st_size;
+    for (int i = 0; i < 8; i++) {
+        header->file_size[i] = (uint8_t)(size >> (8 * i));
+    }
+
+    // Mapping avoids copying file content, read() is used only when mapping is not possible
+    const uint8_t *map = NULL;
+    if (size > 0 && size <= SIZE_MAX) {
+        void *m = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m != MAP_FAILED) {
+            map = m;
+            madvise(m, (size_t)size, alg == DIGEST_SHA256_TREE ? MADV_WILLNEED : MADV_SEQUENTIAL);
+        }
+    }
+
+    int ret;
+    if (alg == DIGEST_SHA256_TREE) {
+        ret = digest_tree(map, fd, size, header->digest);
+    } else {
+        ret = digest_linear(map, fd, size, alg, header->digest);
+    }
+
+    if (map) {
+        munmap((void *)map, (size_t)size);
+    }
+    close(fd);
+
+    if (ret != 0) {
+        LT_LOG_ERROR("Error hashing file %s", path);
+    }
+    return ret;
+}
@@ -0,0 +1,98 @@
+#ifndef DIGEST_H
+#define DIGEST_H
+
+/**
+ * @file digest.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Host side SHA-256/SHA-512 used to sign digests of files of any size
+ *
+ * @details SHA-256 uses SHA-NI instructions when CPU supports them. DIGEST_SHA256_TREE splits the file into
+ * leaves of 2^DIGEST_TREE_LEAF_LOG2 bytes which are hashed in parallel by all CPUs, see digest_file().
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Size of SHA-256 digest */
+#define DIGEST_SHA256_LEN 32
+/** @brief Size of SHA-512 digest */
+#define DIGEST_SHA512_LEN 64
+/** @brief Size of the biggest supported digest */
+#define DIGEST_LEN_MAX    DIGEST_SHA512_LEN
+/** @brief Leaf of DIGEST_SHA256_TREE is 8 MiB */
+#define DIGEST_TREE_LEAF_LOG2 23
+
+/** @brief "LTSG", first bytes of detached signature file */
+#define DIGEST_HEADER_MAGIC   "LTSG"
+/** @brief Version of struct digest_header */
+#define DIGEST_HEADER_VERSION 1
+
+/** @brief Supported digest algorithms, values are stored in struct digest_header */
+enum digest_alg {
+    DIGEST_SHA256      = 1,
+    DIGEST_SHA512      = 2,
+    /** Tree of SHA-256: leaf_i = SHA-256(0x00 || leaf data), root = SHA-256(0x01 || leaf_0 || leaf_1 || ...) */
+    DIGEST_SHA256_TREE = 3,
+};
+
+/**
+ * @brief Describes what was hashed, this whole structure is signed by TROPIC01
+ *
+ * @details Detached signature file consists of this header followed by 64B EdDSA signature of the header.
+ *          Multi-byte values are little endian, unused bytes of digest are zero.
+ */
+struct digest_header {
+    uint8_t magic[4];
+    uint8_t version;
+    uint8_t alg;
+    uint8_t digest_len;
+    uint8_t leaf_log2;
+    uint8_t file_size[8];
+    uint8_t digest[DIGEST_LEN_MAX];
+} __attribute__((__packed__));
+
+struct digest_sha256_ctx {
+    uint32_t state[8];
+    uint64_t len;
+    uint8_t buf[64];
+    size_t buf_len;
+};
+
+struct digest_sha512_ctx {
+    uint64_t state[8];
+    uint64_t len;
+    uint8_t buf[128];
+    size_t buf_len;
+};
+
+void digest_sha256_init(struct digest_sha256_ctx *ctx);
+void digest_sha256_update(struct digest_sha256_ctx *ctx, const uint8_t *data, size_t len);
+void digest_sha256_final(struct digest_sha256_ctx *ctx, uint8_t *digest);
+
+void digest_sha512_init(struct digest_sha512_ctx *ctx);
+void digest_sha512_update(struct digest_sha512_ctx *ctx, const uint8_t *data, size_t len);
+void digest_sha512_final(struct digest_sha512_ctx *ctx, uint8_t *digest);
+
+/**
+ * @brief Parse name of digest algorithm
+ *
+ * @param name        "sha256", "sha512" or "sha256-tree"
+ * @param alg         Parsed algorithm
+ * @return int        0 if success, otherwise 1
+ */
+int digest_alg_parse(const char *name, enum digest_alg *alg);
+
+/**
+ * @brief Hash content of a file, file is mapped into memory and hashed in one pass
+ *
+ * @param path        Path to the file
+ * @param alg         Digest algorithm
+ * @param header      Header to be filled with digest and description of what was hashed
+ * @return int        0 if success, otherwise 1
+ */
+int digest_file(const char *path, enum digest_alg alg, struct digest_header *header);
+
+#endif
@@ -0,0 +1,189 @@
+/**
+ * @file eph_pool.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Pool of host ephemeral X25519 keypairs computed ahead of the handshake
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#if LT_UTIL_EPH_POOL
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+
+#include "libtropic_logging.h"
+#include "eph_pool.h"
+
+void __real_lt_X25519_scalarmult(const uint8_t *sk, uint8_t *pk);
+void __wrap_lt_X25519_scalarmult(const uint8_t *sk, uint8_t *pk);
+void lt_X25519_scalarmult(const uint8_t *sk, uint8_t *pk);
+
+struct eph_keypair {
+    uint8_t priv[32];
+    uint8_t pub[32];
+};
+
+// Last entry is where the refill thread computes, so no private key is left on its stack
+static struct {
+    struct eph_keypair pair[LT_EPH_POOL_SIZE + 1];
+} eph_keys __attribute__((aligned(4096)));
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t refill;  /**< Signalled when a keypair is taken, or on stop */
+    pthread_cond_t filled;  /**< Signalled when a keypair is added */
+    pthread_t thread;
+    bool running;
+    bool stop;
+    size_t count;
+    struct lt_eph_pool_stats stats;
+} eph_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .refill = PTHREAD_COND_INITIALIZER,
+    .filled = PTHREAD_COND_INITIALIZER,
+};
+
+static pthread_once_t eph_pool_once = PTHREAD_ONCE_INIT;
+
+// Stores through volatile pointer are not dropped by the compiler as dead stores
+static void eph_zeroize(void *buf, size_t len)
+{
+    volatile uint8_t *p = buf;
+    while (len--) {
+        *p++ = 0;
+    }
+}
+
+static bool eph_pool_enabled(void)
+{
+    const char *env = getenv(LT_UTIL_EPH_POOL_ENV);
+    return !(env && (strcmp(env, "0") == 0));
+}
+
+static void *eph_pool_refill(void *arg)
+{
+    struct eph_keypair *scratch = &eph_keys.pair[LT_EPH_POOL_SIZE];
+
+    pthread_mutex_lock(&eph_pool.lock);
+    while (!eph_pool.stop) {
+        if (eph_pool.count == LT_EPH_POOL_SIZE) {
+            pthread_cond_wait(&eph_pool.refill, &eph_pool.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&eph_pool.lock);
+
+        bool ok = (getentropy(scratch->priv, sizeof(scratch->priv)) == 0);
+        if (ok) {
+            __real_lt_X25519_scalarmult(scratch->priv, scratch->pub);
+        }
+
+        pthread_mutex_lock(&eph_pool.lock);
+        if (!ok) {
+            LT_LOG_WARN("getentropy() failed, ephemeral keypair pool stopped");
+            break;
+        }
+        if (eph_pool.count < LT_EPH_POOL_SIZE) {
+            eph_keys.pair[eph_pool.count++] = *scratch;
+            pthread_cond_broadcast(&eph_pool.filled);
+        }
+        eph_zeroize(scratch, sizeof(*scratch));
+    }
+    eph_pool.running = false;
+    pthread_cond_broadcast(&eph_pool.filled);
+    pthread_mutex_unlock(&eph_pool.lock);
+
+    return NULL;
+}
+
+static void eph_pool_stop(void)
+{
+    pthread_mutex_lock(&eph_pool.lock);
+    eph_pool.stop = true;
+    pthread_cond_signal(&eph_pool.refill);
+    pthread_mutex_unlock(&eph_pool.lock);
+    pthread_join(eph_pool.thread, NULL);
+
+    eph_zeroize(&eph_keys, sizeof(eph_keys));
+    munlock(&eph_keys, sizeof(eph_keys));
+}
+
+static void eph_pool_init(void)
+{
+    if (!eph_pool_enabled()) {
+        return;
+    }
+    // Locked pages are never swapped out, so private keys do not end up on disk
+    if (mlock(&eph_keys, sizeof(eph_keys)) != 0) {
+        LT_LOG_WARN("Can not lock ephemeral keypair pool into memory, pool is not used");
+        return;
+    }
+    eph_pool.running = true;
+    if (pthread_create(&eph_pool.thread, NULL, eph_pool_refill, NULL) != 0) {
+        eph_pool.running = false;
+        munlock(&eph_keys, sizeof(eph_keys));
+        return;
+    }
+    atexit(eph_pool_stop);
+}
+
+void lt_eph_pool_start(void)
+{
+    pthread_once(&eph_pool_once, eph_pool_init);
+}
+
+void lt_eph_pool_wait_full(void)
+{
+    pthread_mutex_lock(&eph_pool.lock);
+    while (eph_pool.running && (eph_pool.count < LT_EPH_POOL_SIZE)) {
+        pthread_cond_wait(&eph_pool.filled, &eph_pool.lock);
+    }
+    pthread_mutex_unlock(&eph_pool.lock);
+}
+
+void lt_eph_pool_keypair(uint8_t priv[32], uint8_t pub[32])
+{
+    if (getentropy(priv, 32) != 0) {
+        memset(priv, 0, 32);
+    }
+    lt_X25519_scalarmult(priv, pub);
+}
+
+void lt_eph_pool_get_stats(struct lt_eph_pool_stats *stats)
+{
+    pthread_mutex_lock(&eph_pool.lock);
+    *stats = eph_pool.stats;
+    pthread_mutex_unlock(&eph_pool.lock);
+}
+
+void __wrap_lt_X25519_scalarmult(const uint8_t *sk, uint8_t *pk)
+{
+    pthread_mutex_lock(&eph_pool.lock);
+    if (!eph_pool.running) {
+        pthread_mutex_unlock(&eph_pool.lock);
+        __real_lt_X25519_scalarmult(sk, pk);
+        return;
+    }
+    if (eph_pool.count == 0) {
+        eph_pool.stats.misses++;
+        pthread_mutex_unlock(&eph_pool.lock);
+        __real_lt_X25519_scalarmult(sk, pk);
+        return;
+    }
+
+    // sk points to the writable buffer lt_session_start() drew the private key into, it is replaced by the
+    // pooled one, whose public key is already known
+    struct eph_keypair *pair = &eph_keys.pair[--eph_pool.count];
+    memcpy((uint8_t *)sk, pair->priv, sizeof(pair->priv));
+    memcpy(pk, pair->pub, sizeof(pair->pub));
+    eph_zeroize(pair, sizeof(*pair));
+    eph_pool.stats.hits++;
+    pthread_cond_signal(&eph_pool.refill);
+    pthread_mutex_unlock(&eph_pool.lock);
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef EPH_POOL_H
+#define EPH_POOL_H
+
+/**
+ * @file eph_pool.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Pool of host ephemeral X25519 keypairs computed ahead of the handshake
+ *
+ * @details lt_session_start() draws the host ephemeral private key and derives its public key with
+ * lt_X25519_scalarmult() of the crypto backend, on the critical path of every command. With LT_UTIL_EPH_POOL,
+ * CMakeLists.txt links with -Wl,--wrap=lt_X25519_scalarmult and a background thread keeps a pool of keypairs,
+ * so the handshake takes a ready one instead. The keypair replaces the private key lt_session_start() drew
+ * into its local buffer, which it then uses for the rest of the handshake.
+ *
+ * The thread starts with the first lt_util_dev_open(), so the first keypair is computed while lt_init() and the
+ * certificate store transfer run. Pool memory is locked into RAM, every keypair is zeroized when taken and the
+ * whole pool at exit. An empty pool falls back to the crypto backend. Setting LT_UTIL_EPH_POOL_ENV to "0" turns
+ * the pool off at runtime.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdint.h>
+
+/** @brief Environment variable which turns the pool off when set to "0" */
+#define LT_UTIL_EPH_POOL_ENV "LT_UTIL_EPH_POOL"
+
+/** @brief Number of keypairs kept ready */
+#ifndef LT_EPH_POOL_SIZE
+#define LT_EPH_POOL_SIZE 8
+#endif
+
+#if LT_UTIL_EPH_POOL
+
+/** @brief Keypairs served from the pool and computed on the critical path */
+struct lt_eph_pool_stats {
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/**
+ * @brief Start the refill thread, does nothing when it runs already or the pool is turned off
+ */
+void lt_eph_pool_start(void);
+
+/**
+ * @brief Wait until the pool is full, returns at once when the pool is turned off
+ */
+void lt_eph_pool_wait_full(void);
+
+/**
+ * @brief Get keypair the way lt_session_start() does: random private key, then lt_X25519_scalarmult()
+ *
+ * @param priv        Filled with private key
+ * @param pub         Filled with public key
+ */
+void lt_eph_pool_keypair(uint8_t priv[32], uint8_t pub[32]);
+
+/**
+ * @brief Read counters of keypairs served so far
+ *
+ * @param stats       Filled with the counters
+ */
+void lt_eph_pool_get_stats(struct lt_eph_pool_stats *stats);
+
+#else
+
+#define lt_eph_pool_start() do {} while (0)
+
+#endif
+
+#endif
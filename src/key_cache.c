@@ -0,0 +1,207 @@
+/**
+ * @file key_cache.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Host side cache of public keys in ECC slots, one file per chip
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "crc32.h"
+#include "key_cache.h"
+
+#define LT_KEY_CACHE_VERSION 1
+
+static const uint8_t key_cache_magic[4] = {'L', 'T', 'K', 'C'};
+
+static uint32_t key_cache_crc(const struct lt_key_cache *cache)
+{
+    return lt_util_crc32(0, (const uint8_t *)cache, offsetof(struct lt_key_cache, crc));
+}
+
+// Directory of cache files, NULL if the cache is disabled
+static const char *key_cache_dir(char *buf, size_t len)
+{
+    const char *dir = getenv(LT_UTIL_CACHE_DIR_ENV);
+    if (dir) {
+        return dir[0] ? dir : NULL;
+    }
+
+    const char *xdg = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    if (xdg && xdg[0]) {
+        snprintf(buf, len, "%s/lt-util", xdg);
+    } else if (home && home[0]) {
+        snprintf(buf, len, "%s/.cache/lt-util", home);
+    } else {
+        return NULL;
+    }
+
+    return buf;
+}
+
+int lt_util_cache_file(const char *name, char *path, size_t len)
+{
+    char dir_buf[PATH_MAX];
+    const char *dir = key_cache_dir(dir_buf, sizeof(dir_buf));
+    if (!dir) {
+        return 1;
+    }
+
+    return snprintf(path, len, "%s/%s", dir, name) >= (int)len;
+}
+
+int lt_util_cache_path(lt_handle_t *h, const char *ext, char *path, size_t len)
+{
+    // Disabled cache does not open the device for its serial number
+    char dir_buf[PATH_MAX];
+    if (!key_cache_dir(dir_buf, sizeof(dir_buf))) {
+        return 1;
+    }
+
+    char serial[LT_UTIL_SERIAL_HEX_LEN + 1];
+    char name[LT_UTIL_SERIAL_HEX_LEN + 32];
+    if (lt_util_chip_serial(h, serial) != 0) {
+        return 1;
+    }
+    snprintf(name, sizeof(name), "%s.%s", serial, ext);
+
+    return lt_util_cache_file(name, path, len);
+}
+
+int lt_util_cache_write(const char *path_in, const void *data, size_t len)
+{
+    char path[PATH_MAX], tmp[PATH_MAX + 32];
+    if (snprintf(path, sizeof(path), "%s", path_in) >= (int)sizeof(path)) {
+        return 1;
+    }
+
+    // Create the directory and its parent (~/.cache), other errors show up when the file is created
+    char *slash = strrchr(path, '/');
+    if (slash) {
+        *slash = '\0';
+        char *parent = strrchr(path, '/');
+        if (parent && parent != path) {
+            *parent = '\0';
+            mkdir(path, 0700);
+            *parent = '/';
+        }
+        mkdir(path, 0700);
+        *slash = '/';
+    }
+
+    // Written aside and renamed, so readers in other processes see the old or the new file, never a mix
+    snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path, (long)getpid());
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        LT_LOG_WARN("Error creating cache file %s: %s", tmp, strerror(errno));
+        return 1;
+    }
+    size_t written = fwrite(data, 1, len, fp);
+    if ((fclose(fp) != 0) || (written != len) || (rename(tmp, path) != 0)) {
+        LT_LOG_WARN("Error writing cache file %s", path);
+        unlink(tmp);
+        return 1;
+    }
+
+    return 0;
+}
+
+size_t lt_key_cache_pubkey_len(uint8_t curve)
+{
+    return (curve == CURVE_P256) ? 64 : 32;
+}
+
+bool lt_key_cache_enabled(void)
+{
+    const char *on = getenv(LT_UTIL_KEY_CACHE_ENV);
+    const char *dir = getenv(LT_UTIL_CACHE_DIR_ENV);
+    return on && (strcmp(on, "1") == 0) && !(dir && (dir[0] == '\0'));
+}
+
+int lt_key_cache_load(lt_handle_t *h, struct lt_key_cache *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    memcpy(cache->magic, key_cache_magic, sizeof(key_cache_magic));
+    cache->version = LT_KEY_CACHE_VERSION;
+
+    char path[PATH_MAX];
+    if (lt_util_cache_path(h, "keys", path, sizeof(path)) != 0) {
+        return 1;
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 0;
+    }
+    struct lt_key_cache file;
+    size_t read = fread(&file, 1, sizeof(file), fp);
+    fclose(fp);
+
+    // Cache of other format or torn by a crash is the same as no cache
+    if (read == sizeof(file) && !memcmp(file.magic, key_cache_magic, sizeof(key_cache_magic))
+        && file.version == LT_KEY_CACHE_VERSION && file.crc == key_cache_crc(&file)) {
+        memcpy(cache, &file, sizeof(*cache));
+    } else {
+        LT_LOG_WARN("Ignoring invalid key cache %s", path);
+    }
+
+    return 0;
+}
+
+int lt_key_cache_save(lt_handle_t *h, struct lt_key_cache *cache)
+{
+    char path[PATH_MAX];
+    if (lt_util_cache_path(h, "keys", path, sizeof(path)) != 0) {
+        return 1;
+    }
+    cache->crc = key_cache_crc(cache);
+
+    return lt_util_cache_write(path, cache, sizeof(*cache));
+}
+
+int lt_key_cache_record(struct lt_key_cache *cache, uint8_t slot, lt_ret_t ret, const uint8_t *pubkey,
+                        lt_ecc_curve_type_t curve, ecc_key_origin_t origin)
+{
+    struct lt_key_cache_slot *s = &cache->slot[slot];
+
+    memset(s, 0, sizeof(*s));
+    if (ret == LT_OK) {
+        s->state = LT_KEY_CACHE_KEY;
+        s->curve = (uint8_t)curve;
+        s->origin = (uint8_t)origin;
+        memcpy(s->pubkey, pubkey, lt_key_cache_pubkey_len(s->curve));
+        return 0;
+    }
+    // Chip refuses to read a key from an empty slot
+    if (ret == LT_L3_ECC_INVALID_KEY || ret == LT_L3_FAIL) {
+        s->state = LT_KEY_CACHE_EMPTY;
+        return 0;
+    }
+
+    return 1;
+}
+
+void lt_key_cache_invalidate(lt_handle_t *h, uint8_t slot)
+{
+    struct lt_key_cache cache;
+
+    if (lt_key_cache_load(h, &cache) != 0 || cache.slot[slot].state == LT_KEY_CACHE_UNKNOWN) {
+        return;
+    }
+    memset(&cache.slot[slot], 0, sizeof(cache.slot[slot]));
+    lt_key_cache_save(h, &cache);
+}
@@ -0,0 +1,156 @@
+#ifndef KEY_CACHE_H
+#define KEY_CACHE_H
+
+/**
+ * @file key_cache.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Host side cache of public keys in ECC slots, one file per chip
+ *
+ * @details Public keys change only when lt-util generates, installs or clears a key, while they are read much more
+ * often. The cache keeps what lt_ecc_key_read() returned for each slot. With LT_UTIL_KEY_CACHE_ENV=1, lt-util -e -d
+ * is answered from it without a secure session, only serial number of the chip is read to find its cache file.
+ * Commands which change a slot mark it unknown, lt-util -e --list reads all slots again.
+ *
+ * Cache files are "<dir>/<serial>.keys", dir is LT_UTIL_CACHE_DIR_ENV, or "lt-util" in $XDG_CACHE_HOME or in
+ * ~/.cache. Empty LT_UTIL_CACHE_DIR_ENV disables the cache. A file is replaced atomically and carries CRC, a file
+ * which does not match is ignored.
+ *
+ * Keys changed by other hosts, or by other tools than lt-util, are not seen until the next lt-util -e --list.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libtropic.h"
+
+/** @brief Environment variable with directory of cache files, empty value disables the cache */
+#define LT_UTIL_CACHE_DIR_ENV "LT_UTIL_CACHE_DIR"
+/** @brief Environment variable which, set to 1, lets public keys be served from the cache instead of the chip */
+#define LT_UTIL_KEY_CACHE_ENV "LT_UTIL_KEY_CACHE"
+
+/** @brief Number of ECC slots */
+#define LT_KEY_CACHE_SLOTS 32
+/** @brief Number of R memory slots whose occupancy is recorded */
+#define LT_KEY_CACHE_R_MEM_SLOTS 512
+
+/** @brief State of a slot in struct lt_key_cache_slot */
+enum lt_key_cache_state {
+    LT_KEY_CACHE_UNKNOWN = 0, /**< Not read yet, or changed since */
+    LT_KEY_CACHE_EMPTY = 1,   /**< Slot holds no key */
+    LT_KEY_CACHE_KEY = 2,     /**< Slot holds the key below */
+};
+
+/** @brief One ECC slot as lt_ecc_key_read() returned it */
+struct lt_key_cache_slot {
+    uint8_t state;      /**< enum lt_key_cache_state */
+    uint8_t curve;      /**< lt_ecc_curve_type_t */
+    uint8_t origin;     /**< ecc_key_origin_t */
+    uint8_t reserved;
+    uint8_t pubkey[64]; /**< 32 B of Ed25519 key, 64 B of P256 key */
+} __attribute__((__packed__));
+
+/** @brief Content of a cache file */
+struct lt_key_cache {
+    uint8_t magic[4];
+    uint8_t version;
+    uint8_t r_mem_valid; /**< Set when r_mem holds result of a probe */
+    uint16_t reserved;
+    uint64_t r_mem_time; /**< Unix time of R memory probe, occupancy may have changed since */
+    struct lt_key_cache_slot slot[LT_KEY_CACHE_SLOTS];
+    uint8_t r_mem[LT_KEY_CACHE_R_MEM_SLOTS / 8]; /**< Bit set for occupied R memory slot */
+    uint32_t crc;
+} __attribute__((__packed__));
+
+/**
+ * @brief Path of a cache file which belongs to no chip, "<dir>/<name>"
+ *
+ * @param name        File name
+ * @param path        Filled with the path
+ * @param len         Size of path buffer
+ * @return int        0 if success, 1 if the cache is disabled
+ */
+int lt_util_cache_file(const char *name, char *path, size_t len);
+
+/**
+ * @brief Path of a cache file of the chip, "<dir>/<serial>.<ext>"
+ *
+ * @param h           Device's handle, the device is opened to read serial number if it is not open yet
+ * @param ext         Extension telling what is cached
+ * @param path        Filled with the path
+ * @param len         Size of path buffer
+ * @return int        0 if success, 1 if the cache is disabled or serial number can not be read
+ */
+int lt_util_cache_path(lt_handle_t *h, const char *ext, char *path, size_t len);
+
+/**
+ * @brief Replace a cache file atomically, its directory is created when missing
+ *
+ * @param path        Path from lt_util_cache_path()
+ * @param data        Content of the file
+ * @param len         Length of the content
+ * @return int        0 if success, otherwise 1
+ */
+int lt_util_cache_write(const char *path, const void *data, size_t len);
+
+/**
+ * @brief Tell whether public keys are served from the cache, by LT_UTIL_KEY_CACHE_ENV and by directory of cache files
+ *
+ * @details The cache is written by lt-util -e --list either way, it is only not used to answer commands.
+ *
+ * @return true       lt-util -e -d and -e --find take keys from the cache
+ */
+bool lt_key_cache_enabled(void);
+
+/**
+ * @brief Load cache of the chip, a chip without valid cache file gets all slots unknown
+ *
+ * @param h           Device's handle, the device is opened to read serial number if it is not open yet
+ * @param cache       Filled with the cache
+ * @return int        0 if success, 1 if the cache is disabled or serial number can not be read
+ */
+int lt_key_cache_load(lt_handle_t *h, struct lt_key_cache *cache);
+
+/**
+ * @brief Store cache of the chip
+ *
+ * @param h           Device's handle
+ * @param cache       Cache to store
+ * @return int        0 if success, otherwise 1
+ */
+int lt_key_cache_save(lt_handle_t *h, struct lt_key_cache *cache);
+
+/**
+ * @brief Record result of lt_ecc_key_read() of one slot
+ *
+ * @param cache       Cache
+ * @param slot        ECC slot
+ * @param ret         Result of lt_ecc_key_read()
+ * @param pubkey      Public key read
+ * @param curve       Curve read
+ * @param origin      Origin read
+ * @return int        0 if the result tells state of the slot, 1 if it is an error of communication
+ */
+int lt_key_cache_record(struct lt_key_cache *cache, uint8_t slot, lt_ret_t ret, const uint8_t *pubkey,
+                        lt_ecc_curve_type_t curve, ecc_key_origin_t origin);
+
+/**
+ * @brief Mark ECC slot unknown, called whenever a key may have changed
+ *
+ * @param h           Device's handle
+ * @param slot        ECC slot
+ */
+void lt_key_cache_invalidate(lt_handle_t *h, uint8_t slot);
+
+/**
+ * @brief Length of public key of the curve
+ *
+ * @param curve       Curve
+ * @return            64 for P256, otherwise 32
+ */
+size_t lt_key_cache_pubkey_len(uint8_t curve);
+
+#endif
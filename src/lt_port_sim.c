@@ -0,0 +1,123 @@
+/**
+ * @file lt_port_sim.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Implementation of libtropic_port.h, SPI transfers are passed byte by byte into the chip model.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "libtropic_port.h"
+#include "lt_port_sim.h"
+
+lt_ret_t lt_port_init(lt_l2_state_t *s2)
+{
+    struct lt_dev_sim *dev = (struct lt_dev_sim *)s2->device;
+
+    if (!dev->chip) {
+        dev->chip = calloc(1, sizeof(*dev->chip));
+        if (!dev->chip) {
+            return LT_FAIL;
+        }
+        dev->chip->state_path = dev->state_path;
+        if (dev->latency && sim_chip_latency_parse(dev->chip, dev->latency)) {
+            free(dev->chip);
+            dev->chip = NULL;
+            return LT_FAIL;
+        }
+    }
+
+    return sim_chip_power_up(dev->chip, dev->sh0pub) ? LT_FAIL : LT_OK;
+}
+
+lt_ret_t lt_port_deinit(lt_l2_state_t *s2)
+{
+    // Chip keeps running, the next lt_port_init() finds it as it was left
+    (void)s2;
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_csn_low(lt_l2_state_t *s2)
+{
+    struct lt_dev_sim *dev = (struct lt_dev_sim *)s2->device;
+    sim_chip_csn_low(dev->chip);
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_csn_high(lt_l2_state_t *s2)
+{
+    struct lt_dev_sim *dev = (struct lt_dev_sim *)s2->device;
+    sim_chip_csn_high(dev->chip);
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_transfer(lt_l2_state_t *s2, uint8_t offset, uint16_t tx_data_length, uint32_t timeout)
+{
+    struct lt_dev_sim *dev = (struct lt_dev_sim *)s2->device;
+    (void)timeout;
+
+    if (offset + tx_data_length > sizeof(s2->buff)) {
+        return LT_L1_DATA_LEN_ERROR;
+    }
+    sim_chip_transfer(dev->chip, s2->buff + offset, tx_data_length);
+    if (offset == 0) {
+        lt_timing_poll_frame(&dev->poll, dev->chip->get_response);
+    }
+
+    // Bus clocked faster than it can carry flips a bit of what the host receives
+    if (dev->spi_max_hz && (dev->spi_speed > dev->spi_max_hz) && tx_data_length) {
+        s2->buff[offset + (size_t)rand() % tx_data_length] ^= (uint8_t)(1u << (rand() % 8));
+    }
+    return LT_OK;
+}
+
+lt_ret_t lt_port_delay(lt_l2_state_t *s2, uint32_t ms)
+{
+    struct lt_dev_sim *dev = (struct lt_dev_sim *)s2->device;
+    lt_timing_delay(&dev->poll, ms);
+    return LT_OK;
+}
+
+#ifdef LT_USE_INT_PIN
+lt_ret_t lt_port_delay_on_int(lt_l2_state_t *s2, uint32_t ms)
+{
+    // Interrupt pin of the model rises as soon as the response is available
+    struct lt_dev_sim *dev = (struct lt_dev_sim *)s2->device;
+    uint64_t now = lt_timing_now_ns();
+    uint64_t until = now + ms * 1000000ull;
+    if (dev->chip->frame_len && dev->chip->frame_ready_ns < until) {
+        until = dev->chip->frame_ready_ns;
+    }
+    if (until > now) {
+        lt_timing_sleep_us((uint32_t)((until - now + 999) / 1000));
+    }
+    return LT_OK;
+}
+#endif
+
+lt_ret_t lt_port_random_bytes(lt_l2_state_t *s2, void *buff, size_t count)
+{
+    (void)s2;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return LT_FAIL;
+    }
+    uint8_t *p = buff;
+    while (count) {
+        ssize_t n = read(fd, p, count);
+        if (n <= 0) {
+            close(fd);
+            return LT_FAIL;
+        }
+        p += n;
+        count -= (size_t)n;
+    }
+    close(fd);
+    return LT_OK;
+}
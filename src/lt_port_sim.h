@@ -0,0 +1,43 @@
+#ifndef LT_PORT_SIM_H
+#define LT_PORT_SIM_H
+
+/**
+ * @file lt_port_sim.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief libtropic HAL port which talks to simulated TROPIC01 in the same process (SIMULATOR build)
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdint.h>
+
+#include "sim_chip.h"
+#include "timing.h"
+
+/** @brief Environment variable with path of file keeping non volatile content of simulated chip */
+#define LT_SIM_STATE_ENV   "LT_SIM_STATE"
+/** @brief Environment variable with latency of operations, see sim_chip_latency_parse() */
+#define LT_SIM_LATENCY_ENV "LT_SIM_LATENCY"
+/** @brief Environment variable with the fastest SPI clock in Hz the simulated bus transfers without errors */
+#define LT_SIM_SPI_MAX_HZ_ENV "LT_SIM_SPI_MAX_HZ"
+
+/** @brief Device description of simulated chip */
+struct lt_dev_sim {
+    /** @brief Public pairing key provisioned into slot 0 when a new chip is created */
+    uint8_t sh0pub[32];
+    /** @brief State file, NULL keeps chip only in memory of this process */
+    const char *state_path;
+    /** @brief Latency specification, NULL for chip which responds immediately */
+    const char *latency;
+    /** @brief SPI clock in Hz, as lt_dev_unix_spi_t has it */
+    uint32_t spi_speed;
+    /** @brief Above this clock one received byte of every transfer is damaged, 0 for a bus without errors */
+    uint32_t spi_max_hz;
+    /** @brief Chip created by the first lt_port_init(), it lives as long as the process */
+    struct sim_chip *chip;
+    /** @brief Polls of chip status for the current response */
+    struct lt_timing_poll poll;
+};
+
+#endif
@@ -0,0 +1,419 @@
+/**
+ * @file lt_port_spi_ioc.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Implementation of libtropic_port.h for SPI and GPIO Linux UAPI, see lt_port_spi_ioc.h.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+#include <linux/spi/spidev.h>
+
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "libtropic_port.h"
+#include "lt_port_spi_ioc.h"
+
+// L1 request which reads chip status and then the response
+#define SPI_IOC_GET_RESPONSE 0xAA
+// Chip status, L2 status and length of response
+#define SPI_IOC_HEADER_LEN   3
+// CRC which follows data of response
+#define SPI_IOC_CRC_LEN      2
+
+static bool spi_ioc_native(const struct lt_dev_spi_ioc *dev)
+{
+    return dev->gpio_cs_num == LT_SPI_IOC_CS_NATIVE;
+}
+
+static lt_ret_t spi_ioc_cs(struct lt_dev_spi_ioc *dev, bool high)
+{
+    struct gpio_v2_line_values values = {.bits = high ? 1 : 0, .mask = 1};
+    dev->stats.cs_sets++;
+    if (ioctl(dev->gpio_fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &values) < 0) {
+        LT_LOG_ERROR("Error setting chip select: %s", strerror(errno));
+        return LT_L1_SPI_ERROR;
+    }
+    return LT_OK;
+}
+
+// Sends pending chip select low and chained transfers as one message, hold keeps native chip select active after
+// it. Empty chain only releases native chip select.
+static lt_ret_t spi_ioc_flush(struct lt_dev_spi_ioc *dev, uint8_t *buff, bool hold)
+{
+    bool native = spi_ioc_native(dev);
+    if (dev->csn_pending) {
+        dev->csn_pending = false;
+        if (!native) {
+            lt_ret_t ret = spi_ioc_cs(dev, false);
+            if (ret != LT_OK) {
+                dev->chain_len = 0;
+                return ret;
+            }
+        }
+    }
+
+    struct spi_ioc_transfer tr[LT_SPI_IOC_CHAIN_MAX];
+    memset(tr, 0, sizeof(tr));
+    unsigned n = dev->chain_len;
+    for (unsigned i = 0; i < n; i++) {
+        tr[i].tx_buf = (uintptr_t)(buff + dev->chain[i].offset);
+        tr[i].rx_buf = (uintptr_t)(buff + dev->chain[i].offset);
+        tr[i].len = dev->chain[i].len;
+        tr[i].speed_hz = dev->spi_speed;
+        tr[i].bits_per_word = 8;
+        dev->stats.bytes += dev->chain[i].len;
+    }
+    dev->chain_len = 0;
+    if (n == 0) {
+        // Transfer without data, controller releases chip select at its end
+        tr[0].speed_hz = dev->spi_speed;
+        n = 1;
+    }
+    // On the last transfer of a message cs_change means chip select stays active until the next message
+    tr[n - 1].cs_change = native && hold;
+
+    dev->stats.messages++;
+    if (ioctl(dev->spi_fd, SPI_IOC_MESSAGE(n), tr) < 0) {
+        LT_LOG_ERROR("Error SPI transfer: %s", strerror(errno));
+        dev->cs_held = false;
+        return LT_L1_SPI_ERROR;
+    }
+    dev->cs_held = native && hold;
+
+    return LT_OK;
+}
+
+static lt_ret_t spi_ioc_chain(struct lt_dev_spi_ioc *dev, uint8_t *buff, uint16_t offset, uint16_t len)
+{
+    if (dev->chain_len == LT_SPI_IOC_CHAIN_MAX) {
+        lt_ret_t ret = spi_ioc_flush(dev, buff, true);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+    dev->chain[dev->chain_len].offset = offset;
+    dev->chain[dev->chain_len].len = len;
+    dev->chain_len++;
+    return LT_OK;
+}
+
+static void spi_ioc_close(struct lt_dev_spi_ioc *dev)
+{
+    if (dev->epoll_fd >= 0) {
+        close(dev->epoll_fd);
+        dev->epoll_fd = -1;
+    }
+    if (dev->int_fd >= 0) {
+        close(dev->int_fd);
+        dev->int_fd = -1;
+    }
+    if (dev->gpio_fd >= 0) {
+        close(dev->gpio_fd);
+        dev->gpio_fd = -1;
+    }
+    if (dev->spi_fd >= 0) {
+        close(dev->spi_fd);
+        dev->spi_fd = -1;
+    }
+}
+
+// Chip select line as output, inactive (high)
+static int spi_ioc_request_cs(struct lt_dev_spi_ioc *dev)
+{
+    int chip_fd = open(dev->gpio_dev, O_RDWR | O_CLOEXEC);
+    if (chip_fd < 0) {
+        LT_LOG_ERROR("Error opening %s: %s", dev->gpio_dev, strerror(errno));
+        return 1;
+    }
+
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = (uint32_t)dev->gpio_cs_num;
+    req.num_lines = 1;
+    strncpy(req.consumer, "lt-util", sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values = 1;
+    req.config.attrs[0].mask = 1;
+
+    int ret = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip_fd);
+    if (ret < 0) {
+        LT_LOG_ERROR("Error requesting GPIO %d of %s: %s", dev->gpio_cs_num, dev->gpio_dev, strerror(errno));
+        return 1;
+    }
+    dev->gpio_fd = req.fd;
+
+    return 0;
+}
+
+#ifdef LT_USE_INT_PIN
+// Rising edge of interrupt pin as event, failure leaves libtropic polling
+static void spi_ioc_request_int(struct lt_dev_spi_ioc *dev)
+{
+    int chip_fd = open(dev->gpio_dev, O_RDWR | O_CLOEXEC);
+    if (chip_fd < 0) {
+        LT_LOG_WARN("Error opening %s: %s, polling chip status instead", dev->gpio_dev, strerror(errno));
+        return;
+    }
+
+    struct gpio_v2_line_request req;
+    memset(&req, 0, sizeof(req));
+    req.offsets[0] = (uint32_t)dev->gpio_int_num;
+    req.num_lines = 1;
+    strncpy(req.consumer, "lt-util", sizeof(req.consumer) - 1);
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING;
+    req.event_buffer_size = 16;
+
+    int ret = ioctl(chip_fd, GPIO_V2_GET_LINE_IOCTL, &req);
+    close(chip_fd);
+    if (ret < 0) {
+        LT_LOG_WARN("Error requesting interrupt GPIO %d of %s: %s, polling chip status instead", dev->gpio_int_num,
+                    dev->gpio_dev, strerror(errno));
+        return;
+    }
+    dev->int_fd = req.fd;
+
+    // Events are drained without blocking before every wait
+    struct epoll_event ev = {.events = EPOLLIN};
+    dev->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if ((fcntl(dev->int_fd, F_SETFL, O_NONBLOCK) < 0) || (dev->epoll_fd < 0)
+        || (epoll_ctl(dev->epoll_fd, EPOLL_CTL_ADD, dev->int_fd, &ev) < 0)) {
+        LT_LOG_WARN("Error waiting for interrupt GPIO %d: %s, polling chip status instead", dev->gpio_int_num,
+                    strerror(errno));
+        if (dev->epoll_fd >= 0) {
+            close(dev->epoll_fd);
+            dev->epoll_fd = -1;
+        }
+        close(dev->int_fd);
+        dev->int_fd = -1;
+    }
+}
+#endif
+
+lt_ret_t lt_port_init(lt_l2_state_t *s2)
+{
+    struct lt_dev_spi_ioc *dev = (struct lt_dev_spi_ioc *)s2->device;
+
+    dev->gpio_fd = -1;
+    dev->int_fd = -1;
+    dev->epoll_fd = -1;
+    dev->csn_pending = false;
+    dev->cs_held = false;
+    dev->chain_len = 0;
+    dev->ahead_len = 0;
+    dev->spi_fd = open(dev->spi_dev, O_RDWR | O_CLOEXEC);
+    if (dev->spi_fd < 0) {
+        LT_LOG_ERROR("Error opening %s: %s", dev->spi_dev, strerror(errno));
+        return LT_FAIL;
+    }
+
+    uint8_t mode = SPI_MODE_0;
+    uint8_t bits = 8;
+    if ((ioctl(dev->spi_fd, SPI_IOC_WR_MODE, &mode) < 0) || (ioctl(dev->spi_fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0)
+        || (ioctl(dev->spi_fd, SPI_IOC_WR_MAX_SPEED_HZ, &dev->spi_speed) < 0)) {
+        LT_LOG_ERROR("Error setting up %s: %s", dev->spi_dev, strerror(errno));
+        spi_ioc_close(dev);
+        return LT_FAIL;
+    }
+
+    if (!spi_ioc_native(dev) && (spi_ioc_request_cs(dev) != 0)) {
+        spi_ioc_close(dev);
+        return LT_FAIL;
+    }
+#ifdef LT_USE_INT_PIN
+    if (dev->gpio_int_num != LT_SPI_IOC_INT_NONE) {
+        spi_ioc_request_int(dev);
+    }
+#endif
+
+    return LT_OK;
+}
+
+lt_ret_t lt_port_deinit(lt_l2_state_t *s2)
+{
+    spi_ioc_close((struct lt_dev_spi_ioc *)s2->device);
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_csn_low(lt_l2_state_t *s2)
+{
+    // Goes out with the first message of the frame
+    struct lt_dev_spi_ioc *dev = (struct lt_dev_spi_ioc *)s2->device;
+    dev->csn_pending = true;
+    dev->chain_len = 0;
+    dev->ahead_len = 0;
+    dev->response_end = 0;
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_csn_high(lt_l2_state_t *s2)
+{
+    struct lt_dev_spi_ioc *dev = (struct lt_dev_spi_ioc *)s2->device;
+    bool native = spi_ioc_native(dev);
+    lt_ret_t ret = LT_OK;
+
+    if (dev->chain_len || dev->cs_held) {
+        ret = spi_ioc_flush(dev, s2->buff, false);
+    } else if (dev->csn_pending && !native) {
+        // Frame without any transfer
+        ret = spi_ioc_cs(dev, false);
+    }
+    dev->csn_pending = false;
+    dev->chain_len = 0;
+    dev->ahead_len = 0;
+
+    if (!native) {
+        lt_ret_t cs_ret = spi_ioc_cs(dev, true);
+        if (ret == LT_OK) {
+            ret = cs_ret;
+        }
+    }
+    dev->stats.frames++;
+
+    return ret;
+}
+
+lt_ret_t lt_port_spi_transfer(lt_l2_state_t *s2, uint8_t offset, uint16_t tx_data_length, uint32_t timeout)
+{
+    struct lt_dev_spi_ioc *dev = (struct lt_dev_spi_ioc *)s2->device;
+    (void)timeout;
+
+    if ((size_t)offset + tx_data_length > sizeof(s2->buff)) {
+        return LT_L1_DATA_LEN_ERROR;
+    }
+
+    // Taken from what the header of response brought along
+    uint16_t pos = offset;
+    uint16_t len = tx_data_length;
+    if (dev->ahead_len) {
+        uint16_t n = (len < dev->ahead_len) ? len : dev->ahead_len;
+        if (dev->ahead_offset != pos) {
+            memmove(s2->buff + pos, s2->buff + dev->ahead_offset, n);
+        }
+        dev->ahead_offset += n;
+        dev->ahead_len -= n;
+        pos += n;
+        len -= n;
+        if (len == 0) {
+            return LT_OK;
+        }
+    }
+
+    bool first = dev->csn_pending && (dev->chain_len == 0);
+    if (first) {
+        lt_timing_poll_frame(&dev->poll, s2->buff[pos] == SPI_IOC_GET_RESPONSE);
+    }
+    if (first && (s2->buff[pos] == SPI_IOC_GET_RESPONSE) && (len == 1)
+        && ((size_t)pos + SPI_IOC_HEADER_LEN <= sizeof(s2->buff))) {
+        // L2 status and length are clocked in now, libtropic asks for them next when the chip is ready
+        lt_ret_t ret = spi_ioc_chain(dev, s2->buff, pos, SPI_IOC_HEADER_LEN);
+        if (ret == LT_OK) {
+            ret = spi_ioc_flush(dev, s2->buff, true);
+        }
+        if (ret != LT_OK) {
+            return ret;
+        }
+        dev->ahead_offset = pos + 1;
+        dev->ahead_len = SPI_IOC_HEADER_LEN - 1;
+        dev->response_end = pos + SPI_IOC_HEADER_LEN + s2->buff[pos + 2] + SPI_IOC_CRC_LEN;
+        return LT_OK;
+    }
+
+    lt_ret_t ret = spi_ioc_chain(dev, s2->buff, pos, len);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    if (dev->response_end) {
+        // Response is read now, the transfer which completes it releases chip select
+        return spi_ioc_flush(dev, s2->buff, pos + len != dev->response_end);
+    }
+    // Request, received bytes are not read by libtropic, so it goes out at chip select high
+    return LT_OK;
+}
+
+lt_ret_t lt_port_delay(lt_l2_state_t *s2, uint32_t ms)
+{
+    struct lt_dev_spi_ioc *dev = (struct lt_dev_spi_ioc *)s2->device;
+    lt_timing_delay(&dev->poll, ms);
+    return LT_OK;
+}
+
+#ifdef LT_USE_INT_PIN
+// Edges queued before now belong to responses which were already read
+static void spi_ioc_int_drain(struct lt_dev_spi_ioc *dev)
+{
+    struct gpio_v2_line_event events[4];
+    ssize_t n;
+    do {
+        dev->stats.int_calls++;
+        n = read(dev->int_fd, events, sizeof(events));
+    } while (n == (ssize_t)sizeof(events));
+}
+
+lt_ret_t lt_port_delay_on_int(lt_l2_state_t *s2, uint32_t ms)
+{
+    struct lt_dev_spi_ioc *dev = (struct lt_dev_spi_ioc *)s2->device;
+    if (dev->int_fd < 0) {
+        return lt_port_delay(s2, ms);
+    }
+
+    spi_ioc_int_drain(dev);
+
+    // Pin which is already up has no edge to wait for
+    struct gpio_v2_line_values values = {.mask = 1};
+    dev->stats.int_calls++;
+    if ((ioctl(dev->int_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) == 0) && (values.bits & 1)) {
+        return LT_OK;
+    }
+
+    struct epoll_event ev;
+    int ret;
+    do {
+        dev->stats.int_calls++;
+        ret = epoll_wait(dev->epoll_fd, &ev, 1, (int)ms);
+    } while ((ret < 0) && (errno == EINTR));
+
+    if (ret > 0) {
+        spi_ioc_int_drain(dev);
+    } else if (ret == 0) {
+        // libtropic polls chip status anyway
+        dev->stats.int_timeouts++;
+    } else {
+        LT_LOG_WARN("Error waiting for interrupt GPIO %d: %s", dev->gpio_int_num, strerror(errno));
+        return lt_port_delay(s2, ms);
+    }
+
+    return LT_OK;
+}
+#endif
+
+lt_ret_t lt_port_random_bytes(lt_l2_state_t *s2, void *buff, size_t count)
+{
+    (void)s2;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return LT_FAIL;
+    }
+    uint8_t *p = buff;
+    while (count) {
+        ssize_t n = read(fd, p, count);
+        if (n <= 0) {
+            close(fd);
+            return LT_FAIL;
+        }
+        p += n;
+        count -= (size_t)n;
+    }
+    close(fd);
+    return LT_OK;
+}
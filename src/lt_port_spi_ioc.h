@@ -0,0 +1,101 @@
+#ifndef LT_PORT_SPI_IOC_H
+#define LT_PORT_SPI_IOC_H
+
+/**
+ * @file lt_port_spi_ioc.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief libtropic HAL port for SPI and GPIO Linux UAPI with fewer system calls (LINUX_SPI_IOC build)
+ *
+ * @details Talks to the chip as lt_port_unix_spi.c of libtropic does, but every ioctl() carries as much of the L1
+ * frame as is known at that moment:
+ *
+ * - chip select low is sent with the first SPI message of the frame
+ * - transfers of a request frame, whose received bytes libtropic does not read, are chained into one
+ *   SPI_IOC_MESSAGE(n) sent at chip select high
+ * - GET_RESPONSE clocks in L2 status and length together with chip status, so a response takes one message for
+ *   its header and one for the rest
+ * - with the controller's own chip select (LT_SPI_IOC_CS_NATIVE) no GPIO ioctl is needed at all, the controller
+ *   keeps chip select active between messages of one frame and releases it with the last one
+ *
+ * Native chip select works only on boards which wire CSN of TROPIC01 to a chip select of the SPI controller, RPi
+ * shield uses GPIO 25 instead.
+ *
+ * With LT_USE_INT_PIN libtropic waits in lt_port_delay_on_int() between polls of chip status. When the interrupt pin
+ * of TROPIC01 is wired to a GPIO line (gpio_int_num), its rising edge is waited for in epoll_wait(), so the next poll
+ * comes as soon as the response is ready. Without the line, or when the wait times out, lt_port_delay_on_int() just
+ * returns and libtropic keeps polling.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "timing.h"
+
+/** @brief Longest path of spidev and gpiochip */
+#define LT_SPI_IOC_PATH_LEN_MAX 256
+
+/** @brief Value of gpio_cs_num which leaves chip select to the SPI controller */
+#define LT_SPI_IOC_CS_NATIVE -1
+
+/** @brief Value of gpio_int_num when interrupt pin is not wired */
+#define LT_SPI_IOC_INT_NONE -1
+
+/** @brief Transfers chained into one SPI_IOC_MESSAGE(n) at most */
+#define LT_SPI_IOC_CHAIN_MAX 4
+
+/** @brief Counters of system calls, reset by the caller whenever it wants */
+struct lt_spi_ioc_stats {
+    /** @brief SPI_IOC_MESSAGE ioctls */
+    uint64_t messages;
+    /** @brief GPIO_V2_LINE_SET_VALUES ioctls */
+    uint64_t cs_sets;
+    /** @brief L1 frames, chip select low to high */
+    uint64_t frames;
+    uint64_t bytes;
+    /** @brief System calls spent waiting for interrupt pin */
+    uint64_t int_calls;
+    /** @brief Waits for interrupt pin which ran out of time */
+    uint64_t int_timeouts;
+};
+
+/** @brief Device description, fields of lt_dev_unix_spi_t come first under the same names */
+struct lt_dev_spi_ioc {
+    char gpio_dev[LT_SPI_IOC_PATH_LEN_MAX];
+    char spi_dev[LT_SPI_IOC_PATH_LEN_MAX];
+    uint32_t spi_speed;
+    /** @brief GPIO line of chip select, LT_SPI_IOC_CS_NATIVE for chip select of the controller */
+    int gpio_cs_num;
+    int spi_fd;
+    /** @brief File of the requested GPIO line */
+    int gpio_fd;
+    /** @brief GPIO line of interrupt pin, LT_SPI_IOC_INT_NONE when it is not wired (LT_USE_INT_PIN) */
+    int gpio_int_num;
+    /** @brief File of the requested interrupt line and epoll instance waiting on it, -1 when not used */
+    int int_fd;
+    int epoll_fd;
+
+    /** @brief Chip select low is sent with the next message */
+    bool csn_pending;
+    /** @brief Native chip select is kept active after the last message */
+    bool cs_held;
+    /** @brief Transfers waiting for chip select high, as offset and length within the L2 buffer */
+    struct {
+        uint16_t offset;
+        uint16_t len;
+    } chain[LT_SPI_IOC_CHAIN_MAX];
+    uint8_t chain_len;
+    /** @brief Bytes clocked in ahead of the transfer which asks for them, at ahead_offset of the L2 buffer */
+    uint16_t ahead_offset;
+    uint16_t ahead_len;
+    /** @brief Bytes of the response announced by its header, counted from the start of the frame */
+    uint16_t response_end;
+    /** @brief Polls of chip status for the current response */
+    struct lt_timing_poll poll;
+
+    struct lt_spi_ioc_stats stats;
+};
+
+#endif
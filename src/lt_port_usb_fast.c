@@ -0,0 +1,359 @@
+/**
+ * @file lt_port_usb_fast.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Implementation of libtropic_port.h for TS1301/TS1302 USB dongle, see lt_port_usb_fast.h.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "libtropic_port.h"
+#include "lt_port_usb_fast.h"
+
+static const char usb_fast_csn_low[] = "CS=0\n";
+static const char usb_fast_csn_high[] = "CS=1\n";
+static const char usb_fast_ok[] = "OK\r\n";
+static const char usb_fast_hex[] = "0123456789ABCDEF";
+
+#define USB_FAST_CMD_LEN (sizeof(usb_fast_csn_low) - 1)
+#define USB_FAST_OK_LEN  (sizeof(usb_fast_ok) - 1)
+
+#define USB_FAST_GET_RESPONSE 0xAA
+
+// Chip select, hexadecimal frame and "x\n"
+#define USB_FAST_TX_MAX (USB_FAST_CMD_LEN + 2 * sizeof(((lt_l2_state_t *)0)->buff) + 2)
+// "OK\r\n", hexadecimal frame and "\r\n"
+#define USB_FAST_RX_MAX (USB_FAST_OK_LEN + 2 * sizeof(((lt_l2_state_t *)0)->buff) + 2)
+
+static const struct {
+    uint32_t baud;
+    speed_t speed;
+} usb_fast_bauds[] = {
+#ifdef B4000000
+    {4000000, B4000000},
+#endif
+#ifdef B3000000
+    {3000000, B3000000},
+#endif
+#ifdef B2000000
+    {2000000, B2000000},
+#endif
+#ifdef B1000000
+    {1000000, B1000000},
+#endif
+#ifdef B921600
+    {921600, B921600},
+#endif
+#ifdef B460800
+    {460800, B460800},
+#endif
+    {230400, B230400},
+    {115200, B115200},
+    {57600, B57600},
+    {9600, B9600},
+};
+#define USB_FAST_BAUDS_COUNT (sizeof(usb_fast_bauds) / sizeof(usb_fast_bauds[0]))
+
+static int8_t usb_fast_nibble(uint8_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return (int8_t)(c - '0');
+    }
+    if (c >= 'A' && c <= 'F') {
+        return (int8_t)(c - 'A' + 10);
+    }
+    if (c >= 'a' && c <= 'f') {
+        return (int8_t)(c - 'a' + 10);
+    }
+    return -1;
+}
+
+static uint64_t usb_fast_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+// Time len bytes take on the wire (8N1) plus time the dongle has to answer
+static uint32_t usb_fast_timeout_ms(const struct lt_dev_usb_fast *dev, size_t len)
+{
+    uint32_t baud = dev->baud_rate ? dev->baud_rate : 9600;
+    return LT_USB_FAST_TIMEOUT_MS + (uint32_t)((len * 10u * 1000u + baud - 1) / baud);
+}
+
+static lt_ret_t usb_fast_write(struct lt_dev_usb_fast *dev, const uint8_t *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = write(dev->fd, buf, len);
+        dev->stats.writes++;
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return LT_L1_SPI_ERROR;
+        }
+        dev->stats.bytes_out += (uint64_t)n;
+        buf += n;
+        len -= (size_t)n;
+    }
+    return LT_OK;
+}
+
+// Reads exactly len bytes, waiting in poll() until they arrive or time runs out
+static lt_ret_t usb_fast_read(struct lt_dev_usb_fast *dev, uint8_t *buf, size_t len, uint32_t timeout_ms)
+{
+    uint64_t deadline = usb_fast_now_ms() + timeout_ms;
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(dev->fd, buf + got, len - got);
+        dev->stats.reads++;
+        if (n > 0) {
+            dev->stats.bytes_in += (uint64_t)n;
+            got += (size_t)n;
+            continue;
+        }
+        if ((n < 0) && (errno != EINTR) && (errno != EAGAIN)) {
+            return LT_L1_SPI_ERROR;
+        }
+
+        uint64_t now = usb_fast_now_ms();
+        if (now >= deadline) {
+            return LT_L1_SPI_ERROR;
+        }
+        struct pollfd pfd = {.fd = dev->fd, .events = POLLIN};
+        int ret = poll(&pfd, 1, (int)(deadline - now));
+        dev->stats.polls++;
+        if ((ret < 0) && (errno != EINTR)) {
+            return LT_L1_SPI_ERROR;
+        }
+        if ((ret > 0) && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+            return LT_L1_SPI_ERROR;
+        }
+    }
+    return LT_OK;
+}
+
+static lt_ret_t usb_fast_command(struct lt_dev_usb_fast *dev, const char *cmd)
+{
+    uint8_t ok[USB_FAST_OK_LEN];
+    lt_ret_t ret = usb_fast_write(dev, (const uint8_t *)cmd, USB_FAST_CMD_LEN);
+    if (ret == LT_OK) {
+        ret = usb_fast_read(dev, ok, sizeof(ok), usb_fast_timeout_ms(dev, USB_FAST_CMD_LEN + sizeof(ok)));
+    }
+    if ((ret == LT_OK) && (memcmp(ok, usb_fast_ok, sizeof(ok)) != 0)) {
+        ret = LT_L1_SPI_ERROR;
+    }
+    return ret;
+}
+
+static int usb_fast_set_speed(struct lt_dev_usb_fast *dev, speed_t speed)
+{
+    struct termios tty;
+    if (tcgetattr(dev->fd, &tty) != 0) {
+        return 1;
+    }
+    // Raw bytes, read() returns what is there and poll() does the waiting
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    if ((cfsetispeed(&tty, speed) != 0) || (cfsetospeed(&tty, speed) != 0)) {
+        return 1;
+    }
+    if (tcsetattr(dev->fd, TCSANOW, &tty) != 0) {
+        return 1;
+    }
+    tcflush(dev->fd, TCIOFLUSH);
+    return 0;
+}
+
+// Fastest rate at which the dongle answers chip select high
+static lt_ret_t usb_fast_probe_baud(struct lt_dev_usb_fast *dev)
+{
+    for (size_t i = 0; i < USB_FAST_BAUDS_COUNT; i++) {
+        if (usb_fast_set_speed(dev, usb_fast_bauds[i].speed) != 0) {
+            continue;
+        }
+        dev->baud_rate = usb_fast_bauds[i].baud;
+        if (usb_fast_command(dev, usb_fast_csn_high) == LT_OK) {
+            LT_LOG_INFO("USB dongle answers at %u baud", (unsigned)dev->baud_rate);
+            return LT_OK;
+        }
+    }
+    dev->baud_rate = LT_USB_FAST_BAUD_AUTO;
+    LT_LOG_ERROR("USB dongle %s does not answer at any baud rate", dev->dev_path);
+    return LT_L1_SPI_ERROR;
+}
+
+lt_ret_t lt_port_init(lt_l2_state_t *s2)
+{
+    struct lt_dev_usb_fast *dev = (struct lt_dev_usb_fast *)s2->device;
+
+    dev->csn_pending = false;
+    dev->fd = open(dev->dev_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (dev->fd < 0) {
+        LT_LOG_ERROR("Error opening %s: %s", dev->dev_path, strerror(errno));
+        return LT_FAIL;
+    }
+
+#ifdef __linux__
+    // USB serial converters otherwise hold received bytes back for up to 16 ms
+    struct serial_struct serial;
+    if (ioctl(dev->fd, TIOCGSERIAL, &serial) == 0) {
+        serial.flags |= ASYNC_LOW_LATENCY;
+        ioctl(dev->fd, TIOCSSERIAL, &serial);
+    }
+#endif
+
+    if (dev->baud_rate == LT_USB_FAST_BAUD_AUTO) {
+        if (usb_fast_probe_baud(dev) != LT_OK) {
+            close(dev->fd);
+            dev->fd = -1;
+            return LT_FAIL;
+        }
+        return LT_OK;
+    }
+
+    for (size_t i = 0; i < USB_FAST_BAUDS_COUNT; i++) {
+        if (usb_fast_bauds[i].baud == dev->baud_rate) {
+            if (usb_fast_set_speed(dev, usb_fast_bauds[i].speed) == 0) {
+                return LT_OK;
+            }
+            break;
+        }
+    }
+    LT_LOG_ERROR("Baud rate %u is not supported on %s", (unsigned)dev->baud_rate, dev->dev_path);
+    close(dev->fd);
+    dev->fd = -1;
+    return LT_FAIL;
+}
+
+lt_ret_t lt_port_deinit(lt_l2_state_t *s2)
+{
+    struct lt_dev_usb_fast *dev = (struct lt_dev_usb_fast *)s2->device;
+    if (dev->fd >= 0) {
+        close(dev->fd);
+        dev->fd = -1;
+    }
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_csn_low(lt_l2_state_t *s2)
+{
+    // Goes out with the transfer which follows
+    struct lt_dev_usb_fast *dev = (struct lt_dev_usb_fast *)s2->device;
+    dev->csn_pending = true;
+    return LT_OK;
+}
+
+lt_ret_t lt_port_spi_csn_high(lt_l2_state_t *s2)
+{
+    struct lt_dev_usb_fast *dev = (struct lt_dev_usb_fast *)s2->device;
+    if (dev->csn_pending) {
+        dev->csn_pending = false;
+        lt_ret_t ret = usb_fast_command(dev, usb_fast_csn_low);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+    return usb_fast_command(dev, usb_fast_csn_high);
+}
+
+lt_ret_t lt_port_spi_transfer(lt_l2_state_t *s2, uint8_t offset, uint16_t tx_data_length, uint32_t timeout)
+{
+    struct lt_dev_usb_fast *dev = (struct lt_dev_usb_fast *)s2->device;
+    uint8_t tx[USB_FAST_TX_MAX];
+    uint8_t rx[USB_FAST_RX_MAX];
+    (void)timeout;
+
+    if ((size_t)offset + tx_data_length > sizeof(s2->buff)) {
+        return LT_L1_DATA_LEN_ERROR;
+    }
+
+    // One write carries pending chip select and the whole frame, responses to both are read at once
+    size_t tx_len = 0;
+    size_t rx_len = 2 * (size_t)tx_data_length + 2;
+    size_t ok_len = 0;
+    if (dev->csn_pending) {
+        lt_timing_poll_frame(&dev->poll, tx_data_length && (s2->buff[offset] == USB_FAST_GET_RESPONSE));
+        memcpy(tx, usb_fast_csn_low, USB_FAST_CMD_LEN);
+        tx_len = USB_FAST_CMD_LEN;
+        ok_len = USB_FAST_OK_LEN;
+        dev->csn_pending = false;
+    }
+    const uint8_t *data = s2->buff + offset;
+    for (uint16_t i = 0; i < tx_data_length; i++) {
+        tx[tx_len++] = usb_fast_hex[data[i] >> 4];
+        tx[tx_len++] = usb_fast_hex[data[i] & 0x0f];
+    }
+    tx[tx_len++] = 'x';
+    tx[tx_len++] = '\n';
+
+    lt_ret_t ret = usb_fast_write(dev, tx, tx_len);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    ret = usb_fast_read(dev, rx, ok_len + rx_len, usb_fast_timeout_ms(dev, tx_len + ok_len + rx_len));
+    if (ret != LT_OK) {
+        return ret;
+    }
+    if (ok_len && (memcmp(rx, usb_fast_ok, ok_len) != 0)) {
+        return LT_L1_SPI_ERROR;
+    }
+
+    const uint8_t *hex = rx + ok_len;
+    uint8_t *out = s2->buff + offset;
+    for (uint16_t i = 0; i < tx_data_length; i++) {
+        int8_t hi = usb_fast_nibble(hex[2 * i]);
+        int8_t lo = usb_fast_nibble(hex[2 * i + 1]);
+        if ((hi < 0) || (lo < 0)) {
+            return LT_L1_SPI_ERROR;
+        }
+        out[i] = (uint8_t)((hi << 4) | lo);
+    }
+
+    return LT_OK;
+}
+
+lt_ret_t lt_port_delay(lt_l2_state_t *s2, uint32_t ms)
+{
+    struct lt_dev_usb_fast *dev = (struct lt_dev_usb_fast *)s2->device;
+    lt_timing_delay(&dev->poll, ms);
+    return LT_OK;
+}
+
+lt_ret_t lt_port_random_bytes(lt_l2_state_t *s2, void *buff, size_t count)
+{
+    (void)s2;
+    int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return LT_FAIL;
+    }
+    uint8_t *p = buff;
+    while (count) {
+        ssize_t n = read(fd, p, count);
+        if (n <= 0) {
+            close(fd);
+            return LT_FAIL;
+        }
+        p += n;
+        count -= (size_t)n;
+    }
+    close(fd);
+    return LT_OK;
+}
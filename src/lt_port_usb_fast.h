@@ -0,0 +1,57 @@
+#ifndef LT_PORT_USB_FAST_H
+#define LT_PORT_USB_FAST_H
+
+/**
+ * @file lt_port_usb_fast.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief libtropic HAL port for TS1301/TS1302 USB dongle, event driven (USB_DONGLE_FAST build)
+ *
+ * @details Speaks the same serial protocol as lt_port_unix_usb_dongle.c of libtropic: "CS=0\n" and "CS=1\n" are
+ * answered by "OK\r\n", SPI transfer is sent as hexadecimal bytes ended by "x\n" and received bytes come back
+ * as hexadecimal ended by "\r\n". Unlike that port it does not sleep before reading a response:
+ *
+ * - serial port is in raw mode with VMIN=0 and VTIME=0, so read() returns whatever arrived and poll() waits for
+ *   the rest, a response is consumed as soon as its last byte arrives
+ * - chip select low is sent together with the frame which follows it, so L2 frame costs one write() and its
+ *   response is read at once
+ * - baud rate is configurable, 0 probes supported rates from the fastest one down
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "lt_port_unix_usb_dongle.h"
+#include "timing.h"
+
+/** @brief Baud rate which makes lt_port_init() probe the dongle for the fastest working one */
+#define LT_USB_FAST_BAUD_AUTO 0
+
+/** @brief Time the dongle has to answer, on top of the time bytes take on the wire at the baud rate */
+#define LT_USB_FAST_TIMEOUT_MS 100
+
+/** @brief Counters of system calls, reset by the caller whenever it wants */
+struct lt_usb_fast_stats {
+    uint64_t writes;
+    uint64_t reads;
+    uint64_t polls;
+    uint64_t bytes_out;
+    uint64_t bytes_in;
+};
+
+/** @brief Device description of USB dongle, fields of lt_dev_unix_usb_dongle_t come first under the same names */
+struct lt_dev_usb_fast {
+    char dev_path[DEVICE_PATH_MAX_LEN];
+    /** @brief Baud rate, LT_USB_FAST_BAUD_AUTO is replaced by the probed one in lt_port_init() */
+    uint32_t baud_rate;
+    int fd;
+    /** @brief Chip select low is sent with the next transfer */
+    bool csn_pending;
+    /** @brief Polls of chip status for the current response */
+    struct lt_timing_poll poll;
+    struct lt_usb_fast_stats stats;
+};
+
+#endif
@@ -1,3 +1,6 @@
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "inttypes.h"
 #include "libtropic.h"
 #include "libtropic_examples.h"
@@ -9,9 +12,444 @@
 // Needed to access HMAC_SHA256
 #include "lt_hmac_sha256.h"
 #include "macandd.h"
+#include "crc32.h"
+#include "timing.h"
+
+/** @brief Largest content of one R memory slot */
+#define MACANDD_R_MEM_LEN_MAX 444
+/** @brief Number of R memory slots */
+#define MACANDD_R_MEM_SLOTS 512
+/** @brief Number of M&D slots */
+#define MACANDD_MD_SLOTS 128
+
+/** @brief First delay after the chip reported busy status [us] */
+#define MACANDD_BACKOFF_MIN_US    250
+/** @brief Delay doubles after each busy status up to this value [us] */
+#define MACANDD_BACKOFF_MAX_US    32000
+/** @brief Operation fails when the chip is still busy after sleeping this long in total [us] */
+#define MACANDD_BACKOFF_BUDGET_US 500000
+
+// Per thread, so chips driven from their own threads do not mix their statistics
+static _Thread_local struct lt_macandd_stats macandd_stats;
+
+void lt_macandd_stats_get(struct lt_macandd_stats *stats)
+{
+    *stats = macandd_stats;
+}
+
+void lt_macandd_stats_reset(void)
+{
+    memset(&macandd_stats, 0, sizeof(macandd_stats));
+}
+
+static const char *const macandd_phase_names[LT_MACANDD_PHASE_COUNT] = {
+    [LT_MACANDD_PHASE_MAC_AND_DESTROY] = "mac_and_destroy",
+    [LT_MACANDD_PHASE_R_MEM_READ] = "r_mem_read",
+    [LT_MACANDD_PHASE_R_MEM_WRITE] = "r_mem_write",
+    [LT_MACANDD_PHASE_R_MEM_ERASE] = "r_mem_erase",
+    [LT_MACANDD_PHASE_KDF] = "kdf",
+    [LT_MACANDD_PHASE_RANDOM] = "random",
+    [LT_MACANDD_PHASE_BACKOFF] = "backoff",
+};
+
+const char *lt_macandd_phase_name(enum lt_macandd_phase phase)
+{
+    return phase < LT_MACANDD_PHASE_COUNT ? macandd_phase_names[phase] : "?";
+}
+
+static uint64_t macandd_now_ns(void)
+{
+    return lt_timing_now_ns();
+}
+
+static void macandd_phase_end(enum lt_macandd_phase phase, uint64_t start_ns)
+{
+    macandd_stats.phase_ns[phase] += macandd_now_ns() - start_ns;
+    macandd_stats.phase_calls[phase]++;
+}
+
+static void macandd_kdf(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t *out)
+{
+    uint64_t start = macandd_now_ns();
+    lt_hmac_sha256(key, key_len, data, data_len, out);
+    macandd_phase_end(LT_MACANDD_PHASE_KDF, start);
+}
+
+static lt_ret_t macandd_md(lt_handle_t *h, uint8_t slot, const uint8_t *data_out, uint8_t *data_in)
+{
+    uint64_t start = macandd_now_ns();
+    lt_ret_t ret = lt_mac_and_destroy(h, slot, data_out, data_in);
+    macandd_phase_end(LT_MACANDD_PHASE_MAC_AND_DESTROY, start);
+    return ret;
+}
+
+static lt_ret_t macandd_random(lt_handle_t *h, void *buff, size_t len)
+{
+    uint64_t start = macandd_now_ns();
+    lt_ret_t ret = lt_port_random_bytes(&h->l2, buff, len);
+    macandd_phase_end(LT_MACANDD_PHASE_RANDOM, start);
+    return ret;
+}
+
+/**
+ * Statuses of a chip which is busy or still starting up, the same request succeeds once it is ready. Any other error is
+ * returned: a request whose response got lost or corrupted was executed, resending it puts nonces of the secure session
+ * out of step, and a failed write is a real failure.
+ */
+static bool macandd_busy(lt_ret_t ret)
+{
+    switch (ret) {
+        case LT_L1_CHIP_BUSY:
+        case LT_L1_CHIP_STARTUP_MODE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+lt_ret_t lt_macandd_r_mem(lt_handle_t *h, enum lt_macandd_r_mem_op op, uint16_t slot, uint8_t *data, uint16_t *len)
+{
+    uint32_t delay = MACANDD_BACKOFF_MIN_US;
+    uint32_t slept = 0;
+    uint64_t busy_since = 0;
+    lt_ret_t ret;
+
+    macandd_stats.ops++;
+    for (;;) {
+        uint64_t start = macandd_now_ns();
+        if (op == LT_MACANDD_R_MEM_READ) {
+            ret = lt_r_mem_data_read(h, slot, data, len);
+            macandd_phase_end(LT_MACANDD_PHASE_R_MEM_READ, start);
+        } else if (op == LT_MACANDD_R_MEM_WRITE) {
+            ret = lt_r_mem_data_write(h, slot, data, *len);
+            macandd_phase_end(LT_MACANDD_PHASE_R_MEM_WRITE, start);
+        } else {
+            ret = lt_r_mem_data_erase(h, slot);
+            macandd_phase_end(LT_MACANDD_PHASE_R_MEM_ERASE, start);
+        }
+        if (ret == LT_OK || !macandd_busy(ret) || slept + delay > MACANDD_BACKOFF_BUDGET_US) {
+            break;
+        }
+        if (!busy_since) {
+            busy_since = macandd_now_ns();
+        }
+        start = macandd_now_ns();
+        // Below the millisecond libtropic's lt_port_delay() is limited to
+        lt_timing_sleep_us(delay);
+        macandd_phase_end(LT_MACANDD_PHASE_BACKOFF, start);
+        slept += delay;
+        delay = delay * 2 > MACANDD_BACKOFF_MAX_US ? MACANDD_BACKOFF_MAX_US : delay * 2;
+        macandd_stats.retries++;
+    }
+    if (ret == LT_OK && op != LT_MACANDD_R_MEM_ERASE) {
+        macandd_stats.bytes += *len;
+    }
+
+    if (busy_since) {
+        uint64_t wait = (macandd_now_ns() - busy_since) / 1000u;
+        macandd_stats.wait_us += wait;
+        if (wait > macandd_stats.wait_max_us) {
+            macandd_stats.wait_max_us = wait;
+        }
+    }
+    return ret;
+}
+
+bool lt_macandd_r_mem_empty(lt_ret_t ret, uint16_t size)
+{
+    return (ret == LT_OK) && (size == 0);
+}
+
+static lt_ret_t macandd_erase(lt_handle_t *h, uint16_t slot)
+{
+    return lt_macandd_r_mem(h, LT_MACANDD_R_MEM_ERASE, slot, NULL, NULL);
+}
+
+static lt_ret_t macandd_write(lt_handle_t *h, uint16_t slot, const void *data, uint16_t len)
+{
+    return lt_macandd_r_mem(h, LT_MACANDD_R_MEM_WRITE, slot, (uint8_t *)data, &len);
+}
+
+/**
+ * Journaled layout: ciphertexts and tag in layout->data_slot never change after PIN set, the number of remaining
+ * attempts is appended as struct lt_macandd_entry_t into one of layout->journal_slots slots. Writing into an empty
+ * slot needs no erase, so a decrement is one 14 B write. Only when the slot after the newest record is occupied, all
+ * slots except the newest one are erased at once, so each record costs one erase in the long run.
+ *
+ * A decrement is always written before the M&D slot is used. A torn record fails its CRC and the previous record stays
+ * valid, but the attempt did not happen either. No valid record at all means no attempts are left.
+ */
+
+/** @brief Marks data of journaled layout, single slot layout starts with i which is at most MACANDD_ROUNDS_MAX */
+static const uint8_t macandd_magic[4] = {'M', 'D', 'J', '1'};
+
+/** @brief Header of data in journaled layout: magic and generation */
+#define MACANDD_DATA_HEAD_LEN 8
+
+/** @brief Content of layout->data_slot, in either of the layouts */
+struct macandd_data {
+    bool journaled;
+    uint8_t i; /**< Number of remaining attempts, single slot layout only */
+    uint32_t gen;
+    uint8_t ci[MACANDD_ROUNDS_MAX * 32];
+    uint8_t t[32];
+};
+
+/** @brief Newest valid journal record and occupancy of journal slots */
+struct macandd_journal {
+    uint32_t gen;
+    uint32_t seq;
+    uint8_t i;
+    uint8_t last;  /**< Slot index of the newest valid record */
+    uint32_t used; /**< Bit per slot index, set if the slot is not empty */
+};
+
+void lt_macandd_layout_default(struct lt_macandd_layout *layout)
+{
+    layout->data_slot = R_MEM_DATA_SLOT_MACANDD;
+    layout->journal_slot = R_MEM_DATA_SLOT_MACANDD - MACANDD_JOURNAL_SLOTS;
+    layout->journal_slots = MACANDD_JOURNAL_SLOTS;
+    layout->md_slot = 0;
+    layout->rounds = MACANDD_ROUNDS;
+}
+
+static bool macandd_layout_valid(const struct lt_macandd_layout *l)
+{
+    return l && (l->rounds >= 1) && (l->rounds <= MACANDD_ROUNDS_MAX) && (l->md_slot + l->rounds <= MACANDD_MD_SLOTS)
+           && (l->data_slot < MACANDD_R_MEM_SLOTS) && ((l->journal_slots == 0) || (l->journal_slots >= 2))
+           && (l->journal_slots <= 32) && (l->journal_slot + l->journal_slots <= MACANDD_R_MEM_SLOTS);
+}
+
+// Serializes data for layout->data_slot, returns its length
+static uint16_t macandd_data_pack(const struct lt_macandd_layout *l, const struct macandd_data *data, uint8_t *raw)
+{
+    uint16_t len = 0;
+    if (data->journaled) {
+        memcpy(raw, macandd_magic, sizeof(macandd_magic));
+        memcpy(raw + sizeof(macandd_magic), &data->gen, sizeof(data->gen));
+        len = MACANDD_DATA_HEAD_LEN;
+    } else {
+        raw[0] = data->i;
+        len = 1;
+    }
+    memcpy(raw + len, data->ci, l->rounds * 32);
+    len += l->rounds * 32;
+    memcpy(raw + len, data->t, 32);
+
+    return len + 32;
+}
+
+// Recognizes layout of data read from layout->data_slot, journaled one only when the layout has journal slots
+static lt_ret_t macandd_data_unpack(const struct lt_macandd_layout *l, const uint8_t *raw, uint16_t len,
+                                    struct macandd_data *data)
+{
+    uint16_t off;
+    if (l->journal_slots && (len == MACANDD_DATA_HEAD_LEN + l->rounds * 32 + 32)
+        && !memcmp(raw, macandd_magic, sizeof(macandd_magic))) {
+        data->journaled = true;
+        memcpy(&data->gen, raw + sizeof(macandd_magic), sizeof(data->gen));
+        off = MACANDD_DATA_HEAD_LEN;
+    } else if ((len == 1 + l->rounds * 32 + 32) && (raw[0] <= l->rounds)) {
+        data->journaled = false;
+        data->i = raw[0];
+        off = 1;
+    } else {
+        return LT_FAIL;
+    }
+    memcpy(data->ci, raw + off, l->rounds * 32);
+    memcpy(data->t, raw + off + l->rounds * 32, 32);
+
+    return LT_OK;
+}
+
+static uint32_t macandd_entry_crc(const struct lt_macandd_entry_t *entry)
+{
+    return lt_util_crc32(0, (const uint8_t *)entry, offsetof(struct lt_macandd_entry_t, crc));
+}
+
+// Finds the newest valid record of journal->gen, fails if there is none
+static lt_ret_t macandd_journal_load(lt_handle_t *h, const struct lt_macandd_layout *l,
+                                     struct macandd_journal *journal)
+{
+    bool found = false;
+
+    journal->used = 0;
+    for (uint8_t k = 0; k < l->journal_slots; k++) {
+        uint8_t buff[MACANDD_R_MEM_LEN_MAX];
+        struct lt_macandd_entry_t entry;
+        uint16_t size = 0;
+
+        lt_ret_t ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_READ, l->journal_slot + k, buff, &size);
+        if (lt_macandd_r_mem_empty(ret, size)) {
+            continue;
+        }
+        if (ret != LT_OK) {
+            return ret;
+        }
+        journal->used |= 1u << k;
+        if (size != sizeof(entry)) {
+            continue;
+        }
+        memcpy(&entry, buff, sizeof(entry));
+        if (entry.crc != macandd_entry_crc(&entry) || entry.gen != journal->gen || entry.i > l->rounds) {
+            continue;
+        }
+        if (!found || entry.seq > journal->seq) {
+            found = true;
+            journal->seq = entry.seq;
+            journal->i = entry.i;
+            journal->last = k;
+        }
+    }
+
+    return found ? LT_OK : LT_FAIL;
+}
+
+// Erases all journal slots except the one with the newest record
+static lt_ret_t macandd_journal_compact(lt_handle_t *h, const struct lt_macandd_layout *l,
+                                        struct macandd_journal *journal)
+{
+    for (uint8_t k = 0; k < l->journal_slots; k++) {
+        if (k == journal->last || !(journal->used & (1u << k))) {
+            continue;
+        }
+        lt_ret_t ret = macandd_erase(h, l->journal_slot + k);
+        if (ret != LT_OK) {
+            return ret;
+        }
+        journal->used &= ~(1u << k);
+    }
+
+    return LT_OK;
+}
+
+// Writes record with i into the slot following the newest one, the journal is compacted first if that slot is occupied
+static lt_ret_t macandd_journal_append(lt_handle_t *h, const struct lt_macandd_layout *l,
+                                       struct macandd_journal *journal, uint8_t i)
+{
+    uint8_t k = (journal->last + 1) % l->journal_slots;
+    struct lt_macandd_entry_t entry = {.gen = journal->gen, .seq = journal->seq + 1, .i = i};
+    entry.crc = macandd_entry_crc(&entry);
+
+    if (journal->used & (1u << k)) {
+        lt_ret_t ret = macandd_journal_compact(h, l, journal);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+    // Slot counts as used from now on, even a failed write may leave a part of the record there
+    journal->used |= 1u << k;
+    lt_ret_t ret = macandd_write(h, l->journal_slot + k, &entry, sizeof(entry));
+    if (ret != LT_OK) {
+        return ret;
+    }
+    journal->seq = entry.seq;
+    journal->i = i;
+    journal->last = k;
+
+    return LT_OK;
+}
+
+// Reads back the newest record known to journal, fails if it is not in its slot any more (PIN was set again)
+static lt_ret_t macandd_journal_verify(lt_handle_t *h, const struct lt_macandd_layout *l,
+                                       const struct macandd_journal *journal)
+{
+    uint8_t buff[MACANDD_R_MEM_LEN_MAX];
+    struct lt_macandd_entry_t entry;
+    uint16_t size = 0;
+
+    lt_ret_t ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_READ, l->journal_slot + journal->last, buff, &size);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    if (lt_macandd_r_mem_empty(ret, size) || size != sizeof(entry)) {
+        return LT_FAIL;
+    }
+    memcpy(&entry, buff, sizeof(entry));
+    if (entry.crc != macandd_entry_crc(&entry) || entry.gen != journal->gen || entry.seq != journal->seq) {
+        return LT_FAIL;
+    }
+
+    return LT_OK;
+}
+
+// Stores data of a new PIN and, in journaled layout, starts its journal with all attempts
+static lt_ret_t macandd_data_init(lt_handle_t *h, const struct lt_macandd_layout *l, struct macandd_data *data)
+{
+    uint8_t raw[MACANDD_R_MEM_LEN_MAX];
+    struct macandd_journal journal = {0};
+    lt_ret_t ret;
+
+    data->journaled = l->journal_slots != 0;
+    data->i = l->rounds;
+    if (data->journaled) {
+        ret = macandd_random(h, &journal.gen, sizeof(journal.gen));
+        if (ret != LT_OK) {
+            return ret;
+        }
+        data->gen = journal.gen;
+
+        // Records of the previous PIN would be ignored because of their generation, but their slots are needed empty
+        for (uint8_t k = 0; k < l->journal_slots; k++) {
+            ret = macandd_erase(h, l->journal_slot + k);
+            if (ret != LT_OK) {
+                return ret;
+            }
+        }
+    }
+    ret = macandd_write(h, l->data_slot, raw, macandd_data_pack(l, data, raw));
+    memset(raw, 0, sizeof(raw));
+    if (ret != LT_OK || !data->journaled) {
+        return ret;
+    }
+    // Starting behind the last slot makes the first record land in slot index 0
+    journal.last = l->journal_slots - 1;
+
+    return macandd_journal_append(h, l, &journal, l->rounds);
+}
+
+// Single slot layout: the whole data slot is erased and written again with new number of attempts
+static lt_ret_t macandd_data_rewrite(lt_handle_t *h, const struct lt_macandd_layout *l, struct macandd_data *data,
+                                     uint8_t i)
+{
+    uint8_t raw[MACANDD_R_MEM_LEN_MAX];
+
+    data->i = i;
+    lt_ret_t ret = macandd_erase(h, l->data_slot);
+    if (ret == LT_OK) {
+        ret = macandd_write(h, l->data_slot, raw, macandd_data_pack(l, data, raw));
+    }
+    memset(raw, 0, sizeof(raw));
+
+    return ret;
+}
+
+/**
+ * Initializes M&D slots from..rounds-1 of the layout with u. Slot i is destroyed by the PIN check itself and the slots
+ * above it by wrong PINs before, so all of them have to be initialized again.
+ */
+static lt_ret_t macandd_rearm_slots(lt_handle_t *h, const struct lt_macandd_layout *l, uint8_t from, const uint8_t *u)
+{
+    for (int x = from; x < l->rounds; x++) {
+        uint8_t garbage[32] = {0};
+
+        lt_ret_t ret = macandd_md(h, l->md_slot + x, u, garbage);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+
+    return LT_OK;
+}
 
-/** @brief Last slot in User memory used for storing of M&D related data (only in this example). */
-#define R_MEM_DATA_SLOT_MACANDD (511)
+lt_ret_t lt_PIN_set(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
+                           const uint8_t add_size, uint8_t *secret)
+{
+    struct lt_macandd_layout layout;
+    lt_macandd_layout_default(&layout);
+
+    return lt_PIN_set_layout(h, &layout, PIN, PIN_size, add, add_size, secret);
+}
 
 /**
  * @brief Example function how to set PIN with Mac And Destroy
@@ -23,6 +461,7 @@
  *          Take it as an inspiration, copy it into your project and adapt it to your specific hw resources.
  *
  * @param h           Device's handle
+ * @param layout      Slots used for this PIN and number of attempts
  * @param PIN         Array of bytes (size between MAC_AND_DESTROY_PIN_SIZE_MIN and MAC_AND_DESTROY_PIN_SIZE_MAX)
  * representing PIN
  * @param PIN_size    Length of the PIN field
@@ -32,13 +471,11 @@
  * @param secret      Buffer into which secret will be placed when all went successfully
  * @return lt_ret_t   LT_OK if correct, otherwise LT_FAIL
  */
-// Might help to stabilize the sequence, until we improve USB communication
-#define MACANDD_DELAY 50
-lt_ret_t lt_PIN_set(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
-                           const uint8_t add_size, uint8_t *secret)
+lt_ret_t lt_PIN_set_layout(lt_handle_t *h, const struct lt_macandd_layout *layout, const uint8_t *PIN,
+                           const uint8_t PIN_size, const uint8_t *add, const uint8_t add_size, uint8_t *secret)
 {
-    if (!h || !PIN || (PIN_size < MAC_AND_DESTROY_PIN_SIZE_MIN) || (PIN_size > MAC_AND_DESTROY_PIN_SIZE_MAX) || !add
-        || (add_size > MAC_AND_DESTROY_ADD_SIZE_MAX) || !secret) {
+    if (!h || !macandd_layout_valid(layout) || !PIN || (PIN_size < MAC_AND_DESTROY_PIN_SIZE_MIN)
+        || (PIN_size > MAC_AND_DESTROY_PIN_SIZE_MAX) || !add || (add_size > MAC_AND_DESTROY_ADD_SIZE_MAX) || !secret) {
         return LT_PARAM_ERR;
     }
     if (h->l3.session != SESSION_ON) {
@@ -61,7 +498,7 @@ lt_ret_t lt_PIN_set(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size,
     uint8_t u[32] = {0};
 
     // This organizes data which will be stored into nvm
-    struct lt_macandd_nvm_t nvm = {0};
+    struct macandd_data data = {0};
 
     // User is expected to pass not only PIN, but might also pass another data(e.g. HW ID, ...)
     // Both arrays are concatenated and used together as an input for KDF
@@ -69,69 +506,65 @@ lt_ret_t lt_PIN_set(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size,
     memcpy(kdf_input_buff, PIN, PIN_size);
     memcpy(kdf_input_buff + PIN_size, add, add_size);
 
-    lt_ret_t ret = lt_port_random_bytes(&h->l2, s, 32);
+    lt_ret_t ret = macandd_random(h, s, 32);
     if (ret != LT_OK) {
         goto exit;
     }
 
     // Erase a slot in R memory, which will be used as a storage for NVM data
-    ret = lt_r_mem_data_erase(h, R_MEM_DATA_SLOT_MACANDD);
+    ret = macandd_erase(h, layout->data_slot);
     if (ret != LT_OK) {
         goto exit;
     }
 
-    // Store number of attempts
-    nvm.i = MACANDD_ROUNDS;
     // Compute tag t = KDF(s, "0"), save into nvm struct
     // Tag will be later used during lt_PIN_check() to verify validity of secret
-    lt_hmac_sha256(s, 32, (uint8_t *)"0", 1, nvm.t);
+    macandd_kdf(s, 32, (uint8_t *)"0", 1, data.t);
 
     // Compute u = KDF(s, "1")
     // This value will be sent through M&D sequence to initialize a slot
-    lt_hmac_sha256(s, 32, (uint8_t *)"1", 1, u);
+    macandd_kdf(s, 32, (uint8_t *)"1", 1, u);
 
     // Compute v = KDF(0, PIN||A) where 0 is all zeroes key
-    lt_hmac_sha256((uint8_t*)"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 32, kdf_input_buff, PIN_size+add_size, v);
+    macandd_kdf((uint8_t*)"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 32, kdf_input_buff, PIN_size+add_size, v);
 
-    for (int i = 0; i < nvm.i; i++) {
+    for (int i = 0; i < layout->rounds; i++) {
         uint8_t garbage[32] = {0};
 
         // This call of a M&D sequence results in initialization of one slot
-        ret = lt_mac_and_destroy(h, i, u, garbage);
+        ret = macandd_md(h, layout->md_slot + i, u, garbage);
         if (ret != LT_OK) {
             goto exit;
         }
         // This call of a M&D sequence overwrites a previous slot, but key w is returned.
         // This key is later used to derive k_i (used to encrypt precious secret)
-        ret = lt_mac_and_destroy(h, i, v, w);
+        ret = macandd_md(h, layout->md_slot + i, v, w);
         if (ret != LT_OK) {
             goto exit;
         }
         // Now the slot is initialized again by calling M&S sequence again with 'u'
-        ret = lt_mac_and_destroy(h, i, u, garbage);
+        ret = macandd_md(h, layout->md_slot + i, u, garbage);
         if (ret != LT_OK) {
             goto exit;
         }
 
         // Derive k_i = KDF(w, PIN||A)
         // This key will be used to encrypt secret s
-        lt_hmac_sha256(w, 32, kdf_input_buff, PIN_size + add_size, k_i);
+        macandd_kdf(w, 32, kdf_input_buff, PIN_size + add_size, k_i);
 
         // Encrypt s using k_i as a key
         // TODO implement some better encryption, or discuss if using XOR here is fine
         for (int j = 0; j < 32; j++) {
-            *(nvm.ci + (i * 32 + j)) = k_i[j] ^ s[j];
+            *(data.ci + (i * 32 + j)) = k_i[j] ^ s[j];
         }
     }
-    lt_port_delay(&h->l2, MACANDD_DELAY);
-    // Persistently save nvm data into TROPIC01's R memory slot
-    ret = lt_r_mem_data_write(h, R_MEM_DATA_SLOT_MACANDD, (uint8_t *)&nvm, sizeof(nvm));
+    // Persistently save nvm data with number of attempts into TROPIC01's R memory slot(s)
+    ret = macandd_data_init(h, layout, &data);
     if (ret != LT_OK) {
         goto exit;
     }
-    lt_port_delay(&h->l2, MACANDD_DELAY);
     // Final secret is released to the caller
-    lt_hmac_sha256(s, 32, (uint8_t *)"2", 1, secret);
+    macandd_kdf(s, 32, (uint8_t *)"2", 1, secret);
 
 // Cleanup all sensitive data from memory
 exit:
@@ -141,10 +574,20 @@ exit:
     memset(v, 0, 32);
     memset(w, 0, 32);
     memset(k_i, 0, 32);
+    memset(s, 0, 32);
 
     return ret;
 }
 
+lt_ret_t lt_PIN_check_lazy(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
+                           const uint8_t add_size, uint8_t *secret, struct lt_macandd_rearm *rearm)
+{
+    struct lt_macandd_layout layout;
+    lt_macandd_layout_default(&layout);
+
+    return lt_PIN_check_lazy_layout(h, &layout, PIN, PIN_size, add, add_size, secret, rearm);
+}
+
 /**
  * @brief Check PIN with Mac And Destroy
  *
@@ -155,6 +598,7 @@ exit:
  *          Take it as an inspiration, copy it into your project and adapt it to your specific hw resources.
  *
  * @param h           Device's handle
+ * @param layout      Slots used for this PIN and number of attempts, the same as when PIN was set
  * @param PIN         Array of bytes (size between MAC_AND_DESTROY_PIN_SIZE_MIN and MAC_AND_DESTROY_PIN_SIZE_MAX)
  * representing PIN
  * @param PIN_size    Length of the PIN field
@@ -162,16 +606,19 @@ exit:
  * MAC_AND_DESTROY_ADD_SIZE_MAX)
  * @param add_size    Length of additional data
  * @param secret      Buffer ito which secret will be saved
+ * @param rearm       Re-arm of M&D slots to be finished by lt_PIN_rearm()
  * @return lt_ret_t   LT_OK if correct, otherwise LT_FAIL
  */
-
-lt_ret_t lt_PIN_check(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
-                             const uint8_t add_size, uint8_t *secret)
+lt_ret_t lt_PIN_check_lazy_layout(lt_handle_t *h, const struct lt_macandd_layout *layout, const uint8_t *PIN,
+                                  const uint8_t PIN_size, const uint8_t *add, const uint8_t add_size,
+                                  uint8_t *secret, struct lt_macandd_rearm *rearm)
 {
-    if (!h || !PIN || (PIN_size < MAC_AND_DESTROY_PIN_SIZE_MIN) || (PIN_size > MAC_AND_DESTROY_PIN_SIZE_MAX) || !add
-        || (add_size > MAC_AND_DESTROY_ADD_SIZE_MAX) || !secret) {
+    if (!h || !macandd_layout_valid(layout) || !PIN || (PIN_size < MAC_AND_DESTROY_PIN_SIZE_MIN)
+        || (PIN_size > MAC_AND_DESTROY_PIN_SIZE_MAX) || !add || (add_size > MAC_AND_DESTROY_ADD_SIZE_MAX) || !secret
+        || !rearm) {
         return LT_PARAM_ERR;
     }
+    memset(rearm, 0, sizeof(*rearm));
     if (h->l3.session != SESSION_ON) {
         return LT_HOST_NO_SESSION;
     }
@@ -193,8 +640,12 @@ lt_ret_t lt_PIN_check(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size
     // Value used to initialize Mac And Destroy's slot after a correct PIN try
     uint8_t u[32] = {0};
 
-    // This organizes data which will be read from nvm
-    struct lt_macandd_nvm_t nvm = {0};
+    // This organizes data which will be read from nvm, in either of the layouts
+    uint8_t raw[MACANDD_R_MEM_LEN_MAX];
+    struct macandd_data data;
+    struct macandd_journal journal = {0};
+    // Number of remaining attempts
+    uint8_t i;
 
     // User is expected to pass not only PIN, but might also pass another data(e.g. HW ID, ...)
     // Both arrays are concatenated and used together as an input for KDF
@@ -203,88 +654,99 @@ lt_ret_t lt_PIN_check(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size
     memcpy(kdf_input_buff + PIN_size, add, add_size);
 
     // Load M&D data from TROPIC01's R memory
-    uint16_t res_size;
-    lt_ret_t ret = lt_r_mem_data_read(h, R_MEM_DATA_SLOT_MACANDD, (uint8_t *)&nvm, &res_size);
+    uint16_t res_size = 0;
+    lt_ret_t ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_READ, layout->data_slot, raw, &res_size);
+    if (ret != LT_OK) {
+        goto exit;
+    }
+    ret = macandd_data_unpack(layout, raw, res_size, &data);
     if (ret != LT_OK) {
         goto exit;
     }
+    if (data.journaled) {
+        journal.gen = data.gen;
+        ret = macandd_journal_load(h, layout, &journal);
+        if (ret != LT_OK) {
+            goto exit;
+        }
+        i = journal.i;
+    } else {
+        i = data.i;
+    }
 
     // if i == 0: FAIL (no attempts remaining)
-    if (nvm.i == 0) {
+    if (i == 0) {
+        ret = LT_FAIL;
         goto exit;
     }
 
     // Decrement variable which holds number of tries
     // Let i = i - 1
-    nvm.i--;
+    i--;
 
-    // and store M&D data back to TROPIC01's R memory
-    ret = lt_r_mem_data_erase(h, R_MEM_DATA_SLOT_MACANDD);
-    if (ret != LT_OK) {
-        goto exit;
+    // and store it back to TROPIC01's R memory
+    if (data.journaled) {
+        ret = macandd_journal_append(h, layout, &journal, i);
+    } else {
+        ret = macandd_data_rewrite(h, layout, &data, i);
     }
-    lt_port_delay(&h->l2, MACANDD_DELAY);
-    ret = lt_r_mem_data_write(h, R_MEM_DATA_SLOT_MACANDD, (uint8_t *)&nvm, sizeof(nvm));
     if (ret != LT_OK) {
         goto exit;
     }
-    lt_port_delay(&h->l2, MACANDD_DELAY);
     // Compute v’ = KDF(0, PIN’||A).
-    lt_hmac_sha256((uint8_t*)"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 32, kdf_input_buff, PIN_size + add_size, v_);
+    macandd_kdf((uint8_t*)"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00", 32, kdf_input_buff, PIN_size + add_size, v_);
 
     // Execute w’ = MACANDD(i, v’)
-    ret = lt_mac_and_destroy(h, nvm.i, v_, w_);
+    ret = macandd_md(h, layout->md_slot + i, v_, w_);
     if (ret != LT_OK) {
         goto exit;
     }
 
     // Compute k’_i = KDF(w’, PIN’||A)
-    lt_hmac_sha256(w_, 32, kdf_input_buff, PIN_size + add_size, k_i);
+    macandd_kdf(w_, 32, kdf_input_buff, PIN_size + add_size, k_i);
 
     // Read the ciphertext c_i and tag t from NVM, decrypt c_i with k’_i as the key and obtain s_
     // TODO figure out if XOR can be used here?
     for (int j = 0; j < 32; j++) {
-        s_[j] = *(nvm.ci + (nvm.i * 32 + j)) ^ k_i[j];
+        s_[j] = *(data.ci + (i * 32 + j)) ^ k_i[j];
     }
 
     // Compute tag t = KDF(s, "0x00")
-    lt_hmac_sha256(s_, 32, (uint8_t *)"0", 1, t_);
+    macandd_kdf(s_, 32, (uint8_t *)"0", 1, t_);
 
     // If t’ != t: FAIL
-    if (memcmp(nvm.t, t_, 32) != 0) {
+    if (memcmp(data.t, t_, 32) != 0) {
         ret = LT_FAIL;
         goto exit;
     }
 
-    // Pin is correct, now initialize macandd slots again:
+    // Pin is correct, now slots from i up have to be initialized again:
     // Compute u = KDF(s’, "0x01")
-    lt_hmac_sha256(s_, 32, (uint8_t *)"1", 1, u);
-
-    for (int x = nvm.i; x < MACANDD_ROUNDS - 1; x++) {
-        uint8_t garbage[32] = {0};
-
-        ret = lt_mac_and_destroy(h, x, u, garbage);
+    macandd_kdf(s_, 32, (uint8_t *)"1", 1, u);
+
+    if (data.journaled) {
+        // Re-arm is postponed, the decrement written above stays the newest record until it is done
+        rearm->layout = *layout;
+        rearm->from = i;
+        rearm->gen = journal.gen;
+        rearm->seq = journal.seq;
+        rearm->last = journal.last;
+        rearm->used = journal.used;
+        memcpy(rearm->u, u, 32);
+        rearm->pending = true;
+    } else {
+        ret = macandd_rearm_slots(h, layout, i, u);
+        if (ret != LT_OK) {
+            goto exit;
+        }
+        // Set variable which holds number of tries back to initial state and store it for future use
+        ret = macandd_data_rewrite(h, layout, &data, layout->rounds);
         if (ret != LT_OK) {
             goto exit;
         }
     }
-
-    // Set variable which holds number of tries back to initial state MACANDD_ROUNDS
-    nvm.i = MACANDD_ROUNDS;
-
-    // Store NVM data for future use
-    ret = lt_r_mem_data_erase(h, R_MEM_DATA_SLOT_MACANDD);
-    if (ret != LT_OK) {
-        goto exit;
-    }
-    lt_port_delay(&h->l2, MACANDD_DELAY);
-    ret = lt_r_mem_data_write(h, R_MEM_DATA_SLOT_MACANDD, (uint8_t *)&nvm, sizeof(nvm));
-    if (ret != LT_OK) {
-        goto exit;
-    }
-    lt_port_delay(&h->l2, MACANDD_DELAY);
     // Calculate secret and store it into passed array
-    lt_hmac_sha256(s_, 32, (uint8_t *)"2", 1, secret);
+    macandd_kdf(s_, 32, (uint8_t *)"2", 1, secret);
 
 // Cleanup all sensitive data from memory
 exit:
@@ -293,6 +755,71 @@ exit:
     memset(w_, 0, 32);
     memset(k_i, 0, 32);
     memset(v_, 0, 32);
+    memset(s_, 0, 32);
+    memset(u, 0, 32);
+    memset(&data, 0, sizeof(data));
+
+    return ret;
+}
+
+lt_ret_t lt_PIN_check(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
+                             const uint8_t add_size, uint8_t *secret)
+{
+    struct lt_macandd_rearm rearm;
+
+    lt_ret_t ret = lt_PIN_check_lazy(h, PIN, PIN_size, add, add_size, secret, &rearm);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    ret = lt_PIN_rearm(h, &rearm);
+    if (ret != LT_OK) {
+        memset(secret, 0, 32);
+    }
+    memset(&rearm, 0, sizeof(rearm));
+
+    return ret;
+}
+
+lt_ret_t lt_PIN_rearm(lt_handle_t *h, struct lt_macandd_rearm *rearm)
+{
+    if (!h || !rearm) {
+        return LT_PARAM_ERR;
+    }
+    if (!rearm->pending) {
+        return LT_OK;
+    }
+    if (h->l3.session != SESSION_ON) {
+        return LT_HOST_NO_SESSION;
+    }
+
+    const struct lt_macandd_layout *l = &rearm->layout;
+    // Journal as lt_PIN_check_lazy() left it, only its newest record is read back
+    struct macandd_journal journal = {
+        .gen = rearm->gen, .seq = rearm->seq, .i = rearm->from, .last = rearm->last, .used = rearm->used};
+
+    lt_ret_t ret = macandd_journal_verify(h, l, &journal);
+    if (ret == LT_FAIL) {
+        goto drop;
+    }
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    ret = macandd_rearm_slots(h, l, rearm->from, rearm->u);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    // Number of attempts goes back to all rounds only after all slots are usable again
+    ret = macandd_journal_append(h, l, &journal, l->rounds);
+    if (ret == LT_L3_R_MEM_DATA_WRITE_WRITE_FAIL) {
+        // Another PIN check appended its record meanwhile, the next correct PIN re-arms again
+        ret = LT_FAIL;
+    } else if (ret != LT_OK) {
+        return ret;
+    }
+
+drop:
+    memset(rearm, 0, sizeof(*rearm));
 
     return ret;
 }
@@ -1,17 +1,46 @@
 #ifndef MACANDD_H
 #define MACANDD_H
 
+#include <stdbool.h>
+
 #include "libtropic.h"
 
+/** @brief Most rounds one PIN can have, ciphertexts of all of them and the tag must fit into one R memory slot */
+#define MACANDD_ROUNDS_MAX 12
+
 #ifndef MACANDD_ROUNDS
 #define MACANDD_ROUNDS 12
 #endif
 
-#if (MACANDD_ROUNDS > 12)
+#if (MACANDD_ROUNDS < 1) || (MACANDD_ROUNDS > MACANDD_ROUNDS_MAX)
 #error \
     "MACANDD_ROUNDS must be less than 12 here, or generally than MACANDD_ROUNDS_MAX. Read explanation at the beginning of this file"
 #endif
 
+/**
+ * @brief Number of R memory slots holding the journal of remaining attempts, 0 selects the single slot layout
+ *
+ * @details lt_PIN_set() writes the layout selected here. lt_PIN_check() of the journaled layout also accepts data
+ * written in the single slot layout, so a PIN set before keeps working.
+ */
+#ifndef MACANDD_JOURNAL_SLOTS
+#define MACANDD_JOURNAL_SLOTS 4
+#endif
+
+#if (MACANDD_JOURNAL_SLOTS == 1) || (MACANDD_JOURNAL_SLOTS > 32)
+#error "MACANDD_JOURNAL_SLOTS must be 0 or between 2 and 32"
+#endif
+
+/** @brief Last slot in User memory used for storing of M&D related data (only in this example). */
+#define R_MEM_DATA_SLOT_MACANDD (511)
+/**
+ * @brief First R memory slot of lt_PIN_set(), slots from here up to R_MEM_DATA_SLOT_MACANDD are reserved for the PIN
+ *
+ * @details Any other write into them can destroy the newest journal record, which locks the PIN for good. lt-util
+ * refuses to store, erase and restore them and lt-bench to use them.
+ */
+#define MACANDD_R_MEM_RESERVED_FIRST (R_MEM_DATA_SLOT_MACANDD - MACANDD_JOURNAL_SLOTS)
+
 /** @brief Minimal size of MAC-and-Destroy additional data */
 #define MAC_AND_DESTROY_ADD_SIZE_MIN 0
 /** @brief Maximal size of MAC-and-Destroy additional data */
@@ -25,6 +54,8 @@
  * @brief This structure holds data used by host during MAC and Destroy sequence
  * Content of this struct must be stored in non-volatile memory, because it is used
  * between power cycles
+ *
+ * @details This is the single slot layout of a PIN with MACANDD_ROUNDS rounds, ci holds 32 B per round.
  */
 struct lt_macandd_nvm_t {
     uint8_t i;
@@ -32,12 +63,225 @@ struct lt_macandd_nvm_t {
     uint8_t t[32];
 } __attribute__((__packed__));
 
+/**
+ * @brief Static part of M&D data in journaled layout, written only by lt_PIN_set()
+ *
+ * @details Number of remaining attempts is not stored here, it is kept by a journal of struct lt_macandd_entry_t
+ * records in journal slots. gen is random for every lt_PIN_set() and binds journal records to it. Shown for
+ * MACANDD_ROUNDS rounds, ci holds 32 B per round.
+ */
+struct lt_macandd_data_t {
+    uint8_t magic[4];
+    uint32_t gen;
+    uint8_t ci[MACANDD_ROUNDS * 32];
+    uint8_t t[32];
+} __attribute__((__packed__));
+
+/**
+ * @brief Where one PIN keeps its data and how many attempts it has
+ *
+ * @details lt_PIN_set() and lt_PIN_check() use lt_macandd_layout_default(), PIN vault (vault.h) keeps many PINs with
+ * layouts of their own.
+ */
+struct lt_macandd_layout {
+    uint16_t data_slot;    /**< R memory slot with ciphertexts and tag */
+    uint16_t journal_slot; /**< First R memory slot of attempt journal */
+    uint8_t journal_slots; /**< Number of journal slots, 0 for the single slot layout */
+    uint8_t md_slot;       /**< First M&D slot, one slot per round is used */
+    uint8_t rounds;        /**< Number of attempts, 1 to MACANDD_ROUNDS_MAX */
+};
+
+/**
+ * @brief One record of M&D attempt journal
+ *
+ * @details Every change of number of attempts is appended as a new record into the next journal slot, the record with
+ * the highest seq is valid. A record with wrong CRC (torn write) or of other generation is ignored.
+ */
+struct lt_macandd_entry_t {
+    uint32_t gen;
+    uint32_t seq;
+    uint8_t i;
+    uint8_t flags; /**< Reserved, 0 */
+    uint32_t crc;
+} __attribute__((__packed__));
+
+/**
+ * @brief Re-arm of M&D slots postponed by lt_PIN_check_lazy()
+ *
+ * @details Holds u, which re-initializes M&D slots, so it must be kept only in RAM and is zeroed once the re-arm is
+ * done or dropped. Until the re-arm is done, the journal says from attempts remain, exactly as after a wrong PIN. If it
+ * never happens (crash, power loss), the next correct PIN re-arms all of these slots anyway.
+ */
+struct lt_macandd_rearm {
+    bool pending;  /**< Set when lt_PIN_rearm() has work to do */
+    struct lt_macandd_layout layout; /**< Layout of the checked PIN */
+    uint8_t from;  /**< First round to re-arm */
+    uint32_t gen;  /**< Generation of M&D data the re-arm belongs to */
+    uint32_t seq;  /**< Sequence number of the decrement record written by the check */
+    uint8_t last;  /**< Journal slot index of that record */
+    uint32_t used; /**< Occupied journal slots after the check, bit per slot index */
+    uint8_t u[32]; /**< Value initializing M&D slots */
+};
+
+/** @brief Phases of PIN operations timed by struct lt_macandd_stats */
+enum lt_macandd_phase {
+    LT_MACANDD_PHASE_MAC_AND_DESTROY, /**< lt_mac_and_destroy() */
+    LT_MACANDD_PHASE_R_MEM_READ,      /**< lt_r_mem_data_read() */
+    LT_MACANDD_PHASE_R_MEM_WRITE,     /**< lt_r_mem_data_write() */
+    LT_MACANDD_PHASE_R_MEM_ERASE,     /**< lt_r_mem_data_erase() */
+    LT_MACANDD_PHASE_KDF,             /**< HMAC-SHA256 computed on host */
+    LT_MACANDD_PHASE_RANDOM,          /**< lt_port_random_bytes() */
+    LT_MACANDD_PHASE_BACKOFF,         /**< Sleeping while the chip is busy */
+    LT_MACANDD_PHASE_COUNT
+};
+
+/**
+ * @brief Name of phase as used in benchmark output, e.g. "r_mem_write"
+ *
+ * @param phase       Phase
+ * @return            Name
+ */
+const char *lt_macandd_phase_name(enum lt_macandd_phase phase);
+
+/**
+ * @brief Time spent waiting for the chip during lt_PIN_set() and lt_PIN_check()
+ *
+ * @details R memory operations on M&D data are repeated with exponential backoff while the chip reports it is busy
+ * or not ready. A wait is the time from the first such status until the operation finished. Besides that, time of
+ * every chip call and host computation is summed per phase.
+ */
+struct lt_macandd_stats {
+    uint32_t ops;         /**< R memory operations executed */
+    uint32_t bytes;       /**< Data bytes read or written by those operations */
+    uint32_t retries;     /**< Attempts repeated after busy status */
+    uint64_t wait_us;     /**< Sum of all waits */
+    uint64_t wait_max_us; /**< Longest wait of one operation */
+    uint32_t phase_calls[LT_MACANDD_PHASE_COUNT]; /**< Number of calls in each phase */
+    uint64_t phase_ns[LT_MACANDD_PHASE_COUNT];    /**< Time spent in each phase */
+};
+
+/**
+ * @brief Get statistics collected since start or last lt_macandd_stats_reset()
+ *
+ * @param stats       Filled with statistics
+ */
+void lt_macandd_stats_get(struct lt_macandd_stats *stats);
+
+/** @brief Clear statistics */
+void lt_macandd_stats_reset(void);
+
+/** @brief R memory operations of lt_macandd_r_mem() */
+enum lt_macandd_r_mem_op {
+    LT_MACANDD_R_MEM_READ,
+    LT_MACANDD_R_MEM_WRITE,
+    LT_MACANDD_R_MEM_ERASE
+};
+
+/**
+ * @brief Read, write or erase one R memory slot holding PIN data
+ *
+ * @details Busy statuses are retried with bounded exponential backoff instead of sleeping before every operation, so a
+ * ready chip costs no waiting at all. Operations are counted in struct lt_macandd_stats.
+ *
+ * @param h           Device's handle
+ * @param op          Operation
+ * @param slot        R memory slot
+ * @param data        Data to write, or buffer for read big enough for any slot (444 B), NULL for erase
+ * @param len         Length of data to write, for read size of data on return, NULL for erase
+ * @return lt_ret_t   LT_OK if success, otherwise error
+ */
+lt_ret_t lt_macandd_r_mem(lt_handle_t *h, enum lt_macandd_r_mem_op op, uint16_t slot, uint8_t *data, uint16_t *len);
+
+/**
+ * @brief Tell whether result of an R memory read means an empty slot
+ *
+ * @details Only a successful read of zero length data is an empty slot. Any error, LT_L3_FAIL included, is a failed
+ * read and must be reported, so no slot is taken for empty by mistake.
+ *
+ * @param ret         Result of lt_r_mem_data_read() or lt_macandd_r_mem()
+ * @param size        Size of data read
+ * @return true       Slot is empty
+ */
+bool lt_macandd_r_mem_empty(lt_ret_t ret, uint16_t size);
+
+/**
+ * @brief Fill layout used by lt_PIN_set() and lt_PIN_check(): data in slot 511, MACANDD_JOURNAL_SLOTS journal slots
+ *        below it, M&D slots from 0 and MACANDD_ROUNDS rounds
+ *
+ * @param layout      Filled layout
+ */
+void lt_macandd_layout_default(struct lt_macandd_layout *layout);
+
 lt_ret_t lt_PIN_set(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
                            const uint8_t add_size, uint8_t *secret);
 
+/**
+ * @brief Set PIN with Mac And Destroy into slots given by layout, lt_PIN_set() uses the default layout
+ *
+ * @param h           Device's handle
+ * @param layout      Slots used for this PIN and number of attempts
+ * @param PIN         Array of bytes representing PIN
+ * @param PIN_size    Length of the PIN field
+ * @param add         Additional data to be used in M&D sequence
+ * @param add_size    Length of additional data
+ * @param secret      Buffer into which secret will be placed when all went successfully
+ * @return lt_ret_t   LT_OK if success, otherwise error
+ */
+lt_ret_t lt_PIN_set_layout(lt_handle_t *h, const struct lt_macandd_layout *layout, const uint8_t *PIN,
+                           const uint8_t PIN_size, const uint8_t *add, const uint8_t add_size, uint8_t *secret);
+
 
 lt_ret_t lt_PIN_check(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
                              const uint8_t add_size, uint8_t *secret);
 
+/**
+ * @brief Check PIN with Mac And Destroy, release the secret before M&D slots are re-armed
+ *
+ * @details Same as lt_PIN_check(), but the secret is returned as soon as the tag verifies. Re-arm of used slots and
+ * reset of number of attempts is left to lt_PIN_rearm(), which caller runs in idle time or before the next command.
+ * With the single slot layout the re-arm is done here and rearm->pending stays false.
+ *
+ * @param h           Device's handle
+ * @param PIN         Array of bytes representing PIN
+ * @param PIN_size    Length of the PIN field
+ * @param add         Additional data to be used in M&D sequence
+ * @param add_size    Length of additional data
+ * @param secret      Buffer into which secret will be saved
+ * @param rearm       Filled with postponed re-arm
+ * @return lt_ret_t   LT_OK if correct, otherwise LT_FAIL
+ */
+lt_ret_t lt_PIN_check_lazy(lt_handle_t *h, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
+                           const uint8_t add_size, uint8_t *secret, struct lt_macandd_rearm *rearm);
+
+/**
+ * @brief Same as lt_PIN_check_lazy(), but for PIN set with lt_PIN_set_layout()
+ *
+ * @param h           Device's handle
+ * @param layout      Layout the PIN was set with
+ * @param PIN         Array of bytes representing PIN
+ * @param PIN_size    Length of the PIN field
+ * @param add         Additional data to be used in M&D sequence
+ * @param add_size    Length of additional data
+ * @param secret      Buffer into which secret will be saved
+ * @param rearm       Filled with postponed re-arm
+ * @return lt_ret_t   LT_OK if correct, otherwise LT_FAIL
+ */
+lt_ret_t lt_PIN_check_lazy_layout(lt_handle_t *h, const struct lt_macandd_layout *layout, const uint8_t *PIN,
+                                  const uint8_t PIN_size, const uint8_t *add, const uint8_t add_size,
+                                  uint8_t *secret, struct lt_macandd_rearm *rearm);
+
+/**
+ * @brief Re-arm M&D slots and reset number of attempts after lt_PIN_check_lazy()
+ *
+ * @details The journal is not loaded again, only the record lt_PIN_check_lazy() wrote is read back. If it is gone,
+ * the PIN was set again since and the re-arm is dropped. It is dropped as well when another PIN check appended a
+ * record meanwhile. After a communication error it stays pending and may be called again.
+ *
+ * @param h           Device's handle
+ * @param rearm       Postponed re-arm, nothing is done if it is not pending
+ * @return lt_ret_t   LT_OK if done or nothing was pending, LT_FAIL if dropped, otherwise error
+ */
+lt_ret_t lt_PIN_rearm(lt_handle_t *h, struct lt_macandd_rearm *rearm);
+
 
 #endif
\ No newline at end of file
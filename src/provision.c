@@ -0,0 +1,490 @@
+/**
+ * @file provision.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Provisioning of a chip from a manifest, resumable after interruption
+ *
+ * @details Steps are executed as lt-util commands, so they log and check their arguments exactly as when typed on
+ * command line. The session is kept open for the whole chip, as in a batch.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "crc32.h"
+#include "provision.h"
+#include "vault.h"
+
+#define LT_LOG_CMD(f_, ...) LT_LOG("[CMD] " f_, ##__VA_ARGS__)
+#define LT_LOG_PROV(f_, ...) LT_LOG("[PROVISION] " f_, ##__VA_ARGS__)
+
+/** @brief Longest path of a file named in manifest or written into outdir */
+#define PROVISION_PATH_MAX 512
+/** @brief Largest content of one R memory slot */
+#define PROVISION_R_MEM_LEN_MAX 444
+
+enum provision_kind {
+    PROVISION_ECC_GENERATE,
+    PROVISION_ECC_INSTALL,
+    PROVISION_MEM_STORE,
+    PROVISION_PIN,
+};
+
+struct provision_step {
+    enum provision_kind kind;
+    unsigned line_num;
+    uint32_t crc; /**< Of the normalized step line, ties journal records to the step */
+    char slot[8];
+    char arg1[PROVISION_PATH_MAX]; /**< File, or PIN */
+    char arg2[PROVISION_PATH_MAX]; /**< Additional data of PIN */
+};
+
+/** @brief State of steps recovered from journal */
+struct provision_journal {
+    uint32_t begin_crc[LT_UTIL_PROVISION_STEPS_MAX];
+    uint32_t done_crc[LT_UTIL_PROVISION_STEPS_MAX];
+    bool begun[LT_UTIL_PROVISION_STEPS_MAX];
+    bool done[LT_UTIL_PROVISION_STEPS_MAX];
+    FILE *fp;
+};
+
+static uint64_t provision_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static bool provision_slot_valid(const char *slot_in, long max)
+{
+    char *endptr;
+    long slot = strtol(slot_in, &endptr, 10);
+
+    return (*slot_in != '\0') && (*endptr == '\0') && (slot >= 0) && (slot <= max);
+}
+
+// Parses one step line, tokens are separated by whitespace. Returns 0 if the step is valid.
+static int provision_parse_step(char *line, unsigned line_num, const char *serial, struct provision_step *step)
+{
+    char *tok[5];
+    int n = 0;
+    char *save = NULL;
+    for (char *t = strtok_r(line, " \t\r\n", &save); t; t = strtok_r(NULL, " \t\r\n", &save)) {
+        if (n == 5) {
+            return 1;
+        }
+        tok[n++] = t;
+    }
+
+    // CRC is computed over tokens before expansion, each followed by one space, so a journal stays valid only for an
+    // unchanged manifest line
+    memset(step, 0, sizeof(*step));
+    step->line_num = line_num;
+    for (int i = 0; i < n; i++) {
+        step->crc = lt_util_crc32(step->crc, (const uint8_t *)tok[i], strlen(tok[i]));
+        step->crc = lt_util_crc32(step->crc, (const uint8_t *)" ", 1);
+    }
+
+    const char *file = NULL;
+    if (n == 3 && strcmp(tok[0], "ecc") == 0 && strcmp(tok[1], "generate") == 0) {
+        step->kind = PROVISION_ECC_GENERATE;
+    } else if (n == 4 && strcmp(tok[0], "ecc") == 0 && strcmp(tok[1], "install") == 0) {
+        step->kind = PROVISION_ECC_INSTALL;
+        file = tok[3];
+    } else if (n == 4 && strcmp(tok[0], "mem") == 0 && strcmp(tok[1], "store") == 0) {
+        step->kind = PROVISION_MEM_STORE;
+        file = tok[3];
+    } else if (n == 3 && strcmp(tok[0], "pin") == 0) {
+        step->kind = PROVISION_PIN;
+        if (strlen(tok[1]) >= sizeof(step->arg1) || strlen(tok[2]) >= sizeof(step->arg2)) {
+            return 1;
+        }
+        strcpy(step->arg1, tok[1]);
+        strcpy(step->arg2, tok[2]);
+        return 0;
+    } else {
+        return 1;
+    }
+
+    if (strlen(tok[2]) >= sizeof(step->slot)
+        || !provision_slot_valid(tok[2], step->kind == PROVISION_MEM_STORE ? LT_VAULT_R_MEM_RESERVED_FIRST - 1 : 31)) {
+        LT_LOG_ERROR("[PROVISION] line %u: wrong slot number %s", line_num, tok[2]);
+        return 1;
+    }
+    strcpy(step->slot, tok[2]);
+    if (file && lt_util_expand(file, LT_UTIL_CHIP_SERIAL, serial, step->arg1, sizeof(step->arg1)) != 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+// Reads steps of the section of this chip, or of "[*]" if it has none. Whole manifest is checked.
+static int provision_parse(const char *manifest, const char *serial, struct provision_step *steps, unsigned *count)
+{
+    FILE *fp = fopen(manifest, "r");
+    if (!fp) {
+        LT_LOG_ERROR("Error opening manifest %s", manifest);
+        return 1;
+    }
+
+    struct provision_step *wildcard = calloc(LT_UTIL_PROVISION_STEPS_MAX, sizeof(*wildcard));
+    if (!wildcard) {
+        fclose(fp);
+        return 1;
+    }
+
+    enum { SECTION_NONE, SECTION_OWN, SECTION_WILDCARD, SECTION_OTHER } section = SECTION_NONE;
+    char line[BATCH_LINE_LEN_MAX + 1];
+    struct provision_step step;
+    unsigned line_num = 0, wildcard_count = 0;
+    bool have_own = false, have_wildcard = false;
+    int ret = 0;
+    *count = 0;
+    while (ret == 0 && fgets(line, sizeof(line), fp)) {
+        line_num++;
+        char *p = line;
+        while (isspace((unsigned char)*p)) {
+            p++;
+        }
+        char *comment = strchr(p, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        if (*p == '\0') {
+            continue;
+        }
+
+        if (*p == '[') {
+            char *name = p + 1;
+            char *end = strchr(name, ']');
+            if (!end) {
+                LT_LOG_ERROR("[PROVISION] line %u: unterminated section", line_num);
+                ret = 1;
+                break;
+            }
+            *end = '\0';
+            if (strcmp(name, "*") == 0) {
+                section = SECTION_WILDCARD;
+                ret = have_wildcard;
+                have_wildcard = true;
+            } else if (strcmp(name, serial) == 0) {
+                section = SECTION_OWN;
+                ret = have_own;
+                have_own = true;
+            } else {
+                section = SECTION_OTHER;
+                // Serial numbers are compared as lowercase hex, other spelling would never match
+                for (const char *c = name; *c; c++) {
+                    if (!isxdigit((unsigned char)*c) || isupper((unsigned char)*c)) {
+                        LT_LOG_ERROR("[PROVISION] line %u: section is not a lowercase serial number or *", line_num);
+                        ret = 1;
+                        break;
+                    }
+                }
+            }
+            if (ret != 0 && section != SECTION_OTHER) {
+                LT_LOG_ERROR("[PROVISION] line %u: section [%s] given twice", line_num, name);
+            }
+            continue;
+        }
+
+        if (section == SECTION_NONE) {
+            LT_LOG_ERROR("[PROVISION] line %u: step outside of a section", line_num);
+            ret = 1;
+            break;
+        }
+        if (provision_parse_step(p, line_num, serial, &step) != 0) {
+            LT_LOG_ERROR("[PROVISION] line %u: cannot parse step", line_num);
+            ret = 1;
+            break;
+        }
+        if (section == SECTION_OTHER) {
+            continue;
+        }
+
+        unsigned *n = (section == SECTION_OWN) ? count : &wildcard_count;
+        if (*n == LT_UTIL_PROVISION_STEPS_MAX) {
+            LT_LOG_ERROR("[PROVISION] line %u: too many steps, max %d", line_num, LT_UTIL_PROVISION_STEPS_MAX);
+            ret = 1;
+            break;
+        }
+        ((section == SECTION_OWN) ? steps : wildcard)[(*n)++] = step;
+    }
+    if (ret == 0 && ferror(fp)) {
+        LT_LOG_ERROR("Error reading manifest %s", manifest);
+        ret = 1;
+    }
+    fclose(fp);
+
+    if (ret == 0 && !have_own) {
+        if (!have_wildcard) {
+            LT_LOG_ERROR("[PROVISION] manifest has no section for chip %s", serial);
+            ret = 1;
+        } else {
+            memcpy(steps, wildcard, wildcard_count * sizeof(*steps));
+            *count = wildcard_count;
+        }
+    }
+    free(wildcard);
+
+    return ret;
+}
+
+// Recovers state of steps from journal and opens it for appending
+static int provision_journal_open(struct provision_journal *j, const char *path)
+{
+    memset(j, 0, sizeof(*j));
+
+    FILE *fp = fopen(path, "r");
+    if (fp) {
+        char line[64];
+        char what[8];
+        unsigned n;
+        uint32_t crc;
+        while (fgets(line, sizeof(line), fp)) {
+            // Last line may be torn by power loss, it does not parse and is ignored
+            if (sscanf(line, "%7s %u %8x", what, &n, &crc) != 3 || n >= LT_UTIL_PROVISION_STEPS_MAX) {
+                continue;
+            }
+            if (strcmp(what, "begin") == 0) {
+                j->begun[n] = true;
+                j->begin_crc[n] = crc;
+            } else if (strcmp(what, "done") == 0) {
+                j->done[n] = true;
+                j->done_crc[n] = crc;
+            }
+        }
+        fclose(fp);
+    }
+
+    j->fp = fopen(path, "a");
+    if (!j->fp) {
+        LT_LOG_ERROR("Error opening journal %s", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+// Appends a record and waits until it is on disk
+static int provision_journal_write(struct provision_journal *j, const char *what, unsigned n, uint32_t crc)
+{
+    if (fprintf(j->fp, "%s %u %08x\n", what, n, crc) < 0 || fflush(j->fp) != 0 || fsync(fileno(j->fp)) != 0) {
+        LT_LOG_ERROR("Error writing journal");
+        return 1;
+    }
+
+    return 0;
+}
+
+/** @brief Content of the slot a step writes */
+enum provision_slot_state {
+    PROVISION_SLOT_EMPTY,
+    PROVISION_SLOT_OCCUPIED,
+    PROVISION_SLOT_UNKNOWN, /**< Read failed */
+};
+
+// Reads the slot of an ECC or R memory step, PIN sets its slots anew and is always reported as empty
+static enum provision_slot_state provision_slot_state(lt_handle_t *h, const struct provision_step *step)
+{
+    if (step->kind == PROVISION_PIN) {
+        return PROVISION_SLOT_EMPTY;
+    }
+    if (lt_util_session_open(h) != 0) {
+        return PROVISION_SLOT_UNKNOWN;
+    }
+
+    lt_ret_t ret;
+    if (step->kind == PROVISION_MEM_STORE) {
+        uint8_t data[PROVISION_R_MEM_LEN_MAX];
+        uint16_t size = 0;
+        ret = lt_r_mem_data_read(h, (uint16_t)atoi(step->slot), data, &size);
+        if (lt_macandd_r_mem_empty(ret, size)) {
+            return PROVISION_SLOT_EMPTY;
+        }
+        if (ret == LT_OK) {
+            return PROVISION_SLOT_OCCUPIED;
+        }
+    } else {
+        uint8_t pubkey[64];
+        lt_ecc_curve_type_t curve;
+        ecc_key_origin_t origin;
+        ret = lt_ecc_key_read(h, (uint8_t)atoi(step->slot), pubkey, &curve, &origin);
+        if (ret == LT_OK) {
+            return PROVISION_SLOT_OCCUPIED;
+        }
+        // Empty ECC slot fails to read
+        if (ret == LT_L3_ECC_INVALID_KEY || ret == LT_L3_FAIL) {
+            return PROVISION_SLOT_EMPTY;
+        }
+    }
+    LT_LOG_ERROR("[PROVISION] line %u: reading slot %s: %s", step->line_num, step->slot, lt_ret_verbose(ret));
+
+    return PROVISION_SLOT_UNKNOWN;
+}
+
+// Executes a step, resume is set when an earlier attempt of the step, which found its slot empty, may have partly
+// done it
+static int provision_step_run(lt_handle_t *h, const struct provision_step *step, const char *outdir,
+                              const char *serial, bool resume)
+{
+    char out[PROVISION_PATH_MAX];
+    int ret = 0;
+
+    switch (step->kind) {
+        case PROVISION_ECC_GENERATE:
+        case PROVISION_ECC_INSTALL: {
+            // Key generated by the interrupted attempt is kept, slot can not be written twice anyway
+            if (!resume || provision_slot_state(h, step) != PROVISION_SLOT_OCCUPIED) {
+                char *argv[] = {ECC, step->kind == PROVISION_ECC_GENERATE ? ECC_GENERATE : ECC_INSTALL,
+                                (char *)step->slot, (char *)step->arg1};
+                ret = lt_util_run_command(h, step->kind == PROVISION_ECC_GENERATE ? 3 : 4, argv);
+            } else {
+                LT_LOG_PROV("%s: ECC slot %s already holds the key", serial, step->slot);
+            }
+            if (ret == 0) {
+                snprintf(out, sizeof(out), "%s/%s.ecc%s.pub", outdir, serial, step->slot);
+                char *argv[] = {ECC, ECC_DOWNLOAD, (char *)step->slot, out};
+                ret = lt_util_run_command(h, 4, argv);
+            }
+            break;
+        }
+        case PROVISION_MEM_STORE:
+            // Content written by the interrupted attempt may be partial, so it is written again
+            if (resume) {
+                char *argv[] = {MEM, MEM_ERASE, (char *)step->slot};
+                ret = lt_util_run_command(h, 3, argv);
+            }
+            if (ret == 0) {
+                char *argv[] = {MEM, MEM_STORE, (char *)step->slot, (char *)step->arg1};
+                ret = lt_util_run_command(h, 4, argv);
+            }
+            break;
+        case PROVISION_PIN: {
+            // lt_PIN_set() overwrites its slots, so an interrupted attempt is simply repeated
+            snprintf(out, sizeof(out), "%s/%s.pin_secret", outdir, serial);
+            char *argv[] = {MAC_SET, (char *)step->arg1, (char *)step->arg2, out};
+            ret = lt_util_run_command(h, 4, argv);
+            break;
+        }
+    }
+
+    return ret;
+}
+
+int lt_util_provision(lt_handle_t *h, const char *manifest, const char *outdir)
+{
+    if(!h || !manifest || !outdir) {
+        LT_LOG_ERROR("Error, NULL parameters lt_util_provision()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "PROVISION" %s %s", manifest, outdir);
+    }
+
+    uint64_t start = provision_now_ns();
+
+    // Session stays open for all steps, unless caller already keeps it open anyway
+    bool was_kept = lt_util_session_is_kept(h);
+    lt_util_session_keep(h, true);
+
+    char serial[LT_UTIL_SERIAL_HEX_LEN + 1];
+    char path[PROVISION_PATH_MAX];
+    struct provision_step *steps = calloc(LT_UTIL_PROVISION_STEPS_MAX, sizeof(*steps));
+    struct provision_journal *journal = calloc(1, sizeof(*journal));
+    unsigned count = 0, executed = 0, skipped = 0, failed = 0;
+    int ret = 1;
+    if (!steps || !journal || lt_util_chip_serial(h, serial) != 0
+        || provision_parse(manifest, serial, steps, &count) != 0) {
+        goto out;
+    }
+    snprintf(path, sizeof(path), "%s/%s.journal", outdir, serial);
+    if (provision_journal_open(journal, path) != 0) {
+        goto out;
+    }
+    LT_LOG_PROV("%s: %u steps, journal %s", serial, count, path);
+
+    ret = 0;
+    for (unsigned n = 0; n < count; n++) {
+        const struct provision_step *step = &steps[n];
+        if (journal->done[n] && journal->done_crc[n] == step->crc) {
+            skipped++;
+            continue;
+        }
+        if (journal->begun[n] && journal->begin_crc[n] != step->crc) {
+            LT_LOG_WARN("[PROVISION] line %u changed since the journal was written, the step runs again",
+                        step->line_num);
+        }
+        bool resume = journal->begun[n] && journal->begin_crc[n] == step->crc;
+        if (resume) {
+            LT_LOG_PROV("%s: line %u was interrupted, resuming", serial, step->line_num);
+        } else {
+            // Checked before the begin record, so content found in the slot later was written by this step
+            enum provision_slot_state state = provision_slot_state(h, step);
+            if (state != PROVISION_SLOT_EMPTY) {
+                if (state == PROVISION_SLOT_OCCUPIED) {
+                    LT_LOG_ERROR("[PROVISION] line %u: slot %s is occupied, clear it first", step->line_num,
+                                 step->slot);
+                }
+                executed++;
+                failed++;
+                ret = 1;
+                break;
+            }
+        }
+
+        if (provision_journal_write(journal, "begin", n, step->crc) != 0) {
+            ret = 1;
+            break;
+        }
+        int status = provision_step_run(h, step, outdir, serial, resume);
+        if (status != 0) {
+            // One more attempt in a new session, the failed one may have done part of the step. Its slot was empty
+            // before the first attempt or the journal began the step in an earlier run, so it is resumed.
+            lt_util_session_reset(h);
+            LT_LOG_WARN("[PROVISION] line %u failed, retrying", step->line_num);
+            status = provision_step_run(h, step, outdir, serial, true);
+        }
+        executed++;
+        LT_LOG_PROV("%s: line %u: %d", serial, step->line_num, status);
+        if (status != 0) {
+            lt_util_session_reset(h);
+            failed++;
+            ret = 1;
+            break;
+        }
+        if (provision_journal_write(journal, "done", n, step->crc) != 0) {
+            ret = 1;
+            break;
+        }
+    }
+
+out:
+    if (journal && journal->fp) {
+        fclose(journal->fp);
+    }
+    free(journal);
+    free(steps);
+
+    lt_util_session_keep(h, was_kept);
+    lt_util_session_close(h);
+
+    if (count) {
+        LT_LOG_PROV("%s: executed %u, skipped %u, failed %u, %.1f ms", serial, executed, skipped, failed,
+                    (provision_now_ns() - start) / 1e6);
+    }
+
+    return ret;
+}
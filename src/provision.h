@@ -0,0 +1,46 @@
+#ifndef PROVISION_H
+#define PROVISION_H
+
+/**
+ * @file provision.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Provisioning of a chip from a manifest, resumable after interruption
+ *
+ * @details Manifest is a text file with one section per chip, headed by "[<serial number>]" as printed by
+ * lt_util_chip_serial(), or "[*]" for chips without a section of their own. Steps of a section are:
+ *
+ *     ecc generate <slot>           generate Ed25519 key in ECC slot
+ *     ecc install <slot> <file>     install private key from file into ECC slot
+ *     mem store <slot> <file>       store file into R memory slot
+ *     pin <PIN> <additional data>   set M&D PIN, as lt-util -mac-set does
+ *
+ * LT_UTIL_CHIP_SERIAL in file names is replaced by serial number of the chip. Public key of every ECC slot is
+ * exported as "<outdir>/<serial>.ecc<slot>.pub", secret of PIN as "<outdir>/<serial>.pin_secret".
+ *
+ * Progress is journaled in "<outdir>/<serial>.journal". A step is recorded before it starts and when it is done,
+ * each record is synced to disk. Done steps are skipped when provisioning runs again. A step which started but did
+ * not finish is completed, e.g. ECC slot which is already occupied is accepted and only its public key is exported.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include "libtropic.h"
+
+/** @brief Placeholder in manifest file names, replaced by serial number of the chip */
+#define LT_UTIL_CHIP_SERIAL "{chip}"
+
+/** @brief Most steps in one section of manifest */
+#define LT_UTIL_PROVISION_STEPS_MAX 64
+
+/**
+ * @brief Provision the chip by its section of the manifest, all steps run in one secure session
+ *
+ * @param h           Device's handle
+ * @param manifest    Manifest file
+ * @param outdir      Directory for exported public keys, PIN secret and journal
+ * @return int        0 if all steps are done, otherwise 1
+ */
+int lt_util_provision(lt_handle_t *h, const char *manifest, const char *outdir);
+
+#endif
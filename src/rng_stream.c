@@ -0,0 +1,266 @@
+/**
+ * @file rng_stream.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Double buffered output of random bytes: the main thread pulls data from TROPIC01 into one buffer while
+ * a writer thread writes the other one, so the chip is never idle waiting for the disk or pipe.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "rng_stream.h"
+
+#define LT_LOG_CMD(f_, ...) LT_LOG("[CMD] " f_, ##__VA_ARGS__)
+
+/** @brief State shared by producer (chip) and writer thread */
+struct rng_stream {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *buf[2];
+    /** Bytes waiting to be written, 0 when buffer is free to be filled */
+    size_t len[2];
+    bool done;
+    bool failed;
+    /** errno of failed write() */
+    int err;
+    int fd;
+    uint64_t written;
+};
+
+static volatile sig_atomic_t rng_stream_stop = 0;
+
+static void rng_stream_signal(int sig)
+{
+    (void)sig;
+    rng_stream_stop = 1;
+}
+
+static void *rng_stream_writer(void *arg)
+{
+    struct rng_stream *st = arg;
+    int idx = 0;
+
+    while (1) {
+        pthread_mutex_lock(&st->lock);
+        while (st->len[idx] == 0 && !st->done) {
+            pthread_cond_wait(&st->cond, &st->lock);
+        }
+        size_t len = st->len[idx];
+        pthread_mutex_unlock(&st->lock);
+        if (len == 0) {
+            break;
+        }
+
+        const uint8_t *p = st->buf[idx];
+        size_t left = len;
+        while (left) {
+            ssize_t n = write(st->fd, p, left);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                pthread_mutex_lock(&st->lock);
+                st->failed = true;
+                st->err = (n < 0) ? errno : EIO;
+                pthread_cond_signal(&st->cond);
+                pthread_mutex_unlock(&st->lock);
+                return NULL;
+            }
+            p += n;
+            left -= n;
+        }
+
+        pthread_mutex_lock(&st->lock);
+        st->len[idx] = 0;
+        st->written += len;
+        pthread_cond_signal(&st->cond);
+        pthread_mutex_unlock(&st->lock);
+        idx ^= 1;
+    }
+
+    return NULL;
+}
+
+int lt_util_rng_stream(lt_handle_t *h, char *count_in, char *file)
+{
+    if(!count_in || !file) {
+        LT_LOG_ERROR("Error, NULL parameters lt_util_rng_stream()");
+        return 1;
+    }
+
+    // Random data go to stdout, so everything else printed meanwhile is moved to stderr
+    bool to_stdout = (strcmp(file, "-") == 0);
+    int saved_stdout = -1;
+    int fd;
+    if (to_stdout) {
+        fflush(stdout);
+        fd = dup(STDOUT_FILENO);
+        saved_stdout = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    } else {
+        fd = open(file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    LT_LOG_CMD("lt-util "RNG" "RNG_STREAM" %s %s", count_in, file);
+
+    int ret = 1;
+    struct rng_stream st = {.fd = fd};
+    pthread_t writer;
+    bool writer_started = false;
+    struct sigaction sa_int = {0}, old_int, old_pipe;
+
+    // Parsing count number
+    bool infinite = (strcmp(count_in, "inf") == 0);
+    uint64_t count = 0;
+    if (!infinite) {
+        char *endptr;
+        errno = 0;
+        unsigned long long val = strtoull(count_in, &endptr, 10);
+        if ((*endptr != '\0') || (count_in[0] == '-') || (errno != 0) || (val == 0)) {
+            LT_LOG_ERROR("Invalid length passed, use positive number of bytes or inf");
+            goto exit;
+        }
+        count = val;
+    }
+
+    if (fd < 0) {
+        LT_LOG_ERROR("Error opening file %s", file);
+        goto exit;
+    }
+
+    st.buf[0] = malloc(RNG_STREAM_CHUNK);
+    st.buf[1] = malloc(RNG_STREAM_CHUNK);
+    if (!st.buf[0] || !st.buf[1]) {
+        LT_LOG_ERROR("Error allocating buffers");
+        goto exit;
+    }
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+
+    if (lt_util_session_open(h) != 0) {
+        goto exit_sync;
+    }
+
+    if (pthread_create(&writer, NULL, rng_stream_writer, &st) != 0) {
+        LT_LOG_ERROR("Error starting writer thread");
+        lt_util_session_close(h);
+        goto exit_sync;
+    }
+    writer_started = true;
+
+    // Ctrl+C and closed pipe end the stream gracefully, so the summary is still printed
+    rng_stream_stop = 0;
+    sa_int.sa_handler = rng_stream_signal;
+    sigaction(SIGINT, &sa_int, &old_int);
+    struct sigaction sa_pipe = {0};
+    sa_pipe.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa_pipe, &old_pipe);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    ret = 0;
+    uint64_t produced = 0;
+    int idx = 0;
+    while ((infinite || produced < count) && !rng_stream_stop) {
+        pthread_mutex_lock(&st.lock);
+        while (st.len[idx] != 0 && !st.failed) {
+            pthread_cond_wait(&st.cond, &st.lock);
+        }
+        bool failed = st.failed;
+        pthread_mutex_unlock(&st.lock);
+        if (failed) {
+            break;
+        }
+
+        size_t filled = 0;
+        while (filled < RNG_STREAM_CHUNK && (infinite || produced + filled < count) && !rng_stream_stop) {
+            size_t n = RNG_STREAM_CHUNK - filled;
+            if (n > RANDOM_VALUE_GET_LEN_MAX) {
+                n = RANDOM_VALUE_GET_LEN_MAX;
+            }
+            if (!infinite && n > count - produced - filled) {
+                n = count - produced - filled;
+            }
+            lt_ret_t l3_ret = lt_random_value_get(h, st.buf[idx] + filled, (uint16_t)n);
+            if (l3_ret != LT_OK) {
+                LT_LOG_ERROR("Error l3 cmd: %s", lt_ret_verbose(l3_ret));
+                ret = 1;
+                break;
+            }
+            filled += n;
+        }
+
+        pthread_mutex_lock(&st.lock);
+        st.len[idx] = filled;
+        pthread_cond_signal(&st.cond);
+        pthread_mutex_unlock(&st.lock);
+        produced += filled;
+        idx ^= 1;
+
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&st.lock);
+    st.done = true;
+    pthread_cond_signal(&st.cond);
+    pthread_mutex_unlock(&st.lock);
+    pthread_join(writer, NULL);
+    writer_started = false;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGPIPE, &old_pipe, NULL);
+    lt_util_session_close(h);
+
+    // Reader of a pipe going away ends infinite stream, it is not an error
+    if (st.failed && !(infinite && to_stdout && st.err == EPIPE)) {
+        LT_LOG_ERROR("Error writing into %s: %s", file, strerror(st.err));
+        ret = 1;
+    }
+    if (!infinite && !rng_stream_stop && st.written != count) {
+        ret = 1;
+    }
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    LT_LOG("[RNG] %" PRIu64 " bytes in %.3f s, %.0f B/s", st.written, seconds,
+           seconds > 0 ? st.written / seconds : 0.0);
+
+exit_sync:
+    if (writer_started) {
+        pthread_join(writer, NULL);
+    }
+    pthread_cond_destroy(&st.cond);
+    pthread_mutex_destroy(&st.lock);
+exit:
+    free(st.buf[0]);
+    free(st.buf[1]);
+    if (fd >= 0 && close(fd) != 0 && ret == 0) {
+        LT_LOG_ERROR("Error closing %s", file);
+        ret = 1;
+    }
+    if (to_stdout) {
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+    }
+
+    return ret;
+}
@@ -0,0 +1,32 @@
+#ifndef RNG_STREAM_H
+#define RNG_STREAM_H
+
+/**
+ * @file rng_stream.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Streaming of random bytes from TROPIC01 beyond RANDOM_VALUE_GET_LEN_MAX
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include "libtropic.h"
+
+/** @brief Random bytes are collected into buffers of this size before they are written */
+#define RNG_STREAM_CHUNK (64u * 1024u)
+
+/**
+ * @brief Repeat lt_random_value_get() within one secure session and write the bytes into a file or stdout
+ *
+ * @details Two buffers are used: while one is written by a writer thread, the next one is filled from the chip.
+ *          Streaming ends when requested number of bytes is written, on SIGINT, or when reader of stdout goes
+ *          away. Throughput summary is printed at the end; when data go to stdout, log goes to stderr.
+ *
+ * @param h           Device's handle
+ * @param count_in    Number of bytes, or "inf" to stream until interrupted
+ * @param file        Output file, "-" for stdout
+ * @return int        0 if success, otherwise 1
+ */
+int lt_util_rng_stream(lt_handle_t *h, char *count_in, char *file);
+
+#endif
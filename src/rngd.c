@@ -0,0 +1,588 @@
+/**
+ * @file rngd.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details lt-rngd keeps a ring buffer of random bytes from TROPIC01 and serves them to local consumers, so reads
+ * are served from memory and cost no handshake. A refill thread owns the chip: when the pool drops below the low
+ * watermark it pulls random bytes within one kept secure session until the pool reaches the high watermark.
+ *
+ * Consumers connect to a Unix domain socket and send a request with number of wanted bytes (uint32_t, host byte
+ * order, at most RNGD_REQUEST_LEN_MAX), the daemon answers with exactly that many bytes. One connection may carry
+ * any number of requests. Optionally bytes are also written into a FIFO and fed into the kernel entropy pool
+ * with RNDADDENTROPY.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/random.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "utild_proto.h"
+
+/** @brief Name of the socket in runtime directory of the user, used when neither -s nor LT_RNGD_SOCKET is given */
+#define RNGD_SOCKET_NAME    "lt-rngd.sock"
+/** @brief Environment variable overriding default socket path */
+#define RNGD_SOCKET_ENV     "LT_RNGD_SOCKET"
+/** @brief Default size of the pool */
+#define RNGD_POOL_SIZE_DEFAULT  (1024u * 1024u)
+/** @brief Refill starts when pool drops below this percentage of its size */
+#define RNGD_LOW_DEFAULT        25
+/** @brief Refill stops when pool reaches this percentage of its size */
+#define RNGD_HIGH_DEFAULT       100
+/** @brief Refill thread hands bytes over to the pool in pieces of this size */
+#define RNGD_PULL_LEN           4096u
+/** @brief Biggest amount of bytes a consumer can ask for in one request */
+#define RNGD_REQUEST_LEN_MAX    (64u * 1024u)
+/** @brief Maximal number of simultaneously connected consumers */
+#define RNGD_CLIENTS_MAX        64
+/** @brief Consumer must send its request within this time */
+#define RNGD_CLIENT_TIMEOUT_S   30
+/** @brief Bytes passed to kernel with each RNDADDENTROPY */
+#define RNGD_KERNEL_FEED_LEN    64u
+/** @brief Seconds to wait before the chip is tried again after a failure */
+#define RNGD_RETRY_S            1
+
+/** @brief Ring buffer of random bytes, producer is refill thread, consumers are client threads */
+struct rngd_pool {
+    pthread_mutex_t lock;
+    /** Signalled when bytes were added */
+    pthread_cond_t filled;
+    /** Signalled when pool dropped below low watermark */
+    pthread_cond_t drained;
+    uint8_t *buf;
+    size_t size;
+    size_t head;
+    size_t len;
+    size_t low;
+    size_t high;
+    bool stop;
+    // Statistics
+    uint64_t served;
+    uint64_t pulled;
+    uint64_t refills;
+    uint64_t underruns;
+    uint64_t fed_kernel;
+    int clients;
+};
+
+static struct rngd_pool pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .filled = PTHREAD_COND_INITIALIZER,
+    .drained = PTHREAD_COND_INITIALIZER,
+};
+
+static volatile sig_atomic_t rngd_stop = 0;
+
+static void rngd_signal(int sig)
+{
+    (void)sig;
+    rngd_stop = 1;
+}
+
+static void print_usage(void)
+{
+    printf("\r\nUsage:\r\n\n"
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+"\t./lt-rngd /dev/ttyACM0 [-s <socket>] [-f <fifo>] [-b <bytes>] [-l <percent>] [-H <percent>] [-k]\r\n\n"
+#endif
+#if LINUX_SPI || SIMULATOR
+"\t./lt-rngd [-s <socket>] [-f <fifo>] [-b <bytes>] [-l <percent>] [-H <percent>] [-k]\r\n\n"
+#endif
+"\t -s <socket>    Unix domain socket to listen on (default $"RNGD_SOCKET_ENV" or\r\n"
+"\t                $XDG_RUNTIME_DIR/"RNGD_SOCKET_NAME")\r\n"
+"\t -f <fifo>      Also write random bytes into this FIFO, it is created when it does not exist\r\n"
+"\t -b <bytes>     Size of the pool (default %u)\r\n"
+"\t -l <percent>   Refill the pool when it drops below this level (default %d)\r\n"
+"\t -H <percent>   Stop refilling when the pool reaches this level (default %d)\r\n"
+"\t -k             Feed kernel entropy pool with RNDADDENTROPY on every refill (needs CAP_SYS_ADMIN)\r\n\n"
+"\t Consumers send number of wanted bytes as uint32_t (max %u) and receive exactly that many bytes.\r\n\n",
+    RNGD_POOL_SIZE_DEFAULT, RNGD_LOW_DEFAULT, RNGD_HIGH_DEFAULT, RNGD_REQUEST_LEN_MAX);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Appends bytes at the tail of the ring, caller makes sure they fit
+static void pool_put(struct rngd_pool *p, const uint8_t *data, size_t len)
+{
+    pthread_mutex_lock(&p->lock);
+    size_t tail = (p->head + p->len) % p->size;
+    size_t first = p->size - tail;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(p->buf + tail, data, first);
+    memcpy(p->buf, data + first, len - first);
+    p->len += len;
+    p->pulled += len;
+    pthread_cond_broadcast(&p->filled);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Takes len bytes from the head of the ring, waits for refill when pool runs dry.
+// Returns number of bytes taken, which is less than len only when daemon stops.
+static size_t pool_take(struct rngd_pool *p, uint8_t *out, size_t len)
+{
+    size_t taken = 0;
+
+    pthread_mutex_lock(&p->lock);
+    while (taken < len) {
+        if (p->len == 0) {
+            p->underruns++;
+            pthread_cond_signal(&p->drained);
+            while (p->len == 0 && !p->stop) {
+                pthread_cond_wait(&p->filled, &p->lock);
+            }
+            if (p->stop) {
+                break;
+            }
+        }
+        size_t n = len - taken;
+        if (n > p->len) {
+            n = p->len;
+        }
+        if (n > p->size - p->head) {
+            n = p->size - p->head;
+        }
+        memcpy(out + taken, p->buf + p->head, n);
+        // Bytes are handed out only once
+        memset(p->buf + p->head, 0, n);
+        p->head = (p->head + n) % p->size;
+        p->len -= n;
+        taken += n;
+    }
+    p->served += taken;
+    if (p->len < p->low) {
+        pthread_cond_signal(&p->drained);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return taken;
+}
+
+static lt_ret_t rngd_pull(lt_handle_t *h, uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i += RANDOM_VALUE_GET_LEN_MAX) {
+        size_t n = len - i;
+        if (n > RANDOM_VALUE_GET_LEN_MAX) {
+            n = RANDOM_VALUE_GET_LEN_MAX;
+        }
+        lt_ret_t ret = lt_random_value_get(h, buf + i, (uint16_t)n);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+    return LT_OK;
+}
+
+// Credits kernel with full entropy of the bytes, returns 0 if success
+static int rngd_feed_kernel(int fd, const uint8_t *data, size_t len)
+{
+    struct {
+        struct rand_pool_info info;
+        uint8_t buf[RNGD_KERNEL_FEED_LEN];
+    } entropy;
+
+    entropy.info.entropy_count = (int)(len * 8);
+    entropy.info.buf_size = (int)len;
+    memcpy(entropy.info.buf, data, len);
+    int ret = ioctl(fd, RNDADDENTROPY, &entropy.info);
+    memset(&entropy, 0, sizeof(entropy));
+
+    return ret;
+}
+
+struct rngd_refill_args {
+    lt_handle_t *h;
+    int kernel_fd;
+};
+
+static void *rngd_refill(void *arg)
+{
+    struct rngd_refill_args *args = arg;
+    uint8_t chunk[RNGD_PULL_LEN];
+
+    pthread_mutex_lock(&pool.lock);
+    while (!pool.stop) {
+        while (pool.len >= pool.low && !pool.stop) {
+            pthread_cond_wait(&pool.drained, &pool.lock);
+        }
+        if (pool.stop) {
+            break;
+        }
+        pool.refills++;
+
+        // Refill up to the high watermark within one session, chip is not touched until next drop below low
+        while (pool.len < pool.high && !pool.stop) {
+            size_t n = pool.high - pool.len;
+            if (n > sizeof(chunk)) {
+                n = sizeof(chunk);
+            }
+            pthread_mutex_unlock(&pool.lock);
+
+            lt_ret_t ret = LT_FAIL;
+            if (lt_util_session_open(args->h) == 0) {
+                ret = rngd_pull(args->h, chunk, n);
+            }
+            if (ret != LT_OK) {
+                LT_LOG_ERROR("Refill failed: %s, retrying in %d s", lt_ret_verbose(ret), RNGD_RETRY_S);
+                lt_util_session_reset(args->h);
+                sleep(RNGD_RETRY_S);
+                pthread_mutex_lock(&pool.lock);
+                continue;
+            }
+            pool_put(&pool, chunk, n);
+
+            pthread_mutex_lock(&pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        if (args->kernel_fd >= 0) {
+            if (rngd_pull(args->h, chunk, RNGD_KERNEL_FEED_LEN) == LT_OK
+                && rngd_feed_kernel(args->kernel_fd, chunk, RNGD_KERNEL_FEED_LEN) == 0) {
+                pthread_mutex_lock(&pool.lock);
+                pool.fed_kernel += RNGD_KERNEL_FEED_LEN;
+                pthread_mutex_unlock(&pool.lock);
+            } else {
+                LT_LOG_WARN("Feeding kernel entropy pool failed: %s", strerror(errno));
+            }
+        }
+        memset(chunk, 0, sizeof(chunk));
+
+        pthread_mutex_lock(&pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+
+    return NULL;
+}
+
+// Serves requests of one consumer until it disconnects
+static void *rngd_client(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    uint8_t out[RNGD_REQUEST_LEN_MAX];
+
+    struct timeval tv = {.tv_sec = RNGD_CLIENT_TIMEOUT_S, .tv_usec = 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    uint32_t len;
+    while (read_all(fd, &len, sizeof(len)) == 0) {
+        if (len == 0 || len > RNGD_REQUEST_LEN_MAX) {
+            break;
+        }
+        if (pool_take(&pool, out, len) != len) {
+            break;
+        }
+        int ret = write_all(fd, out, len);
+        memset(out, 0, len);
+        if (ret != 0) {
+            break;
+        }
+    }
+    close(fd);
+
+    pthread_mutex_lock(&pool.lock);
+    pool.clients--;
+    pthread_mutex_unlock(&pool.lock);
+
+    return NULL;
+}
+
+// Writes random bytes into FIFO whenever somebody reads it
+static void *rngd_fifo(void *arg)
+{
+    const char *path = arg;
+    uint8_t chunk[RNGD_PULL_LEN];
+
+    while (!pool.stop) {
+        // Blocks until a reader opens the FIFO
+        int fd = open(path, O_WRONLY);
+        if (fd < 0) {
+            LT_LOG_ERROR("Error opening FIFO %s: %s", path, strerror(errno));
+            break;
+        }
+        while (pool_take(&pool, chunk, sizeof(chunk)) == sizeof(chunk)) {
+            if (write_all(fd, chunk, sizeof(chunk)) != 0) {
+                break;
+            }
+        }
+        memset(chunk, 0, sizeof(chunk));
+        close(fd);
+    }
+
+    return NULL;
+}
+
+static int rngd_listen(const char *path)
+{
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LT_LOG_ERROR("Socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LT_LOG_ERROR("Error socket(): %s", strerror(errno));
+        return -1;
+    }
+
+    unlink(path);
+    mode_t old_mask = umask(0077);
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (ret != 0 || listen(fd, 16) != 0) {
+        LT_LOG_ERROR("Error binding %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static int parse_number(const char *str, long min, long max, long *val)
+{
+    char *endptr;
+    *val = strtol(str, &endptr, 10);
+    if (*endptr != '\0' || *val < min || *val > max) {
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev_path = NULL;
+    const char *socket_path = getenv(RNGD_SOCKET_ENV);
+    const char *fifo_path = NULL;
+    long pool_size = RNGD_POOL_SIZE_DEFAULT;
+    long low = RNGD_LOW_DEFAULT;
+    long high = RNGD_HIGH_DEFAULT;
+    bool feed_kernel = false;
+    char default_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+    if (socket_path && !socket_path[0]) {
+        socket_path = NULL;
+    }
+
+    int i = 1;
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+    if (argc < 2) {
+        print_usage();
+        return 0;
+    }
+    dev_path = argv[i++];
+#endif
+    for (; i < argc; i++) {
+        int err = 0;
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            fifo_path = argv[++i];
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], RNGD_PULL_LEN, 1024L * 1024L * 1024L, &pool_size);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], 1, 100, &low);
+        } else if (strcmp(argv[i], "-H") == 0 && i + 1 < argc) {
+            err = parse_number(argv[++i], 1, 100, &high);
+        } else if (strcmp(argv[i], "-k") == 0) {
+            feed_kernel = true;
+        } else {
+            print_usage();
+            return 1;
+        }
+        if (err) {
+            LT_LOG_ERROR("Invalid value of %s", argv[i - 1]);
+            return 1;
+        }
+    }
+    if (low > high) {
+        LT_LOG_ERROR("Low watermark must not be above high watermark");
+        return 1;
+    }
+
+    pool.size = (size_t)pool_size;
+    pool.low = pool.size * low / 100;
+    pool.high = pool.size * high / 100;
+    pool.buf = calloc(1, pool.size);
+    if (!pool.buf) {
+        LT_LOG_ERROR("Error allocating pool of %zu bytes", pool.size);
+        return 1;
+    }
+
+    struct rngd_refill_args refill_args = {.kernel_fd = -1};
+    if (feed_kernel) {
+        refill_args.kernel_fd = open("/dev/random", O_WRONLY);
+        if (refill_args.kernel_fd < 0) {
+            LT_LOG_ERROR("Error opening /dev/random: %s", strerror(errno));
+            return 1;
+        }
+    }
+
+    if (fifo_path && mkfifo(fifo_path, 0600) != 0 && errno != EEXIST) {
+        LT_LOG_ERROR("Error creating FIFO %s: %s", fifo_path, strerror(errno));
+        return 1;
+    }
+
+    // Default lives in a directory of this user only, nobody else can take the path over before the daemon binds it
+    if (!socket_path) {
+        if (lt_util_runtime_path(RNGD_SOCKET_NAME, default_path, sizeof(default_path)) != 0) {
+            return 1;
+        }
+        socket_path = default_path;
+    }
+
+    int listen_fd = rngd_listen(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    lt_handle_t h = {0};
+    struct lt_util_dev dev;
+    lt_util_dev_setup(&h, &dev, dev_path);
+    lt_util_session_keep(&h, true);
+    refill_args.h = &h;
+
+    // Only main thread handles signals
+    sigset_t mask, old_mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &mask, &old_mask);
+
+    pthread_t refill_thread, fifo_thread;
+    if (pthread_create(&refill_thread, NULL, rngd_refill, &refill_args) != 0) {
+        LT_LOG_ERROR("Error starting refill thread");
+        return 1;
+    }
+    if (fifo_path && pthread_create(&fifo_thread, NULL, rngd_fifo, (void *)fifo_path) != 0) {
+        LT_LOG_ERROR("Error starting FIFO thread");
+        return 1;
+    }
+    pthread_attr_t client_attr;
+    pthread_attr_init(&client_attr);
+    pthread_attr_setdetachstate(&client_attr, PTHREAD_CREATE_DETACHED);
+
+    struct sigaction sa = {0};
+    sa.sa_handler = rngd_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+    pthread_sigmask(SIG_SETMASK, &old_mask, NULL);
+
+    LT_LOG_INFO("lt-rngd listening on %s, pool %zu bytes, refill below %zu up to %zu", socket_path, pool.size,
+                pool.low, pool.high);
+
+    while (!rngd_stop) {
+        struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+        if (poll(&pfd, 1, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LT_LOG_ERROR("Error poll(): %s", strerror(errno));
+            break;
+        }
+
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        pthread_mutex_lock(&pool.lock);
+        bool full = (pool.clients >= RNGD_CLIENTS_MAX);
+        if (!full) {
+            pool.clients++;
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        pthread_t thread;
+        if (full || pthread_create(&thread, &client_attr, rngd_client, (void *)(intptr_t)client) != 0) {
+            LT_LOG_WARN("Too many consumers, connection refused");
+            if (!full) {
+                pthread_mutex_lock(&pool.lock);
+                pool.clients--;
+                pthread_mutex_unlock(&pool.lock);
+            }
+            close(client);
+        }
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = true;
+    pthread_cond_broadcast(&pool.filled);
+    pthread_cond_broadcast(&pool.drained);
+    LT_LOG_INFO("lt-rngd exiting: served %" PRIu64 " B, pulled %" PRIu64 " B in %" PRIu64
+                " refills, %" PRIu64 " underruns, fed kernel %" PRIu64 " B",
+                pool.served, pool.pulled, pool.refills, pool.underruns, pool.fed_kernel);
+    pthread_mutex_unlock(&pool.lock);
+
+    // FIFO thread may be blocked in open() waiting for a reader, it ends together with the process
+    pthread_join(refill_thread, NULL);
+    close(listen_fd);
+    unlink(socket_path);
+    lt_util_session_reset(&h);
+    if (refill_args.kernel_fd >= 0) {
+        close(refill_args.kernel_fd);
+    }
+
+    pthread_mutex_lock(&pool.lock);
+    memset(pool.buf, 0, pool.size);
+    pthread_mutex_unlock(&pool.lock);
+
+    return 0;
+}
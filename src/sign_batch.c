@@ -0,0 +1,405 @@
+/**
+ * @file sign_batch.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Ring of SIGN_BATCH_DEPTH slots passed between three threads, each slot goes FREE -> READ -> SIGNED ->
+ * FREE again. Reader fills free slots with messages, the main thread signs them in the chip and the writer stores
+ * signatures. All of them walk the ring in the same order, so signatures are written in order of files and the chip
+ * waits for the disk only when the ring is full or empty.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "sign_batch.h"
+
+#define LT_LOG_CMD(f_, ...) LT_LOG("[CMD] " f_, ##__VA_ARGS__)
+
+enum sign_batch_state {
+    SIGN_BATCH_FREE,
+    SIGN_BATCH_READ,
+    SIGN_BATCH_SIGNED,
+};
+
+struct sign_batch_slot {
+    enum sign_batch_state state;
+    size_t file;   /**< Index into list of files */
+    bool skip;     /**< File could not be read or not signed, nothing is written */
+    uint16_t len;
+    uint8_t msg[ECC_SIGN_MSG_LEN_MAX];
+    uint8_t signature[64];
+};
+
+/** @brief State shared by reader, signing (main) and writer thread */
+struct sign_batch {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct sign_batch_slot slot[SIGN_BATCH_DEPTH];
+    char **files;
+    size_t count;
+    const char *outdir;
+    /** Set by the main thread when the chip fails, reader and writer stop */
+    bool abort;
+    /** Counters of reader and writer, read by the main thread after they finish */
+    size_t read_failed;
+    size_t write_failed;
+    size_t written;
+    uint64_t bytes;
+};
+
+static uint64_t sign_batch_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Waits until slot k gets into given state, returns false if the batch was aborted meanwhile
+static bool sign_batch_wait(struct sign_batch *sb, size_t k, enum sign_batch_state state)
+{
+    pthread_mutex_lock(&sb->lock);
+    while (sb->slot[k].state != state && !sb->abort) {
+        pthread_cond_wait(&sb->cond, &sb->lock);
+    }
+    bool ok = !sb->abort;
+    pthread_mutex_unlock(&sb->lock);
+
+    return ok;
+}
+
+static void sign_batch_set(struct sign_batch *sb, size_t k, enum sign_batch_state state)
+{
+    pthread_mutex_lock(&sb->lock);
+    sb->slot[k].state = state;
+    pthread_cond_broadcast(&sb->cond);
+    pthread_mutex_unlock(&sb->lock);
+}
+
+static void sign_batch_abort(struct sign_batch *sb)
+{
+    pthread_mutex_lock(&sb->lock);
+    sb->abort = true;
+    pthread_cond_broadcast(&sb->cond);
+    pthread_mutex_unlock(&sb->lock);
+}
+
+// Reads whole message into the slot, fails for a file bigger than the chip signs
+static int sign_batch_read_file(const char *path, struct sign_batch_slot *slot)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        LT_LOG_ERROR("[SIGN] Error opening file %s", path);
+        return 1;
+    }
+
+    // One byte more than fits, so a bigger file is detected without stat()
+    size_t len = 0;
+    uint8_t extra;
+    while (1) {
+        ssize_t n = (len < sizeof(slot->msg)) ? read(fd, slot->msg + len, sizeof(slot->msg) - len)
+                                               : read(fd, &extra, 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            LT_LOG_ERROR("[SIGN] Error reading file %s", path);
+            close(fd);
+            return 1;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (len == sizeof(slot->msg)) {
+            LT_LOG_ERROR("[SIGN] %s is bigger than %d B, use "ECC" "ECC_SIGN_DIGEST, path, ECC_SIGN_MSG_LEN_MAX);
+            close(fd);
+            return 1;
+        }
+        len += n;
+    }
+    close(fd);
+    slot->len = (uint16_t)len;
+
+    return 0;
+}
+
+static void *sign_batch_reader(void *arg)
+{
+    struct sign_batch *sb = arg;
+
+    for (size_t i = 0; i < sb->count; i++) {
+        size_t k = i % SIGN_BATCH_DEPTH;
+        if (!sign_batch_wait(sb, k, SIGN_BATCH_FREE)) {
+            break;
+        }
+        struct sign_batch_slot *slot = &sb->slot[k];
+        slot->file = i;
+        slot->skip = (sign_batch_read_file(sb->files[i], slot) != 0);
+        if (slot->skip) {
+            sb->read_failed++;
+        }
+        sign_batch_set(sb, k, SIGN_BATCH_READ);
+    }
+
+    return NULL;
+}
+
+// Writes "<outdir>/<file name>.sig"
+static int sign_batch_write_file(const struct sign_batch *sb, const struct sign_batch_slot *slot)
+{
+    const char *file = sb->files[slot->file];
+    const char *name = strrchr(file, '/');
+    name = name ? name + 1 : file;
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s.sig", sb->outdir, name) >= (int)sizeof(path)) {
+        LT_LOG_ERROR("[SIGN] Path too long for signature of %s", file);
+        return 1;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        LT_LOG_ERROR("[SIGN] Error opening file %s", path);
+        return 1;
+    }
+    ssize_t n;
+    do {
+        n = write(fd, slot->signature, sizeof(slot->signature));
+    } while (n < 0 && errno == EINTR);
+    if ((close(fd) != 0) || (n != (ssize_t)sizeof(slot->signature))) {
+        LT_LOG_ERROR("[SIGN] Error writing into file %s", path);
+        return 1;
+    }
+
+    return 0;
+}
+
+static void *sign_batch_writer(void *arg)
+{
+    struct sign_batch *sb = arg;
+
+    for (size_t i = 0; i < sb->count; i++) {
+        size_t k = i % SIGN_BATCH_DEPTH;
+        if (!sign_batch_wait(sb, k, SIGN_BATCH_SIGNED)) {
+            break;
+        }
+        struct sign_batch_slot *slot = &sb->slot[k];
+        if (!slot->skip) {
+            if (sign_batch_write_file(sb, slot) != 0) {
+                sb->write_failed++;
+            } else {
+                sb->written++;
+                sb->bytes += slot->len;
+            }
+        }
+        sign_batch_set(sb, k, SIGN_BATCH_FREE);
+    }
+
+    return NULL;
+}
+
+static int sign_batch_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static int sign_batch_add(struct sign_batch *sb, const char *path)
+{
+    if (sb->count == SIGN_BATCH_FILES_MAX) {
+        LT_LOG_ERROR("[SIGN] Too many files, max %d", SIGN_BATCH_FILES_MAX);
+        return 1;
+    }
+    if (sb->count % 1024 == 0) {
+        char **files = realloc(sb->files, (sb->count + 1024) * sizeof(char *));
+        if (!files) {
+            return 1;
+        }
+        sb->files = files;
+    }
+    sb->files[sb->count] = strdup(path);
+    if (!sb->files[sb->count]) {
+        return 1;
+    }
+    sb->count++;
+
+    return 0;
+}
+
+// Collects regular files of a directory sorted by name, or paths listed in a file
+static int sign_batch_collect(struct sign_batch *sb, const char *src)
+{
+    struct stat st;
+    if (stat(src, &st) != 0) {
+        LT_LOG_ERROR("[SIGN] Error opening %s", src);
+        return 1;
+    }
+
+    char path[PATH_MAX];
+    int ret = 0;
+    if (S_ISDIR(st.st_mode)) {
+        DIR *dir = opendir(src);
+        if (!dir) {
+            LT_LOG_ERROR("[SIGN] Error opening directory %s", src);
+            return 1;
+        }
+        struct dirent *e;
+        while (ret == 0 && (e = readdir(dir)) != NULL) {
+            snprintf(path, sizeof(path), "%s/%s", src, e->d_name);
+            if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+                ret = sign_batch_add(sb, path);
+            }
+        }
+        closedir(dir);
+        if (ret == 0 && sb->count) {
+            qsort(sb->files, sb->count, sizeof(char *), sign_batch_cmp);
+        }
+    } else {
+        FILE *fp = fopen(src, "r");
+        if (!fp) {
+            LT_LOG_ERROR("[SIGN] Error opening list %s", src);
+            return 1;
+        }
+        while (ret == 0 && fgets(path, sizeof(path), fp)) {
+            path[strcspn(path, "\r\n")] = '\0';
+            if (path[0] != '\0' && path[0] != '#') {
+                ret = sign_batch_add(sb, path);
+            }
+        }
+        fclose(fp);
+    }
+
+    if (ret == 0 && sb->count == 0) {
+        LT_LOG_ERROR("[SIGN] No files to sign in %s", src);
+        ret = 1;
+    }
+
+    return ret;
+}
+
+int lt_util_sign_batch(lt_handle_t *h, char *slot_in, char *src, char *outdir)
+{
+    if(!slot_in || !src || !outdir) {
+        LT_LOG_ERROR("Error, NULL parameters lt_util_sign_batch()");
+        return 1;
+    } else {
+        LT_LOG_CMD("lt-util "ECC" "ECC_SIGN_BATCH" %s %s %s", slot_in, src, outdir);
+    }
+
+    // Parsing slot number
+    char *endptr;
+    long int slot = strtol(slot_in, &endptr, 10);
+
+    if((*endptr != '\0') || (slot < 0) || (slot > 31)) {
+        LT_LOG_ERROR("Error, wrong slot number ");
+        return 1;
+    }
+
+    struct sign_batch *sb = calloc(1, sizeof(*sb));
+    if (!sb) {
+        return 1;
+    }
+    sb->outdir = outdir;
+
+    int ret = 1;
+    pthread_t reader, writer;
+    bool reader_started = false;
+    if (sign_batch_collect(sb, src) != 0) {
+        goto exit;
+    }
+    pthread_mutex_init(&sb->lock, NULL);
+    pthread_cond_init(&sb->cond, NULL);
+
+    if (lt_util_session_open(h) != 0) {
+        goto exit_sync;
+    }
+
+    // Reader starts after the handshake, both threads would otherwise only wait for it
+    if (pthread_create(&reader, NULL, sign_batch_reader, sb) != 0) {
+        LT_LOG_ERROR("Error starting reader thread");
+        lt_util_session_close(h);
+        goto exit_sync;
+    }
+    reader_started = true;
+    if (pthread_create(&writer, NULL, sign_batch_writer, sb) != 0) {
+        LT_LOG_ERROR("Error starting writer thread");
+        sign_batch_abort(sb);
+        lt_util_session_close(h);
+        goto exit_sync;
+    }
+
+    uint64_t start = sign_batch_now_ns();
+    uint64_t chip_ns = 0;
+    size_t sign_failed = 0;
+    ret = 0;
+    for (size_t i = 0; i < sb->count; i++) {
+        size_t k = i % SIGN_BATCH_DEPTH;
+        if (!sign_batch_wait(sb, k, SIGN_BATCH_READ)) {
+            break;
+        }
+        struct sign_batch_slot *s = &sb->slot[k];
+        if (!s->skip) {
+            uint64_t t = sign_batch_now_ns();
+            lt_ret_t l3_ret = lt_ecc_eddsa_sign(h, (uint8_t)slot, s->msg, s->len, s->signature);
+            chip_ns += sign_batch_now_ns() - t;
+            if (l3_ret != LT_OK) {
+                LT_LOG_ERROR("[SIGN] %s: Error l3 cmd: %s", sb->files[s->file], lt_ret_verbose(l3_ret));
+                sign_failed++;
+                ret = 1;
+                sign_batch_abort(sb);
+                break;
+            }
+        }
+        sign_batch_set(sb, k, SIGN_BATCH_SIGNED);
+    }
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+    reader_started = false;
+    uint64_t elapsed_ns = sign_batch_now_ns() - start;
+
+    if (ret != 0) {
+        // Do not trust the session after a failure
+        lt_util_session_reset(h);
+    } else {
+        lt_util_session_close(h);
+    }
+    if (sb->read_failed || sb->write_failed || sb->written != sb->count) {
+        ret = 1;
+    }
+
+    double seconds = elapsed_ns / 1e9;
+    LT_LOG("[SIGN] %zu of %zu files signed (%zu not read, %zu not signed, %zu not written), %llu bytes in %.3f s",
+           sb->written, sb->count, sb->read_failed, sign_failed, sb->write_failed, (unsigned long long)sb->bytes,
+           seconds);
+    LT_LOG("[SIGN] %.1f files/s, %.0f B/s, chip busy %.0f %% of the time", seconds > 0 ? sb->written / seconds : 0.0,
+           seconds > 0 ? sb->bytes / seconds : 0.0, elapsed_ns ? 100.0 * chip_ns / elapsed_ns : 0.0);
+
+exit_sync:
+    if (reader_started) {
+        pthread_join(reader, NULL);
+    }
+    pthread_cond_destroy(&sb->cond);
+    pthread_mutex_destroy(&sb->lock);
+exit:
+    for (size_t i = 0; i < sb->count; i++) {
+        free(sb->files[i]);
+    }
+    free(sb->files);
+    free(sb);
+
+    return ret;
+}
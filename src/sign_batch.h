@@ -0,0 +1,38 @@
+#ifndef SIGN_BATCH_H
+#define SIGN_BATCH_H
+
+/**
+ * @file sign_batch.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Signing of many files within one secure session
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include "libtropic.h"
+
+/** @brief Messages read ahead of the one being signed, and signatures waiting to be written */
+#define SIGN_BATCH_DEPTH 8
+
+/** @brief Most files signed by one command */
+#define SIGN_BATCH_FILES_MAX 100000
+
+/**
+ * @brief Sign every file of a directory or list with lt_ecc_eddsa_sign(), as lt-util -e -s does one
+ *
+ * @details Files are processed as a pipeline of three threads: a reader loads next messages while the chip signs
+ *          the current one, and a writer stores finished signatures. Signature of "<path>/<name>" is written into
+ *          "<outdir>/<name>.sig". A file which can not be read or is bigger than 4095 B is reported and skipped,
+ *          an error of the chip ends the batch. Throughput summary is printed at the end.
+ *
+ * @param h           Device's handle
+ * @param slot_in     ECC slot (0-31)
+ * @param src         Directory, whose regular files are signed in order of their names, or file listing one path
+ *                    per line
+ * @param outdir      Directory for signatures
+ * @return int        0 if all files were signed, otherwise 1
+ */
+int lt_util_sign_batch(lt_handle_t *h, char *slot_in, char *src, char *outdir);
+
+#endif
@@ -0,0 +1,881 @@
+/**
+ * @file sim_chip.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Layers of the model mirror libtropic: sim_chip_transfer() and sim_chip_csn_*() handle L1 framing,
+ * l2_request() dispatches L2 requests and l3_command() executes decrypted L3 commands. Time the chip needs for an
+ * operation is modelled by holding the response back (GET_RESPONSE returns NO_RESP) until latency expires, exactly
+ * as a busy chip does, so the host's polling behaviour is part of every measurement.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "digest.h"
+#include "libtropic_logging.h"
+#include "lt_crc16.h"
+#include "sim_chip.h"
+#include "sim_crypto.h"
+
+#define SIM_NVM_MAGIC   "LTSM"
+#define SIM_NVM_VERSION 1
+
+// L1
+#define SIM_GET_RESPONSE      0xAA
+#define SIM_CHIP_STATUS_READY 0x01
+
+// L2 requests
+#define SIM_L2_GET_INFO      0x01
+#define SIM_L2_HANDSHAKE     0x02
+#define SIM_L2_ENCRYPTED_CMD 0x04
+#define SIM_L2_SESSION_ABT   0x08
+#define SIM_L2_RESEND        0x10
+#define SIM_L2_SLEEP         0x20
+#define SIM_L2_GET_LOG       0xA2
+#define SIM_L2_STARTUP       0xB3
+
+// L2 statuses
+#define SIM_L2_REQ_OK      0x01
+#define SIM_L2_RES_OK      0x02
+#define SIM_L2_REQ_CONT    0x03
+#define SIM_L2_RES_CONT    0x04
+#define SIM_L2_HSK_ERR     0x79
+#define SIM_L2_NO_SESSION  0x7A
+#define SIM_L2_TAG_ERR     0x7B
+#define SIM_L2_CRC_ERR     0x7C
+#define SIM_L2_UNKNOWN_REQ 0x7E
+#define SIM_L2_GEN_ERR     0x7F
+#define SIM_L2_NO_RESP     0xFF
+
+/** @brief Chunk size of L3 result, host accepts any length up to a full frame */
+#define SIM_L2_CHUNK_LEN 128
+
+// GET_INFO objects
+#define SIM_INFO_CERT_STORE 0x00
+#define SIM_INFO_CHIP_ID    0x01
+#define SIM_INFO_RISCV_FW   0x02
+#define SIM_INFO_SPECT_FW   0x04
+#define SIM_INFO_BLOCK_LEN  128
+#define SIM_CERT_STORE_LEN  3840
+
+// L3 commands
+#define SIM_L3_PING                 0x01
+#define SIM_L3_PAIRING_KEY_WRITE    0x10
+#define SIM_L3_PAIRING_KEY_READ     0x11
+#define SIM_L3_PAIRING_KEY_INVALIDATE 0x12
+#define SIM_L3_R_MEM_DATA_WRITE     0x40
+#define SIM_L3_R_MEM_DATA_READ      0x41
+#define SIM_L3_R_MEM_DATA_ERASE     0x42
+#define SIM_L3_RANDOM_VALUE_GET     0x50
+#define SIM_L3_ECC_KEY_GENERATE     0x60
+#define SIM_L3_ECC_KEY_STORE        0x61
+#define SIM_L3_ECC_KEY_READ         0x62
+#define SIM_L3_ECC_KEY_ERASE        0x63
+#define SIM_L3_ECDSA_SIGN           0x70
+#define SIM_L3_EDDSA_SIGN           0x71
+#define SIM_L3_MCOUNTER_INIT        0x80
+#define SIM_L3_MCOUNTER_UPDATE      0x81
+#define SIM_L3_MCOUNTER_GET         0x82
+#define SIM_L3_MAC_AND_DESTROY      0x90
+
+// L3 results
+#define SIM_L3_OK                   0xC3
+#define SIM_L3_FAIL                 0x3C
+#define SIM_L3_INVALID_CMD          0x02
+#define SIM_L3_R_MEM_WRITE_FAIL     0x10
+#define SIM_L3_ECC_INVALID_KEY      0x12
+#define SIM_L3_MCOUNTER_UPDATE_ERR  0x13
+#define SIM_L3_COUNTER_INVALID      0x14
+#define SIM_L3_PAIRING_KEY_EMPTY    0x15
+#define SIM_L3_PAIRING_KEY_INVALID  0x16
+
+#define SIM_CURVE_P256    1
+#define SIM_CURVE_ED25519 2
+#define SIM_ORIGIN_GENERATED 1
+#define SIM_ORIGIN_STORED    2
+
+#define SIM_PAIRING_EMPTY   0
+#define SIM_PAIRING_WRITTEN 1
+#define SIM_PAIRING_INVALID 2
+
+static const char *sim_op_names[SIM_OP_COUNT] = {
+    [SIM_OP_GET_INFO] = "get_info",
+    [SIM_OP_HANDSHAKE] = "handshake",
+    [SIM_OP_PING] = "ping",
+    [SIM_OP_PAIRING_KEY] = "pairing_key",
+    [SIM_OP_R_MEM_DATA_WRITE] = "r_mem_data_write",
+    [SIM_OP_R_MEM_DATA_READ] = "r_mem_data_read",
+    [SIM_OP_R_MEM_DATA_ERASE] = "r_mem_data_erase",
+    [SIM_OP_RANDOM_VALUE_GET] = "random_value_get",
+    [SIM_OP_ECC_KEY_GENERATE] = "ecc_key_generate",
+    [SIM_OP_ECC_KEY_STORE] = "ecc_key_store",
+    [SIM_OP_ECC_KEY_READ] = "ecc_key_read",
+    [SIM_OP_ECC_KEY_ERASE] = "ecc_key_erase",
+    [SIM_OP_ECC_EDDSA_SIGN] = "ecc_eddsa_sign",
+    [SIM_OP_MCOUNTER] = "mcounter",
+    [SIM_OP_MAC_AND_DESTROY] = "mac_and_destroy",
+};
+
+static uint64_t sim_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/** @brief Source of chip's TRNG, shared by all chips simulated in the process */
+static int sim_random_fd = -1;
+static pthread_once_t sim_random_once = PTHREAD_ONCE_INIT;
+
+static void sim_random_open(void)
+{
+    sim_random_fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+}
+
+// Chip's TRNG
+static void sim_random(uint8_t *buff, size_t len)
+{
+    pthread_once(&sim_random_once, sim_random_open);
+    int fd = sim_random_fd;
+    while (len) {
+        ssize_t n = fd < 0 ? -1 : read(fd, buff, len);
+        if (n <= 0) {
+            // Never expected, keep the model running with weak randomness rather than returning zeros
+            for (size_t i = 0; i < len; i++) {
+                buff[i] = (uint8_t)rand();
+            }
+            return;
+        }
+        buff += n;
+        len -= (size_t)n;
+    }
+}
+
+int sim_op_parse(const char *name, enum sim_op *op)
+{
+    for (int i = 0; i < SIM_OP_COUNT; i++) {
+        if (strcmp(name, sim_op_names[i]) == 0) {
+            *op = (enum sim_op)i;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int sim_chip_latency_parse(struct sim_chip *chip, const char *spec)
+{
+    char buf[512];
+    if (strlen(spec) >= sizeof(buf)) {
+        LT_LOG_ERROR("Latency specification is too long");
+        return 1;
+    }
+    strcpy(buf, spec);
+
+    char *save;
+    for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        char *endptr;
+        if (!eq) {
+            LT_LOG_ERROR("Latency item '%s' is not <op>=<us>", item);
+            return 1;
+        }
+        *eq = '\0';
+        unsigned long us = strtoul(eq + 1, &endptr, 10);
+        if (eq[1] == '\0' || *endptr != '\0' || us > 10000000) {
+            LT_LOG_ERROR("Latency of '%s' is not a number of microseconds (max 10 s)", item);
+            return 1;
+        }
+
+        if (strcmp(item, "*") == 0) {
+            for (int i = 0; i < SIM_OP_COUNT; i++) {
+                chip->latency_us[i] = (uint32_t)us;
+            }
+            continue;
+        }
+        enum sim_op op;
+        if (sim_op_parse(item, &op)) {
+            LT_LOG_ERROR("Unknown operation '%s' in latency specification", item);
+            return 1;
+        }
+        chip->latency_us[op] = (uint32_t)us;
+    }
+    return 0;
+}
+
+static int nvm_save(struct sim_chip *chip)
+{
+    if (!chip->state_path) {
+        return 0;
+    }
+
+    // Written aside and renamed, so the state file is never torn
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", chip->state_path) >= (int)sizeof(tmp)) {
+        LT_LOG_ERROR("Simulator state path is too long");
+        return 1;
+    }
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        LT_LOG_ERROR("Simulator state file %s can't be written", tmp);
+        return 1;
+    }
+    size_t n = fwrite(&chip->nvm, sizeof(chip->nvm), 1, f);
+    if (fclose(f) != 0 || n != 1 || rename(tmp, chip->state_path) != 0) {
+        LT_LOG_ERROR("Simulator state file %s can't be written", chip->state_path);
+        unlink(tmp);
+        return 1;
+    }
+    return 0;
+}
+
+static void nvm_manufacture(struct sim_nvm *nvm, const uint8_t sh0pub[32])
+{
+    memset(nvm, 0, sizeof(*nvm));
+    memcpy(nvm->magic, SIM_NVM_MAGIC, sizeof(nvm->magic));
+    nvm->version = SIM_NVM_VERSION;
+    sim_random(nvm->st_priv, sizeof(nvm->st_priv));
+    sim_random(nvm->serial, sizeof(nvm->serial));
+    sim_random(nvm->macandd_key, sizeof(nvm->macandd_key));
+    nvm->pairing_state[0] = SIM_PAIRING_WRITTEN;
+    memcpy(nvm->pairing_key[0], sh0pub, 32);
+}
+
+// Loads non volatile content from state file, or manufactures a new chip when there is none
+static int nvm_load(struct sim_chip *chip, const uint8_t sh0pub[32])
+{
+    if (chip->state_path) {
+        FILE *f = fopen(chip->state_path, "rb");
+        if (f) {
+            size_t n = fread(&chip->nvm, sizeof(chip->nvm), 1, f);
+            fclose(f);
+            if (n != 1 || memcmp(chip->nvm.magic, SIM_NVM_MAGIC, sizeof(chip->nvm.magic)) != 0
+                || chip->nvm.version != SIM_NVM_VERSION) {
+                LT_LOG_ERROR("Simulator state file %s is not valid, remove it to start with a new chip",
+                             chip->state_path);
+                memset(&chip->nvm, 0, sizeof(chip->nvm));
+                return 1;
+            }
+            return 0;
+        }
+    }
+
+    nvm_manufacture(&chip->nvm, sh0pub);
+    return nvm_save(chip);
+}
+
+int sim_chip_power_up(struct sim_chip *chip, const uint8_t sh0pub[32])
+{
+    chip->selected = false;
+    chip->frame_len = 0;
+    chip->last_len = 0;
+    chip->session = false;
+    chip->cmd_len = 0;
+    chip->res_len = 0;
+    chip->res_off = 0;
+
+    if (chip->nvm.version == SIM_NVM_VERSION) {
+        // Already powered in this process, non volatile content is in memory
+        return 0;
+    }
+    if (nvm_load(chip, sh0pub)) {
+        return 1;
+    }
+    sim_x25519(chip->st_pub, chip->nvm.st_priv, NULL);
+    return 0;
+}
+
+/*
+ * L2
+ */
+
+static void l2_respond(struct sim_chip *chip, uint8_t status, const uint8_t *data, uint8_t len, uint64_t ready_ns)
+{
+    chip->frame[0] = status;
+    chip->frame[1] = len;
+    if (len) {
+        memcpy(chip->frame + 2, data, len);
+    }
+    add_crc(chip->frame);
+    chip->frame_len = len + 4;
+    chip->frame_ready_ns = ready_ns;
+}
+
+// Prepares next chunk of L3 result, if any
+static void l2_next_chunk(struct sim_chip *chip)
+{
+    if (chip->res_off >= chip->res_len) {
+        chip->res_len = chip->res_off = 0;
+        return;
+    }
+    size_t n = chip->res_len - chip->res_off;
+    if (n > SIM_L2_CHUNK_LEN) {
+        n = SIM_L2_CHUNK_LEN;
+    }
+    uint8_t status = chip->res_off + n < chip->res_len ? SIM_L2_RES_CONT : SIM_L2_RES_OK;
+    l2_respond(chip, status, chip->res + chip->res_off, (uint8_t)n, chip->res_ready_ns);
+    chip->res_off += n;
+}
+
+// Minimal DER certificate which carries STPUB as X25519 SubjectPublicKeyInfo, followed by three empty certificates
+static void get_cert_store(struct sim_chip *chip, uint8_t store[SIM_CERT_STORE_LEN])
+{
+    static const uint8_t cert_head[] = {
+        0x30, 0x81, 0x8d,                                         // Certificate
+        0x30, 0x41,                                               //   tbsCertificate
+        0xa0, 0x03, 0x02, 0x01, 0x02,                             //     version v3
+        0x02, 0x01, 0x01,                                         //     serialNumber
+        0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70,                 //     signature Ed25519
+        0x30, 0x00, 0x30, 0x00, 0x30, 0x00,                       //     issuer, validity, subject
+        0x30, 0x2a, 0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x6e,     //     subjectPublicKeyInfo X25519
+        0x03, 0x21, 0x00                                          //       subjectPublicKey
+    };
+    static const uint8_t cert_tail[] = {
+        0x30, 0x05, 0x06, 0x03, 0x2b, 0x65, 0x70,                 //   signatureAlgorithm Ed25519
+        0x03, 0x41, 0x00                                          //   signatureValue, 64 zeros follow
+    };
+    const size_t cert_len = sizeof(cert_head) + 32 + sizeof(cert_tail) + 64;
+    const uint8_t empty_cert[] = {0x30, 0x00};
+
+    memset(store, 0, SIM_CERT_STORE_LEN);
+    uint8_t *p = store;
+    *p++ = 1; // version
+    *p++ = 4; // number of certificates
+    *p++ = (uint8_t)(cert_len >> 8);
+    *p++ = (uint8_t)cert_len;
+    for (int i = 1; i < 4; i++) {
+        *p++ = 0;
+        *p++ = sizeof(empty_cert);
+    }
+    memcpy(p, cert_head, sizeof(cert_head));
+    p += sizeof(cert_head);
+    memcpy(p, chip->st_pub, 32);
+    p += 32;
+    memcpy(p, cert_tail, sizeof(cert_tail));
+    p += sizeof(cert_tail) + 64;
+    for (int i = 1; i < 4; i++) {
+        memcpy(p, empty_cert, sizeof(empty_cert));
+        p += sizeof(empty_cert);
+    }
+}
+
+static void l2_get_info(struct sim_chip *chip, const uint8_t *data, uint8_t len)
+{
+    uint64_t ready = sim_now_ns() + chip->latency_us[SIM_OP_GET_INFO] * 1000ull;
+    uint8_t out[SIM_INFO_BLOCK_LEN] = {0};
+    uint8_t out_len = 0;
+
+    if (len < 1) {
+        l2_respond(chip, SIM_L2_GEN_ERR, NULL, 0, ready);
+        return;
+    }
+    uint8_t block = len > 1 ? data[1] : 0;
+
+    switch (data[0]) {
+        case SIM_INFO_CERT_STORE: {
+            uint8_t store[SIM_CERT_STORE_LEN];
+            if ((size_t)block * SIM_INFO_BLOCK_LEN >= sizeof(store)) {
+                l2_respond(chip, SIM_L2_GEN_ERR, NULL, 0, ready);
+                return;
+            }
+            get_cert_store(chip, store);
+            memcpy(out, store + block * SIM_INFO_BLOCK_LEN, SIM_INFO_BLOCK_LEN);
+            out_len = SIM_INFO_BLOCK_LEN;
+            break;
+        }
+        case SIM_INFO_CHIP_ID:
+            // Everything zero except ser_num field
+            memcpy(out + 52, chip->nvm.serial, sizeof(chip->nvm.serial));
+            out_len = SIM_INFO_BLOCK_LEN;
+            break;
+        case SIM_INFO_RISCV_FW:
+        case SIM_INFO_SPECT_FW:
+            out[2] = 1; // 0.1.0
+            out_len = 4;
+            break;
+        default:
+            l2_respond(chip, SIM_L2_GEN_ERR, NULL, 0, ready);
+            return;
+    }
+    l2_respond(chip, SIM_L2_REQ_OK, out, out_len, ready);
+}
+
+static void sha256_chain(uint8_t h[32], const uint8_t *data, size_t len)
+{
+    struct digest_sha256_ctx ctx;
+    digest_sha256_init(&ctx);
+    digest_sha256_update(&ctx, h, 32);
+    digest_sha256_update(&ctx, data, len);
+    digest_sha256_final(&ctx, h);
+}
+
+// Noise_KK1_25519_AESGCM_SHA256, responder side
+static void l2_handshake(struct sim_chip *chip, const uint8_t *data, uint8_t len)
+{
+    static const uint8_t protocol_name[32] = "Noise_KK1_25519_AESGCM_SHA256\0\0\0";
+    uint64_t ready = sim_now_ns() + chip->latency_us[SIM_OP_HANDSHAKE] * 1000ull;
+    uint8_t idx = len == 33 ? data[32] : 0xff;
+
+    chip->session = false;
+    if (idx >= SIM_PAIRING_SLOTS || chip->nvm.pairing_state[idx] != SIM_PAIRING_WRITTEN) {
+        l2_respond(chip, SIM_L2_HSK_ERR, NULL, 0, ready);
+        return;
+    }
+    const uint8_t *ehpub = data;
+    const uint8_t *shipub = chip->nvm.pairing_key[idx];
+    const uint8_t *stpub = chip->st_pub;
+    uint8_t etpriv[32], out[32 + SIM_AESGCM_TAG_LEN];
+    uint8_t *etpub = out, *tag = out + 32;
+
+    sim_random(etpriv, sizeof(etpriv));
+    sim_x25519(etpub, etpriv, NULL);
+
+    uint8_t h[32];
+    struct digest_sha256_ctx ctx;
+    digest_sha256_init(&ctx);
+    digest_sha256_update(&ctx, protocol_name, sizeof(protocol_name));
+    digest_sha256_final(&ctx, h);
+    sha256_chain(h, shipub, 32);
+    sha256_chain(h, stpub, 32);
+    sha256_chain(h, ehpub, 32);
+    sha256_chain(h, &idx, 1);
+    sha256_chain(h, etpub, 32);
+
+    uint8_t ck[32], k_auth[32], shared[32], unused[32];
+    memcpy(ck, protocol_name, sizeof(ck));
+    sim_x25519(shared, etpriv, ehpub);
+    sim_hkdf(ck, shared, sizeof(shared), ck, unused);
+    sim_x25519(shared, etpriv, shipub);
+    sim_hkdf(ck, shared, sizeof(shared), ck, unused);
+    sim_x25519(shared, chip->nvm.st_priv, ehpub);
+    sim_hkdf(ck, shared, sizeof(shared), ck, k_auth);
+    sim_hkdf(ck, NULL, 0, chip->k_cmd, chip->k_res);
+
+    const uint8_t iv[SIM_AESGCM_IV_LEN] = {0};
+    sim_aesgcm_encrypt(k_auth, iv, h, sizeof(h), NULL, 0, tag);
+
+    memset(etpriv, 0, sizeof(etpriv));
+    memset(shared, 0, sizeof(shared));
+    memset(k_auth, 0, sizeof(k_auth));
+    chip->session = true;
+    chip->nonce = 0;
+    chip->cmd_len = 0;
+    l2_respond(chip, SIM_L2_REQ_OK, out, sizeof(out), ready);
+}
+
+/*
+ * L3
+ */
+
+static uint16_t get_slot(const uint8_t *cmd)
+{
+    return (uint16_t)(cmd[1] | (cmd[2] << 8));
+}
+
+/**
+ * Executes decrypted command, returns operation for latency. Result goes into out, *dirty is set when non volatile
+ * content changed.
+ */
+static enum sim_op l3_command(struct sim_chip *chip, const uint8_t *cmd, size_t len, uint8_t *out, size_t *out_len,
+                              bool *dirty)
+{
+    struct sim_nvm *nvm = &chip->nvm;
+    uint16_t slot = len >= 3 ? get_slot(cmd) : 0xffff;
+
+    out[0] = SIM_L3_FAIL;
+    *out_len = 1;
+
+    switch (len ? cmd[0] : 0) {
+        case SIM_L3_PING:
+            out[0] = SIM_L3_OK;
+            memcpy(out + 1, cmd + 1, len - 1);
+            *out_len = len;
+            return SIM_OP_PING;
+
+        case SIM_L3_PAIRING_KEY_WRITE:
+            if (len == 4 + 32 && slot < SIM_PAIRING_SLOTS && nvm->pairing_state[slot] == SIM_PAIRING_EMPTY) {
+                memcpy(nvm->pairing_key[slot], cmd + 4, 32);
+                nvm->pairing_state[slot] = SIM_PAIRING_WRITTEN;
+                out[0] = SIM_L3_OK;
+                *dirty = true;
+            }
+            return SIM_OP_PAIRING_KEY;
+        case SIM_L3_PAIRING_KEY_READ:
+            if (len == 3 && slot < SIM_PAIRING_SLOTS) {
+                if (nvm->pairing_state[slot] == SIM_PAIRING_EMPTY) {
+                    out[0] = SIM_L3_PAIRING_KEY_EMPTY;
+                } else if (nvm->pairing_state[slot] == SIM_PAIRING_INVALID) {
+                    out[0] = SIM_L3_PAIRING_KEY_INVALID;
+                } else {
+                    memset(out, 0, 4);
+                    out[0] = SIM_L3_OK;
+                    memcpy(out + 4, nvm->pairing_key[slot], 32);
+                    *out_len = 4 + 32;
+                }
+            }
+            return SIM_OP_PAIRING_KEY;
+        case SIM_L3_PAIRING_KEY_INVALIDATE:
+            if (len == 3 && slot < SIM_PAIRING_SLOTS) {
+                nvm->pairing_state[slot] = SIM_PAIRING_INVALID;
+                memset(nvm->pairing_key[slot], 0xff, 32);
+                out[0] = SIM_L3_OK;
+                *dirty = true;
+            }
+            return SIM_OP_PAIRING_KEY;
+
+        case SIM_L3_R_MEM_DATA_WRITE:
+            if (len >= 5 && len <= 4 + SIM_R_MEM_SLOT_LEN && slot < SIM_R_MEM_SLOTS) {
+                if (nvm->r_mem[slot].len) {
+                    out[0] = SIM_L3_R_MEM_WRITE_FAIL;
+                } else {
+                    nvm->r_mem[slot].len = (uint16_t)(len - 4);
+                    memcpy(nvm->r_mem[slot].data, cmd + 4, len - 4);
+                    out[0] = SIM_L3_OK;
+                    *dirty = true;
+                }
+            }
+            return SIM_OP_R_MEM_DATA_WRITE;
+        case SIM_L3_R_MEM_DATA_READ:
+            // Empty slot is returned as zero length data
+            if (len == 3 && slot < SIM_R_MEM_SLOTS) {
+                memset(out, 0, 4);
+                out[0] = SIM_L3_OK;
+                memcpy(out + 4, nvm->r_mem[slot].data, nvm->r_mem[slot].len);
+                *out_len = 4 + nvm->r_mem[slot].len;
+            }
+            return SIM_OP_R_MEM_DATA_READ;
+        case SIM_L3_R_MEM_DATA_ERASE:
+            if (len == 3 && slot < SIM_R_MEM_SLOTS) {
+                memset(&nvm->r_mem[slot], 0, sizeof(nvm->r_mem[slot]));
+                out[0] = SIM_L3_OK;
+                *dirty = true;
+            }
+            return SIM_OP_R_MEM_DATA_ERASE;
+
+        case SIM_L3_RANDOM_VALUE_GET:
+            if (len == 2) {
+                memset(out, 0, 4);
+                out[0] = SIM_L3_OK;
+                sim_random(out + 4, cmd[1]);
+                *out_len = 4 + cmd[1];
+            }
+            return SIM_OP_RANDOM_VALUE_GET;
+
+        case SIM_L3_ECC_KEY_GENERATE:
+        case SIM_L3_ECC_KEY_STORE: {
+            bool store = cmd[0] == SIM_L3_ECC_KEY_STORE;
+            enum sim_op op = store ? SIM_OP_ECC_KEY_STORE : SIM_OP_ECC_KEY_GENERATE;
+            if (len != (store ? 16u + 32 : 4u) || slot >= SIM_ECC_SLOTS || nvm->ecc[slot].curve) {
+                return op;
+            }
+            // P-256 is not modelled
+            if (cmd[3] != SIM_CURVE_ED25519) {
+                return op;
+            }
+            nvm->ecc[slot].curve = SIM_CURVE_ED25519;
+            if (store) {
+                nvm->ecc[slot].origin = SIM_ORIGIN_STORED;
+                memcpy(nvm->ecc[slot].key, cmd + 16, 32);
+            } else {
+                nvm->ecc[slot].origin = SIM_ORIGIN_GENERATED;
+                sim_random(nvm->ecc[slot].key, 32);
+            }
+            out[0] = SIM_L3_OK;
+            *dirty = true;
+            return op;
+        }
+        case SIM_L3_ECC_KEY_READ:
+            if (len == 3 && slot < SIM_ECC_SLOTS) {
+                if (!nvm->ecc[slot].curve) {
+                    out[0] = SIM_L3_ECC_INVALID_KEY;
+                } else {
+                    memset(out, 0, 16);
+                    out[0] = SIM_L3_OK;
+                    out[1] = nvm->ecc[slot].curve;
+                    out[2] = nvm->ecc[slot].origin;
+                    sim_ed25519_pubkey(out + 16, nvm->ecc[slot].key);
+                    *out_len = 16 + 32;
+                }
+            }
+            return SIM_OP_ECC_KEY_READ;
+        case SIM_L3_ECC_KEY_ERASE:
+            if (len == 3 && slot < SIM_ECC_SLOTS) {
+                memset(&nvm->ecc[slot], 0, sizeof(nvm->ecc[slot]));
+                out[0] = SIM_L3_OK;
+                *dirty = true;
+            }
+            return SIM_OP_ECC_KEY_ERASE;
+        case SIM_L3_ECDSA_SIGN:
+            // Only Ed25519 keys exist in the model
+            if (len == 16 + 32 && slot < SIM_ECC_SLOTS) {
+                out[0] = SIM_L3_ECC_INVALID_KEY;
+            }
+            return SIM_OP_ECC_EDDSA_SIGN;
+        case SIM_L3_EDDSA_SIGN:
+            if (len > 16 && len <= 16 + 4096 && slot < SIM_ECC_SLOTS) {
+                if (nvm->ecc[slot].curve != SIM_CURVE_ED25519) {
+                    out[0] = SIM_L3_ECC_INVALID_KEY;
+                } else {
+                    memset(out, 0, 16);
+                    out[0] = SIM_L3_OK;
+                    sim_ed25519_sign(out + 16, cmd + 16, len - 16, nvm->ecc[slot].key);
+                    *out_len = 16 + 64;
+                }
+            }
+            return SIM_OP_ECC_EDDSA_SIGN;
+
+        case SIM_L3_MCOUNTER_INIT:
+            if (len == 8 && slot < SIM_MCOUNTERS) {
+                nvm->mcounter[slot] = (uint32_t)cmd[4] | ((uint32_t)cmd[5] << 8) | ((uint32_t)cmd[6] << 16)
+                                      | ((uint32_t)cmd[7] << 24);
+                nvm->mcounter_valid[slot] = 1;
+                out[0] = SIM_L3_OK;
+                *dirty = true;
+            }
+            return SIM_OP_MCOUNTER;
+        case SIM_L3_MCOUNTER_UPDATE:
+            if (len == 3 && slot < SIM_MCOUNTERS) {
+                if (!nvm->mcounter_valid[slot]) {
+                    out[0] = SIM_L3_COUNTER_INVALID;
+                } else if (nvm->mcounter[slot] == 0) {
+                    out[0] = SIM_L3_MCOUNTER_UPDATE_ERR;
+                } else {
+                    nvm->mcounter[slot]--;
+                    out[0] = SIM_L3_OK;
+                    *dirty = true;
+                }
+            }
+            return SIM_OP_MCOUNTER;
+        case SIM_L3_MCOUNTER_GET:
+            if (len == 3 && slot < SIM_MCOUNTERS) {
+                if (!nvm->mcounter_valid[slot]) {
+                    out[0] = SIM_L3_COUNTER_INVALID;
+                } else {
+                    memset(out, 0, 4);
+                    out[0] = SIM_L3_OK;
+                    for (int i = 0; i < 4; i++) {
+                        out[4 + i] = (uint8_t)(nvm->mcounter[slot] >> (8 * i));
+                    }
+                    *out_len = 8;
+                }
+            }
+            return SIM_OP_MCOUNTER;
+
+        case SIM_L3_MAC_AND_DESTROY:
+            // Slot value keys the returned MAC and is then replaced by a value derived from data_out, so the same
+            // data_out written twice restores the slot and any other input destroys it
+            if (len == 4 + 32 && slot < SIM_MACANDD_SLOTS) {
+                uint8_t msg[2 + 32];
+                memset(out, 0, 4);
+                out[0] = SIM_L3_OK;
+                sim_hmac_sha256(nvm->macandd[slot], 32, cmd + 4, 32, out + 4);
+                msg[0] = (uint8_t)slot;
+                msg[1] = (uint8_t)(slot >> 8);
+                memcpy(msg + 2, cmd + 4, 32);
+                sim_hmac_sha256(nvm->macandd_key, 32, msg, sizeof(msg), nvm->macandd[slot]);
+                *out_len = 4 + 32;
+                *dirty = true;
+            }
+            return SIM_OP_MAC_AND_DESTROY;
+
+        default:
+            out[0] = SIM_L3_INVALID_CMD;
+            return SIM_OP_PING;
+    }
+}
+
+// Decrypts complete command packet, executes it and prepares encrypted result
+static void l3_process(struct sim_chip *chip)
+{
+    size_t size = chip->cmd[0] | (chip->cmd[1] << 8);
+    uint8_t *ct = chip->cmd + 2;
+    uint8_t iv[SIM_AESGCM_IV_LEN] = {0};
+    for (int i = 0; i < 4; i++) {
+        iv[i] = (uint8_t)(chip->nonce >> (8 * i));
+    }
+
+    if (sim_aesgcm_decrypt(chip->k_cmd, iv, NULL, 0, ct, size, ct + size)) {
+        chip->session = false;
+        l2_respond(chip, SIM_L2_TAG_ERR, NULL, 0, sim_now_ns());
+        return;
+    }
+
+    bool dirty = false;
+    size_t out_len;
+    uint8_t *out = chip->res + 2;
+    enum sim_op op = l3_command(chip, ct, size, out, &out_len, &dirty);
+    if (dirty && nvm_save(chip)) {
+        // Command takes no effect when it can't be made persistent
+        out[0] = SIM_L3_FAIL;
+        out_len = 1;
+    }
+
+    chip->res[0] = (uint8_t)out_len;
+    chip->res[1] = (uint8_t)(out_len >> 8);
+    sim_aesgcm_encrypt(chip->k_res, iv, NULL, 0, out, out_len, out + out_len);
+    chip->res_len = 2 + out_len + SIM_AESGCM_TAG_LEN;
+    chip->res_off = 0;
+    chip->res_ready_ns = sim_now_ns() + chip->latency_us[op] * 1000ull;
+    chip->nonce++;
+
+    l2_respond(chip, SIM_L2_REQ_OK, NULL, 0, sim_now_ns());
+}
+
+static void l2_encrypted_cmd(struct sim_chip *chip, const uint8_t *data, uint8_t len)
+{
+    uint64_t now = sim_now_ns();
+
+    if (!chip->session) {
+        l2_respond(chip, SIM_L2_NO_SESSION, NULL, 0, now);
+        return;
+    }
+    if (chip->cmd_len + len > sizeof(chip->cmd)) {
+        chip->cmd_len = 0;
+        l2_respond(chip, SIM_L2_GEN_ERR, NULL, 0, now);
+        return;
+    }
+    // First chunk drops whatever was left from previous command
+    chip->res_len = chip->res_off = 0;
+    memcpy(chip->cmd + chip->cmd_len, data, len);
+    chip->cmd_len += len;
+
+    if (chip->cmd_len < 2) {
+        l2_respond(chip, SIM_L2_REQ_CONT, NULL, 0, now);
+        return;
+    }
+    size_t total = 2 + (chip->cmd[0] | (chip->cmd[1] << 8)) + SIM_AESGCM_TAG_LEN;
+    if (total > sizeof(chip->cmd) || chip->cmd_len > total) {
+        chip->cmd_len = 0;
+        l2_respond(chip, SIM_L2_GEN_ERR, NULL, 0, now);
+        return;
+    }
+    if (chip->cmd_len < total) {
+        l2_respond(chip, SIM_L2_REQ_CONT, NULL, 0, now);
+        return;
+    }
+    chip->cmd_len = 0;
+    l3_process(chip);
+}
+
+static void l2_request(struct sim_chip *chip, const uint8_t *req, size_t len)
+{
+    uint64_t now = sim_now_ns();
+    uint8_t check[SIM_L2_FRAME_MAX];
+
+    if (len < 4 || len != (size_t)req[1] + 4) {
+        l2_respond(chip, SIM_L2_GEN_ERR, NULL, 0, now);
+        return;
+    }
+    memcpy(check, req, len);
+    add_crc(check);
+    if (memcmp(check + len - 2, req + len - 2, 2) != 0) {
+        l2_respond(chip, SIM_L2_CRC_ERR, NULL, 0, now);
+        return;
+    }
+
+    const uint8_t *data = req + 2;
+    uint8_t data_len = req[1];
+    switch (req[0]) {
+        case SIM_L2_GET_INFO:
+            l2_get_info(chip, data, data_len);
+            break;
+        case SIM_L2_HANDSHAKE:
+            l2_handshake(chip, data, data_len);
+            break;
+        case SIM_L2_ENCRYPTED_CMD:
+            l2_encrypted_cmd(chip, data, data_len);
+            break;
+        case SIM_L2_SESSION_ABT:
+            chip->session = false;
+            l2_respond(chip, SIM_L2_REQ_OK, NULL, 0, now);
+            break;
+        case SIM_L2_RESEND:
+            memcpy(chip->frame, chip->last, chip->last_len);
+            chip->frame_len = chip->last_len;
+            chip->frame_ready_ns = now;
+            break;
+        case SIM_L2_SLEEP:
+        case SIM_L2_GET_LOG:
+            l2_respond(chip, SIM_L2_REQ_OK, NULL, 0, now);
+            break;
+        case SIM_L2_STARTUP:
+            // Reboot drops the session
+            chip->session = false;
+            l2_respond(chip, SIM_L2_REQ_OK, NULL, 0, now);
+            break;
+        default:
+            l2_respond(chip, SIM_L2_UNKNOWN_REQ, NULL, 0, now);
+            break;
+    }
+}
+
+/*
+ * L1
+ */
+
+void sim_chip_csn_low(struct sim_chip *chip)
+{
+    chip->selected = true;
+    chip->get_response = false;
+    chip->delivering = false;
+    chip->pos = 0;
+}
+
+void sim_chip_csn_high(struct sim_chip *chip)
+{
+    if (!chip->selected || chip->pos == 0) {
+        chip->selected = false;
+        return;
+    }
+    chip->selected = false;
+
+    if (chip->get_response) {
+        // Response is consumed only when host clocked it out completely
+        if (chip->delivering && chip->pos >= 1 + chip->frame_len) {
+            memcpy(chip->last, chip->frame, chip->frame_len);
+            chip->last_len = chip->frame_len;
+            chip->frame_len = 0;
+            l2_next_chunk(chip);
+        }
+        return;
+    }
+    l2_request(chip, chip->req, chip->pos > sizeof(chip->req) ? sizeof(chip->req) : chip->pos);
+}
+
+void sim_chip_transfer(struct sim_chip *chip, uint8_t *buff, size_t len)
+{
+    if (!chip->selected) {
+        memset(buff, 0xff, len);
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint8_t in = buff[i];
+        uint8_t out = 0;
+
+        if (chip->pos == 0) {
+            chip->get_response = in == SIM_GET_RESPONSE;
+            chip->delivering = chip->get_response && chip->frame_len && sim_now_ns() >= chip->frame_ready_ns;
+            out = SIM_CHIP_STATUS_READY;
+        } else if (chip->get_response) {
+            if (chip->delivering) {
+                out = chip->pos - 1u < chip->frame_len ? chip->frame[chip->pos - 1] : 0;
+            } else {
+                out = chip->pos == 1 ? SIM_L2_NO_RESP : 0;
+            }
+        }
+        if (!chip->get_response && chip->pos < sizeof(chip->req)) {
+            chip->req[chip->pos] = in;
+        }
+        if (chip->pos < UINT16_MAX) {
+            chip->pos++;
+        }
+        buff[i] = out;
+    }
+}
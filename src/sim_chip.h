@@ -0,0 +1,167 @@
+#ifndef SIM_CHIP_H
+#define SIM_CHIP_H
+
+/**
+ * @file sim_chip.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Software model of TROPIC01 used by SIMULATOR build
+ *
+ * @details Model speaks the chip's SPI protocol byte by byte, so libtropic runs unchanged on top of it: L1 frames
+ * with CHIP_STATUS and GET_RESPONSE polling, L2 requests with CRC, Noise KK1 handshake and AES-GCM encrypted L3
+ * commands. Implemented L3 commands are ping, R-memory, random value, ECC keys (Ed25519 only), EdDSA signature,
+ * monotonic counters and Mac-And-Destroy. Non volatile content can be kept in a file between processes.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Number of ECC key slots */
+#define SIM_ECC_SLOTS        32
+/** @brief Number of R-memory slots */
+#define SIM_R_MEM_SLOTS      512
+/** @brief Size of one R-memory slot */
+#define SIM_R_MEM_SLOT_LEN   444
+/** @brief Number of Mac-And-Destroy slots */
+#define SIM_MACANDD_SLOTS    128
+/** @brief Number of pairing key slots */
+#define SIM_PAIRING_SLOTS    4
+/** @brief Number of monotonic counters */
+#define SIM_MCOUNTERS        16
+/** @brief Longest L3 packet: size, EdDSA command with 4096B message, tag */
+#define SIM_L3_PACKET_MAX    (2 + 16 + 4096 + 16)
+/** @brief Longest L2 frame: id/status, length, 255B data, CRC */
+#define SIM_L2_FRAME_MAX     (2 + 255 + 2)
+
+/** @brief Operations with configurable latency */
+enum sim_op {
+    SIM_OP_GET_INFO,
+    SIM_OP_HANDSHAKE,
+    SIM_OP_PING,
+    SIM_OP_PAIRING_KEY,
+    SIM_OP_R_MEM_DATA_WRITE,
+    SIM_OP_R_MEM_DATA_READ,
+    SIM_OP_R_MEM_DATA_ERASE,
+    SIM_OP_RANDOM_VALUE_GET,
+    SIM_OP_ECC_KEY_GENERATE,
+    SIM_OP_ECC_KEY_STORE,
+    SIM_OP_ECC_KEY_READ,
+    SIM_OP_ECC_KEY_ERASE,
+    SIM_OP_ECC_EDDSA_SIGN,
+    SIM_OP_MCOUNTER,
+    SIM_OP_MAC_AND_DESTROY,
+    SIM_OP_COUNT
+};
+
+/** @brief Non volatile content of the chip, this is what state file holds */
+struct sim_nvm {
+    uint8_t magic[4];
+    uint32_t version;
+    uint8_t st_priv[32];
+    uint8_t serial[16];
+    uint8_t macandd_key[32];
+    uint8_t pairing_state[SIM_PAIRING_SLOTS];
+    uint8_t pairing_key[SIM_PAIRING_SLOTS][32];
+    struct {
+        uint8_t curve;
+        uint8_t origin;
+        uint8_t key[32];
+    } ecc[SIM_ECC_SLOTS];
+    struct {
+        uint16_t len;
+        uint8_t data[SIM_R_MEM_SLOT_LEN];
+    } r_mem[SIM_R_MEM_SLOTS];
+    uint8_t macandd[SIM_MACANDD_SLOTS][32];
+    uint8_t mcounter_valid[SIM_MCOUNTERS];
+    uint32_t mcounter[SIM_MCOUNTERS];
+};
+
+/** @brief Simulated chip, one per simulated device */
+struct sim_chip {
+    struct sim_nvm nvm;
+    /** @brief File with non volatile content, NULL keeps it only in memory */
+    const char *state_path;
+    /** @brief Time the chip spends on each operation before response is available */
+    uint32_t latency_us[SIM_OP_COUNT];
+
+    /** @brief Public identity key, derived from st_priv at power up */
+    uint8_t st_pub[32];
+
+    // L1: position within current chip select frame
+    bool selected;
+    bool get_response;
+    bool delivering;
+    uint16_t pos;
+    uint8_t req[SIM_L2_FRAME_MAX];
+
+    // L2: response frame waiting for GET_RESPONSE and the last delivered one for RESEND
+    uint8_t frame[SIM_L2_FRAME_MAX];
+    uint16_t frame_len;
+    uint64_t frame_ready_ns;
+    uint8_t last[SIM_L2_FRAME_MAX];
+    uint16_t last_len;
+
+    // L3: secure session and encrypted packets being assembled or returned in chunks
+    bool session;
+    uint8_t k_cmd[32];
+    uint8_t k_res[32];
+    uint32_t nonce;
+    uint8_t cmd[SIM_L3_PACKET_MAX];
+    size_t cmd_len;
+    uint8_t res[SIM_L3_PACKET_MAX];
+    size_t res_len;
+    size_t res_off;
+    uint64_t res_ready_ns;
+};
+
+/**
+ * @brief Get operation by its name as used in latency specification
+ *
+ * @param name        Name, e.g. "ecc_eddsa_sign"
+ * @param op          Found operation
+ * @return int        0 if found, otherwise 1
+ */
+int sim_op_parse(const char *name, enum sim_op *op);
+
+/**
+ * @brief Set latency of operations from specification string
+ *
+ * @details Specification is a comma separated list of <op>=<microseconds>, where <op> is a name of operation
+ *          or "*" for all of them, e.g. "*=200,handshake=15000,ecc_eddsa_sign=9000". Later items win.
+ *
+ * @param chip        Simulated chip
+ * @param spec        Specification
+ * @return int        0 if success, otherwise 1
+ */
+int sim_chip_latency_parse(struct sim_chip *chip, const char *spec);
+
+/**
+ * @brief Power up the chip: load non volatile content from state file or manufacture a new chip
+ *
+ * @details New chip gets random identity key and serial number, sh0pub in pairing slot 0 and everything else empty.
+ *
+ * @param chip        Simulated chip, state_path and latency_us must be set
+ * @param sh0pub      Public pairing key written into slot 0 of a new chip
+ * @return int        0 if success, otherwise 1
+ */
+int sim_chip_power_up(struct sim_chip *chip, const uint8_t sh0pub[32]);
+
+/** @brief Chip select goes low, a new L1 frame starts */
+void sim_chip_csn_low(struct sim_chip *chip);
+
+/** @brief Chip select goes high, received request is processed */
+void sim_chip_csn_high(struct sim_chip *chip);
+
+/**
+ * @brief Full duplex transfer, bytes sent by host are replaced by bytes sent by chip
+ *
+ * @param chip        Simulated chip
+ * @param buff        Bytes
+ * @param len         Number of bytes
+ */
+void sim_chip_transfer(struct sim_chip *chip, uint8_t *buff, size_t len);
+
+#endif
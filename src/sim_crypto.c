@@ -0,0 +1,618 @@
+/**
+ * @file sim_crypto.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Curve25519 arithmetic follows TweetNaCl (public domain): field elements are 16 limbs of 16 bits.
+ * AES uses byte oriented S-box implementation, GHASH is computed bit by bit. Speed is not a concern, simulated
+ * latency of commands is configured separately.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <string.h>
+
+#include "digest.h"
+#include "sim_crypto.h"
+
+/*
+ * Curve25519 field arithmetic
+ */
+
+typedef int64_t gf[16];
+
+static const gf gf0 = {0};
+static const gf gf1 = {1};
+static const gf gf121665 = {0xDB41, 1};
+static const gf ed_d2 = {0xf159, 0x26b2, 0x9b94, 0xebd6, 0xb156, 0x8283, 0x149a, 0x00e0,
+                         0xd130, 0xeef3, 0x80f2, 0x198e, 0xfce7, 0x56df, 0xd9dc, 0x2406};
+static const gf ed_x = {0xd51a, 0x8f25, 0x2d60, 0xc956, 0xa7b2, 0x9525, 0xc760, 0x692c,
+                        0xdc5c, 0xfdd6, 0xe231, 0xc0a4, 0x53fe, 0xcd6e, 0x36d3, 0x2169};
+static const gf ed_y = {0x6658, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666,
+                        0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666, 0x6666};
+
+static void gf_copy(gf r, const gf a)
+{
+    memcpy(r, a, sizeof(gf));
+}
+
+static void gf_carry(gf o)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] += (1LL << 16);
+        int64_t c = o[i] >> 16;
+        o[(i + 1) * (i < 15)] += c - 1 + 37 * (c - 1) * (i == 15);
+        o[i] -= c * (1LL << 16);
+    }
+}
+
+static void gf_select(gf p, gf q, int b)
+{
+    int64_t c = ~(b - 1);
+    for (int i = 0; i < 16; i++) {
+        int64_t t = c & (p[i] ^ q[i]);
+        p[i] ^= t;
+        q[i] ^= t;
+    }
+}
+
+static void gf_pack(uint8_t *o, const gf n)
+{
+    gf m, t;
+    gf_copy(t, n);
+    gf_carry(t);
+    gf_carry(t);
+    gf_carry(t);
+    for (int j = 0; j < 2; j++) {
+        m[0] = t[0] - 0xffed;
+        for (int i = 1; i < 15; i++) {
+            m[i] = t[i] - 0xffff - ((m[i - 1] >> 16) & 1);
+            m[i - 1] &= 0xffff;
+        }
+        m[15] = t[15] - 0x7fff - ((m[14] >> 16) & 1);
+        int b = (m[15] >> 16) & 1;
+        m[14] &= 0xffff;
+        gf_select(t, m, 1 - b);
+    }
+    for (int i = 0; i < 16; i++) {
+        o[2 * i] = t[i] & 0xff;
+        o[2 * i + 1] = t[i] >> 8;
+    }
+}
+
+static void gf_unpack(gf o, const uint8_t *n)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = n[2 * i] + ((int64_t)n[2 * i + 1] << 8);
+    }
+    o[15] &= 0x7fff;
+}
+
+static void gf_add(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] + b[i];
+    }
+}
+
+static void gf_sub(gf o, const gf a, const gf b)
+{
+    for (int i = 0; i < 16; i++) {
+        o[i] = a[i] - b[i];
+    }
+}
+
+static void gf_mul(gf o, const gf a, const gf b)
+{
+    int64_t t[31] = {0};
+    for (int i = 0; i < 16; i++) {
+        for (int j = 0; j < 16; j++) {
+            t[i + j] += a[i] * b[j];
+        }
+    }
+    for (int i = 0; i < 15; i++) {
+        t[i] += 38 * t[i + 16];
+    }
+    for (int i = 0; i < 16; i++) {
+        o[i] = t[i];
+    }
+    gf_carry(o);
+    gf_carry(o);
+}
+
+static void gf_inv(gf o, const gf i)
+{
+    gf c;
+    gf_copy(c, i);
+    for (int a = 253; a >= 0; a--) {
+        gf_mul(c, c, c);
+        if (a != 2 && a != 4) {
+            gf_mul(c, c, i);
+        }
+    }
+    gf_copy(o, c);
+}
+
+static int gf_parity(const gf a)
+{
+    uint8_t d[32];
+    gf_pack(d, a);
+    return d[0] & 1;
+}
+
+void sim_x25519(uint8_t out[SIM_X25519_LEN], const uint8_t scalar[SIM_X25519_LEN], const uint8_t *point)
+{
+    static const uint8_t base[32] = {9};
+    uint8_t z[32];
+    gf x, a, b, c, d, e, f;
+
+    memcpy(z, scalar, 32);
+    z[31] = (z[31] & 127) | 64;
+    z[0] &= 248;
+    gf_unpack(x, point ? point : base);
+
+    gf_copy(b, x);
+    gf_copy(a, gf1);
+    gf_copy(c, gf0);
+    gf_copy(d, gf1);
+    for (int i = 254; i >= 0; i--) {
+        int r = (z[i >> 3] >> (i & 7)) & 1;
+        gf_select(a, b, r);
+        gf_select(c, d, r);
+        gf_add(e, a, c);
+        gf_sub(a, a, c);
+        gf_add(c, b, d);
+        gf_sub(b, b, d);
+        gf_mul(d, e, e);
+        gf_mul(f, a, a);
+        gf_mul(a, c, a);
+        gf_mul(c, b, e);
+        gf_add(e, a, c);
+        gf_sub(a, a, c);
+        gf_mul(b, a, a);
+        gf_sub(c, d, f);
+        gf_mul(a, c, gf121665);
+        gf_add(a, a, d);
+        gf_mul(c, c, a);
+        gf_mul(a, d, f);
+        gf_mul(d, b, x);
+        gf_mul(b, e, e);
+        gf_select(a, b, r);
+        gf_select(c, d, r);
+    }
+    gf_inv(c, c);
+    gf_mul(a, a, c);
+    gf_pack(out, a);
+    memset(z, 0, sizeof(z));
+}
+
+/*
+ * Ed25519, points in extended coordinates (X, Y, Z, T)
+ */
+
+static void ed_add(gf p[4], gf q[4])
+{
+    gf a, b, c, d, t, e, f, g, h;
+
+    gf_sub(a, p[1], p[0]);
+    gf_sub(t, q[1], q[0]);
+    gf_mul(a, a, t);
+    gf_add(b, p[0], p[1]);
+    gf_add(t, q[0], q[1]);
+    gf_mul(b, b, t);
+    gf_mul(c, p[3], q[3]);
+    gf_mul(c, c, ed_d2);
+    gf_mul(d, p[2], q[2]);
+    gf_add(d, d, d);
+    gf_sub(e, b, a);
+    gf_sub(f, d, c);
+    gf_add(g, d, c);
+    gf_add(h, b, a);
+
+    gf_mul(p[0], e, f);
+    gf_mul(p[1], h, g);
+    gf_mul(p[2], g, f);
+    gf_mul(p[3], e, h);
+}
+
+static void ed_swap(gf p[4], gf q[4], int b)
+{
+    for (int i = 0; i < 4; i++) {
+        gf_select(p[i], q[i], b);
+    }
+}
+
+static void ed_pack(uint8_t *r, gf p[4])
+{
+    gf tx, ty, zi;
+    gf_inv(zi, p[2]);
+    gf_mul(tx, p[0], zi);
+    gf_mul(ty, p[1], zi);
+    gf_pack(r, ty);
+    r[31] ^= gf_parity(tx) << 7;
+}
+
+static void ed_scalarbase(gf p[4], const uint8_t *s)
+{
+    gf q[4];
+    gf_copy(q[0], ed_x);
+    gf_copy(q[1], ed_y);
+    gf_copy(q[2], gf1);
+    gf_mul(q[3], ed_x, ed_y);
+
+    gf_copy(p[0], gf0);
+    gf_copy(p[1], gf1);
+    gf_copy(p[2], gf1);
+    gf_copy(p[3], gf0);
+    for (int i = 255; i >= 0; i--) {
+        int b = (s[i / 8] >> (i & 7)) & 1;
+        ed_swap(p, q, b);
+        ed_add(q, p);
+        ed_add(p, p);
+        ed_swap(p, q, b);
+    }
+}
+
+// Order of the base point
+static const int64_t ed_l[32] = {0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7,
+                                 0xa2, 0xde, 0xf9, 0xde, 0x14, 0,    0,    0,    0,    0,    0,
+                                 0,    0,    0,    0,    0,    0,    0,    0,    0,    0x10};
+
+static void ed_mod_l(uint8_t *r, int64_t x[64])
+{
+    int64_t carry;
+    int i, j;
+    for (i = 63; i >= 32; i--) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * ed_l[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * ed_l[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) {
+        x[j] -= carry * ed_l[j];
+    }
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+static void ed_reduce(uint8_t *r)
+{
+    int64_t x[64];
+    for (int i = 0; i < 64; i++) {
+        x[i] = r[i];
+    }
+    memset(r, 0, 64);
+    ed_mod_l(r, x);
+}
+
+// Expands private key into clamped scalar (first half) and prefix (second half)
+static void ed_expand(uint8_t d[64], const uint8_t seed[32])
+{
+    struct digest_sha512_ctx ctx;
+    digest_sha512_init(&ctx);
+    digest_sha512_update(&ctx, seed, 32);
+    digest_sha512_final(&ctx, d);
+    d[0] &= 248;
+    d[31] &= 127;
+    d[31] |= 64;
+}
+
+void sim_ed25519_pubkey(uint8_t pubkey[SIM_ED25519_LEN], const uint8_t seed[SIM_ED25519_LEN])
+{
+    uint8_t d[64];
+    gf p[4];
+    ed_expand(d, seed);
+    ed_scalarbase(p, d);
+    ed_pack(pubkey, p);
+    memset(d, 0, sizeof(d));
+}
+
+void sim_ed25519_sign(uint8_t signature[2 * SIM_ED25519_LEN], const uint8_t *msg, size_t msg_len,
+                      const uint8_t seed[SIM_ED25519_LEN])
+{
+    uint8_t d[64], r[64], h[64], pubkey[32];
+    int64_t x[64];
+    gf p[4];
+    struct digest_sha512_ctx ctx;
+
+    ed_expand(d, seed);
+    ed_scalarbase(p, d);
+    ed_pack(pubkey, p);
+
+    // r = SHA-512(prefix || M) mod L, R = rB
+    digest_sha512_init(&ctx);
+    digest_sha512_update(&ctx, d + 32, 32);
+    digest_sha512_update(&ctx, msg, msg_len);
+    digest_sha512_final(&ctx, r);
+    ed_reduce(r);
+    ed_scalarbase(p, r);
+    ed_pack(signature, p);
+
+    // S = (r + SHA-512(R || A || M) * s) mod L
+    digest_sha512_init(&ctx);
+    digest_sha512_update(&ctx, signature, 32);
+    digest_sha512_update(&ctx, pubkey, 32);
+    digest_sha512_update(&ctx, msg, msg_len);
+    digest_sha512_final(&ctx, h);
+    ed_reduce(h);
+
+    memset(x, 0, sizeof(x));
+    for (int i = 0; i < 32; i++) {
+        x[i] = r[i];
+    }
+    for (int i = 0; i < 32; i++) {
+        for (int j = 0; j < 32; j++) {
+            x[i + j] += h[i] * (int64_t)d[j];
+        }
+    }
+    ed_mod_l(signature + 32, x);
+
+    memset(d, 0, sizeof(d));
+    memset(r, 0, sizeof(r));
+}
+
+/*
+ * AES-256 (encryption only, GCM needs nothing else)
+ */
+
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+#define AES256_ROUNDS 14
+
+struct aes256 {
+    uint8_t round_key[16 * (AES256_ROUNDS + 1)];
+};
+
+static uint8_t aes_xtime(uint8_t x)
+{
+    return (uint8_t)((x << 1) ^ ((x >> 7) * 0x1b));
+}
+
+static void aes256_init(struct aes256 *ctx, const uint8_t key[32])
+{
+    uint8_t *w = ctx->round_key;
+    uint8_t rcon = 1;
+
+    memcpy(w, key, 32);
+    for (int i = 8; i < 4 * (AES256_ROUNDS + 1); i++) {
+        uint8_t t[4];
+        memcpy(t, w + 4 * (i - 1), 4);
+        if (i % 8 == 0) {
+            uint8_t tmp = t[0];
+            t[0] = aes_sbox[t[1]] ^ rcon;
+            t[1] = aes_sbox[t[2]];
+            t[2] = aes_sbox[t[3]];
+            t[3] = aes_sbox[tmp];
+            rcon = aes_xtime(rcon);
+        } else if (i % 8 == 4) {
+            for (int k = 0; k < 4; k++) {
+                t[k] = aes_sbox[t[k]];
+            }
+        }
+        for (int k = 0; k < 4; k++) {
+            w[4 * i + k] = w[4 * (i - 8) + k] ^ t[k];
+        }
+    }
+}
+
+static void aes256_encrypt(const struct aes256 *ctx, const uint8_t in[16], uint8_t out[16])
+{
+    uint8_t s[16];
+    for (int i = 0; i < 16; i++) {
+        s[i] = in[i] ^ ctx->round_key[i];
+    }
+
+    for (int round = 1; round <= AES256_ROUNDS; round++) {
+        uint8_t t[16];
+        // SubBytes and ShiftRows, state is column major
+        for (int c = 0; c < 4; c++) {
+            for (int r = 0; r < 4; r++) {
+                t[4 * c + r] = aes_sbox[s[4 * ((c + r) % 4) + r]];
+            }
+        }
+        // MixColumns, skipped in the last round
+        if (round != AES256_ROUNDS) {
+            for (int c = 0; c < 4; c++) {
+                uint8_t *col = t + 4 * c;
+                uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                col[0] ^= all ^ aes_xtime(a0 ^ a1);
+                col[1] ^= all ^ aes_xtime(a1 ^ a2);
+                col[2] ^= all ^ aes_xtime(a2 ^ a3);
+                col[3] ^= all ^ aes_xtime(a3 ^ a0);
+            }
+        }
+        for (int i = 0; i < 16; i++) {
+            s[i] = t[i] ^ ctx->round_key[16 * round + i];
+        }
+    }
+    memcpy(out, s, 16);
+}
+
+/*
+ * GCM
+ */
+
+// x = x * h in GF(2^128) with GCM bit order
+static void gcm_mult(uint8_t x[16], const uint8_t h[16])
+{
+    uint8_t z[16] = {0};
+    uint8_t v[16];
+    memcpy(v, h, 16);
+
+    for (int i = 0; i < 128; i++) {
+        if ((x[i / 8] >> (7 - (i % 8))) & 1) {
+            for (int k = 0; k < 16; k++) {
+                z[k] ^= v[k];
+            }
+        }
+        int lsb = v[15] & 1;
+        for (int k = 15; k > 0; k--) {
+            v[k] = (uint8_t)((v[k] >> 1) | (v[k - 1] << 7));
+        }
+        v[0] >>= 1;
+        if (lsb) {
+            v[0] ^= 0xe1;
+        }
+    }
+    memcpy(x, z, 16);
+}
+
+static void gcm_ghash(uint8_t y[16], const uint8_t h[16], const uint8_t *data, size_t len)
+{
+    while (len) {
+        size_t n = len < 16 ? len : 16;
+        for (size_t k = 0; k < n; k++) {
+            y[k] ^= data[k];
+        }
+        gcm_mult(y, h);
+        data += n;
+        len -= n;
+    }
+}
+
+static void gcm_crypt(const struct aes256 *aes, const uint8_t j0[16], uint8_t *data, size_t len)
+{
+    uint8_t ctr[16], stream[16];
+    memcpy(ctr, j0, 16);
+
+    for (size_t i = 0; i < len; i += 16) {
+        // inc32
+        for (int k = 15; k >= 12; k--) {
+            if (++ctr[k]) {
+                break;
+            }
+        }
+        aes256_encrypt(aes, ctr, stream);
+        for (size_t k = 0; k < 16 && i + k < len; k++) {
+            data[i + k] ^= stream[k];
+        }
+    }
+}
+
+// Tag over AAD and ciphertext
+static void gcm_tag(const struct aes256 *aes, const uint8_t h[16], const uint8_t j0[16], const uint8_t *aad,
+                    size_t aad_len, const uint8_t *data, size_t len, uint8_t tag[16])
+{
+    uint8_t y[16] = {0}, lens[16], ek[16];
+    gcm_ghash(y, h, aad, aad_len);
+    gcm_ghash(y, h, data, len);
+    uint64_t aad_bits = (uint64_t)aad_len * 8, data_bits = (uint64_t)len * 8;
+    for (int k = 0; k < 8; k++) {
+        lens[k] = (uint8_t)(aad_bits >> (56 - 8 * k));
+        lens[8 + k] = (uint8_t)(data_bits >> (56 - 8 * k));
+    }
+    gcm_ghash(y, h, lens, 16);
+    aes256_encrypt(aes, j0, ek);
+    for (int k = 0; k < 16; k++) {
+        tag[k] = y[k] ^ ek[k];
+    }
+}
+
+static void gcm_setup(struct aes256 *aes, uint8_t h[16], uint8_t j0[16], const uint8_t key[32], const uint8_t iv[12])
+{
+    static const uint8_t zero[16] = {0};
+    aes256_init(aes, key);
+    aes256_encrypt(aes, zero, h);
+    memcpy(j0, iv, 12);
+    j0[12] = j0[13] = j0[14] = 0;
+    j0[15] = 1;
+}
+
+void sim_aesgcm_encrypt(const uint8_t key[32], const uint8_t iv[SIM_AESGCM_IV_LEN], const uint8_t *aad,
+                        size_t aad_len, uint8_t *data, size_t len, uint8_t tag[SIM_AESGCM_TAG_LEN])
+{
+    struct aes256 aes;
+    uint8_t h[16], j0[16];
+    gcm_setup(&aes, h, j0, key, iv);
+    gcm_crypt(&aes, j0, data, len);
+    gcm_tag(&aes, h, j0, aad, aad_len, data, len, tag);
+    memset(&aes, 0, sizeof(aes));
+}
+
+int sim_aesgcm_decrypt(const uint8_t key[32], const uint8_t iv[SIM_AESGCM_IV_LEN], const uint8_t *aad,
+                       size_t aad_len, uint8_t *data, size_t len, const uint8_t tag[SIM_AESGCM_TAG_LEN])
+{
+    struct aes256 aes;
+    uint8_t h[16], j0[16], expected[16];
+    gcm_setup(&aes, h, j0, key, iv);
+    gcm_tag(&aes, h, j0, aad, aad_len, data, len, expected);
+    gcm_crypt(&aes, j0, data, len);
+    memset(&aes, 0, sizeof(aes));
+
+    uint8_t diff = 0;
+    for (int k = 0; k < 16; k++) {
+        diff |= expected[k] ^ tag[k];
+    }
+    return diff ? 1 : 0;
+}
+
+/*
+ * HMAC and HKDF
+ */
+
+void sim_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t out[32])
+{
+    uint8_t pad[64];
+    uint8_t inner[32];
+    struct digest_sha256_ctx ctx;
+
+    memset(pad, 0x36, sizeof(pad));
+    for (size_t i = 0; i < key_len && i < sizeof(pad); i++) {
+        pad[i] ^= key[i];
+    }
+    digest_sha256_init(&ctx);
+    digest_sha256_update(&ctx, pad, sizeof(pad));
+    digest_sha256_update(&ctx, data, data_len);
+    digest_sha256_final(&ctx, inner);
+
+    for (size_t i = 0; i < sizeof(pad); i++) {
+        pad[i] ^= 0x36 ^ 0x5c;
+    }
+    digest_sha256_init(&ctx);
+    digest_sha256_update(&ctx, pad, sizeof(pad));
+    digest_sha256_update(&ctx, inner, sizeof(inner));
+    digest_sha256_final(&ctx, out);
+}
+
+void sim_hkdf(const uint8_t ck[32], const uint8_t *input, size_t input_len, uint8_t out1[32], uint8_t out2[32])
+{
+    uint8_t temp_key[32];
+    uint8_t buf[33];
+
+    sim_hmac_sha256(ck, 32, input, input_len, temp_key);
+    buf[0] = 0x01;
+    sim_hmac_sha256(temp_key, 32, buf, 1, out1);
+    memcpy(buf, out1, 32);
+    buf[32] = 0x02;
+    sim_hmac_sha256(temp_key, 32, buf, 33, out2);
+    memset(temp_key, 0, sizeof(temp_key));
+}
@@ -0,0 +1,104 @@
+#ifndef SIM_CRYPTO_H
+#define SIM_CRYPTO_H
+
+/**
+ * @file sim_crypto.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Chip side cryptography of simulated TROPIC01 (SIMULATOR build)
+ *
+ * @details Simulated chip does not use libtropic's host side crypto backend, so a bug on either side shows up as
+ * a failed handshake or tag instead of being hidden by the shared code. Implementations are compact and not
+ * constant time, they must not be used for anything else than the simulator.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SIM_X25519_LEN   32
+#define SIM_ED25519_LEN  32
+#define SIM_AESGCM_IV_LEN  12
+#define SIM_AESGCM_TAG_LEN 16
+
+/**
+ * @brief X25519 function of RFC 7748
+ *
+ * @param out         Shared secret or public key
+ * @param scalar      Private key
+ * @param point       Public key of the other side, NULL for base point
+ */
+void sim_x25519(uint8_t out[SIM_X25519_LEN], const uint8_t scalar[SIM_X25519_LEN], const uint8_t *point);
+
+/**
+ * @brief Derive Ed25519 public key from 32B private key (seed)
+ *
+ * @param pubkey      Public key
+ * @param seed        Private key
+ */
+void sim_ed25519_pubkey(uint8_t pubkey[SIM_ED25519_LEN], const uint8_t seed[SIM_ED25519_LEN]);
+
+/**
+ * @brief Ed25519 signature of RFC 8032
+ *
+ * @param signature   R || S
+ * @param msg         Message
+ * @param msg_len     Length of message
+ * @param seed        Private key
+ */
+void sim_ed25519_sign(uint8_t signature[2 * SIM_ED25519_LEN], const uint8_t *msg, size_t msg_len,
+                      const uint8_t seed[SIM_ED25519_LEN]);
+
+/**
+ * @brief AES-256-GCM encryption with 96 bit IV, data is encrypted in place
+ *
+ * @param key         32B key
+ * @param iv          12B IV
+ * @param aad         Additional authenticated data
+ * @param aad_len     Length of aad
+ * @param data        Plaintext on input, ciphertext on output
+ * @param len         Length of data
+ * @param tag         16B authentication tag
+ */
+void sim_aesgcm_encrypt(const uint8_t key[32], const uint8_t iv[SIM_AESGCM_IV_LEN], const uint8_t *aad,
+                        size_t aad_len, uint8_t *data, size_t len, uint8_t tag[SIM_AESGCM_TAG_LEN]);
+
+/**
+ * @brief AES-256-GCM decryption with 96 bit IV, data is decrypted in place
+ *
+ * @param key         32B key
+ * @param iv          12B IV
+ * @param aad         Additional authenticated data
+ * @param aad_len     Length of aad
+ * @param data        Ciphertext on input, plaintext on output
+ * @param len         Length of data
+ * @param tag         16B authentication tag to be checked
+ * @return int        0 if tag matches, otherwise 1 (data is then garbage)
+ */
+int sim_aesgcm_decrypt(const uint8_t key[32], const uint8_t iv[SIM_AESGCM_IV_LEN], const uint8_t *aad,
+                       size_t aad_len, uint8_t *data, size_t len, const uint8_t tag[SIM_AESGCM_TAG_LEN]);
+
+/**
+ * @brief HMAC-SHA256
+ *
+ * @param key         Key
+ * @param key_len     Length of key, at most 64
+ * @param data        Data
+ * @param data_len    Length of data
+ * @param out         32B MAC
+ */
+void sim_hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t out[32]);
+
+/**
+ * @brief HKDF of Noise protocol framework with two 32B outputs
+ *
+ * @param ck          32B chaining key
+ * @param input       Input key material
+ * @param input_len   Length of input
+ * @param out1        First output
+ * @param out2        Second output
+ */
+void sim_hkdf(const uint8_t ck[32], const uint8_t *input, size_t input_len, uint8_t out1[32], uint8_t out2[32]);
+
+#endif
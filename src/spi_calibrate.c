@@ -0,0 +1,155 @@
+/**
+ * @file spi_calibrate.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Calibration of SPI clock for LINUX_SPI (and SIMULATOR) builds
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "crc32.h"
+#include "key_cache.h"
+#include "spi_calibrate.h"
+
+#define LT_SPI_CALIBRATE_VERSION 1
+
+/** @brief Content of a cache file */
+struct lt_spi_speed_cache {
+    uint8_t magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+    uint32_t speed_hz;  /**< Chosen clock */
+    uint32_t max_ok_hz; /**< Fastest error-free clock */
+    uint32_t crc;
+} __attribute__((__packed__));
+
+static const uint8_t spi_cache_magic[4] = {'L', 'T', 'S', 'C'};
+
+// The first step is the default clock, its chip ID is the reference for the others
+static const uint32_t spi_calibrate_steps[] = {
+    1000000, 2000000, 4000000, 5000000, 8000000, 10000000, 12000000, 16000000, 20000000, 25000000, 32000000,
+};
+#define SPI_CALIBRATE_STEPS_COUNT (sizeof(spi_calibrate_steps) / sizeof(spi_calibrate_steps[0]))
+
+static uint32_t spi_cache_crc(const struct lt_spi_speed_cache *cache)
+{
+    return lt_util_crc32(0, (const uint8_t *)cache, offsetof(struct lt_spi_speed_cache, crc));
+}
+
+static int spi_cache_load(const char *path, struct lt_spi_speed_cache *cache)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 1;
+    }
+    size_t got = fread(cache, 1, sizeof(*cache), fp);
+    fclose(fp);
+
+    if ((got != sizeof(*cache)) || (memcmp(cache->magic, spi_cache_magic, sizeof(cache->magic)) != 0)
+        || (cache->version != LT_SPI_CALIBRATE_VERSION) || (cache->crc != spi_cache_crc(cache))
+        || (cache->speed_hz == 0)) {
+        LT_LOG_WARN("Ignoring invalid SPI clock cache file %s", path);
+        return 1;
+    }
+    return 0;
+}
+
+// Exchanges of one step at the clock already set, ref is filled by the first step
+static int spi_calibrate_step(lt_handle_t *h, struct lt_chip_id_t *ref, bool first)
+{
+    lt_util_session_reset(h);
+    if (lt_util_session_open(h) != 0) {
+        return 1;
+    }
+
+    for (int round = 0; round < LT_SPI_CALIBRATE_ROUNDS; round++) {
+        struct lt_chip_id_t chip_id;
+        lt_ret_t ret = lt_get_info_chip_id(h, &chip_id);
+        if (ret != LT_OK) {
+            LT_LOG_WARN("lt_get_info_chip_id(): %s", lt_ret_verbose(ret));
+            return 1;
+        }
+        if (first && (round == 0)) {
+            *ref = chip_id;
+        } else if (memcmp(&chip_id, ref, sizeof(chip_id)) != 0) {
+            LT_LOG_WARN("Chip ID differs from the one read at %u Hz", (unsigned)spi_calibrate_steps[0]);
+            return 1;
+        }
+
+        uint8_t random[255];
+        ret = lt_random_value_get(h, random, sizeof(random));
+        if (ret != LT_OK) {
+            LT_LOG_WARN("lt_random_value_get(): %s", lt_ret_verbose(ret));
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int lt_util_spi_calibrate(lt_handle_t *h, const char *bus, uint32_t *speed, bool force)
+{
+    char name[PATH_MAX / 2];
+    char path[PATH_MAX];
+    snprintf(name, sizeof(name), "spi-%s.speed", bus);
+    bool cached = (lt_util_cache_file(name, path, sizeof(path)) == 0);
+
+    struct lt_spi_speed_cache cache;
+    if (cached && !force && (spi_cache_load(path, &cache) == 0)) {
+        LT_LOG_INFO("SPI clock of %s: %u Hz (cached)", bus, (unsigned)cache.speed_hz);
+        *speed = cache.speed_hz;
+        return 0;
+    }
+
+    uint32_t initial = *speed;
+    uint32_t max_ok = 0;
+    struct lt_chip_id_t ref;
+    for (size_t i = 0; i < SPI_CALIBRATE_STEPS_COUNT; i++) {
+        *speed = spi_calibrate_steps[i];
+        if (spi_calibrate_step(h, &ref, i == 0) != 0) {
+            LT_LOG_INFO("SPI clock %u Hz: failed", (unsigned)*speed);
+            break;
+        }
+        LT_LOG_INFO("SPI clock %u Hz: %d rounds without error", (unsigned)*speed, LT_SPI_CALIBRATE_ROUNDS);
+        max_ok = *speed;
+    }
+    lt_util_session_reset(h);
+
+    if (max_ok == 0) {
+        LT_LOG_ERROR("SPI clock calibration of %s failed already at %u Hz", bus, (unsigned)spi_calibrate_steps[0]);
+        *speed = initial;
+        return 1;
+    }
+
+    // Margin for temperature, supply and the rest of the bus
+    uint32_t chosen = spi_calibrate_steps[0];
+    for (size_t i = 0; i < SPI_CALIBRATE_STEPS_COUNT; i++) {
+        if ((uint64_t)spi_calibrate_steps[i] * 100 <= (uint64_t)max_ok * LT_SPI_CALIBRATE_MARGIN_PCT) {
+            chosen = spi_calibrate_steps[i];
+        }
+    }
+    *speed = chosen;
+    LT_LOG_INFO("SPI clock of %s calibrated to %u Hz, fastest error-free %u Hz", bus, (unsigned)chosen,
+                (unsigned)max_ok);
+
+    if (cached) {
+        memset(&cache, 0, sizeof(cache));
+        memcpy(cache.magic, spi_cache_magic, sizeof(cache.magic));
+        cache.version = LT_SPI_CALIBRATE_VERSION;
+        cache.speed_hz = chosen;
+        cache.max_ok_hz = max_ok;
+        cache.crc = spi_cache_crc(&cache);
+        lt_util_cache_write(path, &cache, sizeof(cache));
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+#ifndef SPI_CALIBRATE_H
+#define SPI_CALIBRATE_H
+
+/**
+ * @file spi_calibrate.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Calibration of SPI clock for LINUX_SPI (and SIMULATOR) builds
+ *
+ * @details SPI clock is raised step by step from the default 1 MHz. At every step the chip is initialized again and
+ * LT_SPI_CALIBRATE_ROUNDS rounds of Get_Info (chip ID, compared with the one read at 1 MHz) and of 255 random bytes
+ * within a new secure session are exchanged, so L2 CRC, L3 authentication tag and content of responses are all
+ * checked. The first failing step ends the calibration. The clock chosen is the fastest step within
+ * LT_SPI_CALIBRATE_MARGIN_PCT percent of the fastest error-free one.
+ *
+ * The result is stored in cache file "spi-<spidev>-cs<gpio_cs_num>.speed" (see key_cache.h for its directory), so
+ * the next lt-util on the same bus and chip select only reads it.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libtropic.h"
+
+/** @brief Environment variable with SPI clock in Hz, "auto" (cached calibration) or "calibrate" (new one) */
+#define LT_UTIL_SPI_SPEED_ENV "LT_UTIL_SPI_SPEED"
+
+/** @brief Rounds of exchanges at every step */
+#define LT_SPI_CALIBRATE_ROUNDS 16
+
+/** @brief Chosen clock is at most this percentage of the fastest error-free one */
+#define LT_SPI_CALIBRATE_MARGIN_PCT 80
+
+/**
+ * @brief Set SPI clock from cache of the bus, or calibrate it when there is none
+ *
+ * @details Device is left closed, lt_util_dev_open() initializes it at the chosen clock.
+ *
+ * @param h           Device's handle
+ * @param bus         Name of the bus and chip select, names the cache file
+ * @param speed       SPI clock of the device description, set to the chosen clock, unchanged if calibration fails
+ * @param force       Calibrate even when the cache has a clock
+ * @return int        0 if success, otherwise 1
+ */
+int lt_util_spi_calibrate(lt_handle_t *h, const char *bus, uint32_t *speed, bool force);
+
+#endif
@@ -0,0 +1,151 @@
+/**
+ * @file stpub_cache.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Host side cache of verified static public key of the chip (STPUB), one file per chip
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_common.h"
+#include "libtropic_logging.h"
+#include "lt_hmac_sha256.h"
+#include "commands.h"
+#include "key_cache.h"
+#include "stpub_cache.h"
+
+#define LT_STPUB_CACHE_VERSION 1
+
+static const uint8_t stpub_cache_magic[4] = {'L', 'T', 'S', 'P'};
+static const char stpub_cache_label[] = "lt-util STPUB cache";
+
+bool lt_stpub_cache_enabled(void)
+{
+    const char *on = getenv(LT_UTIL_STPUB_CACHE_ENV);
+    const char *dir = getenv(LT_UTIL_CACHE_DIR_ENV);
+    return on && (strcmp(on, "1") == 0) && !(dir && (dir[0] == '\0'));
+}
+
+static void stpub_cache_mac(const struct lt_stpub_cache *cache, const uint8_t *shipriv, uint8_t mac[32])
+{
+    uint8_t key[32];
+    lt_hmac_sha256(shipriv, 32, (const uint8_t *)stpub_cache_label, sizeof(stpub_cache_label) - 1, key);
+    lt_hmac_sha256(key, sizeof(key), (const uint8_t *)cache, offsetof(struct lt_stpub_cache, mac), mac);
+    memset(key, 0, sizeof(key));
+}
+
+// Compare in constant time, so a forged file does not learn how much of its MAC matched
+static bool stpub_cache_mac_equal(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < 32; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+// STPUB of the cache file, 1 if there is no valid file for this chip
+static int stpub_cache_load(const char *path, const char *serial, const uint8_t *shipriv, uint8_t stpub[32])
+{
+    struct lt_stpub_cache cache;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return 1;
+    }
+    size_t got = fread(&cache, 1, sizeof(cache), fp);
+    fclose(fp);
+
+    uint8_t mac[32];
+    stpub_cache_mac(&cache, shipriv, mac);
+    if ((got != sizeof(cache)) || (memcmp(cache.magic, stpub_cache_magic, sizeof(cache.magic)) != 0)
+        || (cache.version != LT_STPUB_CACHE_VERSION) || !stpub_cache_mac_equal(mac, cache.mac)) {
+        LT_LOG_WARN("Ignoring invalid STPUB cache file %s", path);
+        return 1;
+    }
+    if (strncmp(cache.serial, serial, sizeof(cache.serial)) != 0) {
+        LT_LOG_WARN("STPUB cache file %s belongs to another chip", path);
+        return 1;
+    }
+
+    memcpy(stpub, cache.stpub, 32);
+    return 0;
+}
+
+static void stpub_cache_save(const char *path, const char *serial, const uint8_t *shipriv, const uint8_t stpub[32])
+{
+    struct lt_stpub_cache cache;
+    memset(&cache, 0, sizeof(cache));
+    memcpy(cache.magic, stpub_cache_magic, sizeof(cache.magic));
+    cache.version = LT_STPUB_CACHE_VERSION;
+    strncpy(cache.serial, serial, sizeof(cache.serial));
+    memcpy(cache.stpub, stpub, 32);
+    stpub_cache_mac(&cache, shipriv, cache.mac);
+
+    lt_util_cache_write(path, &cache, sizeof(cache));
+}
+
+// Same steps as lt_verify_chip_and_start_secure_session(), with STPUB handed back for the cache
+static lt_ret_t stpub_verify_and_start(lt_handle_t *h, const uint8_t *shipriv, const uint8_t *shipub,
+                                       uint8_t pkey_index, uint8_t stpub[32])
+{
+    uint8_t certs[LT_NUM_CERTIFICATES][LT_L2_GET_INFO_REQ_CERT_SIZE_SINGLE];
+    struct lt_cert_store_t store;
+    memset(&store, 0, sizeof(store));
+    for (int i = 0; i < LT_NUM_CERTIFICATES; i++) {
+        store.certs[i] = certs[i];
+        store.buf_len[i] = sizeof(certs[i]);
+    }
+
+    lt_ret_t ret = lt_get_info_cert_store(h, &store);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    ret = lt_get_st_pub(&store, stpub, 32);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    return lt_session_start(h, stpub, pkey_index, shipriv, shipub);
+}
+
+lt_ret_t lt_stpub_session_start(lt_handle_t *h, const uint8_t *shipriv, const uint8_t *shipub, uint8_t pkey_index)
+{
+    char path[PATH_MAX];
+    char serial[LT_UTIL_SERIAL_HEX_LEN + 1];
+    uint8_t stpub[32];
+
+    if ((lt_util_chip_serial(h, serial) != 0) || (lt_util_cache_path(h, "stpub", path, sizeof(path)) != 0)) {
+        return lt_verify_chip_and_start_secure_session(h, (uint8_t *)shipriv, (uint8_t *)shipub, pkey_index);
+    }
+
+    if (stpub_cache_load(path, serial, shipriv, stpub) == 0) {
+        lt_ret_t ret = lt_session_start(h, stpub, pkey_index, shipriv, shipub);
+        if (ret == LT_OK) {
+            LT_LOG_INFO("Handshake with cached STPUB of chip %s", serial);
+            return LT_OK;
+        }
+
+        // The chip state after a failed handshake is not known, start over from lt_init()
+        LT_LOG_WARN("Handshake with cached STPUB failed (%s), verifying chip again", lt_ret_verbose(ret));
+        unlink(path);
+        lt_util_session_reset(h);
+        if (lt_util_dev_open(h) != 0) {
+            return LT_FAIL;
+        }
+    }
+
+    lt_ret_t ret = stpub_verify_and_start(h, shipriv, shipub, pkey_index, stpub);
+    if (ret == LT_OK) {
+        stpub_cache_save(path, serial, shipriv, stpub);
+    }
+
+    return ret;
+}
@@ -0,0 +1,59 @@
+#ifndef STPUB_CACHE_H
+#define STPUB_CACHE_H
+
+/**
+ * @file stpub_cache.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Host side cache of verified static public key of the chip (STPUB), one file per chip
+ *
+ * @details lt_verify_chip_and_start_secure_session() reads the whole certificate store of the chip, several kB
+ * of L2 frames, only to take STPUB from the device certificate before the handshake. STPUB does not change for the
+ * life of the chip, so with the cache enabled it is taken from "<dir>/<serial>.stpub" (see key_cache.h for dir) and
+ * only serial number is read from the chip before the handshake.
+ *
+ * A cache file carries HMAC-SHA256 of its content under a key derived from the pairing private key, so it can
+ * not be made without the pairing key, and a file of another chip, or a damaged one, is refused. A refused file
+ * or a handshake which fails with cached STPUB falls back to the full verification, whose STPUB then replaces
+ * the file.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libtropic.h"
+
+/** @brief Environment variable which enables the cache when set to "1" */
+#define LT_UTIL_STPUB_CACHE_ENV "LT_UTIL_STPUB_CACHE"
+
+/** @brief Content of a cache file */
+struct lt_stpub_cache {
+    uint8_t magic[4];
+    uint8_t version;
+    uint8_t reserved[3];
+    char serial[32];    /**< Serial number of the chip as lt_util_chip_serial() prints it */
+    uint8_t stpub[32];
+    uint8_t mac[32];    /**< HMAC-SHA256 of all above */
+} __attribute__((__packed__));
+
+/**
+ * @brief Tell whether the cache is enabled, by LT_UTIL_STPUB_CACHE_ENV and by directory of cache files
+ *
+ * @return true       Session is started by lt_stpub_session_start()
+ */
+bool lt_stpub_cache_enabled(void);
+
+/**
+ * @brief Start secure session with STPUB from the cache, as lt_verify_chip_and_start_secure_session() does otherwise
+ *
+ * @param h           Device's handle, the device must be open
+ * @param shipriv     Pairing private key
+ * @param shipub      Pairing public key
+ * @param pkey_index  Pairing key slot
+ * @return lt_ret_t   LT_OK if success, otherwise error of the full verification
+ */
+lt_ret_t lt_stpub_session_start(lt_handle_t *h, const uint8_t *shipriv, const uint8_t *shipub, uint8_t pkey_index);
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file timing.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Sleeps with microsecond resolution for ports of lt-util and host side retries
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include "libtropic_logging.h"
+#include "timing.h"
+
+static struct {
+    uint32_t poll_us;
+    uint64_t spin_ns;
+} timing_cfg;
+
+static pthread_once_t timing_once = PTHREAD_ONCE_INIT;
+
+// Updated by threads of all devices at once, so only through atomics
+static struct lt_timing_hist timing_hist;
+
+static uint32_t timing_env_us(const char *name, uint32_t def)
+{
+    const char *env = getenv(name);
+    if (!env || !*env) {
+        return def;
+    }
+    char *endptr;
+    unsigned long us = strtoul(env, &endptr, 10);
+    if ((*endptr != '\0') || (us > 1000000)) {
+        LT_LOG_WARN("Ignoring %s=%s, using %u us", name, env, (unsigned)def);
+        return def;
+    }
+    return (uint32_t)us;
+}
+
+static void timing_print_at_exit(void)
+{
+    lt_timing_print_hist(stderr);
+}
+
+static void timing_init(void)
+{
+    timing_cfg.poll_us = timing_env_us(LT_UTIL_POLL_US_ENV, 0);
+    timing_cfg.spin_ns = (uint64_t)timing_env_us(LT_UTIL_SPIN_US_ENV, LT_TIMING_SPIN_US_DEFAULT) * 1000u;
+    if (getenv(LT_UTIL_TIMING_HIST_ENV)) {
+        atexit(timing_print_at_exit);
+    }
+}
+
+static unsigned timing_bucket(uint64_t ns)
+{
+    uint64_t us = ns / 1000u;
+    unsigned i = 0;
+    while (us && (i < LT_TIMING_HIST_BUCKETS - 1)) {
+        us >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static void timing_record(uint64_t overshoot_ns)
+{
+    __atomic_fetch_add(&timing_hist.count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&timing_hist.sum_ns, overshoot_ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&timing_hist.bucket[timing_bucket(overshoot_ns)], 1, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&timing_hist.max_ns, __ATOMIC_RELAXED);
+    while ((overshoot_ns > max)
+           && !__atomic_compare_exchange_n(&timing_hist.max_ns, &max, overshoot_ns, false, __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED)) {
+    }
+}
+
+uint64_t lt_timing_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+void lt_timing_sleep_us(uint32_t us)
+{
+    pthread_once(&timing_once, timing_init);
+
+    uint64_t deadline = lt_timing_now_ns() + (uint64_t)us * 1000u;
+
+#ifdef __linux__
+    // Default slack of 50 us would be added to every wake up, it is kept per thread
+    static __thread bool slack_set;
+    if (!slack_set) {
+        prctl(PR_SET_TIMERSLACK, 1ul);
+        slack_set = true;
+    }
+#endif
+
+    if ((uint64_t)us * 1000u > timing_cfg.spin_ns) {
+        uint64_t wake = deadline - timing_cfg.spin_ns;
+#ifdef TIMER_ABSTIME
+        struct timespec ts = {.tv_sec = (time_t)(wake / 1000000000u), .tv_nsec = (long)(wake % 1000000000u)};
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        }
+#else
+        // No absolute sleep (macOS), relative one is repeated until the wake up time
+        uint64_t now;
+        while ((now = lt_timing_now_ns()) < wake) {
+            uint64_t left = wake - now;
+            struct timespec ts = {.tv_sec = (time_t)(left / 1000000000u), .tv_nsec = (long)(left % 1000000000u)};
+            nanosleep(&ts, NULL);
+        }
+#endif
+    }
+
+    uint64_t now;
+    while ((now = lt_timing_now_ns()) < deadline) {
+    }
+    timing_record(now - deadline);
+}
+
+void lt_timing_poll_frame(struct lt_timing_poll *poll, bool get_response)
+{
+    poll->active = get_response;
+    if (!get_response) {
+        poll->next_us = 0;
+    }
+}
+
+void lt_timing_delay(struct lt_timing_poll *poll, uint32_t ms)
+{
+    pthread_once(&timing_once, timing_init);
+
+    uint32_t us = ms * 1000u;
+    if (poll->active && timing_cfg.poll_us) {
+        uint32_t next = poll->next_us ? poll->next_us : timing_cfg.poll_us;
+        if (next < us) {
+            us = next;
+        }
+        poll->next_us = (us < ms * 500u) ? us * 2 : ms * 1000u;
+    }
+    lt_timing_sleep_us(us);
+}
+
+void lt_timing_get_hist(struct lt_timing_hist *hist)
+{
+    hist->count = __atomic_load_n(&timing_hist.count, __ATOMIC_RELAXED);
+    hist->sum_ns = __atomic_load_n(&timing_hist.sum_ns, __ATOMIC_RELAXED);
+    hist->max_ns = __atomic_load_n(&timing_hist.max_ns, __ATOMIC_RELAXED);
+    for (unsigned i = 0; i < LT_TIMING_HIST_BUCKETS; i++) {
+        hist->bucket[i] = __atomic_load_n(&timing_hist.bucket[i], __ATOMIC_RELAXED);
+    }
+}
+
+void lt_timing_print_hist(FILE *fp)
+{
+    struct lt_timing_hist hist;
+    lt_timing_get_hist(&hist);
+    if (hist.count == 0) {
+        return;
+    }
+
+    fprintf(fp, "Sleep overshoot: %llu sleeps, mean %.1f us, max %.1f us (poll %u us, spin %u us)\n",
+            (unsigned long long)hist.count, hist.sum_ns / 1e3 / hist.count, hist.max_ns / 1e3,
+            (unsigned)timing_cfg.poll_us, (unsigned)(timing_cfg.spin_ns / 1000u));
+    for (unsigned i = 0; i < LT_TIMING_HIST_BUCKETS; i++) {
+        if (hist.bucket[i] == 0) {
+            continue;
+        }
+        char range[32];
+        if (i == 0) {
+            snprintf(range, sizeof(range), "< 1 us");
+        } else if (i == LT_TIMING_HIST_BUCKETS - 1) {
+            snprintf(range, sizeof(range), ">= %u us", 1u << (i - 1));
+        } else {
+            snprintf(range, sizeof(range), "%u-%u us", 1u << (i - 1), 1u << i);
+        }
+        fprintf(fp, "  %-14s %10llu %5.1f %%\n", range, (unsigned long long)hist.bucket[i],
+                100.0 * hist.bucket[i] / hist.count);
+    }
+}
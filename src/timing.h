@@ -0,0 +1,100 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/**
+ * @file timing.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Sleeps with microsecond resolution for ports of lt-util and host side retries
+ *
+ * @details libtropic asks its port for delays in whole milliseconds and usleep() adds timer slack on top. Sleeps of
+ * this module run to an absolute deadline of the monotonic clock: clock_nanosleep() wakes up shortly before it and the
+ * rest is spun on the clock, so they neither round up nor oversleep. Delays which libtropic makes between polls of
+ * chip status start at a shorter interval, which doubles with every poll of the same response until it reaches
+ * libtropic's one again. Short operations are picked up soon after the chip finishes them, while libtropic, which gives
+ * up after a fixed number of polls, still waits nearly as long for slow ones. Overshoot of every sleep is counted in a
+ * histogram, which shows the spin tail and poll interval a board needs.
+ *
+ * Environment variables, read once per process:
+ *     LT_UTIL_POLL_US       first interval between polls of chip status in microseconds, libtropic's delay when not set
+ *     LT_UTIL_SPIN_US       spun tail of every sleep in microseconds (default LT_TIMING_SPIN_US_DEFAULT, 0 spins never)
+ *     LT_UTIL_TIMING_HIST   when set, histogram is printed to stderr at exit
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define LT_UTIL_POLL_US_ENV       "LT_UTIL_POLL_US"
+#define LT_UTIL_SPIN_US_ENV       "LT_UTIL_SPIN_US"
+#define LT_UTIL_TIMING_HIST_ENV   "LT_UTIL_TIMING_HIST"
+
+/** @brief Spun tail of every sleep when LT_UTIL_SPIN_US is not set */
+#define LT_TIMING_SPIN_US_DEFAULT 20
+
+/** @brief Buckets of overshoot: below 1 us, then [2^(i-1), 2^i) us, the last one takes everything longer */
+#define LT_TIMING_HIST_BUCKETS 16
+
+/** @brief Overshoot of sleeps over their deadlines */
+struct lt_timing_hist {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    uint64_t bucket[LT_TIMING_HIST_BUCKETS];
+};
+
+/** @brief Polls of chip status for one response, kept by the port of each device */
+struct lt_timing_poll {
+    /** @brief Last frame was GET_RESPONSE, so the next delay comes between polls */
+    bool active;
+    /** @brief Interval before the next poll [us], 0 starts again at LT_UTIL_POLL_US */
+    uint32_t next_us;
+};
+
+/**
+ * @brief Current time of monotonic clock
+ *
+ * @return uint64_t   Nanoseconds
+ */
+uint64_t lt_timing_now_ns(void);
+
+/**
+ * @brief Sleep for given time, overshoot is recorded in the histogram
+ *
+ * @param us          Microseconds
+ */
+void lt_timing_sleep_us(uint32_t us);
+
+/**
+ * @brief Called by the port when a frame starts, any other frame than GET_RESPONSE begins a new response
+ *
+ * @param poll        Polls of the device
+ * @param get_response  Frame starts with GET_RESPONSE
+ */
+void lt_timing_poll_frame(struct lt_timing_poll *poll, bool get_response);
+
+/**
+ * @brief Delay asked for by libtropic through lt_port_delay()
+ *
+ * @param poll        Polls of the device, shorter interval is slept after GET_RESPONSE
+ * @param ms          Milliseconds libtropic asked for
+ */
+void lt_timing_delay(struct lt_timing_poll *poll, uint32_t ms);
+
+/**
+ * @brief Copy histogram of all sleeps made so far
+ *
+ * @param hist        Histogram
+ */
+void lt_timing_get_hist(struct lt_timing_hist *hist);
+
+/**
+ * @brief Print histogram of all sleeps made so far, nothing when there were none
+ *
+ * @param fp          Output stream
+ */
+void lt_timing_print_hist(FILE *fp);
+
+#endif
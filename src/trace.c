@@ -0,0 +1,178 @@
+/**
+ * @file trace.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Spans are appended to a growing array under a mutex and written out once at the end, so recording
+ * costs two clock reads and a copy of the name.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#if LT_UTIL_TRACE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libtropic_logging.h"
+#include "trace.h"
+
+/** @brief Spans array grows by this many spans */
+#define TRACE_GROW 1024
+
+struct trace_span {
+    const char *cat;
+    char name[LT_TRACE_NAME_LEN_MAX + 1];
+    uint64_t start;
+    uint64_t dur;
+    long tid;
+};
+
+static struct {
+    pthread_mutex_t lock;
+    bool active;
+    char *path;
+    uint64_t epoch;
+    struct trace_span *spans;
+    size_t count;
+    size_t capacity;
+} trace = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+uint64_t lt_trace_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int lt_trace_open(const char *path)
+{
+    pthread_mutex_lock(&trace.lock);
+    free(trace.path);
+    trace.path = strdup(path);
+    trace.epoch = lt_trace_now();
+    trace.count = 0;
+    trace.active = (trace.path != NULL);
+    pthread_mutex_unlock(&trace.lock);
+
+    return trace.active ? 0 : 1;
+}
+
+void lt_trace_span(const char *cat, const char *name, uint64_t start)
+{
+    uint64_t end = lt_trace_now();
+
+    pthread_mutex_lock(&trace.lock);
+    if (!trace.active) {
+        pthread_mutex_unlock(&trace.lock);
+        return;
+    }
+    if (trace.count == trace.capacity) {
+        struct trace_span *spans = realloc(trace.spans, (trace.capacity + TRACE_GROW) * sizeof(*spans));
+        if (!spans) {
+            pthread_mutex_unlock(&trace.lock);
+            return;
+        }
+        trace.spans = spans;
+        trace.capacity += TRACE_GROW;
+    }
+    struct trace_span *span = &trace.spans[trace.count++];
+    span->cat = cat;
+    snprintf(span->name, sizeof(span->name), "%s", name);
+    span->start = start;
+    span->dur = end - start;
+    span->tid = (long)syscall(SYS_gettid);
+    pthread_mutex_unlock(&trace.lock);
+}
+
+// Names are produced by lt-util itself (command arguments), only characters breaking JSON strings are replaced
+static void print_json_name(FILE *fp, const char *name)
+{
+    for (; *name; name++) {
+        fputc((*name == '"' || *name == '\\' || (unsigned char)*name < 0x20) ? '_' : *name, fp);
+    }
+}
+
+static int write_json(void)
+{
+    FILE *fp = fopen(trace.path, "w");
+    if (!fp) {
+        LT_LOG_ERROR("Error opening trace file %s", trace.path);
+        return 1;
+    }
+
+    long pid = (long)getpid();
+    fprintf(fp, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+    for (size_t i = 0; i < trace.count; i++) {
+        const struct trace_span *span = &trace.spans[i];
+        fprintf(fp, "%s\n{\"name\": \"", i ? "," : "");
+        print_json_name(fp, span->name);
+        fprintf(fp, "\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": %ld, \"tid\": %ld}",
+                span->cat, (span->start - trace.epoch) / 1e3, span->dur / 1e3, pid, span->tid);
+    }
+    fprintf(fp, "\n]}\n");
+
+    if (fclose(fp) != 0) {
+        LT_LOG_ERROR("Error writing trace file %s", trace.path);
+        return 1;
+    }
+    return 0;
+}
+
+static int compare_span(const void *a, const void *b)
+{
+    const struct trace_span *x = a, *y = b;
+    int ret = strcmp(x->cat, y->cat);
+    return ret ? ret : strcmp(x->name, y->name);
+}
+
+// Sorts spans by category and name and prints one line per group
+static void print_summary(void)
+{
+    qsort(trace.spans, trace.count, sizeof(*trace.spans), compare_span);
+
+    LT_LOG("[TRACE] %-4s %-28s %8s %12s %10s %10s", "cat", "name", "count", "total [ms]", "avg [us]", "max [us]");
+    for (size_t i = 0; i < trace.count;) {
+        size_t j = i;
+        uint64_t total = 0, max = 0;
+        for (; j < trace.count && compare_span(&trace.spans[i], &trace.spans[j]) == 0; j++) {
+            total += trace.spans[j].dur;
+            if (trace.spans[j].dur > max) {
+                max = trace.spans[j].dur;
+            }
+        }
+        LT_LOG("[TRACE] %-4s %-28s %8zu %12.3f %10.1f %10.1f", trace.spans[i].cat, trace.spans[i].name, j - i,
+               total / 1e6, total / 1e3 / (j - i), max / 1e3);
+        i = j;
+    }
+}
+
+int lt_trace_close(void)
+{
+    pthread_mutex_lock(&trace.lock);
+    if (!trace.active) {
+        pthread_mutex_unlock(&trace.lock);
+        return 0;
+    }
+    trace.active = false;
+
+    // JSON keeps spans in order of their end, summary reorders them
+    int ret = write_json();
+    print_summary();
+
+    free(trace.spans);
+    free(trace.path);
+    trace.spans = NULL;
+    trace.path = NULL;
+    trace.count = trace.capacity = 0;
+    pthread_mutex_unlock(&trace.lock);
+
+    return ret;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * @file trace.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Opt-in timing of lt-util layers, enabled by cmake option LT_UTIL_TRACE
+ *
+ * @details Spans are recorded with monotonic clock timestamps and written as Chrome trace-event JSON (open it in
+ * chrome://tracing or https://ui.perfetto.dev), aggregated summary is printed at the end. Categories are:
+ *     cmd     lt-util commands (process_* functions), secure session establishment
+ *     l3      encryption of requests and decryption of responses
+ *     l2      sending L2 requests and receiving L2 responses
+ *     l1      HAL port calls (chip select, SPI transfer, delays)
+ * l1, l2 and l3 are measured by wrappers in trace_wrap.c, which the linker puts between libtropic and its callees.
+ * When LT_UTIL_TRACE is not defined, all macros compile to nothing.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdint.h>
+
+/** @brief lt-util option which enables tracing, followed by path of JSON file */
+#define TRACE "--trace"
+
+#if LT_UTIL_TRACE
+
+/** @brief Longest name of span stored in a trace, longer names are truncated */
+#define LT_TRACE_NAME_LEN_MAX 47
+
+/**
+ * @brief Start collecting spans, they are written into a file by lt_trace_close()
+ *
+ * @param path        Path of Chrome trace-event JSON file
+ * @return int        0 if success, otherwise 1
+ */
+int lt_trace_open(const char *path);
+
+/**
+ * @brief Write collected spans as JSON and print summary of each category and name
+ *
+ * @return int        0 if success, otherwise 1
+ */
+int lt_trace_close(void);
+
+/**
+ * @brief Current time of monotonic clock
+ *
+ * @return uint64_t   Nanoseconds
+ */
+uint64_t lt_trace_now(void);
+
+/**
+ * @brief Record span which started at start and ends now, does nothing until lt_trace_open() is called
+ *
+ * @param cat         Category, must be a string literal
+ * @param name        Name of span, it is copied
+ * @param start       Value of lt_trace_now() when the span started
+ */
+void lt_trace_span(const char *cat, const char *name, uint64_t start);
+
+#define LT_TRACE_BEGIN(start_)             uint64_t start_ = lt_trace_now()
+#define LT_TRACE_END(start_, cat_, name_)  lt_trace_span(cat_, name_, start_)
+
+#else
+
+#define LT_TRACE_BEGIN(start_)             do {} while (0)
+#define LT_TRACE_END(start_, cat_, name_)  do {} while (0)
+
+#endif
+
+#endif
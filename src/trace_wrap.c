@@ -0,0 +1,103 @@
+/**
+ * @file trace_wrap.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Wrappers measuring libtropic layers without changes in libtropic itself. With LT_UTIL_TRACE, CMakeLists.txt
+ * links lt-util with -Wl,--wrap=<function> for every function below, so each call of <function> crossing object
+ * files goes to __wrap_<function>, which measures __real_<function>. Calls within one object file of libtropic
+ * are not measured.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#if LT_UTIL_TRACE
+
+#include "libtropic_common.h"
+#include "libtropic_port.h"
+#include "lt_l2.h"
+#include "lt_l3_process.h"
+#include "trace.h"
+
+lt_ret_t __real_lt_port_spi_csn_low(lt_l2_state_t *s2);
+lt_ret_t __real_lt_port_spi_csn_high(lt_l2_state_t *s2);
+lt_ret_t __real_lt_port_spi_transfer(lt_l2_state_t *s2, uint8_t offset, uint16_t tx_data_length, uint32_t timeout);
+lt_ret_t __real_lt_port_delay(lt_l2_state_t *s2, uint32_t ms);
+lt_ret_t __real_lt_l2_send(lt_l2_state_t *s2);
+lt_ret_t __real_lt_l2_receive(lt_l2_state_t *s2);
+lt_ret_t __real_lt_l3_encrypt_request(lt_l3_state_t *s3);
+lt_ret_t __real_lt_l3_decrypt_response(lt_l3_state_t *s3);
+
+lt_ret_t __wrap_lt_port_spi_csn_low(lt_l2_state_t *s2);
+lt_ret_t __wrap_lt_port_spi_csn_high(lt_l2_state_t *s2);
+lt_ret_t __wrap_lt_port_spi_transfer(lt_l2_state_t *s2, uint8_t offset, uint16_t tx_data_length, uint32_t timeout);
+lt_ret_t __wrap_lt_port_delay(lt_l2_state_t *s2, uint32_t ms);
+lt_ret_t __wrap_lt_l2_send(lt_l2_state_t *s2);
+lt_ret_t __wrap_lt_l2_receive(lt_l2_state_t *s2);
+lt_ret_t __wrap_lt_l3_encrypt_request(lt_l3_state_t *s3);
+lt_ret_t __wrap_lt_l3_decrypt_response(lt_l3_state_t *s3);
+
+lt_ret_t __wrap_lt_port_spi_csn_low(lt_l2_state_t *s2)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_port_spi_csn_low(s2);
+    LT_TRACE_END(start, "l1", "spi_csn_low");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_port_spi_csn_high(lt_l2_state_t *s2)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_port_spi_csn_high(s2);
+    LT_TRACE_END(start, "l1", "spi_csn_high");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_port_spi_transfer(lt_l2_state_t *s2, uint8_t offset, uint16_t tx_data_length, uint32_t timeout)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_port_spi_transfer(s2, offset, tx_data_length, timeout);
+    LT_TRACE_END(start, "l1", "spi_transfer");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_port_delay(lt_l2_state_t *s2, uint32_t ms)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_port_delay(s2, ms);
+    LT_TRACE_END(start, "l1", "delay");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_l2_send(lt_l2_state_t *s2)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_l2_send(s2);
+    LT_TRACE_END(start, "l2", "send");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_l2_receive(lt_l2_state_t *s2)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_l2_receive(s2);
+    LT_TRACE_END(start, "l2", "receive");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_l3_encrypt_request(lt_l3_state_t *s3)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_l3_encrypt_request(s3);
+    LT_TRACE_END(start, "l3", "encrypt_request");
+    return ret;
+}
+
+lt_ret_t __wrap_lt_l3_decrypt_response(lt_l3_state_t *s3)
+{
+    LT_TRACE_BEGIN(start);
+    lt_ret_t ret = __real_lt_l3_decrypt_response(s3);
+    LT_TRACE_END(start, "l3", "decrypt_response");
+    return ret;
+}
+
+#endif
@@ -0,0 +1,310 @@
+/**
+ * @file utild.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details lt-utild keeps TROPIC01 initialized and one secure session established, and executes lt-util commands
+ * received over a Unix domain socket (see utild_proto.h). Clients are served one at a time in order of arrival,
+ * so per-command latency is the cost of the L3 command alone. Session is re-established after a failed command,
+ * or lazily after it was closed on idle timeout.
+ * Use it together with `lt-util --via-daemon <command>`.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libtropic.h"
+#include "libtropic_logging.h"
+#include "commands.h"
+#include "utild_proto.h"
+
+/** @brief Session is closed after this many seconds without a request */
+#define UTILD_IDLE_TIMEOUT_DEFAULT 60
+/** @brief Client must deliver whole request within this time */
+#define UTILD_CLIENT_TIMEOUT_S 5
+
+static volatile sig_atomic_t utild_stop = 0;
+
+static void utild_signal(int sig)
+{
+    (void)sig;
+    utild_stop = 1;
+}
+
+static void print_usage(void)
+{
+    printf("\r\nUsage:\r\n\n"
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+"\t./lt-utild /dev/ttyACM0 [-s <socket>] [-t <seconds>]\r\n\n"
+#endif
+#if LINUX_SPI || SIMULATOR
+"\t./lt-utild [-s <socket>] [-t <seconds>]\r\n\n"
+#endif
+"\t -s <socket>    Unix domain socket to listen on (default $"LT_UTILD_SOCKET_ENV" or\r\n"
+"\t                $XDG_RUNTIME_DIR/"LT_UTILD_SOCKET_NAME")\r\n"
+"\t -t <seconds>   Close secure session after this many idle seconds, 0 keeps it open forever (default %d)\r\n\n"
+"\t Then execute commands with: ./lt-util "VIA_DAEMON" <command>, e.g. ./lt-util "VIA_DAEMON" "RNG" 32 file\r\n\n",
+    UTILD_IDLE_TIMEOUT_DEFAULT);
+}
+
+static int utild_listen(const char *path)
+{
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LT_LOG_ERROR("Socket path too long: %s", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LT_LOG_ERROR("Error socket(): %s", strerror(errno));
+        return -1;
+    }
+
+    // Only owner of the daemon may talk to the chip
+    unlink(path);
+    mode_t old_mask = umask(0077);
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (ret != 0 || listen(fd, 16) != 0) {
+        LT_LOG_ERROR("Error binding %s: %s", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/** @brief Output of one command, read from a pipe while the command runs */
+struct utild_capture {
+    int fd;
+    char buf[LT_UTILD_OUT_LEN_MAX];
+    size_t len;
+    size_t dropped; /**< Bytes beyond what is returned to the client, read only to keep the pipe flowing */
+};
+
+static void *utild_capture_reader(void *arg)
+{
+    struct utild_capture *cap = arg;
+    char chunk[4096];
+    ssize_t n;
+
+    while ((n = read(cap->fd, chunk, sizeof(chunk))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        size_t keep = sizeof(cap->buf) - cap->len;
+        if (keep > (size_t)n) {
+            keep = (size_t)n;
+        }
+        memcpy(cap->buf + cap->len, chunk, keep);
+        cap->len += keep;
+        cap->dropped += (size_t)n - keep;
+    }
+
+    return NULL;
+}
+
+// Executes one request, what the command prints is captured up to LT_UTILD_OUT_LEN_MAX and returned to the client
+static void utild_serve(lt_handle_t *h, int client, struct lt_utild_request *req)
+{
+    struct timeval tv = {.tv_sec = UTILD_CLIENT_TIMEOUT_S, .tv_usec = 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    if (lt_utild_recv_request(client, req) != 0) {
+        LT_LOG_ERROR("Malformed request");
+        return;
+    }
+
+    if (chdir(req->cwd) != 0) {
+        char msg[128];
+        int len = snprintf(msg, sizeof(msg), "lt-utild cannot access working directory: %s\n", strerror(errno));
+        lt_utild_send_response(client, 1, msg, len);
+        return;
+    }
+
+    // Nothing goes to disk, output beyond the limit is read and dropped, so a talkative command never blocks
+    static struct utild_capture capture;
+    int pipe_fd[2];
+    pthread_t reader;
+    if (pipe(pipe_fd) != 0) {
+        LT_LOG_ERROR("Error pipe(): %s", strerror(errno));
+        lt_utild_send_response(client, 1, NULL, 0);
+        return;
+    }
+    capture.fd = pipe_fd[0];
+    capture.len = 0;
+    capture.dropped = 0;
+    if (pthread_create(&reader, NULL, utild_capture_reader, &capture) != 0) {
+        LT_LOG_ERROR("Error creating capture thread");
+        close(pipe_fd[0]);
+        close(pipe_fd[1]);
+        lt_utild_send_response(client, 1, NULL, 0);
+        return;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    int saved_out = dup(STDOUT_FILENO);
+    int saved_err = dup(STDERR_FILENO);
+    dup2(pipe_fd[1], STDOUT_FILENO);
+    dup2(pipe_fd[1], STDERR_FILENO);
+    close(pipe_fd[1]);
+
+    int status = lt_util_run_command(h, req->argc, req->argv);
+    if (status == LT_UTIL_ERR_ARGS) {
+        LT_LOG_ERROR("ERROR wrong parameters entered");
+    } else if (status != 0) {
+        // Do not trust the session after a failure, next command starts a new one
+        lt_util_session_reset(h);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved_out, STDOUT_FILENO);
+    dup2(saved_err, STDERR_FILENO);
+    close(saved_out);
+    close(saved_err);
+    // Last write end is closed above, so the reader sees end of file
+    pthread_join(reader, NULL);
+    close(pipe_fd[0]);
+    if (capture.dropped) {
+        LT_LOG_WARN("Output of the command truncated, %zu B dropped", capture.dropped);
+    }
+
+    if (lt_utild_send_response(client, status, capture.buf, capture.len) != 0) {
+        LT_LOG_WARN("Client left before response was sent");
+    }
+
+    LT_LOG_INFO("Command %s %s finished with status %d", req->argc ? req->argv[0] : "",
+                req->argc > 1 ? req->argv[1] : "", status);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dev_path = NULL;
+    const char *socket_path = NULL;
+    long idle_timeout = UTILD_IDLE_TIMEOUT_DEFAULT;
+
+    int i = 1;
+#if (USB_DONGLE_TS1301 || USB_DONGLE_TS1302)
+    if (argc < 2) {
+        print_usage();
+        return 0;
+    }
+    dev_path = argv[i++];
+#endif
+    for (; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            char *endptr;
+            idle_timeout = strtol(argv[++i], &endptr, 10);
+            if (*endptr != '\0' || idle_timeout < 0) {
+                LT_LOG_ERROR("Invalid idle timeout");
+                return 1;
+            }
+        } else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (!socket_path) {
+        socket_path = lt_utild_socket_path();
+    }
+    if (!socket_path) {
+        return 1;
+    }
+
+    lt_handle_t h = {0};
+    struct lt_util_dev dev;
+    lt_util_dev_setup(&h, &dev, dev_path);
+    lt_util_session_keep(&h, true);
+    dev.daemon = true;
+
+    int listen_fd = utild_listen(socket_path);
+    if (listen_fd < 0) {
+        return 1;
+    }
+
+    struct sigaction sa = {0};
+    sa.sa_handler = utild_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    // Open the session upfront, so even the first client does not pay for the handshake
+    if (lt_util_session_open(&h) != 0) {
+        LT_LOG_WARN("Secure session not established yet, will retry on first command");
+    }
+    LT_LOG_INFO("lt-utild listening on %s", socket_path);
+
+    static struct lt_utild_request req;
+    bool session_idle = false;
+    bool rearm_failed = false;
+    while (!utild_stop) {
+        struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+        int timeout_ms = (idle_timeout && !session_idle) ? (int)(idle_timeout * 1000) : -1;
+        // Re-arm of M&D slots after a PIN check runs as soon as no client is waiting
+        bool rearm = lt_util_macandd_rearm_pending(&h) && !rearm_failed;
+        int ret = poll(&pfd, 1, rearm ? 0 : timeout_ms);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LT_LOG_ERROR("Error poll(): %s", strerror(errno));
+            break;
+        }
+        if (ret == 0 && rearm) {
+            // After a failure the next try comes with the next command, not in a busy loop
+            rearm_failed = lt_util_macandd_rearm(&h) != 0;
+            continue;
+        }
+        if (ret == 0) {
+            LT_LOG_INFO("Idle for %ld s, closing secure session", idle_timeout);
+            lt_util_session_reset(&h);
+            session_idle = true;
+            continue;
+        }
+
+        int client = accept(listen_fd, NULL, NULL);
+        if (client < 0) {
+            continue;
+        }
+        if (lt_util_peer_check(client) != 0) {
+            LT_LOG_WARN("Connection of another user refused");
+            close(client);
+            continue;
+        }
+        utild_serve(&h, client, &req);
+        close(client);
+        session_idle = false;
+        rearm_failed = false;
+    }
+
+    LT_LOG_INFO("lt-utild exiting");
+    close(listen_fd);
+    unlink(socket_path);
+    lt_util_macandd_rearm(&h);
+    lt_util_session_reset(&h);
+
+    return 0;
+}
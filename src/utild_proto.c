@@ -0,0 +1,262 @@
+/**
+ * @file utild_proto.c
+ * @author Tropic Square s.r.o.
+ *
+ * @details Socket helpers shared by lt-util (--via-daemon) and lt-utild.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libtropic_logging.h"
+#include "utild_proto.h"
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (n == 0) {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int write_u32(int fd, uint32_t val)
+{
+    return write_all(fd, &val, sizeof(val));
+}
+
+static int read_u32(int fd, uint32_t *val)
+{
+    return read_all(fd, val, sizeof(*val));
+}
+
+static int write_str(int fd, const char *str)
+{
+    uint32_t len = strlen(str);
+    if (write_u32(fd, len) != 0) {
+        return -1;
+    }
+    return write_all(fd, str, len);
+}
+
+// Reads length prefixed string into buffer of size LT_UTILD_ARG_LEN_MAX + 1 and terminates it
+static int read_str(int fd, char *str)
+{
+    uint32_t len;
+    if (read_u32(fd, &len) != 0 || len > LT_UTILD_ARG_LEN_MAX) {
+        return -1;
+    }
+    if (read_all(fd, str, len) != 0) {
+        return -1;
+    }
+    str[len] = '\0';
+    return 0;
+}
+
+int lt_util_runtime_path(const char *name, char *path, size_t len)
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char fallback[64];
+
+    // Anybody can create files in /tmp, so the directory must not be taken over by another user
+    if (!dir || !dir[0]) {
+        snprintf(fallback, sizeof(fallback), LT_UTIL_RUNTIME_DIR_FALLBACK, (unsigned)getuid());
+        if (mkdir(fallback, 0700) != 0 && errno != EEXIST) {
+            LT_LOG_ERROR("Error creating %s: %s", fallback, strerror(errno));
+            return -1;
+        }
+        struct stat st;
+        if (lstat(fallback, &st) != 0 || !S_ISDIR(st.st_mode) || st.st_uid != getuid() || (st.st_mode & 0077)) {
+            LT_LOG_ERROR("%s is not a private directory of this user, set XDG_RUNTIME_DIR", fallback);
+            return -1;
+        }
+        dir = fallback;
+    }
+
+    if (snprintf(path, len, "%s/%s", dir, name) >= (int)len) {
+        LT_LOG_ERROR("Runtime directory path too long: %s", dir);
+        return -1;
+    }
+
+    return 0;
+}
+
+int lt_util_peer_check(int fd)
+{
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        LT_LOG_ERROR("Error getsockopt(SO_PEERCRED): %s", strerror(errno));
+        return -1;
+    }
+    if (cred.uid != getuid()) {
+        LT_LOG_ERROR("Peer of the socket runs as uid %u, expected %u", (unsigned)cred.uid, (unsigned)getuid());
+        return -1;
+    }
+
+    return 0;
+}
+
+const char *lt_utild_socket_path(void)
+{
+    static char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    const char *env = getenv(LT_UTILD_SOCKET_ENV);
+    if (env && env[0]) {
+        return env;
+    }
+    if (lt_util_runtime_path(LT_UTILD_SOCKET_NAME, path, sizeof(path)) != 0) {
+        return NULL;
+    }
+    return path;
+}
+
+int lt_utild_request(int argc, char *argv[])
+{
+    if (argc < 0 || argc > LT_UTILD_ARGS_MAX) {
+        LT_LOG_ERROR("Too many arguments for lt-utild");
+        return 1;
+    }
+
+    char cwd[LT_UTILD_ARG_LEN_MAX + 1];
+    if (!getcwd(cwd, sizeof(cwd))) {
+        LT_LOG_ERROR("Error getcwd(): %s", strerror(errno));
+        return 1;
+    }
+
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    const char *path = lt_utild_socket_path();
+    if (!path) {
+        return 1;
+    }
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        LT_LOG_ERROR("Socket path too long: %s", path);
+        return 1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LT_LOG_ERROR("Error socket(): %s", strerror(errno));
+        return 1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        LT_LOG_ERROR("Error connecting to lt-utild at %s: %s", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    // Arguments may carry a PIN, they go only to a daemon of the same user
+    if (lt_util_peer_check(fd) != 0) {
+        LT_LOG_ERROR("Refusing to talk to %s, it is not served by lt-utild of this user", path);
+        close(fd);
+        return 1;
+    }
+
+    int err = write_u32(fd, LT_UTILD_MAGIC);
+    err |= write_str(fd, cwd);
+    err |= write_u32(fd, (uint32_t)argc);
+    for (int i = 0; i < argc && !err; i++) {
+        if (strlen(argv[i]) > LT_UTILD_ARG_LEN_MAX) {
+            err = -1;
+            break;
+        }
+        err |= write_str(fd, argv[i]);
+    }
+    if (err) {
+        LT_LOG_ERROR("Error sending request to lt-utild");
+        close(fd);
+        return 1;
+    }
+
+    uint32_t status, out_len;
+    if (read_u32(fd, &status) != 0 || read_u32(fd, &out_len) != 0 || out_len > LT_UTILD_OUT_LEN_MAX) {
+        LT_LOG_ERROR("Error receiving response from lt-utild");
+        close(fd);
+        return 1;
+    }
+
+    char *out = malloc(out_len ? out_len : 1);
+    if (!out || read_all(fd, out, out_len) != 0) {
+        LT_LOG_ERROR("Error receiving output from lt-utild");
+        free(out);
+        close(fd);
+        return 1;
+    }
+    fwrite(out, 1, out_len, stdout);
+    free(out);
+    close(fd);
+
+    return (int)status;
+}
+
+int lt_utild_recv_request(int fd, struct lt_utild_request *req)
+{
+    uint32_t magic, argc;
+    if (read_u32(fd, &magic) != 0 || magic != LT_UTILD_MAGIC) {
+        return -1;
+    }
+    if (read_str(fd, req->cwd) != 0) {
+        return -1;
+    }
+    if (read_u32(fd, &argc) != 0 || argc > LT_UTILD_ARGS_MAX) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < argc; i++) {
+        if (read_str(fd, req->args[i]) != 0) {
+            return -1;
+        }
+        req->argv[i] = req->args[i];
+    }
+    req->argv[argc] = NULL;
+    req->argc = (int)argc;
+
+    return 0;
+}
+
+int lt_utild_send_response(int fd, int status, const char *out, size_t out_len)
+{
+    if (out_len > LT_UTILD_OUT_LEN_MAX) {
+        out_len = LT_UTILD_OUT_LEN_MAX;
+    }
+    if (write_u32(fd, (uint32_t)status) != 0 || write_u32(fd, (uint32_t)out_len) != 0) {
+        return -1;
+    }
+    return write_all(fd, out, out_len);
+}
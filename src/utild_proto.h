@@ -0,0 +1,102 @@
+#ifndef UTILD_PROTO_H
+#define UTILD_PROTO_H
+
+/**
+ * @file utild_proto.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief Wire format used between lt-util (--via-daemon) and lt-utild over a Unix domain socket
+ *
+ * @details Request:  magic, length prefixed working directory, argc, length prefixed arguments.
+ *          Response: status returned by lt_util_run_command(), length prefixed captured output.
+ *          All integers are uint32_t in host byte order, both sides always run on the same host.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+/** @brief Name of the socket in runtime directory of the user, used when LT_UTILD_SOCKET_ENV is not set */
+#define LT_UTILD_SOCKET_NAME    "lt-utild.sock"
+/** @brief Private directory created for sockets when XDG_RUNTIME_DIR is not set, %u is uid of the user */
+#define LT_UTIL_RUNTIME_DIR_FALLBACK "/tmp/lt-util-%u"
+/** @brief Environment variable which overrides socket path on both sides */
+#define LT_UTILD_SOCKET_ENV     "LT_UTILD_SOCKET"
+/** @brief "LTU1", bump when wire format changes */
+#define LT_UTILD_MAGIC          0x3155544cu
+/** @brief Maximal number of forwarded arguments */
+#define LT_UTILD_ARGS_MAX       16
+/** @brief Maximal length of one forwarded argument or working directory */
+#define LT_UTILD_ARG_LEN_MAX    PATH_MAX
+/** @brief Maximal size of output returned to the client */
+#define LT_UTILD_OUT_LEN_MAX    (64u * 1024u)
+
+/** @brief Request as received by lt-utild */
+struct lt_utild_request {
+    char cwd[LT_UTILD_ARG_LEN_MAX + 1];
+    int argc;
+    char *argv[LT_UTILD_ARGS_MAX + 1];
+    char args[LT_UTILD_ARGS_MAX][LT_UTILD_ARG_LEN_MAX + 1];
+};
+
+/**
+ * @brief Path of a socket in runtime directory of the user
+ *
+ * @details Runtime directory is $XDG_RUNTIME_DIR, or LT_UTIL_RUNTIME_DIR_FALLBACK which is created with 0700
+ *          permissions and refused when it is not a directory owned by the user and closed to others.
+ *
+ * @param name        File name of the socket
+ * @param path        Buffer for the path
+ * @param len         Size of the buffer
+ * @return int        0 if success, otherwise -1
+ */
+int lt_util_runtime_path(const char *name, char *path, size_t len);
+
+/**
+ * @brief Check that process on the other end of a connected Unix domain socket runs as the same user
+ *
+ * @param fd          Connected socket
+ * @return int        0 if peer uid is the uid of this process, otherwise -1
+ */
+int lt_util_peer_check(int fd);
+
+/**
+ * @brief Path of lt-utild socket
+ *
+ * @return const char*  Value of LT_UTILD_SOCKET_ENV if set, otherwise LT_UTILD_SOCKET_NAME in runtime directory
+ *                      of the user, NULL if there is no usable runtime directory
+ */
+const char *lt_utild_socket_path(void);
+
+/**
+ * @brief Client side: forward arguments to lt-utild, print its output and return its status
+ *
+ * @param argc        Number of command arguments
+ * @param argv        Command arguments without program name and serialport
+ * @return int        Status of the command, 1 if daemon could not be reached
+ */
+int lt_utild_request(int argc, char *argv[]);
+
+/**
+ * @brief Daemon side: read one request from connected client
+ *
+ * @param fd          Connected socket
+ * @param req         Request to be filled
+ * @return int        0 if success, otherwise -1
+ */
+int lt_utild_recv_request(int fd, struct lt_utild_request *req);
+
+/**
+ * @brief Daemon side: send status and captured output back to the client
+ *
+ * @param fd          Connected socket
+ * @param status      Status returned by lt_util_run_command()
+ * @param out         Captured output
+ * @param out_len     Length of captured output
+ * @return int        0 if success, otherwise -1
+ */
+int lt_utild_send_response(int fd, int status, const char *out, size_t out_len);
+
+#endif
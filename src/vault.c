@@ -0,0 +1,269 @@
+/**
+ * @file vault.c
+ * @author Tropic Square s.r.o.
+ *
+ * @brief PIN vault: many Mac-And-Destroy protected records, each with its own number of attempts
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libtropic.h"
+#include "crc32.h"
+#include "vault.h"
+
+#if LT_VAULT_INDEX_SLOT < 0
+#error "PIN vault does not fit into R memory with this MACANDD_JOURNAL_SLOTS"
+#endif
+
+#if LT_VAULT_MD_END - LT_VAULT_MD_FIRST < MACANDD_ROUNDS_MAX
+#error "PIN vault has not enough M&D slots for a record with MACANDD_ROUNDS_MAX rounds"
+#endif
+
+/** @brief Marks a valid copy of the index */
+static const uint8_t vault_magic[4] = {'L', 'T', 'V', '1'};
+
+static uint32_t vault_index_crc(const struct lt_vault_index *index)
+{
+    return lt_util_crc32(0, (const uint8_t *)index, offsetof(struct lt_vault_index, crc));
+}
+
+// Reads one copy of the index, valid is false for an empty slot or a copy which is torn or of other format
+static lt_ret_t vault_index_read_slot(lt_handle_t *h, uint16_t slot, struct lt_vault_index *index, bool *valid,
+                                      bool *empty)
+{
+    uint8_t buff[444];
+    uint16_t size = 0;
+
+    *valid = false;
+    *empty = false;
+    lt_ret_t ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_READ, slot, buff, &size);
+    if (lt_macandd_r_mem_empty(ret, size)) {
+        *empty = true;
+        return LT_OK;
+    }
+    if (ret != LT_OK) {
+        return ret;
+    }
+    if (size != sizeof(*index)) {
+        return LT_OK;
+    }
+    memcpy(index, buff, sizeof(*index));
+    *valid = !memcmp(index->magic, vault_magic, sizeof(vault_magic)) && (index->crc == vault_index_crc(index));
+
+    return LT_OK;
+}
+
+lt_ret_t lt_vault_index_read(lt_handle_t *h, struct lt_vault_index *index)
+{
+    if (!h || !index) {
+        return LT_PARAM_ERR;
+    }
+
+    struct lt_vault_index copy[2];
+    bool valid[2], empty[2];
+    for (int k = 0; k < 2; k++) {
+        lt_ret_t ret = vault_index_read_slot(h, LT_VAULT_INDEX_SLOT + k, &copy[k], &valid[k], &empty[k]);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+
+    if (valid[0] && (!valid[1] || copy[0].seq > copy[1].seq)) {
+        memcpy(index, &copy[0], sizeof(*index));
+    } else if (valid[1]) {
+        memcpy(index, &copy[1], sizeof(*index));
+    } else if (empty[0] && empty[1]) {
+        memset(index, 0, sizeof(*index));
+        memcpy(index->magic, vault_magic, sizeof(vault_magic));
+    } else {
+        // Something else than the index is there, do not allocate over data of unknown owner
+        return LT_FAIL;
+    }
+
+    return LT_OK;
+}
+
+// Writes index with the next sequence number into the slot not holding the current copy
+static lt_ret_t vault_index_write(lt_handle_t *h, struct lt_vault_index *index)
+{
+    index->seq++;
+    index->crc = vault_index_crc(index);
+
+    uint16_t slot = LT_VAULT_INDEX_SLOT + (index->seq & 1);
+    lt_ret_t ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_ERASE, slot, NULL, NULL);
+    if (ret != LT_OK) {
+        return ret;
+    }
+    uint16_t len = sizeof(*index);
+
+    return lt_macandd_r_mem(h, LT_MACANDD_R_MEM_WRITE, slot, (uint8_t *)index, &len);
+}
+
+lt_ret_t lt_vault_layout(const struct lt_vault_index *index, uint8_t id, struct lt_macandd_layout *layout)
+{
+    if (!index || !layout || id >= LT_VAULT_RECORDS_MAX) {
+        return LT_PARAM_ERR;
+    }
+
+    const struct lt_vault_entry *e = &index->entry[id];
+    if (e->rounds == 0) {
+        return LT_FAIL;
+    }
+    layout->data_slot = e->data_slot;
+    layout->journal_slot = e->journal_slot;
+    layout->journal_slots = e->journal_slots;
+    layout->md_slot = e->md_slot;
+    layout->rounds = e->rounds;
+
+    return LT_OK;
+}
+
+// First fit of rounds M&D slots among ranges of other records, returns false if they do not fit anywhere
+static bool vault_md_alloc(const struct lt_vault_index *index, uint8_t id, uint8_t rounds, uint8_t *md_slot)
+{
+    uint8_t start = LT_VAULT_MD_FIRST;
+
+    while (start + rounds <= LT_VAULT_MD_END) {
+        uint8_t next = start;
+        for (uint8_t k = 0; k < LT_VAULT_RECORDS_MAX; k++) {
+            const struct lt_vault_entry *e = &index->entry[k];
+            if (k == id || e->rounds == 0) {
+                continue;
+            }
+            if (e->md_slot < start + rounds && e->md_slot + e->rounds > start && e->md_slot + e->rounds > next) {
+                next = e->md_slot + e->rounds;
+            }
+        }
+        if (next == start) {
+            *md_slot = start;
+            return true;
+        }
+        start = next;
+    }
+
+    return false;
+}
+
+lt_ret_t lt_vault_set(lt_handle_t *h, uint8_t id, uint8_t rounds, const uint8_t *PIN, const uint8_t PIN_size,
+                      const uint8_t *add, const uint8_t add_size, uint8_t *secret)
+{
+    if (!h || id >= LT_VAULT_RECORDS_MAX || rounds < 1 || rounds > MACANDD_ROUNDS_MAX) {
+        return LT_PARAM_ERR;
+    }
+    if (h->l3.session != SESSION_ON) {
+        return LT_HOST_NO_SESSION;
+    }
+
+    struct lt_vault_index index;
+    lt_ret_t ret = lt_vault_index_read(h, &index);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    // Index is written before M&D data, so the slots are never used by a record the index does not know about
+    struct lt_vault_entry *e = &index.entry[id];
+    if (e->rounds != rounds) {
+        uint8_t md_slot;
+        if (!vault_md_alloc(&index, id, rounds, &md_slot)) {
+            return LT_FAIL;
+        }
+        e->rounds = rounds;
+        e->md_slot = md_slot;
+        e->data_slot = LT_VAULT_R_MEM_FIRST + id * LT_VAULT_RECORD_SLOTS;
+        e->journal_slot = e->data_slot + 1;
+        e->journal_slots = MACANDD_JOURNAL_SLOTS;
+        e->reserved = 0;
+        ret = vault_index_write(h, &index);
+        if (ret != LT_OK) {
+            return ret;
+        }
+    }
+
+    struct lt_macandd_layout layout;
+    lt_vault_layout(&index, id, &layout);
+
+    return lt_PIN_set_layout(h, &layout, PIN, PIN_size, add, add_size, secret);
+}
+
+lt_ret_t lt_vault_check_lazy(lt_handle_t *h, uint8_t id, const uint8_t *PIN, const uint8_t PIN_size,
+                             const uint8_t *add, const uint8_t add_size, uint8_t *secret,
+                             struct lt_macandd_rearm *rearm)
+{
+    if (!h || !secret || !rearm) {
+        return LT_PARAM_ERR;
+    }
+    memset(secret, 0, 32);
+    rearm->pending = false;
+
+    struct lt_vault_index index;
+    lt_ret_t ret = lt_vault_index_read(h, &index);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    struct lt_macandd_layout layout;
+    ret = lt_vault_layout(&index, id, &layout);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    return lt_PIN_check_lazy_layout(h, &layout, PIN, PIN_size, add, add_size, secret, rearm);
+}
+
+lt_ret_t lt_vault_check(lt_handle_t *h, uint8_t id, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
+                        const uint8_t add_size, uint8_t *secret)
+{
+    struct lt_macandd_rearm rearm;
+
+    lt_ret_t ret = lt_vault_check_lazy(h, id, PIN, PIN_size, add, add_size, secret, &rearm);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    ret = lt_PIN_rearm(h, &rearm);
+    if (ret != LT_OK) {
+        memset(secret, 0, 32);
+    }
+    memset(&rearm, 0, sizeof(rearm));
+
+    return ret;
+}
+
+lt_ret_t lt_vault_remove(lt_handle_t *h, uint8_t id)
+{
+    if (!h || id >= LT_VAULT_RECORDS_MAX) {
+        return LT_PARAM_ERR;
+    }
+    if (h->l3.session != SESSION_ON) {
+        return LT_HOST_NO_SESSION;
+    }
+
+    struct lt_vault_index index;
+    lt_ret_t ret = lt_vault_index_read(h, &index);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    struct lt_macandd_layout layout;
+    ret = lt_vault_layout(&index, id, &layout);
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    // Data first: once it is gone, PIN of the record can not be checked even if the index update does not happen
+    ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_ERASE, layout.data_slot, NULL, NULL);
+    for (uint8_t k = 0; ret == LT_OK && k < layout.journal_slots; k++) {
+        ret = lt_macandd_r_mem(h, LT_MACANDD_R_MEM_ERASE, layout.journal_slot + k, NULL, NULL);
+    }
+    if (ret != LT_OK) {
+        return ret;
+    }
+
+    memset(&index.entry[id], 0, sizeof(index.entry[id]));
+
+    return vault_index_write(h, &index);
+}
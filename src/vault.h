@@ -0,0 +1,138 @@
+#ifndef VAULT_H
+#define VAULT_H
+
+/**
+ * @file vault.h
+ * @author Tropic Square s.r.o.
+ *
+ * @brief PIN vault: many Mac-And-Destroy protected records, each with its own number of attempts
+ *
+ * @details Records are addressed by a numeric ID. An index kept in R memory maps each ID to the layout of its record:
+ * R memory slots with M&D data and attempt journal, first M&D slot and number of rounds. The index is an array
+ * indexed by ID, so a record is found without any search. R memory slots of a record are given by its ID, M&D slots
+ * are allocated when the record is added, because their number depends on rounds of the record.
+ *
+ * The index is written alternately into two slots, each copy carries a sequence number and CRC. A torn write leaves
+ * the other copy valid, so the index never loses more than the update which was interrupted.
+ *
+ * @license For the license see file LICENSE.txt file in the root directory of this source tree.
+ */
+
+#include <stdint.h>
+
+#include "libtropic.h"
+#include "macandd.h"
+
+/** @brief Number of records, record ID is 0 to LT_VAULT_RECORDS_MAX-1 */
+#define LT_VAULT_RECORDS_MAX 32
+/** @brief R memory slots of one record: M&D data and its attempt journal */
+#define LT_VAULT_RECORD_SLOTS (1 + MACANDD_JOURNAL_SLOTS)
+/** @brief Records occupy R memory slots just below those of lt_PIN_set() */
+#define LT_VAULT_R_MEM_FIRST  (511 - MACANDD_JOURNAL_SLOTS - LT_VAULT_RECORDS_MAX * LT_VAULT_RECORD_SLOTS)
+/** @brief Two R memory slots below records hold the index */
+#define LT_VAULT_INDEX_SLOT   (LT_VAULT_R_MEM_FIRST - 2)
+/** @brief R memory slots from this one up belong to the vault and to lt_PIN_set(), raw memory commands refuse them */
+#define LT_VAULT_R_MEM_RESERVED_FIRST LT_VAULT_INDEX_SLOT
+/** @brief First M&D slot records may use, slots below are left to lt_PIN_set() */
+#define LT_VAULT_MD_FIRST     MACANDD_ROUNDS_MAX
+/** @brief M&D slots of records end before this one, the last slot is left to lt-bench */
+#define LT_VAULT_MD_END       127
+
+/** @brief Entry of the index, rounds is 0 for a free ID */
+struct lt_vault_entry {
+    uint8_t rounds;
+    uint8_t md_slot;
+    uint16_t data_slot;
+    uint16_t journal_slot;
+    uint8_t journal_slots;
+    uint8_t reserved;
+} __attribute__((__packed__));
+
+/** @brief Content of an index slot */
+struct lt_vault_index {
+    uint8_t magic[4];
+    uint32_t seq;
+    struct lt_vault_entry entry[LT_VAULT_RECORDS_MAX];
+    uint32_t crc;
+} __attribute__((__packed__));
+
+/**
+ * @brief Read the index, an empty vault gives an index with all IDs free
+ *
+ * @param h           Device's handle
+ * @param index       Filled with the newest valid copy of the index
+ * @return lt_ret_t   LT_OK if success, LT_FAIL if the index slots hold no valid copy, otherwise error
+ */
+lt_ret_t lt_vault_index_read(lt_handle_t *h, struct lt_vault_index *index);
+
+/**
+ * @brief Get layout of a record from the index
+ *
+ * @param index       Index
+ * @param id          Record ID
+ * @param layout      Filled with layout of the record
+ * @return lt_ret_t   LT_OK if the record exists, LT_FAIL if the ID is free, LT_PARAM_ERR if it is out of range
+ */
+lt_ret_t lt_vault_layout(const struct lt_vault_index *index, uint8_t id, struct lt_macandd_layout *layout);
+
+/**
+ * @brief Add a record, or set PIN of an existing one again
+ *
+ * @details A record keeps its M&D slots when it is set again with the same rounds, otherwise it gets a new range
+ * from the first free M&D slots which fit.
+ *
+ * @param h           Device's handle
+ * @param id          Record ID
+ * @param rounds      Number of attempts, 1 to MACANDD_ROUNDS_MAX
+ * @param PIN         Array of bytes representing PIN
+ * @param PIN_size    Length of the PIN field
+ * @param add         Additional data to be used in M&D sequence
+ * @param add_size    Length of additional data
+ * @param secret      Buffer into which secret will be placed when all went successfully
+ * @return lt_ret_t   LT_OK if success, LT_FAIL if there are not enough free M&D slots, otherwise error
+ */
+lt_ret_t lt_vault_set(lt_handle_t *h, uint8_t id, uint8_t rounds, const uint8_t *PIN, const uint8_t PIN_size,
+                      const uint8_t *add, const uint8_t add_size, uint8_t *secret);
+
+/**
+ * @brief Check PIN of a record, re-arm is postponed as with lt_PIN_check_lazy()
+ *
+ * @param h           Device's handle
+ * @param id          Record ID
+ * @param PIN         Array of bytes representing PIN
+ * @param PIN_size    Length of the PIN field
+ * @param add         Additional data to be used in M&D sequence
+ * @param add_size    Length of additional data
+ * @param secret      Buffer into which secret will be saved
+ * @param rearm       Filled with postponed re-arm, run it with lt_PIN_rearm()
+ * @return lt_ret_t   LT_OK if correct, otherwise LT_FAIL or error
+ */
+lt_ret_t lt_vault_check_lazy(lt_handle_t *h, uint8_t id, const uint8_t *PIN, const uint8_t PIN_size,
+                             const uint8_t *add, const uint8_t add_size, uint8_t *secret,
+                             struct lt_macandd_rearm *rearm);
+
+/**
+ * @brief Check PIN of a record and re-arm its M&D slots
+ *
+ * @param h           Device's handle
+ * @param id          Record ID
+ * @param PIN         Array of bytes representing PIN
+ * @param PIN_size    Length of the PIN field
+ * @param add         Additional data to be used in M&D sequence
+ * @param add_size    Length of additional data
+ * @param secret      Buffer into which secret will be saved
+ * @return lt_ret_t   LT_OK if correct, otherwise LT_FAIL or error
+ */
+lt_ret_t lt_vault_check(lt_handle_t *h, uint8_t id, const uint8_t *PIN, const uint8_t PIN_size, const uint8_t *add,
+                        const uint8_t add_size, uint8_t *secret);
+
+/**
+ * @brief Remove a record: erase its R memory slots and free its ID and M&D slots
+ *
+ * @param h           Device's handle
+ * @param id          Record ID
+ * @return lt_ret_t   LT_OK if success, LT_FAIL if the ID is free, otherwise error
+ */
+lt_ret_t lt_vault_remove(lt_handle_t *h, uint8_t id);
+
+#endif
@@ -11,6 +11,11 @@ echo "[COMMAND] RNG test expected fails with invalid length:"
 ./lt-util ${UART_PORT}  -r 256 message; echo "  Status: " $?
 echo "[COMMAND] Get 32 random bytes and save as message:"
 ./lt-util ${UART_PORT}  -r 32 message; echo "  Status: " $?
+echo "[COMMAND] Get 1 random byte:"
+./lt-util ${UART_PORT}  -r 1 random_1; echo "  Status: " $?
+echo "[COMMAND] Stream 64 KiB of random bytes:"
+./lt-util ${UART_PORT}  -r --stream 65536 random_stream; echo "  Status: " $?
+stat -c "  Size: %s" random_stream
 #xxd -p ${PATH_TO_BUILD}/message | tr -d '\n' && echo ""
 
 echo "[COMMAND] Erase slot 0: "
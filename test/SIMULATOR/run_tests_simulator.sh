@@ -0,0 +1,171 @@
+#!/bin/bash
+
+PATH_TO_BUILD="../../build"
+cd ${PATH_TO_BUILD}
+
+# Start with factory new simulated chip, its content is kept between commands
+export LT_SIM_STATE=$(pwd)/sim_state.bin
+rm -f ${LT_SIM_STATE}
+# Key cache of the simulated chip does not go into user's ~/.cache
+export LT_UTIL_CACHE_DIR=$(pwd)/key_cache
+rm -rf ${LT_UTIL_CACHE_DIR}
+
+echo ""
+echo "[COMMAND] Print chip ID:"
+./lt-util -i; echo "  Status: " $?
+
+echo "[COMMAND] RNG test expected fails with invalid length:"
+./lt-util -r -1 message; echo "  Status: " $?
+./lt-util -r 0 message; echo "  Status: " $?
+./lt-util -r 256 message; echo "  Status: " $?
+echo "[COMMAND] Get 32 random bytes and save as message:"
+./lt-util -r 32 message; echo "  Status: " $?
+echo "[COMMAND] Stream 64 KiB of random bytes:"
+./lt-util -r --stream 65536 random_stream; echo "  Status: " $?
+stat -c "  Size: %s" random_stream
+
+echo "[COMMAND] Erase slot 0: "
+./lt-util -e -c 0; echo "  Status: " $?
+echo "[COMMAND] Generate EdDSA keypair there: "
+./lt-util -e -g 0; echo "  Status: " $?
+echo "[COMMAND] Generate again, expected fail: "
+./lt-util -e -g 0; echo "  Status: " $?
+echo "[COMMAND] Get public key"
+./lt-util -e -d 0 public_key; echo "  Status: " $?
+echo "[COMMAND] List ECC slots and R memory, then find the key:"
+./lt-util -e --list -m; echo "  Status: " $?
+./lt-util -e --find public_key; echo "  Status: " $?
+LT_UTIL_KEY_CACHE=1 ./lt-util -e -d 0 public_key_cached | grep "not read from the chip"; echo "  Status: " $?
+cmp public_key public_key_cached && echo "  Cached key matches"
+echo "[COMMAND] Regenerated key is read from the chip again, device is initialized once per command:"
+./lt-util -e -g 1 2>&1 | grep -c "lt_init()"; echo "  Status: " $?
+LT_UTIL_KEY_CACHE=1 ./lt-util -e -d 1 public_key_1a; echo "  Status: " $?
+./lt-util -e -c 1 2>&1 | grep -c "lt_init()"; echo "  Status: " $?
+./lt-util -e -g 1; echo "  Status: " $?
+LT_UTIL_KEY_CACHE=1 ./lt-util -e -d 1 public_key_1b; echo "  Status: " $?
+cmp -s public_key_1a public_key_1b || echo "  Keys differ"
+./lt-util -e -c 1; echo "  Status: " $?
+rm -f public_key_1a public_key_1b
+echo "[COMMAND] Sign message"
+./lt-util -e -s 0 message signature1; echo "  Status: " $?
+
+echo "[COMMAND] Store, read back and erase R memory slot 0:"
+./lt-util -m -e 0; echo "  Status: " $?
+./lt-util -m -s 0 message; echo "  Status: " $?
+./lt-util -m -r 0 message_read; echo "  Status: " $?
+cmp message message_read && echo "  Content matches"
+./lt-util -m -e 0; echo "  Status: " $?
+
+echo "[COMMAND] Dump R memory, erase slot 0 and restore it from the dump:"
+./lt-util -m -s 0 message; echo "  Status: " $?
+./lt-util -m --dump 0-344 rmem_dump; echo "  Status: " $?
+./lt-util -m -e 0; echo "  Status: " $?
+./lt-util -m --restore rmem_dump; echo "  Status: " $?
+./lt-util -m -r 0 message_read; echo "  Status: " $?
+cmp message message_read && echo "  Content matches"
+./lt-util -m -e 0; echo "  Status: " $?
+rm -f rmem_dump
+echo "[COMMAND] Empty slots have no record in the dump:"
+./lt-util -m --dump 100-120 rmem_dump; echo "  Status: " $?
+[ "$(stat -c %s rmem_dump)" -eq 8 ] && echo "  Archive holds no record"
+./lt-util -m --restore rmem_dump; echo "  Status: " $?
+rm -f rmem_dump
+echo "[COMMAND] Slots of PIN and PIN vault are refused:"
+./lt-util -m -e 510; echo "  Status (must fail): " $?
+./lt-util -m -s 507 message; echo "  Status (must fail): " $?
+./lt-util -m -e 345; echo "  Status (must fail): " $?
+./lt-util -m -s 400 message; echo "  Status (must fail): " $?
+./lt-util -m --dump 0-511 rmem_dump; echo "  Status (must fail): " $?
+./lt-bench -m 510 -o r_mem_data_read; echo "  Status (must fail): " $?
+./lt-bench -m 345 -o r_mem_data_read; echo "  Status (must fail): " $?
+./lt-bench -a 5 -o mac_and_destroy; echo "  Status (must fail): " $?
+
+echo "[COMMAND] Benchmark with latency of a real chip:"
+LT_SIM_LATENCY="*=1000,get_info=0,handshake=15000,ecc_eddsa_sign=9000" ./lt-bench -n 5 -o handshake,random_value_get,ecc_eddsa_sign; echo "  Status: " $?
+
+echo "[COMMAND] PIN set, correct and wrong PIN check:"
+./lt-util -mac-set 1234 0011 secret_set; echo "  Status: " $?
+./lt-util -mac-ver 1234 0011 secret_ver; echo "  Status: " $?
+cmp secret_set secret_ver && echo "  Secrets match"
+./lt-util -mac-ver 4321 0011 secret_ver; echo "  Status (must fail): " $?
+echo "[COMMAND] Correct PIN restores all attempts, more correct checks than attempts must pass:"
+ok=0
+for i in $(seq 13); do ./lt-util -mac-ver 1234 0011 secret_ver > /dev/null 2>&1 && ok=$((ok + 1)); done
+echo "  Passed ${ok} of 13"
+
+echo "[COMMAND] PIN vault with records of different rounds:"
+./lt-util -vault -s 3 5 1234 0011 secret_set; echo "  Status: " $?
+./lt-util -vault -s 7 2 4321 aa secret_set7; echo "  Status: " $?
+./lt-util -vault -l; echo "  Status: " $?
+./lt-util -vault -v 3 1234 0011 secret_ver; echo "  Status: " $?
+cmp secret_set secret_ver && echo "  Secrets match"
+./lt-util -vault -v 7 1234 aa secret_ver; echo "  Status (must fail): " $?
+./lt-util -vault -v 7 1234 aa secret_ver; echo "  Status (must fail): " $?
+./lt-util -vault -v 7 4321 aa secret_ver; echo "  Status (locked, must fail): " $?
+./lt-util -vault -r 7; echo "  Status: " $?
+
+echo "[COMMAND] PIN phase benchmark:"
+LT_SIM_LATENCY="get_info=0,mac_and_destroy=2000" ./lt-bench-pin -n 3 -j bench_pin.json; echo "  Status: " $?
+python3 -m json.tool bench_pin.json > /dev/null; echo "  JSON check status: " $?
+
+echo "[COMMAND] Same command on three simulated chips at once:"
+./lt-util --devices chip_a.bin,chip_b.bin,chip_c.bin -r 32 "random_{dev}"; echo "  Status: " $?
+ls random_chip_a.bin random_chip_b.bin random_chip_c.bin > /dev/null; echo "  Files check status: " $?
+rm -f chip_a.bin chip_b.bin chip_c.bin
+
+echo "[COMMAND] Sign all files of a directory within one session:"
+mkdir -p to_sign signed
+cp message to_sign/a; cp message_read to_sign/b
+./lt-util -e --sign-batch 0 to_sign signed; echo "  Status: " $?
+ls signed/a.sig signed/b.sig > /dev/null; echo "  Files check status: " $?
+rm -rf to_sign signed
+
+echo "[COMMAND] Provisioning from manifest, second run skips done steps:"
+printf '[*]\necc generate 3\nmem store 20 message\npin 1234 0011\n' > manifest
+mkdir -p provisioned
+LT_SIM_STATE=chip_prov.bin ./lt-util --provision manifest provisioned; echo "  Status: " $?
+LT_SIM_STATE=chip_prov.bin ./lt-util --provision manifest provisioned 2>&1 | grep "skipped 3"; echo "  Status: " $?
+rm -rf chip_prov.bin provisioned manifest
+
+echo "[COMMAND] Provisioning stops at occupied slots and keeps their content:"
+printf '[*]\necc generate 3\nmem store 20 message\n' > manifest
+mkdir -p provisioned
+LT_SIM_STATE=chip_prov.bin ./lt-util -e -g 3 > /dev/null
+LT_SIM_STATE=chip_prov.bin ./lt-util --provision manifest provisioned; echo "  Status (must fail): " $?
+ls provisioned/*.ecc3.pub > /dev/null 2>&1 || echo "  Foreign key not exported"
+LT_SIM_STATE=chip_prov.bin ./lt-util -e -c 3 > /dev/null
+printf 'OLDDATA' > old_data
+LT_SIM_STATE=chip_prov.bin ./lt-util -m -s 20 old_data > /dev/null
+LT_SIM_STATE=chip_prov.bin ./lt-util --provision manifest provisioned; echo "  Status (must fail): " $?
+LT_SIM_STATE=chip_prov.bin ./lt-util -m -r 20 old_data_read > /dev/null
+cmp old_data old_data_read && echo "  Content kept"
+rm -rf chip_prov.bin provisioned manifest old_data old_data_read
+
+echo "[COMMAND] Provisioning rejects a manifest storing into slots of PIN vault:"
+printf '[*]\nmem store 400 message\n' > manifest
+./lt-util --provision manifest provisioned; echo "  Status (must fail): " $?
+rm -rf provisioned manifest
+
+echo "[COMMAND] Provisioning rejects a manifest with too long tokens:"
+long_token=$(printf 'a%.0s' $(seq 2000))
+printf '[*]\nmem store 20 %s %s\n' "${long_token}" "${long_token}" > manifest
+LT_SIM_STATE=chip_prov.bin ./lt-util --provision manifest provisioned; echo "  Status (must fail): " $?
+rm -rf chip_prov.bin provisioned manifest
+
+echo "[COMMAND] Session with cached static public key of the chip:"
+LT_UTIL_STPUB_CACHE=1 ./lt-util -r 32 random_stpub; echo "  Status: " $?
+LT_UTIL_STPUB_CACHE=1 ./lt-util -r 32 random_stpub 2>&1 | grep "cached STPUB"; echo "  Status: " $?
+rm -f random_stpub
+
+echo "[COMMAND] SPI clock calibration, second run takes it from cache:"
+LT_SIM_SPI_MAX_HZ=12000000 ./lt-util --spi-speed calibrate -r 32 random_spi 2>&1 | grep "calibrated to 8000000"; echo "  Status: " $?
+LT_SIM_SPI_MAX_HZ=12000000 ./lt-util --spi-speed auto -r 32 random_spi 2>&1 | grep "cached"; echo "  Status: " $?
+rm -f random_spi
+
+echo ""
+echo "[INFO] Verify signature with python cryptography library"
+../test/verify_signature.py --message message --public-key public_key --signature signature1
+
+rm -f ${LT_SIM_STATE}
+rm -rf ${LT_UTIL_CACHE_DIR}
+cd -
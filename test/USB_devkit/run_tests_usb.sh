@@ -28,6 +28,13 @@ echo ${LINE}
 #echo "[COMMAND] Get 32 random bytes and save as message:"
 ./lt-util ${UART_PORT}  -r 32 message; echo "[<<] lt-util returned status: " $?
 echo ${LINE}
+./lt-util ${UART_PORT}  -r 1 random_1; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+#echo "[COMMAND] Stream 64 KiB of random bytes, size of the file is printed:"
+./lt-util ${UART_PORT}  -r --stream 65536 random_stream; echo "[<<] lt-util returned status: " $?
+stat -c "%s" random_stream
+./lt-util ${UART_PORT}  -r --stream 4096 - | wc -c; echo "[<<] lt-util returned status: " ${PIPESTATUS[0]}
+echo ${LINE}
 xxd -p message | tr -d '\n' && echo ""
 
 #echo "[COMMAND] Erase slot 0: "
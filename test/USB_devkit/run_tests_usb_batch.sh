@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# This script does the same as run_tests_usb.sh, but all lt-util commands are executed
+# as one batch within a single secure session:
+# 1. Gets 32 random bytes used as a message.
+# 2. Erases ECC slot 0 and generates EdDSA keypair there.
+# 3. Signs the message five times using the generated privkey.
+# 4. Verifies each signature against the original message and public key.
+
+PATH_TO_BUILD="../../build"
+UART_PORT=${1:-/dev/ttyACM0}
+cd ${PATH_TO_BUILD}
+LINE="---------------------------------------------------------------------------"
+
+./lt-util ${UART_PORT} --batch - <<BATCH; echo "[<<] lt-util returned status: " $?
+-r 32 message
+-e -c 0
+-e -g 0
+-e -d 0 public_key
+-e -s 0 message signature1
+-e -s 0 message signature2
+-e -s 0 message signature3
+-e -s 0 message signature4
+-e -s 0 message signature5
+BATCH
+echo ${LINE}
+
+for i in 1 2 3 4 5; do
+    ../test/verify_signature.py --message message --public-key public_key --signature signature${i}
+    echo ${LINE}
+done
+
+cd -
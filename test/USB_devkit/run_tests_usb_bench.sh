@@ -0,0 +1,13 @@
+#!/bin/bash
+
+# This script runs lt-bench with USB devkit, prints the table and checks that JSON output is valid.
+# WARNING: ECC slot 31, R memory slot 510 and M&D slot 127 are overwritten.
+
+PATH_TO_BUILD="../../build"
+UART_PORT=${1:-/dev/ttyACM0}
+cd ${PATH_TO_BUILD}
+
+./lt-bench ${UART_PORT} -n 20 -j bench.json; echo "[<<] lt-bench returned status: " $?
+python3 -m json.tool bench.json > /dev/null; echo "[<<] JSON check returned status: " $?
+
+cd -
@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# This script starts lt-utild with USB devkit and does following through lt-util --via-daemon:
+# 1. Gets random bytes used as a message.
+# 2. Erases ECC slot 0 and generates EdDSA keypair there.
+# 3. Signs the message five times, all within one secure session.
+# 4. Verifies each signature against the original message and public key.
+# 5. Checks that streaming and commands from stdin are refused.
+
+PATH_TO_BUILD="../../build"
+UART_PORT=${1:-/dev/ttyACM0}
+cd ${PATH_TO_BUILD}
+LINE="---------------------------------------------------------------------------"
+export LT_UTILD_SOCKET=$(pwd)/lt-utild-test.sock
+
+./lt-utild ${UART_PORT} > lt-utild.log 2>&1 &
+UTILD_PID=$!
+sleep 2
+
+./lt-util --via-daemon -r 32 message; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+./lt-util --via-daemon -e -c 0; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+./lt-util --via-daemon -e -g 0; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+./lt-util --via-daemon -e -d 0 public_key; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+
+for i in 1 2 3 4 5; do
+    ./lt-util --via-daemon -e -s 0 message signature${i}; echo "[<<] lt-util returned status: " $?
+    ../test/verify_signature.py --message message --public-key public_key --signature signature${i}
+    echo ${LINE}
+done
+
+./lt-util --via-daemon -r --stream inf random_stream; echo "[<<] lt-util returned status (must fail): " $?
+echo "-r 32 message" | ./lt-util --via-daemon --batch -; echo "[<<] lt-util returned status (must fail): " $?
+echo ${LINE}
+
+kill ${UTILD_PID}
+wait ${UTILD_PID}
+cat lt-utild.log
+
+cd -
@@ -20,5 +20,15 @@ echo ${LINE}
 ./lt-util ${UART_PORT}  -m -r ${SLOT_NUM} data_to_store_readed; echo "[<<] lt-util returned status: " $?
 echo ${LINE}
 xxd -p data_to_store_readed | tr -d '\n' && echo ""
+# Dump R memory outside of PIN slots, erase the slot and restore it from the dump
+./lt-util ${UART_PORT}  -m --dump 0-344 rmem_dump; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+./lt-util ${UART_PORT}  -m -e ${SLOT_NUM}; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+./lt-util ${UART_PORT}  -m --restore rmem_dump; echo "[<<] lt-util returned status: " $?
+echo ${LINE}
+./lt-util ${UART_PORT}  -m -r ${SLOT_NUM} data_to_store_restored; echo "[<<] lt-util returned status: " $?
+cmp data_to_store data_to_store_restored && echo "Restored data match"
+echo ${LINE}
 
 cd -
@@ -0,0 +1,49 @@
+#!/bin/bash
+
+# This script starts lt-rngd with USB devkit and does following:
+# 1. Reads random bytes from the socket several times over one connection.
+# 2. Reads random bytes from the FIFO.
+# 3. Prints statistics of the daemon.
+
+PATH_TO_BUILD="../../build"
+UART_PORT=${1:-/dev/ttyACM0}
+cd ${PATH_TO_BUILD}
+LINE="---------------------------------------------------------------------------"
+SOCKET=$(pwd)/lt-rngd-test.sock
+FIFO=$(pwd)/lt-rngd-test.fifo
+
+./lt-rngd ${UART_PORT} -s ${SOCKET} -f ${FIFO} -b 65536 > lt-rngd.log 2>&1 &
+RNGD_PID=$!
+sleep 2
+
+python3 - ${SOCKET} <<'PYTHON'
+import socket, struct, sys, time
+
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+
+def get(n):
+    s.sendall(struct.pack("=I", n))
+    data = b""
+    while len(data) < n:
+        data += s.recv(n - len(data))
+    return data
+
+start = time.perf_counter()
+for _ in range(1000):
+    get(32)
+print("1000 x 32B, average latency %.1f us" % ((time.perf_counter() - start) * 1000))
+print("Got %d bytes" % len(get(65536)))
+PYTHON
+echo "[<<] python returned status: " $?
+echo ${LINE}
+
+head -c 100000 ${FIFO} | wc -c; echo "[<<] head returned status: " $?
+echo ${LINE}
+
+kill ${RNGD_PID}
+wait ${RNGD_PID}
+cat lt-rngd.log
+rm -f ${FIFO}
+
+cd -
@@ -3,6 +3,14 @@
 from cryptography.hazmat.primitives import serialization
 from cryptography.hazmat.primitives.asymmetric import ed25519
 from cryptography.exceptions import InvalidSignature
+import hashlib
+import os
+import struct
+
+# Layout of header written by 'lt-util -e -sd', see src/digest.h
+DIGEST_HEADER_FORMAT = '<4sBBBBQ64s'
+DIGEST_HEADER_SIZE = struct.calcsize(DIGEST_HEADER_FORMAT)
+DIGEST_SHA256, DIGEST_SHA512, DIGEST_SHA256_TREE = 1, 2, 3
 
 def verify_signature(message: bytes, public_key_bytes: bytes, signature: bytes) -> bool:
     try:
@@ -20,6 +28,37 @@ def verify_signature(message: bytes, public_key_bytes: bytes, signature: bytes)
         print(f"Error during signature verification: {e}")
         return False
 
+def digest_file(path: str, alg: int, leaf_log2: int) -> bytes:
+    if alg == DIGEST_SHA256_TREE:
+        leaves = []
+        with open(path, 'rb') as f:
+            while True:
+                leaf = f.read(1 << leaf_log2)
+                if not leaf and leaves:
+                    break
+                leaves.append(hashlib.sha256(b'\x00' + leaf).digest())
+                if not leaf:
+                    break
+        return hashlib.sha256(b'\x01' + b''.join(leaves)).digest()
+
+    h = hashlib.sha256() if alg == DIGEST_SHA256 else hashlib.sha512()
+    with open(path, 'rb') as f:
+        for chunk in iter(lambda: f.read(1 << 20), b''):
+            h.update(chunk)
+    return h.digest()
+
+def split_detached(path: str, signature: bytes):
+    """Checks header of detached signature against the file and returns (signed header, signature)"""
+    header, rs = signature[:DIGEST_HEADER_SIZE], signature[DIGEST_HEADER_SIZE:]
+    magic, version, alg, digest_len, leaf_log2, file_size, digest = struct.unpack(DIGEST_HEADER_FORMAT, header)
+    if magic != b'LTSG' or version != 1:
+        raise ValueError('not a detached signature')
+    computed = digest_file(path, alg, leaf_log2)
+    print(f"Digest: {computed.hex()}")
+    if os.path.getsize(path) != file_size or digest[:digest_len] != computed:
+        raise ValueError('digest in header does not match the file')
+    return header, rs
+
 def main():
     import argparse
 
@@ -30,14 +69,17 @@ def main():
                         help='Path to public key file')
     parser.add_argument('--signature', type=str, required=True,
                         help='Path to signature file')
+    parser.add_argument('--detached', action='store_true',
+                        help='Signature was created by "lt-util -e -sd", message is hashed before verification')
 
     args = parser.parse_args()
 
     try:
         # Read message, public key and signature from files
-        with open(args.message, 'rb') as f:
-            message = f.read()
-            print(f"Message: {message.hex()}")
+        if not args.detached:
+            with open(args.message, 'rb') as f:
+                message = f.read()
+                print(f"Message: {message.hex()}")
 
         with open(args.public_key, 'rb') as f:
             public_key_bytes = f.read()
@@ -47,6 +89,9 @@ def main():
             signature = f.read()
             print(f"Signature: {signature.hex()}")
 
+        if args.detached:
+            message, signature = split_detached(args.message, signature)
+
         # Verify the signature
         is_valid = verify_signature(
             message,